@@ -6,6 +6,9 @@
  * none of the original Mozilla code remains.
  */
 
+#ifndef BLOCK_SHA1_SHA1_H
+#define BLOCK_SHA1_SHA1_H
+
 typedef struct {
 	unsigned long long size;
 	unsigned int H[5];
@@ -16,7 +19,15 @@ void blk_SHA1_Init(blk_SHA_CTX *ctx);
 void blk_SHA1_Update(blk_SHA_CTX *ctx, const void *dataIn, unsigned long len);
 void blk_SHA1_Final(unsigned char hashout[20], blk_SHA_CTX *ctx);
 
+/*
+ * When used only as the "unsafe" SHA-1 next to another implementation,
+ * hash.h maps the *_unsafe names to these functions itself.
+ */
+#ifndef SHA1_BLK_UNSAFE
 #define platform_SHA_CTX	blk_SHA_CTX
 #define platform_SHA1_Init	blk_SHA1_Init
 #define platform_SHA1_Update	blk_SHA1_Update
 #define platform_SHA1_Final	blk_SHA1_Final
+#endif
+
+#endif
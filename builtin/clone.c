@@ -935,6 +935,34 @@ static void dissociate_from_references(void)
 	free(alternates);
 }
 
+/*
+ * Reftables record the hash algorithm they were written with, and
+ * init_db() has written HEAD before we knew the one of the remote.
+ * Start over with an empty stack using the right algorithm.
+ */
+static void reinit_reftable(int hash_algo)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct strbuf err = STRBUF_INIT;
+	char *head;
+
+	head = xstrdup_or_null(resolve_ref_unsafe("HEAD", RESOLVE_REF_NO_RECURSE,
+						  NULL, NULL));
+	git_path_buf(&path, "reftable");
+	if (remove_dir_recursively(&path, 0))
+		die_errno(_("could not remove '%s'"), path.buf);
+
+	repo_set_hash_algo(the_repository, hash_algo);
+	if (refs_init_db(&err))
+		die("%s", err.buf);
+	if (head && create_symref("HEAD", head, NULL) < 0)
+		die(_("unable to update HEAD"));
+
+	free(head);
+	strbuf_release(&path);
+	strbuf_release(&err);
+}
+
 static int path_exists(const char *path)
 {
 	struct stat sb;
@@ -1118,7 +1146,7 @@ int cmd_clone(int argc, const char **argv, const char *prefix)
 		}
 	}
 
-	init_db(git_dir, real_git_dir, option_template, GIT_HASH_UNKNOWN, NULL,
+	init_db(git_dir, real_git_dir, option_template, GIT_HASH_UNKNOWN, NULL, NULL,
 		INIT_DB_QUIET);
 
 	if (real_git_dir)
@@ -1233,7 +1261,11 @@ int cmd_clone(int argc, const char **argv, const char *prefix)
 		 * Now that we know what algorithm the remote side is using,
 		 * let's set ours to the same thing.
 		 */
-		initialize_repository_version(hash_algo, 1);
+		initialize_repository_version(hash_algo,
+					      the_repository->ref_storage_format, 1);
+		if (the_repository->ref_storage_format &&
+		    hash_algo != hash_algo_by_ptr(the_hash_algo))
+			reinit_reftable(hash_algo);
 		repo_set_hash_algo(the_repository, hash_algo);
 
 		mapped_refs = wanted_peer_refs(refs, &remote->fetch);
@@ -36,6 +36,7 @@
 #include "help.h"
 #include "commit-reach.h"
 #include "commit-graph.h"
+#include "sparse-index.h"
 
 static const char * const builtin_commit_usage[] = {
 	N_("git commit [<options>] [--] <pathspec>..."),
@@ -363,6 +364,10 @@ static const char *prepare_index(const char **argv, const char *prefix,
 	if (read_cache_preload(&pathspec) < 0)
 		die(_("index file corrupt"));
 
+	/* only the as-is commit works with a sparse index */
+	if (interactive || all || also || only || pathspec.nr)
+		ensure_full_index(&the_index);
+
 	if (interactive) {
 		char *old_index_env = NULL, *old_repo_index_file;
 		hold_locked_index(&index_lock, LOCK_DIE_ON_ERROR);
@@ -1401,6 +1406,8 @@ int cmd_status(int argc, const char **argv, const char *prefix)
 		usage_with_options(builtin_status_usage, builtin_status_options);
 
 	status_init_config(&s, git_status_config);
+	prepare_repo_settings(the_repository);
+	the_repository->settings.command_requires_full_index = 0;
 	argc = parse_options(argc, argv, prefix,
 			     builtin_status_options,
 			     builtin_status_usage, 0);
@@ -1422,6 +1429,8 @@ int cmd_status(int argc, const char **argv, const char *prefix)
 	    status_format != STATUS_FORMAT_PORCELAIN_V2)
 		progress_flag = REFRESH_PROGRESS;
 	repo_read_index(the_repository);
+	if (s.pathspec.nr)
+		ensure_full_index(&the_index);
 	refresh_index(&the_index,
 		      REFRESH_QUIET|REFRESH_UNMERGED|progress_flag,
 		      &s.pathspec, NULL, NULL);
@@ -1565,6 +1574,8 @@ int cmd_commit(int argc, const char **argv, const char *prefix)
 		usage_with_options(builtin_commit_usage, builtin_commit_options);
 
 	status_init_config(&s, git_commit_config);
+	prepare_repo_settings(the_repository);
+	the_repository->settings.command_requires_full_index = 0;
 	s.commit_template = 1;
 	status_format = STATUS_FORMAT_NONE; /* Ignore status.short */
 	s.colopts = 0;
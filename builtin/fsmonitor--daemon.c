@@ -0,0 +1,383 @@
+#include "builtin.h"
+#include "parse-options.h"
+#include "fsmonitor-ipc.h"
+
+static const char * const builtin_fsmonitor__daemon_usage[] = {
+	N_("git fsmonitor--daemon start"),
+	N_("git fsmonitor--daemon run"),
+	N_("git fsmonitor--daemon stop"),
+	N_("git fsmonitor--daemon status"),
+	NULL
+};
+
+#ifdef HAVE_FSMONITOR_DAEMON_BACKEND
+
+#include "config.h"
+#include "run-command.h"
+#include "sigchain.h"
+#include "tempfile.h"
+#include "trace2.h"
+#include "unix-socket.h"
+#include "fsmonitor--daemon.h"
+#include "compat/fsmonitor/fsm-listen.h"
+
+/*
+ * Beyond this many paths, the journal is dropped and the clients are
+ * told to check everything, which is not slower than sending them
+ * such a list anyway.
+ */
+#define JOURNAL_MAX_PATHS (100 * 1000)
+
+/* Don't let a stuck client hold up the (single-threaded) daemon. */
+#define CLIENT_TIMEOUT_SECONDS 5
+
+/* How long `start` waits for the daemon to report that it is ready. */
+#define START_TIMEOUT_SECONDS 60
+
+#define TOKEN_PREFIX "builtin:"
+
+struct journal_entry {
+	struct hashmap_entry ent;
+	uint64_t epoch;
+	char path[FLEX_ARRAY];
+};
+
+static int journal_entry_cmp(const void *unused_cmp_data,
+			     const struct hashmap_entry *eptr,
+			     const struct hashmap_entry *entry_or_key,
+			     const void *keydata)
+{
+	const struct journal_entry *a, *b;
+
+	a = container_of(eptr, const struct journal_entry, ent);
+	b = container_of(entry_or_key, const struct journal_entry, ent);
+	return strcmp(a->path, keydata ? keydata : b->path);
+}
+
+void fsmonitor_journal_add(struct fsmonitor_daemon_state *state,
+			   const char *path)
+{
+	struct journal_entry *e;
+	unsigned int hash = strhash(path);
+
+	e = hashmap_get_entry_from_hash(&state->journal, hash, path,
+					struct journal_entry, ent);
+	if (e) {
+		e->epoch = state->current_epoch;
+		return;
+	}
+
+	if (hashmap_get_size(&state->journal) >= JOURNAL_MAX_PATHS) {
+		fsmonitor_journal_invalidate(state);
+		return;
+	}
+
+	FLEX_ALLOC_STR(e, path, path);
+	e->epoch = state->current_epoch;
+	hashmap_entry_init(&e->ent, hash);
+	hashmap_add(&state->journal, &e->ent);
+}
+
+void fsmonitor_journal_invalidate(struct fsmonitor_daemon_state *state)
+{
+	trace2_data_intmax("fsm_daemon", NULL, "journal/invalidate",
+			   hashmap_get_size(&state->journal));
+	hashmap_free_entries(&state->journal, struct journal_entry, ent);
+	hashmap_init(&state->journal, journal_entry_cmp, NULL, 0);
+
+	/*
+	 * Every token given out so far may be missing some of the
+	 * changes we just dropped.
+	 */
+	state->trivial_before = state->current_epoch;
+}
+
+/*
+ * Returns 1 if `token` was given out by this instance of the daemon
+ * and the journal still has all changes since then, 0 otherwise.
+ */
+static int parse_token(struct fsmonitor_daemon_state *state,
+		       const char *token, uint64_t *epoch)
+{
+	const char *p;
+	char *end;
+
+	if (!skip_prefix(token, TOKEN_PREFIX, &p) ||
+	    !skip_prefix(p, state->instance_id, &p) ||
+	    *p++ != ':')
+		return 0;
+
+	errno = 0;
+	*epoch = strtoumax(p, &end, 10);
+	if (errno || end == p || *end)
+		return 0;
+
+	return state->trivial_before <= *epoch &&
+	       *epoch < state->current_epoch;
+}
+
+static void answer_query(struct fsmonitor_daemon_state *state,
+			 const char *token, struct strbuf *answer)
+{
+	struct hashmap_iter iter;
+	struct journal_entry *e;
+	uint64_t since;
+	intmax_t nr = 0;
+
+	strbuf_addf(answer, "%s%s:%"PRIu64, TOKEN_PREFIX,
+		    state->instance_id, state->current_epoch);
+	strbuf_addch(answer, '\0');
+
+	if (!parse_token(state, token, &since)) {
+		strbuf_addstr(answer, "/");
+		strbuf_addch(answer, '\0');
+		trace2_data_string("fsm_daemon", NULL, "query/trivial", token);
+	} else {
+		hashmap_for_each_entry(&state->journal, &iter, e, ent) {
+			if (e->epoch <= since)
+				continue;
+			strbuf_addstr(answer, e->path);
+			strbuf_addch(answer, '\0');
+			nr++;
+		}
+		trace2_data_intmax("fsm_daemon", NULL, "query/paths", nr);
+	}
+
+	/* Changes seen from now on are news to the client. */
+	state->current_epoch++;
+}
+
+/*
+ * Serve one client.  Returns 1 if the daemon was asked to quit, 0
+ * otherwise.
+ */
+static int handle_client(struct fsmonitor_daemon_state *state, int fd)
+{
+	struct strbuf request = STRBUF_INIT;
+	struct strbuf answer = STRBUF_INIT;
+	struct timeval timeout = { CLIENT_TIMEOUT_SECONDS, 0 };
+	int quit = 0;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) ||
+	    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)))
+		warning_errno(_("unable to set timeouts on client socket"));
+
+	if (strbuf_read(&request, fd, 0) < 0) {
+		warning_errno(_("unable to read request"));
+		goto out;
+	}
+
+	if (!strcmp(request.buf, FSMONITOR_IPC_COMMAND_QUIT)) {
+		quit = 1;
+		goto out;
+	} else if (!strcmp(request.buf, FSMONITOR_IPC_COMMAND_FLUSH)) {
+		fsmonitor_journal_invalidate(state);
+		strbuf_addstr(&answer, "ok");
+	} else {
+		/*
+		 * Make sure every change the client made before asking
+		 * is in the journal.
+		 */
+		if (fsm_listen__drain_events(state) < 0)
+			quit = 1;
+		answer_query(state, request.buf, &answer);
+	}
+
+	if (write_in_full(fd, answer.buf, answer.len) < 0)
+		warning_errno(_("unable to send response"));
+
+out:
+	strbuf_release(&request);
+	strbuf_release(&answer);
+	return quit;
+}
+
+static int serve(struct fsmonitor_daemon_state *state)
+{
+	struct pollfd pfd[2];
+
+	pfd[0].fd = state->listen_fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = fsm_listen__get_fd(state);
+	pfd[1].events = POLLIN;
+
+	for (;;) {
+		if (poll(pfd, ARRAY_SIZE(pfd), -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			return error_errno(_("poll failed"));
+		}
+
+		if (pfd[1].revents & POLLIN &&
+		    fsm_listen__drain_events(state) < 0)
+			return -1;
+
+		if (pfd[0].revents & POLLIN) {
+			int client = accept(state->listen_fd, NULL, NULL);
+			int quit;
+
+			if (client < 0) {
+				warning_errno(_("accept failed"));
+				continue;
+			}
+			/*
+			 * As for `git credential-cache--daemon`, exiting
+			 * closes the connection to a client that asked us
+			 * to quit only once the socket has been removed.
+			 */
+			quit = handle_client(state, client);
+			if (quit)
+				return 0;
+			close(client);
+		}
+	}
+}
+
+static int fsmonitor_run_daemon(int detach)
+{
+	struct fsmonitor_daemon_state state;
+	struct tempfile *socket_file;
+	const char *socket_path = fsmonitor_ipc__get_path();
+	int ret;
+
+	if (fsmonitor_ipc__is_listening())
+		return error(_("fsmonitor--daemon is already running in '%s'"),
+			     get_git_work_tree());
+
+	memset(&state, 0, sizeof(state));
+	strbuf_init(&state.path_worktree_watch, 0);
+	strbuf_addstr(&state.path_worktree_watch, get_git_work_tree());
+	state.instance_id = xstrfmt("%"PRIuMAX".%"PRIuMAX,
+				    (uintmax_t)getpid(), (uintmax_t)getnanotime());
+	hashmap_init(&state.journal, journal_entry_cmp, NULL, 0);
+	state.current_epoch = 1;
+
+	if (fsm_listen__ctor(&state) < 0)
+		return -1;
+
+	state.listen_fd = unix_stream_listen(socket_path);
+	if (state.listen_fd < 0) {
+		fsm_listen__dtor(&state);
+		return error_errno(_("unable to bind to '%s'"), socket_path);
+	}
+	socket_file = register_tempfile(socket_path);
+
+	/* Clients that go away early must not kill us. */
+	sigchain_push(SIGPIPE, SIG_IGN);
+
+	if (detach) {
+		/* Tell `git fsmonitor--daemon start` that we are ready. */
+		printf("ok\n");
+		fclose(stdout);
+		if (!freopen("/dev/null", "w", stderr))
+			die_errno(_("unable to point stderr to /dev/null"));
+		setsid();
+	}
+
+	trace2_region_enter("fsm_daemon", "serve", the_repository);
+	ret = serve(&state);
+	trace2_region_leave("fsm_daemon", "serve", the_repository);
+
+	delete_tempfile(&socket_file);
+	close(state.listen_fd);
+	fsm_listen__dtor(&state);
+	hashmap_free_entries(&state.journal, struct journal_entry, ent);
+	strbuf_release(&state.path_worktree_watch);
+	free(state.instance_id);
+	return ret;
+}
+
+static int fsmonitor_start_daemon(void)
+{
+	struct child_process daemon = CHILD_PROCESS_INIT;
+	char buf[128];
+	int r;
+
+	if (fsmonitor_ipc__is_listening())
+		return error(_("fsmonitor--daemon is already running in '%s'"),
+			     get_git_work_tree());
+
+	strvec_pushl(&daemon.args, "fsmonitor--daemon", "run", "--detach",
+		     NULL);
+	daemon.git_cmd = 1;
+	daemon.no_stdin = 1;
+	daemon.out = -1;
+
+	if (start_command(&daemon))
+		return error_errno(_("unable to start fsmonitor--daemon"));
+	r = read_in_full(daemon.out, buf, sizeof(buf));
+	close(daemon.out);
+	if (r < 0)
+		return error_errno(_("unable to read result code from fsmonitor--daemon"));
+	if (r != 3 || memcmp(buf, "ok\n", 3))
+		return error(_("fsmonitor--daemon did not start"));
+	return 0;
+}
+
+static int fsmonitor_stop_daemon(void)
+{
+	struct strbuf answer = STRBUF_INIT;
+	int ret;
+
+	ret = fsmonitor_ipc__send_command(FSMONITOR_IPC_COMMAND_QUIT, &answer);
+	strbuf_release(&answer);
+	if (ret < 0)
+		return error(_("fsmonitor--daemon is not running"));
+	return 0;
+}
+
+static int fsmonitor_daemon_status(void)
+{
+	if (fsmonitor_ipc__is_listening()) {
+		printf(_("fsmonitor--daemon is watching '%s'\n"),
+		       get_git_work_tree());
+		return 0;
+	}
+	printf(_("fsmonitor--daemon is not watching '%s'\n"),
+	       get_git_work_tree());
+	return 1;
+}
+
+int cmd_fsmonitor__daemon(int argc, const char **argv, const char *prefix)
+{
+	const char *subcmd;
+	int detach = 0;
+	struct option options[] = {
+		OPT_HIDDEN_BOOL(0, "detach", &detach,
+				N_("report readiness on stdout and detach")),
+		OPT_END()
+	};
+
+	argc = parse_options(argc, argv, prefix, options,
+			     builtin_fsmonitor__daemon_usage, 0);
+	if (argc != 1)
+		usage_with_options(builtin_fsmonitor__daemon_usage, options);
+	subcmd = argv[0];
+
+	if (is_bare_repository() || !get_git_work_tree())
+		die(_("fsmonitor--daemon requires a worktree"));
+
+	if (!strcmp(subcmd, "start"))
+		return !!fsmonitor_start_daemon();
+	if (!strcmp(subcmd, "run"))
+		return !!fsmonitor_run_daemon(detach);
+	if (!strcmp(subcmd, "stop"))
+		return !!fsmonitor_stop_daemon();
+	if (!strcmp(subcmd, "status"))
+		return fsmonitor_daemon_status();
+
+	die(_("unknown subcommand '%s'"), subcmd);
+}
+
+#else
+
+int cmd_fsmonitor__daemon(int argc, const char **argv, const char *prefix)
+{
+	struct option options[] = { OPT_END() };
+
+	argc = parse_options(argc, argv, prefix, options,
+			     builtin_fsmonitor__daemon_usage, 0);
+	die(_("fsmonitor--daemon is not supported on this platform"));
+}
+
+#endif /* HAVE_FSMONITOR_DAEMON_BACKEND */
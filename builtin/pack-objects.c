@@ -36,6 +36,7 @@
 #include "trace2.h"
 #include "shallow.h"
 #include "promisor-remote.h"
+#include "pack-mtimes.h"
 
 #define IN_PACK(obj) oe_in_pack(&to_pack, obj)
 #define SIZE(obj) oe_size(&to_pack, obj)
@@ -72,6 +73,9 @@ static int non_empty;
 static int reuse_delta = 1, reuse_object = 1;
 static int keep_unreachable, unpack_unreachable, include_tag;
 static timestamp_t unpack_unreachable_expiration;
+static int cruft;
+static timestamp_t cruft_expiration;
+static int stdin_packs;
 static int pack_loose_unreachable;
 static int local;
 static int have_non_local_packs;
@@ -419,8 +423,8 @@ static off_t write_reuse_object(struct hashfile *f, struct object_entry *entry,
 {
 	struct packed_git *p = IN_PACK(entry);
 	struct pack_window *w_curs = NULL;
-	struct revindex_entry *revidx;
-	off_t offset;
+	struct revindex_entry revidx;
+	off_t offset, next;
 	enum object_type type = oe_type(entry);
 	off_t datalen;
 	unsigned char header[MAX_PACK_OBJECT_HEADER],
@@ -436,10 +440,12 @@ static off_t write_reuse_object(struct hashfile *f, struct object_entry *entry,
 					      type, entry_size);
 
 	offset = entry->in_pack_offset;
-	revidx = find_pack_revindex(p, offset);
-	datalen = revidx[1].offset - offset;
+	if (find_pack_revindex(p, offset, &revidx, &next))
+		die(_("unable to find reverse-index entry for %s"),
+		    oid_to_hex(&entry->idx.oid));
+	datalen = next - offset;
 	if (!pack_to_stdout && p->index_version > 1 &&
-	    check_pack_crc(p, &w_curs, offset, datalen, revidx->nr)) {
+	    check_pack_crc(p, &w_curs, offset, datalen, revidx.nr)) {
 		error(_("bad packed object CRC for %s"),
 		      oid_to_hex(&entry->idx.oid));
 		unuse_pack(&w_curs);
@@ -863,8 +869,8 @@ static void write_reused_pack_one(size_t pos, struct hashfile *out,
 	enum object_type type;
 	unsigned long size;
 
-	offset = reuse_packfile->revindex[pos].offset;
-	next = reuse_packfile->revindex[pos + 1].offset;
+	offset = pack_pos_to_offset(reuse_packfile, pos);
+	next = pack_pos_to_offset(reuse_packfile, pos + 1);
 
 	record_reused_object(offset, offset - hashfile_total(out));
 
@@ -888,7 +894,7 @@ static void write_reused_pack_one(size_t pos, struct hashfile *out,
 			struct object_id base_oid;
 
 			nth_packed_object_id(&base_oid, reuse_packfile,
-					     reuse_packfile->revindex[base_pos].nr);
+					     pack_pos_to_index(reuse_packfile, base_pos));
 
 			len = encode_in_pack_object_header(header, sizeof(header),
 							   OBJ_REF_DELTA, size);
@@ -941,7 +947,7 @@ static size_t write_reused_pack_verbatim(struct hashfile *out,
 		off_t to_write;
 
 		written = (pos * BITS_IN_EWORD);
-		to_write = reuse_packfile->revindex[written].offset
+		to_write = pack_pos_to_offset(reuse_packfile, written)
 			- sizeof(struct pack_header);
 
 		/* We're recording one chunk, not one object. */
@@ -1095,7 +1101,7 @@ static void write_pack_file(void)
 			}
 
 			finish_tmp_packfile(&tmpname, pack_tmp_name,
-					    written_list, nr_written,
+					    written_list, nr_written, &to_pack,
 					    &pack_idx_opts, oid.hash);
 
 			if (write_bitmap_index) {
@@ -1807,11 +1813,10 @@ static void check_object(struct object_entry *entry, uint32_t object_index)
 				goto give_up;
 			}
 			if (reuse_delta && !entry->preferred_base) {
-				struct revindex_entry *revidx;
-				revidx = find_pack_revindex(p, ofs);
-				if (!revidx)
+				struct revindex_entry revidx;
+				if (find_pack_revindex(p, ofs, &revidx, NULL))
 					goto give_up;
-				if (!nth_packed_object_id(&base_ref, p, revidx->nr))
+				if (!nth_packed_object_id(&base_ref, p, revidx.nr))
 					have_base = 1;
 			}
 			entry->in_pack_header_size = used + used_0;
@@ -2919,6 +2924,12 @@ static int git_pack_config(const char *k, const char *v, void *cb)
 		else
 			write_bitmap_options &= ~BITMAP_OPT_HASH_CACHE;
 	}
+	if (!strcmp(k, "pack.writebitmaplookuptable")) {
+		if (git_config_bool(k, v))
+			write_bitmap_options |= BITMAP_OPT_LOOKUP_TABLE;
+		else
+			write_bitmap_options &= ~BITMAP_OPT_LOOKUP_TABLE;
+	}
 	if (!strcmp(k, "pack.usebitmaps")) {
 		use_bitmap_index_default = git_config_bool(k, v);
 		return 0;
@@ -2945,6 +2956,13 @@ static int git_pack_config(const char *k, const char *v, void *cb)
 			    pack_idx_opts.version);
 		return 0;
 	}
+	if (!strcmp(k, "pack.writereverseindex")) {
+		if (git_config_bool(k, v))
+			pack_idx_opts.flags |= WRITE_REV;
+		else
+			pack_idx_opts.flags &= ~WRITE_REV;
+		return 0;
+	}
 	if (!strcmp(k, "uploadpack.blobpackfileuri")) {
 		struct configured_exclusion *ex = xmalloc(sizeof(*ex));
 		const char *oid_end, *pack_end;
@@ -3262,13 +3280,18 @@ static void loosen_unused_packed_objects(void)
 
 		if (open_pack_index(p))
 			die(_("cannot open pack index"));
+		if (p->is_cruft && load_pack_mtimes(p) < 0)
+			die(_("could not load cruft pack .mtimes"));
 
 		for (i = 0; i < p->num_objects; i++) {
+			time_t mtime = p->is_cruft ? nth_packed_mtime(p, i) :
+						     p->mtime;
+
 			nth_packed_object_id(&oid, p, i);
 			if (!packlist_find(&to_pack, &oid) &&
 			    !has_sha1_pack_kept_or_nonlocal(&oid) &&
-			    !loosened_object_can_be_discarded(&oid, p->mtime))
-				if (force_object_loose(&oid, p->mtime))
+			    !loosened_object_can_be_discarded(&oid, mtime))
+				if (force_object_loose(&oid, mtime))
 					die(_("unable to force loose object"));
 		}
 	}
@@ -3389,7 +3412,7 @@ static void get_object_list(int ac, const char **av)
 	if (unpack_unreachable_expiration) {
 		revs.ignore_missing_links = 1;
 		if (add_unseen_recent_objects_to_traversal(&revs,
-				unpack_unreachable_expiration))
+				unpack_unreachable_expiration, NULL, 0))
 			die(_("unable to add recent objects"));
 		if (prepare_revision_walk(&revs))
 			die(_("revision walk setup failed"));
@@ -3407,6 +3430,364 @@ static void get_object_list(int ac, const char **av)
 	oid_array_clear(&recent_objects);
 }
 
+static void mark_pack_kept_in_core(struct string_list *packs, unsigned keep)
+{
+	struct string_list_item *item = NULL;
+	for_each_string_list_item(item, packs) {
+		struct packed_git *p = item->util;
+		if (!p)
+			die(_("could not find pack '%s'"), item->string);
+		p->pack_keep_in_core = keep;
+	}
+}
+
+static int add_object_entry_from_pack(const struct object_id *oid,
+				      struct packed_git *p,
+				      uint32_t pos,
+				      void *data)
+{
+	struct object_info oi = OBJECT_INFO_INIT;
+	enum object_type type;
+	off_t ofs;
+
+	display_progress(progress_state, ++nr_seen);
+
+	if (have_duplicate_entry(oid, 0))
+		return 0;
+
+	ofs = nth_packed_object_offset(p, pos);
+	if (!want_object_in_pack(oid, 0, &p, &ofs))
+		return 0;
+
+	oi.typep = &type;
+	if (packed_object_info(the_repository, p, ofs, &oi) < 0)
+		die(_("could not get type of object %s in pack %s"),
+		    oid_to_hex(oid), p->pack_name);
+
+	create_object_entry(oid, type, 0, 0, 0, p, ofs);
+	return 0;
+}
+
+/*
+ * Read the packs to combine from stdin: "<pack>" names a pack whose
+ * objects are to be included, and "^<pack>" one whose objects are to be
+ * left out even if they also appear in an included pack. The objects are
+ * taken straight from the pack indexes, without any traversal.
+ */
+static void read_packs_list_from_stdin(void)
+{
+	struct strbuf buf = STRBUF_INIT;
+	struct string_list include_packs = STRING_LIST_INIT_DUP;
+	struct string_list exclude_packs = STRING_LIST_INIT_DUP;
+	struct string_list_item *item;
+	struct packed_git *p;
+
+	while (strbuf_getline(&buf, stdin) != EOF) {
+		if (!buf.len)
+			continue;
+
+		if (*buf.buf == '^')
+			string_list_append(&exclude_packs, buf.buf + 1);
+		else
+			string_list_append(&include_packs, buf.buf);
+	}
+
+	string_list_sort(&include_packs);
+	string_list_sort(&exclude_packs);
+
+	for (p = get_all_packs(the_repository); p; p = p->next) {
+		const char *pack_name = pack_basename(p);
+
+		item = string_list_lookup(&include_packs, pack_name);
+		if (!item)
+			item = string_list_lookup(&exclude_packs, pack_name);
+
+		if (item)
+			item->util = p;
+	}
+
+	/*
+	 * Objects in excluded packs are treated as if they were in a kept
+	 * pack, so that want_object_in_pack() rejects them no matter which
+	 * pack we find them in first.
+	 */
+	mark_pack_kept_in_core(&exclude_packs, 1);
+	ignore_packed_keep_in_core = 1;
+
+	for_each_string_list_item(item, &include_packs) {
+		p = item->util;
+		if (!p)
+			die(_("could not find pack '%s'"), item->string);
+		if (open_pack_index(p))
+			die(_("cannot open pack index"));
+		if (for_each_object_in_pack(p, add_object_entry_from_pack,
+					    NULL, FOR_EACH_OBJECT_PACK_ORDER))
+			die(_("unable to enumerate objects in %s"),
+			    pack_basename(p));
+	}
+
+	strbuf_release(&buf);
+	string_list_clear(&include_packs, 0);
+	string_list_clear(&exclude_packs, 0);
+}
+
+/*
+ * Add an unreachable object to a cruft pack, remembering the most recent
+ * of the mtimes it was seen with.
+ */
+static void add_cruft_object_entry(const struct object_id *oid,
+				   enum object_type type,
+				   struct packed_git *pack, off_t offset,
+				   const char *name, uint32_t mtime)
+{
+	struct object_entry *entry;
+
+	display_progress(progress_state, ++nr_seen);
+
+	entry = packlist_find(&to_pack, oid);
+	if (entry) {
+		if (name) {
+			entry->hash = pack_name_hash(name);
+			entry->no_try_delta = no_try_delta(name);
+		}
+	} else {
+		if (!want_object_in_pack(oid, 0, &pack, &offset))
+			return;
+		if (!pack && type == OBJ_BLOB && !has_loose_object(oid)) {
+			/*
+			 * If a traversed tree has a missing blob then we want
+			 * to avoid adding that missing object to our pack.
+			 *
+			 * This only applies to missing blobs, not trees,
+			 * because the traversal needs to parse sub-trees but
+			 * not blobs.
+			 *
+			 * Note we only perform this check when we couldn't
+			 * already find the object in a pack, so we're really
+			 * limited to "ensure non-tip blobs which don't exist in
+			 * packs do exist via loose objects". Confused?
+			 */
+			return;
+		}
+
+		entry = packlist_alloc(&to_pack, oid);
+		entry->hash = pack_name_hash(name);
+		entry->no_try_delta = name && no_try_delta(name);
+		oe_set_type(entry, type);
+		nr_result++;
+		if (pack) {
+			oe_set_in_pack(&to_pack, entry, pack);
+			entry->in_pack_offset = offset;
+		}
+	}
+
+	if (mtime > oe_cruft_mtime(&to_pack, entry))
+		oe_set_cruft_mtime(&to_pack, entry, mtime);
+}
+
+static int add_cruft_packed_object(const struct object_id *oid,
+				   struct packed_git *p, uint32_t pos,
+				   void *data)
+{
+	uint32_t mtime = p->mtime;
+
+	if (p->is_cruft)
+		mtime = nth_packed_mtime(p, pos);
+	add_cruft_object_entry(oid, OBJ_NONE, p,
+			       nth_packed_object_offset(p, pos), NULL, mtime);
+	return 0;
+}
+
+static int add_cruft_loose_object(const struct object_id *oid,
+				  const char *path, void *data)
+{
+	struct stat st;
+	enum object_type type;
+
+	if (stat(path, &st) < 0) {
+		if (errno == ENOENT)
+			return 0;
+		return error_errno("unable to stat %s", oid_to_hex(oid));
+	}
+
+	type = oid_object_info(the_repository, oid, NULL);
+	if (type < 0) {
+		warning(_("loose object at %s could not be examined"), path);
+		return 0;
+	}
+
+	add_cruft_object_entry(oid, type, NULL, 0, NULL, st.st_mtime);
+	return 0;
+}
+
+/*
+ * Without an expiration, every object outside of the fresh packs goes
+ * into the cruft pack, each with the newest mtime it was found with.
+ */
+static void enumerate_cruft_objects(void)
+{
+	struct packed_git *p;
+
+	if (progress)
+		progress_state = start_progress(_("Enumerating cruft objects"), 0);
+
+	for (p = get_all_packs(the_repository); p; p = p->next) {
+		if (!p->pack_local || p->pack_keep || p->pack_keep_in_core)
+			continue;
+		if (open_pack_index(p))
+			die(_("cannot open pack index"));
+		if (p->is_cruft && load_pack_mtimes(p) < 0)
+			die(_("could not load cruft pack .mtimes"));
+		if (for_each_object_in_pack(p, add_cruft_packed_object, NULL,
+					    FOR_EACH_OBJECT_PACK_ORDER))
+			die(_("unable to enumerate objects in %s"),
+			    pack_basename(p));
+	}
+	for_each_loose_file_in_objdir(get_object_directory(),
+				      add_cruft_loose_object,
+				      NULL, NULL, NULL);
+
+	stop_progress(&progress_state);
+}
+
+static void show_cruft_object(struct object *obj, const char *name, void *data)
+{
+	/*
+	 * If we did not record it earlier, it's at least as old as our
+	 * expiration value. Rather than find it exactly, just use that
+	 * value.  This may bump it forward from its real mtime, but it
+	 * will still be "too old" next time we run with the same
+	 * expiration.
+	 *
+	 * If obj does appear in the packing list, this call is a noop (or
+	 * may set the namehash).
+	 */
+	add_cruft_object_entry(&obj->oid, obj->type, NULL, 0, name,
+			       cruft_expiration);
+}
+
+static void show_cruft_commit(struct commit *commit, void *data)
+{
+	show_cruft_object((struct object *)commit, NULL, data);
+}
+
+static void set_cruft_mtime(const struct object *obj,
+			    struct packed_git *pack,
+			    off_t offset, time_t mtime)
+{
+	add_cruft_object_entry(&obj->oid, obj->type, pack, offset, NULL,
+			       mtime);
+}
+
+/*
+ * With an expiration, only objects younger than it go into the cruft
+ * pack, together with everything they reach, however old, so that the
+ * retained objects never refer to ones that are gone.
+ */
+static void enumerate_and_traverse_cruft_objects(struct string_list *fresh_packs)
+{
+	struct packed_git *p;
+	struct rev_info revs;
+	int ret;
+
+	if (progress)
+		progress_state = start_progress(_("Enumerating cruft objects"), 0);
+	nr_seen = 0;
+
+	/*
+	 * Only the fresh packs are kept, so that the traversal does not
+	 * stop early at objects in packs we know nothing about.
+	 */
+	for (p = get_all_packs(the_repository); p; p = p->next)
+		p->pack_keep_in_core = 0;
+	mark_pack_kept_in_core(fresh_packs, 1);
+
+	repo_init_revisions(the_repository, &revs, NULL);
+	revs.tag_objects = 1;
+	revs.tree_objects = 1;
+	revs.blob_objects = 1;
+	revs.ignore_missing_links = 1;
+
+	ret = add_unseen_recent_objects_to_traversal(&revs, cruft_expiration,
+						     set_cruft_mtime, 1);
+	stop_progress(&progress_state);
+
+	if (ret)
+		die(_("unable to add cruft objects"));
+
+	if (prepare_revision_walk(&revs))
+		die(_("revision walk setup failed"));
+	if (progress)
+		progress_state = start_progress(_("Traversing cruft objects"), 0);
+	nr_seen = 0;
+	traverse_commit_list(&revs, show_cruft_commit, show_cruft_object, NULL);
+
+	stop_progress(&progress_state);
+}
+
+/*
+ * Read the packs to build a cruft pack from from stdin: "<pack>" names a
+ * fresh pack, whose objects are left out, and "-<pack>" a pack that is
+ * about to be removed, whose unreachable objects are to be kept.
+ */
+static void read_cruft_objects(void)
+{
+	struct strbuf buf = STRBUF_INIT;
+	struct string_list discard_packs = STRING_LIST_INIT_DUP;
+	struct string_list fresh_packs = STRING_LIST_INIT_DUP;
+	struct packed_git *p;
+
+	ignore_packed_keep_in_core = 1;
+
+	while (strbuf_getline(&buf, stdin) != EOF) {
+		if (!buf.len)
+			continue;
+
+		if (*buf.buf == '-')
+			string_list_append(&discard_packs, buf.buf + 1);
+		else
+			string_list_append(&fresh_packs, buf.buf);
+	}
+
+	string_list_sort(&discard_packs);
+	string_list_sort(&fresh_packs);
+
+	for (p = get_all_packs(the_repository); p; p = p->next) {
+		const char *pack_name = pack_basename(p);
+		struct string_list_item *item;
+
+		item = string_list_lookup(&fresh_packs, pack_name);
+		if (!item)
+			item = string_list_lookup(&discard_packs, pack_name);
+
+		if (item) {
+			item->util = p;
+		} else {
+			/*
+			 * This pack wasn't mentioned in either the "fresh" or
+			 * "discard" list, so the caller didn't know about it.
+			 *
+			 * Mark it as kept so that its objects are ignored by
+			 * add_cruft_object_entry(). We'll later mark it as
+			 * not kept when we traverse in the expiring case.
+			 */
+			p->pack_keep_in_core = 1;
+		}
+	}
+
+	mark_pack_kept_in_core(&fresh_packs, 1);
+	mark_pack_kept_in_core(&discard_packs, 0);
+
+	if (cruft_expiration)
+		enumerate_and_traverse_cruft_objects(&fresh_packs);
+	else
+		enumerate_cruft_objects();
+
+	strbuf_release(&buf);
+	string_list_clear(&discard_packs, 0);
+	string_list_clear(&fresh_packs, 0);
+}
+
 static void add_extra_kept_packs(const struct string_list *names)
 {
 	struct packed_git *p;
@@ -3433,6 +3814,20 @@ static void add_extra_kept_packs(const struct string_list *names)
 	}
 }
 
+static int option_parse_cruft_expiration(const struct option *opt,
+					 const char *arg, int unset)
+{
+	if (unset) {
+		cruft = 0;
+		cruft_expiration = 0;
+	} else {
+		cruft = 1;
+		if (arg)
+			cruft_expiration = approxidate(arg);
+	}
+	return 0;
+}
+
 static int option_parse_index_version(const struct option *opt,
 				      const char *arg, int unset)
 {
@@ -3535,6 +3930,12 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 		OPT_CALLBACK_F(0, "unpack-unreachable", NULL, N_("time"),
 		  N_("unpack unreachable objects newer than <time>"),
 		  PARSE_OPT_OPTARG, option_parse_unpack_unreachable),
+		OPT_BOOL(0, "stdin-packs", &stdin_packs,
+			 N_("read packs from stdin")),
+		OPT_BOOL(0, "cruft", &cruft, N_("create a cruft pack")),
+		OPT_CALLBACK_F(0, "cruft-expiration", NULL, N_("time"),
+		  N_("expire cruft objects older than <time>"),
+		  PARSE_OPT_OPTARG, option_parse_cruft_expiration),
 		OPT_BOOL(0, "sparse", &sparse,
 			 N_("use the sparse reachability algorithm")),
 		OPT_BOOL(0, "thin", &thin,
@@ -3584,6 +3985,8 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 
 	reset_pack_idx_option(&pack_idx_opts);
 	git_config(git_pack_config, NULL);
+	if (git_env_bool(GIT_TEST_WRITE_REV_INDEX, 0))
+		pack_idx_opts.flags |= WRITE_REV;
 
 	progress = isatty(2);
 	argc = parse_options(argc, argv, prefix, pack_objects_options,
@@ -3628,7 +4031,7 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 		use_internal_rev_list = 1;
 		strvec_push(&rp, "--indexed-objects");
 	}
-	if (rev_list_unpacked) {
+	if (rev_list_unpacked && !stdin_packs) {
 		use_internal_rev_list = 1;
 		strvec_push(&rp, "--unpacked");
 	}
@@ -3675,6 +4078,24 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 			die(_("cannot use --filter without --stdout"));
 	}
 
+	if (stdin_packs) {
+		if (use_internal_rev_list)
+			die(_("cannot use internal rev list with --stdin-packs"));
+		if (cruft)
+			die(_("cannot use --stdin-packs with --cruft"));
+		if (filter_options.choice)
+			die(_("cannot use --filter with --stdin-packs"));
+	}
+
+	if (cruft) {
+		if (use_internal_rev_list)
+			die(_("cannot use internal rev list with --cruft"));
+		if (pack_to_stdout)
+			die(_("cannot use --stdout with --cruft"));
+		pack_idx_opts.flags |= WRITE_MTIMES;
+		write_bitmap_index = 0;
+	}
+
 	/*
 	 * "soft" reasons not to use bitmaps - for on-disk repack by default we want
 	 *
@@ -3733,7 +4154,13 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 
 	if (progress)
 		progress_state = start_progress(_("Enumerating objects"), 0);
-	if (!use_internal_rev_list)
+	if (stdin_packs) {
+		read_packs_list_from_stdin();
+		if (rev_list_unpacked)
+			add_unreachable_loose_objects();
+	} else if (cruft)
+		read_cruft_objects();
+	else if (!use_internal_rev_list)
 		read_object_list_from_stdin();
 	else {
 		get_object_list(rp.nr, rp.v);
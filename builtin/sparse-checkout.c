@@ -14,6 +14,7 @@
 #include "unpack-trees.h"
 #include "wt-status.h"
 #include "quote.h"
+#include "sparse-index.h"
 
 static const char *empty_base = "";
 
@@ -138,9 +139,17 @@ static int update_working_directory(struct pattern_list *pl)
 		 * files in the way or dirty entries that can't be removed.
 		 */
 		result = UPDATE_SPARSITY_SUCCESS;
-	if (result == UPDATE_SPARSITY_SUCCESS)
+	if (result == UPDATE_SPARSITY_SUCCESS) {
+		/*
+		 * The new patterns are not written out yet, but they
+		 * decide which directories may become sparse.
+		 */
+		if (pl)
+			r->index->sparse_checkout_patterns = pl;
 		write_locked_index(r->index, &lock_file, COMMIT_LOCK);
-	else
+		if (pl)
+			r->index->sparse_checkout_patterns = NULL;
+	} else
 		rollback_lock_file(&lock_file);
 
 	return result;
@@ -285,12 +294,13 @@ static int set_config(enum sparse_checkout_mode mode)
 }
 
 static char const * const builtin_sparse_checkout_init_usage[] = {
-	N_("git sparse-checkout init [--cone]"),
+	N_("git sparse-checkout init [--cone] [--[no-]sparse-index]"),
 	NULL
 };
 
 static struct sparse_checkout_init_opts {
 	int cone_mode;
+	int sparse_index;
 } init_opts;
 
 static int sparse_checkout_init(int argc, const char **argv)
@@ -305,11 +315,15 @@ static int sparse_checkout_init(int argc, const char **argv)
 	static struct option builtin_sparse_checkout_init_options[] = {
 		OPT_BOOL(0, "cone", &init_opts.cone_mode,
 			 N_("initialize the sparse-checkout in cone mode")),
+		OPT_BOOL(0, "sparse-index", &init_opts.sparse_index,
+			 N_("toggle the use of a sparse index")),
 		OPT_END(),
 	};
 
 	repo_read_index(the_repository);
 
+	init_opts.sparse_index = -1;
+
 	argc = parse_options(argc, argv, NULL,
 			     builtin_sparse_checkout_init_options,
 			     builtin_sparse_checkout_init_usage, 0);
@@ -323,6 +337,13 @@ static int sparse_checkout_init(int argc, const char **argv)
 	if (set_config(mode))
 		return 1;
 
+	if (init_opts.sparse_index >= 0) {
+		if (init_opts.sparse_index && mode != MODE_CONE_PATTERNS)
+			die(_("--sparse-index requires --cone"));
+		if (set_sparse_index_config(the_repository, init_opts.sparse_index) < 0)
+			die(_("failed to modify sparse-index config"));
+	}
+
 	memset(&pl, 0, sizeof(pl));
 
 	sparse_filename = get_sparse_checkout_filename();
@@ -619,6 +640,10 @@ static int sparse_checkout_disable(int argc, const char **argv)
 	strbuf_addstr(&match_all, "/*");
 	add_pattern(strbuf_detach(&match_all, NULL), empty_base, 0, &pl, 0);
 
+	/* the index must not stay sparse once every path is checked out */
+	if (set_sparse_index_config(the_repository, 0) < 0)
+		die(_("failed to modify sparse-index config"));
+
 	if (update_working_directory(&pl))
 		die(_("error while refreshing working directory"));
 
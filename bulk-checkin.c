@@ -9,6 +9,7 @@
 #include "strbuf.h"
 #include "packfile.h"
 #include "object-store.h"
+#include "tmp-objdir.h"
 
 static struct bulk_checkin_state {
 	unsigned plugged:1;
@@ -23,6 +24,8 @@ static struct bulk_checkin_state {
 	uint32_t nr_written;
 } state;
 
+static struct tmp_objdir *bulk_fsync_objdir;
+
 static void finish_bulk_checkin(struct bulk_checkin_state *state)
 {
 	struct object_id oid;
@@ -48,7 +51,7 @@ static void finish_bulk_checkin(struct bulk_checkin_state *state)
 
 	strbuf_addf(&packname, "%s/pack/pack-", get_object_directory());
 	finish_tmp_packfile(&packname, state->pack_tmp_name,
-			    state->written, state->nr_written,
+			    state->written, state->nr_written, NULL,
 			    &state->pack_idx_opts, oid.hash);
 	for (i = 0; i < state->nr_written; i++)
 		free(state->written[i]);
@@ -268,6 +271,61 @@ int index_bulk_checkin(struct object_id *oid,
 	return status;
 }
 
+/*
+ * All loose objects of the batch have been handed to the disk for
+ * writeback; a single fsync() of a dummy file on the same filesystem
+ * flushes the disk's write cache and thereby makes all of them durable.
+ * Only then are they moved into the real object directory, so that an
+ * object is never visible there before its contents are on disk.
+ */
+static void flush_batch_fsync(void)
+{
+	struct strbuf temp_path = STRBUF_INIT;
+	int fd;
+
+	if (!bulk_fsync_objdir)
+		return;
+
+	strbuf_addf(&temp_path, "%s/bulk_fsync_XXXXXX",
+		    tmp_objdir_path(bulk_fsync_objdir));
+	fd = xmkstemp(temp_path.buf);
+	fsync_or_die(fd, temp_path.buf);
+	close(fd);
+	unlink(temp_path.buf);
+	strbuf_release(&temp_path);
+
+	if (tmp_objdir_migrate(bulk_fsync_objdir))
+		die(_("unable to move batched objects into the object directory"));
+	bulk_fsync_objdir = NULL;
+}
+
+const char *prepare_loose_object_bulk_checkin(void)
+{
+	if (!state.plugged || !fsync_object_files ||
+	    fsync_method != FSYNC_METHOD_BATCH)
+		return NULL;
+
+	if (!bulk_fsync_objdir) {
+		bulk_fsync_objdir = tmp_objdir_create("bulk-fsync");
+		if (!bulk_fsync_objdir)
+			return NULL;
+		/* Keep the objects we write visible to ourselves */
+		tmp_objdir_add_as_alternate(bulk_fsync_objdir);
+	}
+	return tmp_objdir_path(bulk_fsync_objdir);
+}
+
+void fsync_loose_object_bulk_checkin(int fd, const char *filename)
+{
+	/*
+	 * If the platform cannot start writeback without waiting for
+	 * the disk, fall back to a full fsync(); the batch is still
+	 * correct, just not any faster.
+	 */
+	if (git_fsync(fd, FSYNC_WRITEOUT_ONLY) < 0)
+		fsync_or_die(fd, filename);
+}
+
 void plug_bulk_checkin(void)
 {
 	state.plugged = 1;
@@ -278,4 +336,5 @@ void unplug_bulk_checkin(void)
 	state.plugged = 0;
 	if (state.f)
 		finish_bulk_checkin(&state);
+	flush_batch_fsync();
 }
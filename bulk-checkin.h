@@ -10,6 +10,24 @@ int index_bulk_checkin(struct object_id *oid,
 		       int fd, size_t size, enum object_type type,
 		       const char *path, unsigned flags);
 
+/*
+ * When core.fsyncMethod is "batch", loose objects written while bulk
+ * checkin is plugged go to a temporary object directory and are only
+ * handed to the disk for writeback; unplug_bulk_checkin() then issues a
+ * single full flush and moves them into the object directory.
+ *
+ * prepare_loose_object_bulk_checkin() returns the directory such loose
+ * objects should be written to, or NULL if they should go to the
+ * repository's object directory as usual.
+ */
+const char *prepare_loose_object_bulk_checkin(void);
+
+/*
+ * Make a loose object written to the directory returned by the function
+ * above durable, as far as the batch is concerned.
+ */
+void fsync_loose_object_bulk_checkin(int fd, const char *filename);
+
 void plug_bulk_checkin(void);
 void unplug_bulk_checkin(void);
 
@@ -45,7 +45,7 @@ static int subtree_name_cmp(const char *one, int onelen,
 	return memcmp(one, two, onelen);
 }
 
-static int subtree_pos(struct cache_tree *it, const char *path, int pathlen)
+int cache_tree_subtree_pos(struct cache_tree *it, const char *path, int pathlen)
 {
 	struct cache_tree_sub **down = it->down;
 	int lo, hi;
@@ -72,7 +72,7 @@ static struct cache_tree_sub *find_subtree(struct cache_tree *it,
 					   int create)
 {
 	struct cache_tree_sub *down;
-	int pos = subtree_pos(it, path, pathlen);
+	int pos = cache_tree_subtree_pos(it, path, pathlen);
 	if (0 <= pos)
 		return it->down[pos];
 	if (!create)
@@ -123,7 +123,7 @@ static int do_invalidate_path(struct cache_tree *it, const char *path)
 	it->entry_count = -1;
 	if (!*slash) {
 		int pos;
-		pos = subtree_pos(it, path, namelen);
+		pos = cache_tree_subtree_pos(it, path, namelen);
 		if (0 <= pos) {
 			cache_tree_free(&it->down[pos]->cache_tree);
 			free(it->down[pos]);
@@ -292,6 +292,22 @@ static int update_one(struct cache_tree *it,
 		 */
 		sublen = slash - (path + baselen);
 		sub = find_subtree(it, path + baselen, sublen, 1);
+
+		/*
+		 * A sparse directory entry stands for the whole subtree;
+		 * record its tree without looking inside.
+		 */
+		if (S_ISSPARSEDIR(ce->ce_mode) && !slash[1]) {
+			cache_tree_free(&sub->cache_tree);
+			sub->cache_tree = cache_tree();
+			sub->cache_tree->entry_count = 1;
+			oidcpy(&sub->cache_tree->oid, &ce->oid);
+			sub->count = 1;
+			sub->used = 1;
+			i++;
+			continue;
+		}
+
 		if (!sub->cache_tree)
 			sub->cache_tree = cache_tree();
 		subcnt = update_one(sub->cache_tree,
@@ -793,6 +809,15 @@ static void verify_one(struct repository *r,
 
 	if (path->len) {
 		pos = index_name_pos(istate, path->buf, path->len);
+		if (pos >= 0) {
+			struct cache_entry *ce = istate->cache[pos];
+
+			if (!S_ISSPARSEDIR(ce->ce_mode) ||
+			    !oideq(&ce->oid, &it->oid))
+				BUG("cache-tree for sparse directory %s does "
+				    "not match", ce->name);
+			return;
+		}
 		pos = -pos - 1;
 	} else {
 		pos = 0;
@@ -69,6 +69,13 @@ unsigned long git_deflate_bound(git_zstream *, unsigned long);
 #define S_IFGITLINK	0160000
 #define S_ISGITLINK(m)	(((m) & S_IFMT) == S_IFGITLINK)
 
+/*
+ * A "sparse directory" index entry (see sparse-index.h) stands for a
+ * whole tree outside of the sparse-checkout cone; its name ends with
+ * a slash.
+ */
+#define S_ISSPARSEDIR(m) ((m) == S_IFDIR)
+
 /*
  * Some mode bits are also used internally for computations.
  *
@@ -305,6 +312,7 @@ static inline unsigned int canon_mode(unsigned int mode)
 struct split_index;
 struct untracked_cache;
 struct progress;
+struct pattern_list;
 
 struct index_state {
 	struct cache_entry **cache;
@@ -319,7 +327,13 @@ struct index_state {
 		 drop_cache_tree : 1,
 		 updated_workdir : 1,
 		 updated_skipworktree : 1,
-		 fsmonitor_has_run_once : 1;
+		 fsmonitor_has_run_once : 1,
+
+		 /*
+		  * The index contains sparse directory entries, see
+		  * sparse-index.h.
+		  */
+		 sparse_index : 1;
 	struct hashmap name_hash;
 	struct hashmap dir_hash;
 	struct object_id oid;
@@ -328,6 +342,7 @@ struct index_state {
 	struct ewah_bitmap *fsmonitor_dirty;
 	struct mem_pool *ce_mem_pool;
 	struct progress *progress;
+	struct pattern_list *sparse_checkout_patterns;
 };
 
 /* Name hashing */
@@ -627,9 +642,10 @@ int path_inside_repo(const char *prefix, const char *path);
 #define INIT_DB_EXIST_OK 0x0002
 
 int init_db(const char *git_dir, const char *real_git_dir,
-	    const char *template_dir, int hash_algo,
+	    const char *template_dir, int hash_algo, const char *ref_format,
 	    const char *initial_branch, unsigned int flags);
-void initialize_repository_version(int hash_algo, int reinit);
+void initialize_repository_version(int hash_algo,
+				   const char *ref_storage_format, int reinit);
 
 void sanitize_stdfds(void);
 int daemonize(void);
@@ -954,6 +970,16 @@ extern int read_replace_refs;
 extern char *git_replace_ref_base;
 
 extern int fsync_object_files;
+
+enum fsync_method {
+	FSYNC_METHOD_FSYNC,
+	FSYNC_METHOD_BATCH
+};
+
+#define FSYNC_METHOD_DEFAULT FSYNC_METHOD_FSYNC
+
+extern enum fsync_method fsync_method;
+extern int threaded_checksum;
 extern int core_preload_index;
 extern int precomposed_unicode;
 extern int protect_hfs;
@@ -1042,6 +1068,7 @@ struct repository_format {
 	int worktree_config;
 	int is_bare;
 	int hash_algo;
+	char *ref_storage_format; /* value of extensions.refstorage */
 	char *work_tree;
 	struct string_list unknown_extensions;
 	struct string_list v1_only_extensions;
@@ -1722,6 +1749,13 @@ struct checkout {
 
 #define TEMPORARY_FILENAME_LENGTH 25
 int checkout_entry(struct cache_entry *ce, const struct checkout *state, char *topath, int *nr_checkouts);
+/*
+ * Refresh the stat information of ce after its file was written, if
+ * state->refresh_cache is set; st is the result of fstat() on the new
+ * file, or NULL to lstat() it.
+ */
+int update_ce_after_write(const struct checkout *state, struct cache_entry *ce,
+			  struct stat *st);
 void enable_delayed_checkout(struct checkout *state);
 int finish_delayed_checkout(struct checkout *state, int *nr_checkouts);
 /*
@@ -425,7 +425,7 @@ static void combine_diff(struct repository *r,
 			 struct sline *sline, unsigned int cnt, int n,
 			 int num_parent, int result_deleted,
 			 struct userdiff_driver *textconv,
-			 const char *path, long flags)
+			 const char *path, struct diff_options *opt)
 {
 	unsigned int p_lno, lno;
 	unsigned long nmask = (1UL << n);
@@ -441,7 +441,8 @@ static void combine_diff(struct repository *r,
 	parent_file.ptr = grab_blob(r, parent, mode, &sz, textconv, path);
 	parent_file.size = sz;
 	memset(&xpp, 0, sizeof(xpp));
-	xpp.flags = flags;
+	xpp.flags = opt->xdl_opts;
+	xpp.max_cost = opt->cost_limit;
 	memset(&xecfg, 0, sizeof(xecfg));
 	memset(&state, 0, sizeof(state));
 	state.nmask = nmask;
@@ -472,7 +473,7 @@ static void combine_diff(struct repository *r,
 			struct sline *sl = &sline[lno];
 			sl->lost = coalesce_lines(sl->lost, &sl->lenlost,
 						  sl->plost.lost_head,
-						  sl->plost.len, n, flags);
+						  sl->plost.len, n, opt->xdl_opts);
 			sl->plost.lost_head = sl->plost.lost_tail = NULL;
 			sl->plost.len = 0;
 		}
@@ -1197,7 +1198,7 @@ static void show_patch_diff(struct combine_diff_path *elem, int num_parent,
 				     elem->parent[i].mode,
 				     &result_file, sline,
 				     cnt, i, num_parent, result_deleted,
-				     textconv, elem->path, opt->xdl_opts);
+				     textconv, elem->path, opt);
 	}
 
 	show_hunks = make_hunks(sline, cnt, num_parent, rev->dense_combined_merges);
@@ -4,7 +4,6 @@
 #include "decorate.h"
 #include "prio-queue.h"
 #include "tree.h"
-#include "ref-filter.h"
 #include "revision.h"
 #include "tag.h"
 #include "commit-reach.h"
@@ -32,14 +31,14 @@ static int queue_has_nonstale(struct prio_queue *queue)
 static struct commit_list *paint_down_to_common(struct repository *r,
 						struct commit *one, int n,
 						struct commit **twos,
-						int min_generation)
+						timestamp_t min_generation)
 {
 	struct prio_queue queue = { compare_commits_by_gen_then_commit_date };
 	struct commit_list *result = NULL;
 	int i;
-	uint32_t last_gen = GENERATION_NUMBER_INFINITY;
+	timestamp_t last_gen = GENERATION_NUMBER_INFINITY;
 
-	if (!min_generation)
+	if (!min_generation && !corrected_commit_dates_enabled(r))
 		queue.compare = compare_commits_by_commit_date;
 
 	one->object.flags |= PARENT1;
@@ -58,10 +57,10 @@ static struct commit_list *paint_down_to_common(struct repository *r,
 		struct commit *commit = prio_queue_get(&queue);
 		struct commit_list *parents;
 		int flags;
-		uint32_t generation = commit_graph_generation(commit);
+		timestamp_t generation = commit_graph_generation(commit);
 
 		if (min_generation && generation > last_gen)
-			BUG("bad generation skip %8x > %8x at %s",
+			BUG("bad generation skip %"PRItime" > %"PRItime" at %s",
 			    generation, last_gen,
 			    oid_to_hex(&commit->object.oid));
 		last_gen = generation;
@@ -177,12 +176,12 @@ static int remove_redundant(struct repository *r, struct commit **array, int cnt
 		repo_parse_commit(r, array[i]);
 	for (i = 0; i < cnt; i++) {
 		struct commit_list *common;
-		uint32_t min_generation = commit_graph_generation(array[i]);
+		timestamp_t min_generation = commit_graph_generation(array[i]);
 
 		if (redundant[i])
 			continue;
 		for (j = filled = 0; j < cnt; j++) {
-			uint32_t curr_generation;
+			timestamp_t curr_generation;
 			if (i == j || redundant[j])
 				continue;
 			filled_index[filled] = j;
@@ -321,7 +320,7 @@ int repo_in_merge_bases_many(struct repository *r, struct commit *commit,
 {
 	struct commit_list *bases;
 	int ret = 0, i;
-	uint32_t generation, max_generation = GENERATION_NUMBER_ZERO;
+	timestamp_t generation, max_generation = GENERATION_NUMBER_ZERO;
 
 	if (repo_parse_commit(r, commit))
 		return ret;
@@ -470,7 +469,7 @@ static int in_commit_list(const struct commit_list *want, struct commit *c)
 static enum contains_result contains_test(struct commit *candidate,
 					  const struct commit_list *want,
 					  struct contains_cache *cache,
-					  uint32_t cutoff)
+					  timestamp_t cutoff)
 {
 	enum contains_result *cached = contains_cache_at(cache, candidate);
 
@@ -500,17 +499,17 @@ static void push_to_contains_stack(struct commit *candidate, struct contains_sta
 	contains_stack->contains_stack[contains_stack->nr++].parents = candidate->parents;
 }
 
-static enum contains_result contains_tag_algo(struct commit *candidate,
-					      const struct commit_list *want,
-					      struct contains_cache *cache)
+/*
+ * No commit with a generation below the lowest one of 'want' can
+ * reach any of them.
+ */
+static timestamp_t contains_cutoff(const struct commit_list *want)
 {
-	struct contains_stack contains_stack = { 0, 0, NULL };
-	enum contains_result result;
-	uint32_t cutoff = GENERATION_NUMBER_INFINITY;
+	timestamp_t cutoff = GENERATION_NUMBER_INFINITY;
 	const struct commit_list *p;
 
 	for (p = want; p; p = p->next) {
-		uint32_t generation;
+		timestamp_t generation;
 		struct commit *c = p->item;
 		load_commit_graph_info(the_repository, c);
 		generation = commit_graph_generation(c);
@@ -518,6 +517,17 @@ static enum contains_result contains_tag_algo(struct commit *candidate,
 			cutoff = generation;
 	}
 
+	return cutoff;
+}
+
+static enum contains_result contains_walk(struct commit *candidate,
+					  const struct commit_list *want,
+					  struct contains_cache *cache,
+					  timestamp_t cutoff)
+{
+	struct contains_stack contains_stack = { 0, 0, NULL };
+	enum contains_result result;
+
 	result = contains_test(candidate, want, cache, cutoff);
 	if (result != CONTAINS_UNKNOWN)
 		return result;
@@ -553,12 +563,153 @@ static enum contains_result contains_tag_algo(struct commit *candidate,
 	return contains_test(candidate, want, cache, cutoff);
 }
 
-int commit_contains(struct ref_filter *filter, struct commit *commit,
-		    struct commit_list *list, struct contains_cache *cache)
+/*
+ * Keep only the bases that cannot reach another one. A tip reaching a
+ * dropped base also reaches the base below it, so the answers do not
+ * change, but no base is now an ancestor of another.
+ */
+static struct commit_list *minimal_bases(struct commit_list *bases)
+{
+	struct commit_list *result = NULL, *b, *o;
+
+	for (b = bases; b; b = b->next) {
+		struct commit_list *others = NULL;
+		int redundant;
+
+		if (in_commit_list(result, b->item))
+			continue;
+		for (o = bases; o; o = o->next)
+			if (o->item != b->item)
+				commit_list_insert(o->item, &others);
+		redundant = others &&
+			repo_is_descendant_of(the_repository, b->item, others);
+		free_commit_list(others);
+		if (!redundant)
+			commit_list_insert(b->item, &result);
+	}
+	return result;
+}
+
+/*
+ * Flags for tips_reaching_bases(): TIP_SIDE marks commits reachable
+ * from a tip, BELOW_BASE marks strict ancestors of a base. A commit
+ * with both cannot reach any base, since the bases are minimal.
+ */
+#define BELOW_BASE	PARENT1
+#define TIP_SIDE	PARENT2
+#define IN_QUEUE	STALE
+#define PAINTED		RESULT
+
+struct tips_walk {
+	struct prio_queue queue;
+	struct contains_cache cache;
+	int live;
+};
+
+static int tips_walk_live(unsigned int flags)
+{
+	return (flags & (TIP_SIDE | BELOW_BASE)) == TIP_SIDE;
+}
+
+static void tips_walk_paint(struct tips_walk *w, struct commit *c,
+			    unsigned int flags)
 {
-	if (filter->with_commit_tag_algo)
-		return contains_tag_algo(commit, list, cache) == CONTAINS_YES;
-	return repo_is_descendant_of(the_repository, commit, list);
+	unsigned int old = c->object.flags;
+
+	if ((old & PAINTED) && (old & flags) == flags)
+		return;
+	c->object.flags |= flags | PAINTED;
+
+	if (!tips_walk_live(c->object.flags) && (c->object.flags & TIP_SIDE))
+		*contains_cache_at(&w->cache, c) = CONTAINS_NO;
+
+	if (!(old & PAINTED)) {
+		c->object.flags |= IN_QUEUE;
+		prio_queue_put(&w->queue, c);
+		if (tips_walk_live(c->object.flags))
+			w->live++;
+	} else if ((old & IN_QUEUE) && tips_walk_live(old) &&
+		   !tips_walk_live(c->object.flags)) {
+		w->live--;
+	}
+}
+
+void tips_reaching_bases(struct commit_list *bases,
+			 struct commit **tips, size_t tips_nr,
+			 unsigned int mark)
+{
+	struct tips_walk w = { { compare_commits_by_gen_then_commit_date } };
+	struct commit_list *want, *b;
+	struct commit *c;
+	timestamp_t cutoff;
+	size_t i;
+
+	if (!bases || !tips_nr)
+		return;
+
+	want = minimal_bases(bases);
+	init_contains_cache(&w.cache);
+	cutoff = contains_cutoff(want);
+
+	/*
+	 * Paint down from the tips and the bases at the same time, in
+	 * generation order, until no commit in the queue can still lead
+	 * from a tip to a base. This is what bounds the walk by date when
+	 * there are no generation numbers, like paint_down_to_common().
+	 */
+	for (i = 0; i < tips_nr; i++) {
+		parse_commit(tips[i]);
+		tips_walk_paint(&w, tips[i], TIP_SIDE);
+	}
+	for (b = want; b; b = b->next) {
+		parse_commit(b->item);
+		tips_walk_paint(&w, b->item, 0);
+	}
+
+	while (w.live && (c = prio_queue_get(&w.queue))) {
+		struct commit_list *parents;
+		unsigned int flags;
+
+		c->object.flags &= ~IN_QUEUE;
+		if (tips_walk_live(c->object.flags))
+			w.live--;
+
+		if (in_commit_list(want, c) || (c->object.flags & BELOW_BASE))
+			flags = BELOW_BASE;
+		else
+			flags = TIP_SIDE;
+
+		for (parents = c->parents; parents; parents = parents->next) {
+			struct commit *p = parents->item;
+
+			parse_commit(p);
+			if (commit_graph_generation(p) < cutoff)
+				continue;
+			tips_walk_paint(&w, p, flags);
+		}
+	}
+	clear_prio_queue(&w.queue);
+
+	/*
+	 * Everything a tip can reach without leaving the painted part of
+	 * the graph is now either a base, known not to reach one, or has
+	 * all its parents painted; the memoized walk does not go further.
+	 */
+	for (i = 0; i < tips_nr; i++) {
+		/* several tips may point at the same commit */
+		if (tips[i]->object.flags & mark)
+			continue;
+		if (contains_walk(tips[i], want, &w.cache, cutoff) == CONTAINS_YES)
+			tips[i]->object.flags |= mark;
+	}
+
+	clear_commit_marks_many(tips_nr, tips,
+				BELOW_BASE | TIP_SIDE | IN_QUEUE | PAINTED);
+	for (b = want; b; b = b->next)
+		clear_commit_marks(b->item,
+				   BELOW_BASE | TIP_SIDE | IN_QUEUE | PAINTED);
+	clear_contains_cache(&w.cache);
+	free_commit_list(want);
 }
 
 static int compare_commits_by_gen(const void *_a, const void *_b)
@@ -566,8 +717,8 @@ static int compare_commits_by_gen(const void *_a, const void *_b)
 	const struct commit *a = *(const struct commit * const *)_a;
 	const struct commit *b = *(const struct commit * const *)_b;
 
-	uint32_t generation_a = commit_graph_generation(a);
-	uint32_t generation_b = commit_graph_generation(b);
+	timestamp_t generation_a = commit_graph_generation(a);
+	timestamp_t generation_b = commit_graph_generation(b);
 
 	if (generation_a < generation_b)
 		return -1;
@@ -580,7 +731,7 @@ int can_all_from_reach_with_flag(struct object_array *from,
 				 unsigned int with_flag,
 				 unsigned int assign_flag,
 				 time_t min_commit_date,
-				 uint32_t min_generation)
+				 timestamp_t min_generation)
 {
 	struct commit **list = NULL;
 	int i;
@@ -681,13 +832,13 @@ int can_all_from_reach(struct commit_list *from, struct commit_list *to,
 	time_t min_commit_date = cutoff_by_min_date ? from->item->date : 0;
 	struct commit_list *from_iter = from, *to_iter = to;
 	int result;
-	uint32_t min_generation = GENERATION_NUMBER_INFINITY;
+	timestamp_t min_generation = GENERATION_NUMBER_INFINITY;
 
 	while (from_iter) {
 		add_object_array(&from_iter->item->object, NULL, &from_objs);
 
 		if (!parse_commit(from_iter->item)) {
-			uint32_t generation;
+			timestamp_t generation;
 			if (from_iter->item->date < min_commit_date)
 				min_commit_date = from_iter->item->date;
 
@@ -701,7 +852,7 @@ int can_all_from_reach(struct commit_list *from, struct commit_list *to,
 
 	while (to_iter) {
 		if (!parse_commit(to_iter->item)) {
-			uint32_t generation;
+			timestamp_t generation;
 			if (to_iter->item->date < min_commit_date)
 				min_commit_date = to_iter->item->date;
 
@@ -741,13 +892,13 @@ struct commit_list *get_reachable_subset(struct commit **from, int nr_from,
 	struct commit_list *found_commits = NULL;
 	struct commit **to_last = to + nr_to;
 	struct commit **from_last = from + nr_from;
-	uint32_t min_generation = GENERATION_NUMBER_INFINITY;
+	timestamp_t min_generation = GENERATION_NUMBER_INFINITY;
 	int num_to_find = 0;
 
 	struct prio_queue queue = { compare_commits_by_gen_then_commit_date };
 
 	for (item = to; item < to_last; item++) {
-		uint32_t generation;
+		timestamp_t generation;
 		struct commit *c = *item;
 
 		parse_commit(c);
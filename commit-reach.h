@@ -5,7 +5,6 @@
 #include "commit-slab.h"
 
 struct commit_list;
-struct ref_filter;
 struct object_id;
 struct object_array;
 
@@ -73,8 +72,21 @@ enum contains_result {
 
 define_commit_slab(contains_cache, enum contains_result);
 
-int commit_contains(struct ref_filter *filter, struct commit *commit,
-		    struct commit_list *list, struct contains_cache *cache);
+/*
+ * Add 'mark' to each commit in the 'tips' array that can reach (or
+ * is) at least one commit in 'bases'.
+ *
+ * The tips and bases are painted together in one walk in generation
+ * order, which stops once no commit left to visit leads from a tip to
+ * a base; without generation numbers, this bounds it by commit date in
+ * the same way as the merge-base walk. A memoized pass over the
+ * painted commits then answers each tip. This makes answering
+ * "--contains" for a large number of refs about as expensive as
+ * walking their history once.
+ */
+void tips_reaching_bases(struct commit_list *bases,
+			 struct commit **tips, size_t tips_nr,
+			 unsigned int mark);
 
 /*
  * Determine if every commit in 'from' can reach at least one commit
@@ -87,7 +99,7 @@ int can_all_from_reach_with_flag(struct object_array *from,
 				 unsigned int with_flag,
 				 unsigned int assign_flag,
 				 time_t min_commit_date,
-				 uint32_t min_generation);
+				 timestamp_t min_generation);
 int can_all_from_reach(struct commit_list *from, struct commit_list *to,
 		       int commit_date_cutoff);
 
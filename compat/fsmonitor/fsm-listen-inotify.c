@@ -0,0 +1,296 @@
+#include "cache.h"
+#include "dir.h"
+#include "fsmonitor--daemon.h"
+#include "fsm-listen.h"
+#include <sys/inotify.h>
+
+/*
+ * inotify only watches single directories, so we keep one watch per
+ * directory of the worktree and map the watch descriptors that come
+ * with the events back to the (worktree-relative) directory they were
+ * added for.
+ *
+ * The kernel queues the event for a change before the system call
+ * making it returns, so draining the inotify queue before answering a
+ * client is enough to make sure that every change the client could
+ * have made or seen before asking is in the journal.
+ */
+
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | \
+		    IN_MOVED_FROM | IN_MOVED_TO | \
+		    IN_DELETE_SELF | IN_MOVE_SELF | \
+		    IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+
+struct watch_entry {
+	struct hashmap_entry ent;
+	int wd;
+	/* "" for the root, "dir/sub/" otherwise */
+	char dir[FLEX_ARRAY];
+};
+
+struct fsm_inotify_data {
+	int fd;
+	struct hashmap watches;
+};
+
+static int watch_entry_cmp(const void *unused_cmp_data,
+			   const struct hashmap_entry *eptr,
+			   const struct hashmap_entry *entry_or_key,
+			   const void *unused_keydata)
+{
+	const struct watch_entry *a, *b;
+
+	a = container_of(eptr, const struct watch_entry, ent);
+	b = container_of(entry_or_key, const struct watch_entry, ent);
+	return a->wd != b->wd;
+}
+
+static struct watch_entry *find_watch(struct fsm_inotify_data *data, int wd)
+{
+	struct watch_entry key;
+
+	hashmap_entry_init(&key.ent, memhash(&wd, sizeof(wd)));
+	key.wd = wd;
+	return hashmap_get_entry(&data->watches, &key, ent, NULL);
+}
+
+static void remember_watch(struct fsm_inotify_data *data, int wd,
+			   const char *dir, size_t len)
+{
+	struct watch_entry *w = find_watch(data, wd);
+
+	/*
+	 * inotify hands out the same descriptor again when a directory
+	 * that is already watched is added under another name, e.g.
+	 * after a rename that we saw before its IN_IGNORED.
+	 */
+	if (w) {
+		hashmap_remove(&data->watches, &w->ent, NULL);
+		free(w);
+	}
+
+	FLEX_ALLOC_MEM(w, dir, dir, len);
+	w->wd = wd;
+	hashmap_entry_init(&w->ent, memhash(&wd, sizeof(wd)));
+	hashmap_add(&data->watches, &w->ent);
+}
+
+static int is_dot_git(const char *name, size_t len)
+{
+	return len == 4 && !fspathncmp(name, ".git", 4);
+}
+
+/*
+ * Watch the directory `rel` (relative to the worktree, with a trailing
+ * slash unless it is the root) and everything below it.
+ */
+static int add_watches(struct fsmonitor_daemon_state *state,
+		       struct strbuf *rel)
+{
+	struct fsm_inotify_data *data = state->backend_data;
+	struct strbuf path = STRBUF_INIT;
+	DIR *dir;
+	struct dirent *de;
+	size_t rel_len = rel->len;
+	int wd, ret = 0;
+
+	strbuf_addbuf(&path, &state->path_worktree_watch);
+	strbuf_addch(&path, '/');
+	strbuf_addbuf(&path, rel);
+
+	wd = inotify_add_watch(data->fd, path.buf, WATCH_MASK);
+	if (wd < 0) {
+		/* Gone, not a directory anymore, or unreadable: ignore it. */
+		if (errno == ENOENT || errno == ENOTDIR || errno == EACCES)
+			goto out;
+		if (errno == ENOSPC)
+			ret = error(_("inotify watch limit reached; consider "
+				      "raising fs.inotify.max_user_watches"));
+		else
+			ret = error_errno(_("unable to watch '%s'"), path.buf);
+		goto out;
+	}
+	remember_watch(data, wd, rel->buf, rel->len);
+
+	dir = opendir(path.buf);
+	if (!dir)
+		goto out;
+	while (!ret && (de = readdir(dir))) {
+		size_t len = strlen(de->d_name);
+
+		if (is_dot_or_dotdot(de->d_name))
+			continue;
+		if (!rel_len && is_dot_git(de->d_name, len))
+			continue;
+		if (DTYPE(de) != DT_DIR && DTYPE(de) != DT_UNKNOWN)
+			continue;
+
+		strbuf_add(rel, de->d_name, len);
+		strbuf_addch(rel, '/');
+		ret = add_watches(state, rel);
+		strbuf_setlen(rel, rel_len);
+	}
+	closedir(dir);
+
+out:
+	strbuf_release(&path);
+	return ret;
+}
+
+/*
+ * Forget the watches of the directory `rel` and of everything below it,
+ * e.g. because it was moved out of the worktree.
+ */
+static void remove_watches(struct fsm_inotify_data *data, const char *rel)
+{
+	struct hashmap_iter iter;
+	struct watch_entry *w;
+	struct watch_entry **doomed = NULL;
+	size_t i, nr = 0, alloc = 0;
+
+	hashmap_for_each_entry(&data->watches, &iter, w, ent) {
+		if (!starts_with(w->dir, rel))
+			continue;
+		ALLOC_GROW(doomed, nr + 1, alloc);
+		doomed[nr++] = w;
+	}
+
+	for (i = 0; i < nr; i++) {
+		inotify_rm_watch(data->fd, doomed[i]->wd);
+		hashmap_remove(&data->watches, &doomed[i]->ent, NULL);
+		free(doomed[i]);
+	}
+	free(doomed);
+}
+
+static int process_event(struct fsmonitor_daemon_state *state,
+			 const struct inotify_event *event,
+			 struct strbuf *rel)
+{
+	struct fsm_inotify_data *data = state->backend_data;
+	struct watch_entry *w;
+
+	if (event->mask & IN_Q_OVERFLOW) {
+		fsmonitor_journal_invalidate(state);
+		return 0;
+	}
+
+	w = find_watch(data, event->wd);
+	if (!w)
+		return 0; /* a watch we already removed */
+
+	if (event->mask & IN_IGNORED) {
+		if (!*w->dir)
+			return error(_("the worktree is no longer watched"));
+		hashmap_remove(&data->watches, &w->ent, NULL);
+		free(w);
+		return 0;
+	}
+
+	if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+		if (!*w->dir)
+			return error(_("the worktree was moved or deleted"));
+		/* the parent directory reports this change */
+		return 0;
+	}
+
+	if (!event->len)
+		return 0;
+	if (!*w->dir && is_dot_git(event->name, strlen(event->name)))
+		return 0;
+
+	strbuf_reset(rel);
+	strbuf_addstr(rel, w->dir);
+	strbuf_addstr(rel, event->name);
+
+	if (!(event->mask & IN_ISDIR)) {
+		fsmonitor_journal_add(state, rel->buf);
+		return 0;
+	}
+
+	strbuf_addch(rel, '/');
+	if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+		if (add_watches(state, rel) < 0)
+			return -1;
+	} else if (event->mask & IN_MOVED_FROM) {
+		remove_watches(data, rel->buf);
+	}
+	fsmonitor_journal_add(state, rel->buf);
+	return 0;
+}
+
+int fsm_listen__drain_events(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_inotify_data *data = state->backend_data;
+	struct strbuf rel = STRBUF_INIT;
+	char buf[64 * 1024]
+		__attribute__ ((aligned(__alignof__(struct inotify_event))));
+	int ret = 0;
+
+	while (!ret) {
+		ssize_t len = read(data->fd, buf, sizeof(buf));
+		char *p;
+
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				ret = error_errno(_("unable to read inotify events"));
+			break;
+		}
+		if (!len)
+			break;
+
+		for (p = buf; !ret && p < buf + len; ) {
+			const struct inotify_event *event = (void *)p;
+
+			ret = process_event(state, event, &rel);
+			p += sizeof(*event) + event->len;
+		}
+	}
+
+	strbuf_release(&rel);
+	return ret;
+}
+
+int fsm_listen__get_fd(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_inotify_data *data = state->backend_data;
+
+	return data->fd;
+}
+
+int fsm_listen__ctor(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_inotify_data *data = xcalloc(1, sizeof(*data));
+	struct strbuf rel = STRBUF_INIT;
+	int ret;
+
+	data->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (data->fd < 0) {
+		free(data);
+		return error_errno(_("unable to initialize inotify"));
+	}
+	hashmap_init(&data->watches, watch_entry_cmp, NULL, 0);
+	state->backend_data = data;
+
+	ret = add_watches(state, &rel);
+	strbuf_release(&rel);
+	if (!ret && !hashmap_get_size(&data->watches))
+		ret = error_errno(_("unable to watch '%s'"),
+				  state->path_worktree_watch.buf);
+	if (ret < 0)
+		fsm_listen__dtor(state);
+	return ret;
+}
+
+void fsm_listen__dtor(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_inotify_data *data = state->backend_data;
+
+	if (!data)
+		return;
+	close(data->fd);
+	hashmap_free_entries(&data->watches, struct watch_entry, ent);
+	FREE_AND_NULL(state->backend_data);
+}
@@ -0,0 +1,39 @@
+#ifndef FSM_LISTEN_H
+#define FSM_LISTEN_H
+
+/*
+ * Platform backend of `git fsmonitor--daemon`, watching the worktree
+ * for changes and feeding them to the journal of the daemon with
+ * fsmonitor_journal_add().
+ */
+
+#ifdef HAVE_FSMONITOR_DAEMON_BACKEND
+
+struct fsmonitor_daemon_state;
+
+/*
+ * Start watching `state->path_worktree_watch`.  Returns 0 on success,
+ * -1 (after reporting an error) on failure.
+ */
+int fsm_listen__ctor(struct fsmonitor_daemon_state *state);
+
+/*
+ * Stop watching and release the resources of the backend.
+ */
+void fsm_listen__dtor(struct fsmonitor_daemon_state *state);
+
+/*
+ * Returns the file descriptor that becomes readable when events are
+ * pending.  The daemon polls it together with its socket.
+ */
+int fsm_listen__get_fd(struct fsmonitor_daemon_state *state);
+
+/*
+ * Add all pending events to the journal without blocking.  Returns 0
+ * if the daemon should keep running, or -1 if it should shut down
+ * because the worktree went away or an error occurred.
+ */
+int fsm_listen__drain_events(struct fsmonitor_daemon_state *state);
+
+#endif /* HAVE_FSMONITOR_DAEMON_BACKEND */
+#endif /* FSM_LISTEN_H */
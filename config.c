@@ -1359,6 +1359,23 @@ static int git_default_core_config(const char *var, const char *value, void *cb)
 		return 0;
 	}
 
+	if (!strcmp(var, "core.fsyncmethod")) {
+		if (!value)
+			return config_error_nonbool(var);
+		if (!strcmp(value, "fsync"))
+			fsync_method = FSYNC_METHOD_FSYNC;
+		else if (!strcmp(value, "batch"))
+			fsync_method = FSYNC_METHOD_BATCH;
+		else
+			warning(_("ignoring unknown core.fsyncMethod value '%s'"), value);
+		return 0;
+	}
+
+	if (!strcmp(var, "core.threadedchecksum")) {
+		threaded_checksum = git_config_bool(var, value);
+		return 0;
+	}
+
 	if (!strcmp(var, "core.preloadindex")) {
 		core_preload_index = git_config_bool(var, value);
 		return 0;
@@ -2350,7 +2367,12 @@ int git_config_get_fsmonitor(void)
 	if (git_config_get_pathname("core.fsmonitor", &core_fsmonitor))
 		core_fsmonitor = getenv("GIT_TEST_FSMONITOR");
 
-	if (core_fsmonitor && !*core_fsmonitor)
+	/*
+	 * Only "true" and "false" are special; anything else, even
+	 * "yes" or "1", names a hook.
+	 */
+	if (core_fsmonitor &&
+	    (!*core_fsmonitor || !strcasecmp(core_fsmonitor, "false")))
 		core_fsmonitor = NULL;
 
 	if (core_fsmonitor)
@@ -7,6 +7,7 @@
 #include "hash.h"
 #include "string-list.h"
 
+struct convert_driver;
 struct index_state;
 struct strbuf;
 
@@ -63,6 +64,33 @@ struct checkout_metadata {
 	struct object_id blob;
 };
 
+enum crlf_action {
+	CRLF_UNDEFINED,
+	CRLF_BINARY,
+	CRLF_TEXT,
+	CRLF_TEXT_INPUT,
+	CRLF_TEXT_CRLF,
+	CRLF_AUTO,
+	CRLF_AUTO_INPUT,
+	CRLF_AUTO_CRLF
+};
+
+struct conv_attrs {
+	struct convert_driver *drv;
+	enum crlf_action attr_action; /* What attr says */
+	enum crlf_action crlf_action; /* When no attr is set, use core.autocrlf */
+	int ident;
+	const char *working_tree_encoding; /* Supported encoding or default encoding if NULL */
+};
+
+/*
+ * Look up the conversion attributes of path.  This is not thread-safe;
+ * callers converting contents from several threads should look up the
+ * attributes upfront and use convert_to_working_tree_ca().
+ */
+void convert_attrs(const struct index_state *istate,
+		   struct conv_attrs *ca, const char *path);
+
 extern enum eol core_eol;
 extern char *check_roundtrip_encoding;
 const char *get_cached_convert_stats_ascii(const struct index_state *istate,
@@ -84,6 +112,17 @@ int async_convert_to_working_tree(const struct index_state *istate,
 				  size_t len, struct strbuf *dst,
 				  const struct checkout_metadata *meta,
 				  void *dco);
+/*
+ * Like convert_to_working_tree(), with attributes looked up already.
+ * Safe to call from multiple threads, as long as ca does not name an
+ * external filter (see conv_attrs_need_external_filter()).
+ */
+int convert_to_working_tree_ca(const struct conv_attrs *ca,
+			       const char *path, const char *src,
+			       size_t len, struct strbuf *dst,
+			       const struct checkout_metadata *meta);
+/* Whether checking out with ca would run a smudge or process filter */
+int conv_attrs_need_external_filter(const struct conv_attrs *ca);
 int async_query_available_blobs(const char *cmd,
 				struct string_list *available_paths);
 int renormalize_buffer(const struct index_state *istate,
@@ -8,21 +8,125 @@
  * able to verify hasn't been messed with afterwards.
  */
 #include "cache.h"
+#include "config.h"
 #include "progress.h"
 #include "csum-file.h"
+#include "thread-utils.h"
+
+#define HASHFILE_BUFFER_SIZE (8 * 1024)
+#define HASHFILE_THREADED_BUFFER_SIZE (128 * 1024)
+
+/*
+ * A thread that feeds the buffers handed to it to the hash of a
+ * hashfile, so that the caller can go on producing and writing out
+ * data in the meantime. Only one buffer is in flight at a time.
+ */
+struct hashfile_worker {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	git_hash_ctx *ctx;
+	const unsigned char *data; /* NULL when idle */
+	unsigned int len;
+	unsigned started : 1,
+		 exit : 1;
+};
+
+static void *hashfile_worker_run(void *data)
+{
+	struct hashfile_worker *w = data;
+
+	pthread_mutex_lock(&w->mutex);
+	for (;;) {
+		while (!w->data && !w->exit)
+			pthread_cond_wait(&w->cond, &w->mutex);
+		if (!w->data)
+			break;
+
+		pthread_mutex_unlock(&w->mutex);
+		the_hash_algo->unsafe_update_fn(w->ctx, w->data, w->len);
+		pthread_mutex_lock(&w->mutex);
+
+		w->data = NULL;
+		pthread_cond_signal(&w->cond);
+	}
+	pthread_mutex_unlock(&w->mutex);
+	return NULL;
+}
+
+/* Wait until the worker (if any) has hashed everything handed to it. */
+static void hashfile_worker_wait(struct hashfile_worker *w)
+{
+	if (!w || !w->started)
+		return;
+
+	pthread_mutex_lock(&w->mutex);
+	while (w->data)
+		pthread_cond_wait(&w->cond, &w->mutex);
+	pthread_mutex_unlock(&w->mutex);
+}
+
+static void hashfile_worker_queue(struct hashfile_worker *w,
+				  const unsigned char *data, unsigned int len)
+{
+	if (!w->started) {
+		int ret = pthread_create(&w->thread, NULL,
+					 hashfile_worker_run, w);
+		if (ret)
+			die(_("unable to create thread: %s"), strerror(ret));
+		w->started = 1;
+	}
+
+	hashfile_worker_wait(w);
+
+	pthread_mutex_lock(&w->mutex);
+	w->data = data;
+	w->len = len;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->mutex);
+}
+
+static void hashfile_worker_stop(struct hashfile *f)
+{
+	struct hashfile_worker *w = f->worker;
+
+	if (!w)
+		return;
+
+	if (w->started) {
+		pthread_mutex_lock(&w->mutex);
+		w->exit = 1;
+		pthread_cond_signal(&w->cond);
+		pthread_mutex_unlock(&w->mutex);
+		pthread_join(w->thread, NULL);
+	}
+	pthread_mutex_destroy(&w->mutex);
+	pthread_cond_destroy(&w->cond);
+	FREE_AND_NULL(f->worker);
+	FREE_AND_NULL(f->spare);
+}
 
 static void flush(struct hashfile *f, const void *buf, unsigned int count)
 {
 	if (0 <= f->check_fd && count)  {
 		unsigned char check_buffer[8192];
-		ssize_t ret = read_in_full(f->check_fd, check_buffer, count);
-
-		if (ret < 0)
-			die_errno("%s: sha1 file read error", f->name);
-		if (ret != count)
-			die("%s: sha1 file truncated", f->name);
-		if (memcmp(buf, check_buffer, count))
-			die("sha1 file '%s' validation error", f->name);
+		const char *p = buf;
+		unsigned int left = count;
+
+		while (left) {
+			unsigned int nr = left > sizeof(check_buffer) ?
+					  sizeof(check_buffer) : left;
+			ssize_t ret = read_in_full(f->check_fd, check_buffer, nr);
+
+			if (ret < 0)
+				die_errno("%s: sha1 file read error", f->name);
+			if (ret != nr)
+				die("%s: sha1 file truncated", f->name);
+			if (memcmp(p, check_buffer, nr))
+				die("sha1 file '%s' validation error", f->name);
+			p += nr;
+			left -= nr;
+		}
 	}
 
 	for (;;) {
@@ -42,13 +146,34 @@ static void flush(struct hashfile *f, const void *buf, unsigned int count)
 	}
 }
 
+/*
+ * Hash and write out the first "count" bytes of f->buffer. With a
+ * worker, the buffer is hashed while we write it out, and we switch to
+ * the spare buffer so that the caller can fill it in the meantime. The
+ * thread is only started once a buffer fills up, so that small files
+ * do not pay for it.
+ */
+static void flush_buffer(struct hashfile *f, unsigned int count)
+{
+	if (f->worker && (f->worker->started || count == f->buffer_len)) {
+		unsigned char *full = f->buffer;
+
+		hashfile_worker_queue(f->worker, full, count);
+		flush(f, full, count);
+		f->buffer = f->spare;
+		f->spare = full;
+	} else {
+		the_hash_algo->unsafe_update_fn(&f->ctx, f->buffer, count);
+		flush(f, f->buffer, count);
+	}
+}
+
 void hashflush(struct hashfile *f)
 {
 	unsigned offset = f->offset;
 
 	if (offset) {
-		the_hash_algo->update_fn(&f->ctx, f->buffer, offset);
-		flush(f, f->buffer, offset);
+		flush_buffer(f, offset);
 		f->offset = 0;
 	}
 }
@@ -58,7 +183,8 @@ int finalize_hashfile(struct hashfile *f, unsigned char *result, unsigned int fl
 	int fd;
 
 	hashflush(f);
-	the_hash_algo->final_fn(f->buffer, &f->ctx);
+	hashfile_worker_stop(f);
+	the_hash_algo->unsafe_final_fn(f->buffer, &f->ctx);
 	if (result)
 		hashcpy(result, f->buffer);
 	if (flags & CSUM_HASH_IN_STREAM)
@@ -82,6 +208,7 @@ int finalize_hashfile(struct hashfile *f, unsigned char *result, unsigned int fl
 		if (close(f->check_fd))
 			die_errno("%s: sha1 file error on close", f->name);
 	}
+	free(f->buffer);
 	free(f);
 	return fd;
 }
@@ -90,30 +217,31 @@ void hashwrite(struct hashfile *f, const void *buf, unsigned int count)
 {
 	while (count) {
 		unsigned offset = f->offset;
-		unsigned left = sizeof(f->buffer) - offset;
+		unsigned left = f->buffer_len - offset;
 		unsigned nr = count > left ? left : count;
-		const void *data;
 
 		if (f->do_crc)
 			f->crc32 = crc32(f->crc32, buf, nr);
 
-		if (nr == sizeof(f->buffer)) {
-			/* process full buffer directly without copy */
-			data = buf;
+		if (nr == f->buffer_len && !f->worker) {
+			/*
+			 * Process full buffer directly without copy. The
+			 * worker thread needs data that outlives this call,
+			 * so we always copy when hashing on a thread.
+			 */
+			the_hash_algo->unsafe_update_fn(&f->ctx, buf, nr);
+			flush(f, buf, nr);
 		} else {
 			memcpy(f->buffer + offset, buf, nr);
-			data = f->buffer;
+			offset += nr;
+			if (offset == f->buffer_len) {
+				flush_buffer(f, offset);
+				offset = 0;
+			}
 		}
 
 		count -= nr;
-		offset += nr;
 		buf = (char *) buf + nr;
-		left -= nr;
-		if (!left) {
-			the_hash_algo->update_fn(&f->ctx, data, offset);
-			flush(f, data, offset);
-			offset = 0;
-		}
 		f->offset = offset;
 	}
 }
@@ -149,21 +277,39 @@ struct hashfile *hashfd_throughput(int fd, const char *name, struct progress *tp
 	f->tp = tp;
 	f->name = name;
 	f->do_crc = 0;
-	the_hash_algo->init_fn(&f->ctx);
+	the_hash_algo->unsafe_init_fn(&f->ctx);
+
+	f->spare = NULL;
+	f->worker = NULL;
+	if (HAVE_THREADS &&
+	    (threaded_checksum ||
+	     git_env_bool(GIT_TEST_THREADED_CHECKSUM, 0))) {
+		f->buffer_len = HASHFILE_THREADED_BUFFER_SIZE;
+		f->spare = xmalloc(f->buffer_len);
+		f->worker = xcalloc(1, sizeof(*f->worker));
+		f->worker->ctx = &f->ctx;
+		pthread_mutex_init(&f->worker->mutex, NULL);
+		pthread_cond_init(&f->worker->cond, NULL);
+	} else {
+		f->buffer_len = HASHFILE_BUFFER_SIZE;
+	}
+	f->buffer = xmalloc(f->buffer_len);
 	return f;
 }
 
 void hashfile_checkpoint(struct hashfile *f, struct hashfile_checkpoint *checkpoint)
 {
 	hashflush(f);
+	hashfile_worker_wait(f->worker);
 	checkpoint->offset = f->total;
-	the_hash_algo->clone_fn(&checkpoint->ctx, &f->ctx);
+	the_hash_algo->unsafe_clone_fn(&checkpoint->ctx, &f->ctx);
 }
 
 int hashfile_truncate(struct hashfile *f, struct hashfile_checkpoint *checkpoint)
 {
 	off_t offset = checkpoint->offset;
 
+	hashfile_worker_wait(f->worker);
 	if (ftruncate(f->fd, offset) ||
 	    lseek(f->fd, offset, SEEK_SET) != offset)
 		return -1;
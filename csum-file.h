@@ -4,6 +4,9 @@
 #include "hash.h"
 
 struct progress;
+struct hashfile_worker;
+
+#define GIT_TEST_THREADED_CHECKSUM "GIT_TEST_THREADED_CHECKSUM"
 
 /* A SHA1-protected file */
 struct hashfile {
@@ -16,7 +19,16 @@ struct hashfile {
 	const char *name;
 	int do_crc;
 	uint32_t crc32;
-	unsigned char buffer[8192];
+	unsigned char *buffer;
+	unsigned int buffer_len;
+
+	/*
+	 * When core.threadedChecksum is in effect, "buffer" is handed to
+	 * "worker" to be hashed once it is full, and we go on filling
+	 * "spare" while it is being hashed and written out.
+	 */
+	unsigned char *spare;
+	struct hashfile_worker *worker;
 };
 
 /* Checkpoint */
@@ -62,4 +74,10 @@ static inline void hashwrite_be32(struct hashfile *f, uint32_t data)
 	hashwrite(f, &data, sizeof(data));
 }
 
+static inline void hashwrite_be64(struct hashfile *f, uint64_t data)
+{
+	hashwrite_be32(f, data >> 32);
+	hashwrite_be32(f, data & 0xffffffffUL);
+}
+
 #endif
@@ -375,6 +375,37 @@ static int show_modified(struct rev_info *revs,
 	return 0;
 }
 
+/*
+ * A sparse directory entry stands for a whole tree that is not checked
+ * out; compare it with the tree entry (if any) by walking both trees.
+ */
+static void diff_sparse_directory(struct rev_info *revs,
+				  const struct cache_entry *idx,
+				  const struct cache_entry *tree)
+{
+	struct diff_options *opt = &revs->diffopt;
+	const struct object_id *old_oid = NULL, *new_oid = NULL;
+	int recursive = opt->flags.recursive;
+
+	if (tree && S_ISSPARSEDIR(tree->ce_mode))
+		old_oid = &tree->oid;
+	if (idx && S_ISSPARSEDIR(idx->ce_mode))
+		new_oid = &idx->oid;
+	if (old_oid && new_oid && oideq(old_oid, new_oid))
+		return;
+
+	/* the other side is a file in the way of the directory */
+	if (tree && !old_oid)
+		diff_index_show_file(revs, "-", tree, &tree->oid, 1,
+				     tree->ce_mode, 0);
+	if (idx && !new_oid)
+		show_new_file(revs, idx, 1, revs->match_missing);
+
+	opt->flags.recursive = 1;
+	diff_tree_oid(old_oid, new_oid, old_oid ? tree->name : idx->name, opt);
+	opt->flags.recursive = recursive;
+}
+
 /*
  * This gets a mix of an existing index and a tree, one pathname entry
  * at a time. The index entry may be a single stage-0 one, but it could
@@ -415,6 +446,12 @@ static void do_oneway_diff(struct unpack_trees_options *o,
 		return;
 	}
 
+	if ((idx && S_ISSPARSEDIR(idx->ce_mode)) ||
+	    (tree && S_ISSPARSEDIR(tree->ce_mode))) {
+		diff_sparse_directory(revs, idx, tree);
+		return;
+	}
+
 	/*
 	 * Something added to the tree?
 	 */
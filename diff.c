@@ -36,6 +36,8 @@
 static int diff_detect_rename_default;
 static int diff_indent_heuristic = 1;
 static int diff_rename_limit_default = 400;
+static int diff_rename_threads_default;
+static unsigned long diff_cost_limit_default;
 static int diff_suppress_blank_empty;
 static int diff_use_color_default = -1;
 static int diff_color_moved_default;
@@ -434,6 +436,19 @@ int git_diff_basic_config(const char *var, const char *value, void *cb)
 		return 0;
 	}
 
+	if (!strcmp(var, "diff.costlimit")) {
+		diff_cost_limit_default = git_config_ulong(var, value);
+		return 0;
+	}
+
+	if (!strcmp(var, "diff.renamethreads")) {
+		diff_rename_threads_default = git_config_int(var, value);
+		if (diff_rename_threads_default < 0)
+			return error(_("invalid number of threads specified (%d) for %s"),
+				     diff_rename_threads_default, var);
+		return 0;
+	}
+
 	if (userdiff_config(var, value) < 0)
 		return -1;
 
@@ -3351,6 +3366,13 @@ static void emit_binary_diff(struct diff_options *o,
 	emit_binary_diff_body(o, two, one);
 }
 
+int diff_filespec_binary_attr(struct repository *r,
+			      struct diff_filespec *one)
+{
+	diff_filespec_load_driver(one, r->index);
+	return one->driver->binary;
+}
+
 int diff_filespec_is_binary(struct repository *r,
 			    struct diff_filespec *one)
 {
@@ -3589,6 +3611,7 @@ static void builtin_diff(const char *name_a,
 		xpp.flags = o->xdl_opts;
 		xpp.anchors = o->anchors;
 		xpp.anchors_nr = o->anchors_nr;
+		xpp.max_cost = o->cost_limit;
 		xecfg.ctxlen = o->context;
 		xecfg.interhunkctxlen = o->interhunkcontext;
 		xecfg.flags = XDL_EMIT_FUNCNAMES;
@@ -3718,6 +3741,7 @@ static void builtin_diffstat(const char *name_a, const char *name_b,
 		xpp.flags = o->xdl_opts;
 		xpp.anchors = o->anchors;
 		xpp.anchors_nr = o->anchors_nr;
+		xpp.max_cost = o->cost_limit;
 		xecfg.ctxlen = o->context;
 		xecfg.interhunkctxlen = o->interhunkcontext;
 		if (xdi_diff_outf(&mf1, &mf2, discard_hunk_line,
@@ -4567,6 +4591,8 @@ void repo_diff_setup(struct repository *r, struct diff_options *options)
 	options->line_termination = '\n';
 	options->break_opt = -1;
 	options->rename_limit = -1;
+	options->rename_threads = diff_rename_threads_default;
+	options->cost_limit = diff_cost_limit_default;
 	options->dirstat_permille = diff_dirstat_permille_default;
 	options->context = diff_context_default;
 	options->interhunkcontext = diff_interhunk_context_default;
@@ -4635,6 +4661,10 @@ void diff_setup_done(struct diff_options *options)
 	if (options->flags.find_copies_harder)
 		options->detect_rename = DIFF_DETECT_COPY;
 
+	/* xdiff takes a long; anything larger is as good as no limit */
+	if (options->cost_limit > LONG_MAX)
+		options->cost_limit = LONG_MAX;
+
 	if (!options->flags.relative_name)
 		options->prefix = NULL;
 	if (options->prefix)
@@ -5507,6 +5537,8 @@ static void prep_parse_options(struct diff_options *options)
 		OPT_CALLBACK_F(0, "anchored", options, N_("<text>"),
 			       N_("generate diff using the \"anchored diff\" algorithm"),
 			       PARSE_OPT_NONEG, diff_opt_anchored),
+		OPT_MAGNITUDE(0, "cost-limit", &options->cost_limit,
+			      N_("stop looking for a small diff after <n> line comparisons")),
 		OPT_CALLBACK_F(0, "word-diff", options, N_("<mode>"),
 			       N_("show word diff, using <mode> to delimit changed words"),
 			       PARSE_OPT_NONEG | PARSE_OPT_OPTARG, diff_opt_word_diff),
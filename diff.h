@@ -276,6 +276,12 @@ struct diff_options {
 	int rename_score;
 	int rename_limit;
 
+	/*
+	 * Number of threads used to compare the remaining rename candidates;
+	 * 0 picks one per CPU.
+	 */
+	int rename_threads;
+
 	int needed_rename_limit;
 	int degraded_cc_to_c;
 	int show_rename_progress;
@@ -303,6 +309,9 @@ struct diff_options {
 	char **anchors;
 	size_t anchors_nr, anchors_alloc;
 
+	/* see --cost-limit in Documentation/diff-options.txt; 0 means none */
+	unsigned long cost_limit;
+
 	int stat_width;
 	int stat_name_width;
 	int stat_graph_width;
@@ -3,12 +3,15 @@
  * Copyright (C) 2005 Junio C Hamano
  */
 #include "cache.h"
+#include "config.h"
 #include "diff.h"
 #include "diffcore.h"
 #include "object-store.h"
 #include "hashmap.h"
 #include "progress.h"
 #include "promisor-remote.h"
+#include "rename-cache.h"
+#include "thread-utils.h"
 
 /* Table of rename/copy destinations */
 
@@ -18,7 +21,7 @@ static struct diff_rename_dst {
 } *rename_dst;
 static int rename_dst_nr, rename_dst_alloc;
 
-static int find_rename_dst(struct diff_filespec *two)
+static int find_rename_dst(const char *path)
 {
 	int first, last;
 
@@ -27,7 +30,7 @@ static int find_rename_dst(struct diff_filespec *two)
 	while (last > first) {
 		int next = first + ((last - first) >> 1);
 		struct diff_rename_dst *dst = &(rename_dst[next]);
-		int cmp = strcmp(two->path, dst->two->path);
+		int cmp = strcmp(path, dst->two->path);
 		if (!cmp)
 			return next;
 		if (cmp < 0) {
@@ -41,7 +44,7 @@ static int find_rename_dst(struct diff_filespec *two)
 
 static struct diff_rename_dst *locate_rename_dst(struct diff_filespec *two)
 {
-	int ofs = find_rename_dst(two);
+	int ofs = find_rename_dst(two->path);
 	return ofs < 0 ? NULL : &rename_dst[ofs];
 }
 
@@ -50,7 +53,7 @@ static struct diff_rename_dst *locate_rename_dst(struct diff_filespec *two)
  */
 static int add_rename_dst(struct diff_filespec *two)
 {
-	int first = find_rename_dst(two);
+	int first = find_rename_dst(two->path);
 
 	if (first >= 0)
 		return -1;
@@ -123,6 +126,27 @@ static int basename_same(struct diff_filespec *src, struct diff_filespec *dst)
 		(!dst_len || dst->path[dst_len - 1] == '/');
 }
 
+/*
+ * While several threads fill the similarity matrix, rename_mutex
+ * serializes loading and hashing the contents of the files, which reads
+ * objects, attributes and possibly the working tree, as well as handing
+ * out the rows of the matrix. Comparing two hashed files needs no lock.
+ */
+static int rename_use_lock;
+static pthread_mutex_t rename_mutex;
+
+static inline void rename_lock(void)
+{
+	if (rename_use_lock)
+		pthread_mutex_lock(&rename_mutex);
+}
+
+static inline void rename_unlock(void)
+{
+	if (rename_use_lock)
+		pthread_mutex_unlock(&rename_mutex);
+}
+
 struct diff_score {
 	int src; /* index in rename_src */
 	int dst; /* index in rename_dst */
@@ -165,6 +189,28 @@ static void prefetch(void *prefetch_options)
 	oid_array_clear(&to_fetch);
 }
 
+/*
+ * We would not consider edits that change the file size so
+ * drastically.  delta_size must be smaller than
+ * (MAX_SCORE-minimum_score)/MAX_SCORE * min(src_size, dst_size).
+ *
+ * Note that base_size == 0 case is handled here already
+ * and the final score computation would not have a
+ * divide-by-zero issue.
+ */
+static int too_different_in_size(unsigned long src_size,
+				 unsigned long dst_size,
+				 int minimum_score)
+{
+	unsigned long max_size, delta_size, base_size;
+
+	max_size = ((src_size > dst_size) ? src_size : dst_size);
+	base_size = ((src_size < dst_size) ? src_size : dst_size);
+	delta_size = max_size - base_size;
+
+	return max_size * (MAX_SCORE-minimum_score) < delta_size * MAX_SCORE;
+}
+
 static int estimate_similarity(struct repository *r,
 			       struct diff_filespec *src,
 			       struct diff_filespec *dst,
@@ -184,18 +230,15 @@ static int estimate_similarity(struct repository *r,
 	 * match than anything else; the destination does not even
 	 * call into this function in that case.
 	 */
-	unsigned long max_size, delta_size, base_size, src_copied, literal_added;
-	int score;
+	unsigned long max_size, src_copied, literal_added;
+	int score, counted = 0, use_cache = 0;
+	unsigned cache_flags = 0;
+	struct rename_cache_score cached;
 	struct diff_populate_filespec_options dpf_options = {
 		.check_size_only = 1
 	};
 	struct prefetch_options prefetch_options = {r, skip_unmodified};
 
-	if (r == the_repository && has_promisor_remote()) {
-		dpf_options.missing_object_cb = prefetch;
-		dpf_options.missing_object_data = &prefetch_options;
-	}
-
 	/* We deal only with regular files.  Symlink renames are handled
 	 * only when they are exact matches --- in other words, no edits
 	 * after renaming.
@@ -203,6 +246,33 @@ static int estimate_similarity(struct repository *r,
 	if (!S_ISREG(src->mode) || !S_ISREG(dst->mode))
 		return 0;
 
+	rename_lock();
+
+	/*
+	 * The score of two blobs only depends on their contents and on
+	 * whether their attributes say how to treat them, so it can be
+	 * remembered across runs.
+	 */
+	if (src->oid_valid && dst->oid_valid && rename_cache_enabled(r)) {
+		use_cache = 1;
+		cache_flags = rename_cache_flags(diff_filespec_binary_attr(r, src),
+						 diff_filespec_binary_attr(r, dst));
+		if (rename_cache_lookup(r, &src->oid, &dst->oid, cache_flags,
+					&cached)) {
+			rename_unlock();
+			if (too_different_in_size(cached.src_size,
+						  cached.dst_size,
+						  minimum_score))
+				return 0;
+			return cached.score;
+		}
+	}
+
+	if (r == the_repository && has_promisor_remote()) {
+		dpf_options.missing_object_cb = prefetch;
+		dpf_options.missing_object_data = &prefetch_options;
+	}
+
 	/*
 	 * Need to check that source and destination sizes are
 	 * filled in before comparing them.
@@ -214,34 +284,39 @@ static int estimate_similarity(struct repository *r,
 	 */
 	if (!src->cnt_data &&
 	    diff_populate_filespec(r, src, &dpf_options))
-		return 0;
+		goto fail;
 	if (!dst->cnt_data &&
 	    diff_populate_filespec(r, dst, &dpf_options))
-		return 0;
+		goto fail;
 
-	max_size = ((src->size > dst->size) ? src->size : dst->size);
-	base_size = ((src->size < dst->size) ? src->size : dst->size);
-	delta_size = max_size - base_size;
-
-	/* We would not consider edits that change the file size so
-	 * drastically.  delta_size must be smaller than
-	 * (MAX_SCORE-minimum_score)/MAX_SCORE * min(src->size, dst->size).
-	 *
-	 * Note that base_size == 0 case is handled here already
-	 * and the final score computation below would not have a
-	 * divide-by-zero issue.
-	 */
-	if (max_size * (MAX_SCORE-minimum_score) < delta_size * MAX_SCORE)
-		return 0;
+	if (too_different_in_size(src->size, dst->size, minimum_score))
+		goto fail;
 
 	dpf_options.check_size_only = 0;
 
 	if (!src->cnt_data && diff_populate_filespec(r, src, &dpf_options))
-		return 0;
+		goto fail;
 	if (!dst->cnt_data && diff_populate_filespec(r, dst, &dpf_options))
-		return 0;
+		goto fail;
 
-	if (diffcore_count_changes(r, src, dst,
+	/*
+	 * Hashing the contents of a file happens only once, and must be
+	 * done under the lock; once both are hashed, the contents are no
+	 * longer needed and comparing the hashes can go on in parallel.
+	 */
+	if (!src->cnt_data || !dst->cnt_data) {
+		if (diffcore_count_changes(r, src, dst,
+					   &src->cnt_data, &dst->cnt_data,
+					   &src_copied, &literal_added))
+			goto fail;
+		counted = 1;
+	}
+	diff_free_filespec_blob(src);
+	diff_free_filespec_blob(dst);
+	rename_unlock();
+
+	if (!counted &&
+	    diffcore_count_changes(r, src, dst,
 				   &src->cnt_data, &dst->cnt_data,
 				   &src_copied, &literal_added))
 		return 0;
@@ -249,11 +324,28 @@ static int estimate_similarity(struct repository *r,
 	/* How similar are they?
 	 * what percentage of material in dst are from source?
 	 */
+	max_size = ((src->size > dst->size) ? src->size : dst->size);
 	if (!dst->size)
 		score = 0; /* should not happen */
 	else
 		score = (int)(src_copied * MAX_SCORE / max_size);
+
+	if (use_cache) {
+		cached.score = score;
+		cached.src_size = src->size;
+		cached.dst_size = dst->size;
+		rename_lock();
+		rename_cache_store(r, &src->oid, &dst->oid, cache_flags,
+				   &cached);
+		rename_unlock();
+	}
 	return score;
+
+fail:
+	diff_free_filespec_blob(src);
+	diff_free_filespec_blob(dst);
+	rename_unlock();
+	return 0;
 }
 
 static void record_rename_pair(int dst_index, int src_index, int score)
@@ -412,6 +504,271 @@ static int find_exact_renames(struct diff_options *options)
 	return renames;
 }
 
+static const char *get_basename(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	return slash ? slash + 1 : path;
+}
+
+struct basename_entry {
+	const char *base;
+	int index;
+};
+
+static int basename_entry_cmp(const void *a_, const void *b_)
+{
+	const struct basename_entry *a = a_, *b = b_;
+	int cmp = strcmp(a->base, b->base);
+
+	return cmp ? cmp : a->index - b->index;
+}
+
+/*
+ * Number of entries starting at "e" that share the same basename.
+ */
+static int basename_run(const struct basename_entry *e, int nr)
+{
+	int i;
+
+	for (i = 1; i < nr; i++)
+		if (strcmp(e[i].base, e[0].base))
+			break;
+	return i;
+}
+
+static int try_rename_hint(struct diff_options *options,
+			   int src_index, int dst_index, int minimum_score)
+{
+	struct diff_filespec *one = rename_src[src_index].p->one;
+	struct diff_filespec *two = rename_dst[dst_index].two;
+	int score;
+
+	if (one->rename_used || rename_dst[dst_index].pair)
+		return 0;
+
+	score = estimate_similarity(options->repo, one, two, minimum_score, 0);
+	if (score < minimum_score)
+		return 0;
+
+	record_rename_pair(dst_index, src_index, score);
+	return 1;
+}
+
+/*
+ * Pair up the remaining sources and destinations whose basename is unique
+ * on both sides, when they are similar enough.
+ */
+static int find_basename_matches(struct diff_options *options,
+				 int minimum_score)
+{
+	struct basename_entry *srcs, *dsts;
+	int i, j, srcs_nr = 0, dsts_nr = 0, renames = 0;
+
+	ALLOC_ARRAY(srcs, rename_src_nr);
+	for (i = 0; i < rename_src_nr; i++) {
+		if (rename_src[i].p->one->rename_used)
+			continue;
+		srcs[srcs_nr].base = get_basename(rename_src[i].p->one->path);
+		srcs[srcs_nr++].index = i;
+	}
+	ALLOC_ARRAY(dsts, rename_dst_nr);
+	for (i = 0; i < rename_dst_nr; i++) {
+		if (rename_dst[i].pair)
+			continue;
+		dsts[dsts_nr].base = get_basename(rename_dst[i].two->path);
+		dsts[dsts_nr++].index = i;
+	}
+	QSORT(srcs, srcs_nr, basename_entry_cmp);
+	QSORT(dsts, dsts_nr, basename_entry_cmp);
+
+	i = j = 0;
+	while (i < srcs_nr && j < dsts_nr) {
+		int cmp = strcmp(srcs[i].base, dsts[j].base);
+		int src_run, dst_run;
+
+		if (cmp < 0) {
+			i++;
+			continue;
+		}
+		if (cmp > 0) {
+			j++;
+			continue;
+		}
+		src_run = basename_run(srcs + i, srcs_nr - i);
+		dst_run = basename_run(dsts + j, dsts_nr - j);
+		if (src_run == 1 && dst_run == 1)
+			renames += try_rename_hint(options, srcs[i].index,
+						   dsts[j].index, minimum_score);
+		i += src_run;
+		j += dst_run;
+	}
+
+	free(srcs);
+	free(dsts);
+	return renames;
+}
+
+struct dir_pair {
+	const char *src, *dst;
+	int src_len, dst_len;
+};
+
+static int dir_pair_cmp(const void *a_, const void *b_)
+{
+	const struct dir_pair *a = a_, *b = b_;
+	int cmp;
+
+	cmp = strncmp(a->src, b->src, a->src_len < b->src_len ?
+		      a->src_len : b->src_len);
+	if (!cmp)
+		cmp = a->src_len - b->src_len;
+	if (cmp)
+		return cmp;
+	cmp = strncmp(a->dst, b->dst, a->dst_len < b->dst_len ?
+		      a->dst_len : b->dst_len);
+	if (!cmp)
+		cmp = a->dst_len - b->dst_len;
+	return cmp;
+}
+
+static int dirname_len(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	return slash ? slash - path : 0;
+}
+
+static int same_dir(const struct dir_pair *a, const struct dir_pair *b,
+		    int dst_too)
+{
+	if (a->src_len != b->src_len || memcmp(a->src, b->src, a->src_len))
+		return 0;
+	return !dst_too ||
+	       (a->dst_len == b->dst_len && !memcmp(a->dst, b->dst, a->dst_len));
+}
+
+/*
+ * Guess where each directory went from the renames found so far: a
+ * directory is taken to be renamed to the one that received most of its
+ * files, unless that is a tie or most of its files stayed in place.
+ * Remaining sources are then paired with the file of the same basename
+ * in the renamed directory, when they are similar enough.
+ */
+static int find_dir_rename_matches(struct diff_options *options,
+				   int minimum_score)
+{
+	struct string_list dir_renames = STRING_LIST_INIT_DUP;
+	struct dir_pair *pairs;
+	struct strbuf path = STRBUF_INIT;
+	int i, pairs_nr = 0, renames = 0;
+
+	ALLOC_ARRAY(pairs, rename_dst_nr);
+	for (i = 0; i < rename_dst_nr; i++) {
+		struct diff_filepair *p = rename_dst[i].pair;
+
+		if (!p)
+			continue;
+		pairs[pairs_nr].src = p->one->path;
+		pairs[pairs_nr].src_len = dirname_len(p->one->path);
+		pairs[pairs_nr].dst = p->two->path;
+		pairs[pairs_nr].dst_len = dirname_len(p->two->path);
+		pairs_nr++;
+	}
+	QSORT(pairs, pairs_nr, dir_pair_cmp);
+
+	for (i = 0; i < pairs_nr; ) {
+		int j = i, best = i, best_count = 0, tie = 0;
+
+		while (j < pairs_nr && same_dir(&pairs[i], &pairs[j], 0)) {
+			int k = j;
+
+			while (k < pairs_nr && same_dir(&pairs[j], &pairs[k], 1))
+				k++;
+			if (k - j > best_count) {
+				best = j;
+				best_count = k - j;
+				tie = 0;
+			} else if (k - j == best_count) {
+				tie = 1;
+			}
+			j = k;
+		}
+		if (!tie && (pairs[best].src_len != pairs[best].dst_len ||
+			     memcmp(pairs[best].src, pairs[best].dst,
+				    pairs[best].src_len))) {
+			struct string_list_item *item;
+
+			item = string_list_append_nodup(&dir_renames,
+				xstrndup(pairs[best].src, pairs[best].src_len));
+			item->util = xstrndup(pairs[best].dst,
+					      pairs[best].dst_len);
+		}
+		i = j;
+	}
+	free(pairs);
+
+	if (!dir_renames.nr)
+		goto out;
+	string_list_sort(&dir_renames);
+
+	for (i = 0; i < rename_src_nr; i++) {
+		struct diff_filespec *one = rename_src[i].p->one;
+		struct string_list_item *item;
+		int dst_index;
+
+		if (one->rename_used)
+			continue;
+		strbuf_reset(&path);
+		strbuf_add(&path, one->path, dirname_len(one->path));
+		item = string_list_lookup(&dir_renames, path.buf);
+		if (!item)
+			continue;
+
+		strbuf_reset(&path);
+		strbuf_addstr(&path, item->util);
+		if (path.len)
+			strbuf_addch(&path, '/');
+		strbuf_addstr(&path, get_basename(one->path));
+		dst_index = find_rename_dst(path.buf);
+		if (dst_index < 0)
+			continue;
+		renames += try_rename_hint(options, i, dst_index,
+					   minimum_score);
+	}
+
+out:
+	strbuf_release(&path);
+	string_list_clear(&dir_renames, 1);
+	return renames;
+}
+
+static int has_broken_src(void)
+{
+	int i;
+
+	for (i = 0; i < rename_src_nr; i++)
+		if (rename_src[i].p->broken_pair)
+			return 1;
+	return 0;
+}
+
+/*
+ * Drop the sources that have already been used; when only looking for
+ * renames, they cannot be picked again.
+ */
+static void remove_used_rename_src(void)
+{
+	int i, nr = 0;
+
+	for (i = 0; i < rename_src_nr; i++) {
+		if (rename_src[i].p->one->rename_used)
+			continue;
+		if (i != nr)
+			rename_src[nr] = rename_src[i];
+		nr++;
+	}
+	rename_src_nr = nr;
+}
+
 #define NUM_CANDIDATE_PER_DST 4
 static void record_if_better(struct diff_score m[], struct diff_score *o)
 {
@@ -497,6 +854,144 @@ static int find_renames(struct diff_score *mx, int dst_cnt, int minimum_score, i
 	return count;
 }
 
+/*
+ * Comparing fewer pairs than this is not worth starting threads for.
+ */
+#define RENAME_THREADS_MIN_PAIRS 4096
+
+struct rename_matrix {
+	struct diff_options *options;
+	struct diff_score *mx;
+	int *rows; /* index in rename_dst of each row of "mx" */
+	int rows_nr, next_row, rows_done;
+	int minimum_score;
+	int skip_unmodified;
+	struct progress *progress;
+};
+
+static void fill_rename_matrix_row(struct rename_matrix *rm, int row)
+{
+	int i = rm->rows[row], j;
+	struct diff_filespec *two = rename_dst[i].two;
+	struct diff_score *m = &rm->mx[row * NUM_CANDIDATE_PER_DST];
+
+	for (j = 0; j < NUM_CANDIDATE_PER_DST; j++)
+		m[j].dst = -1;
+
+	for (j = 0; j < rename_src_nr; j++) {
+		struct diff_filespec *one = rename_src[j].p->one;
+		struct diff_score this_src;
+
+		if (rm->skip_unmodified &&
+		    diff_unmodified_pair(rename_src[j].p))
+			continue;
+
+		this_src.score = estimate_similarity(rm->options->repo,
+						     one, two,
+						     rm->minimum_score,
+						     rm->skip_unmodified);
+		this_src.name_score = basename_same(one, two);
+		this_src.dst = i;
+		this_src.src = j;
+		record_if_better(m, &this_src);
+	}
+}
+
+static void *rename_matrix_worker(void *data)
+{
+	struct rename_matrix *rm = data;
+
+	for (;;) {
+		int row;
+
+		rename_lock();
+		if (rm->next_row < rm->rows_nr)
+			display_progress(rm->progress,
+					 (uint64_t)rm->rows_done * rename_src_nr);
+		row = rm->next_row < rm->rows_nr ? rm->next_row++ : -1;
+		rename_unlock();
+		if (row < 0)
+			break;
+
+		fill_rename_matrix_row(rm, row);
+
+		rename_lock();
+		rm->rows_done++;
+		rename_unlock();
+	}
+	return NULL;
+}
+
+static int rename_threads(struct diff_options *options, int rows_nr)
+{
+	int nr_threads = git_env_ulong("GIT_TEST_RENAME_THREADS", 0);
+
+	if (!HAVE_THREADS)
+		return 1;
+	if (!nr_threads) {
+		if ((uint64_t)rows_nr * rename_src_nr < RENAME_THREADS_MIN_PAIRS)
+			return 1;
+		nr_threads = options->rename_threads;
+		if (!nr_threads)
+			nr_threads = online_cpus();
+	}
+	return nr_threads < rows_nr ? nr_threads : rows_nr;
+}
+
+/*
+ * Fill "mx" with one row per destination that is not paired yet, holding
+ * its best candidate sources, and return the number of rows.
+ * The rows are independent of each other, so they can be filled by
+ * several threads without changing the result.
+ */
+static int fill_rename_matrix(struct diff_options *options,
+			      struct diff_score *mx, int num_create,
+			      int minimum_score, int skip_unmodified,
+			      struct progress *progress)
+{
+	struct rename_matrix rm = {
+		.options = options,
+		.mx = mx,
+		.minimum_score = minimum_score,
+		.skip_unmodified = skip_unmodified,
+		.progress = progress,
+	};
+	int i, nr_threads;
+
+	ALLOC_ARRAY(rm.rows, num_create);
+	for (i = 0; i < rename_dst_nr; i++)
+		if (!rename_dst[i].pair)
+			rm.rows[rm.rows_nr++] = i;
+
+	nr_threads = rename_threads(options, rm.rows_nr);
+	if (nr_threads <= 1) {
+		rename_matrix_worker(&rm);
+	} else {
+		pthread_t *threads;
+
+		/* read the configuration of the cache before the threads do */
+		rename_cache_enabled(options->repo);
+
+		ALLOC_ARRAY(threads, nr_threads);
+		pthread_mutex_init(&rename_mutex, NULL);
+		rename_use_lock = 1;
+		for (i = 0; i < nr_threads; i++)
+			if (pthread_create(&threads[i], NULL,
+					   rename_matrix_worker, &rm))
+				die(_("unable to create thread for rename detection"));
+		for (i = 0; i < nr_threads; i++)
+			if (pthread_join(threads[i], NULL))
+				die(_("unable to join thread for rename detection"));
+		rename_use_lock = 0;
+		pthread_mutex_destroy(&rename_mutex);
+		free(threads);
+	}
+
+	display_progress(progress, (uint64_t)rm.rows_nr * rename_src_nr);
+	free(rm.rows);
+	return rm.rows_nr;
+}
+
 void diffcore_rename(struct diff_options *options)
 {
 	int detect_rename = options->detect_rename;
@@ -504,7 +999,7 @@ void diffcore_rename(struct diff_options *options)
 	struct diff_queue_struct *q = &diff_queued_diff;
 	struct diff_queue_struct outq;
 	struct diff_score *mx;
-	int i, j, rename_count, skip_unmodified = 0;
+	int i, rename_count, skip_unmodified = 0;
 	int num_create, dst_cnt;
 	struct progress *progress = NULL;
 
@@ -576,6 +1071,36 @@ void diffcore_rename(struct diff_options *options)
 	if (!num_create)
 		goto cleanup;
 
+	if (detect_rename == DIFF_DETECT_RENAME) {
+		remove_used_rename_src();
+
+		/*
+		 * Most renames either keep the basename of the file or
+		 * move it along with the rest of its directory, so try
+		 * these cheap guesses before comparing every remaining
+		 * source with every remaining destination, asking for a
+		 * higher score to make up for not looking any further.
+		 * The guesses are not used when looking for copies, as
+		 * the user is then willing to pay for a thorough search,
+		 * nor with broken pairs, whose content similarity should
+		 * not be second-guessed from their name.
+		 */
+		if (!has_broken_src()) {
+			int hint_score = minimum_score +
+				(MAX_SCORE - minimum_score) / 2;
+
+			rename_count += find_basename_matches(options,
+							      hint_score);
+			rename_count += find_dir_rename_matches(options,
+								hint_score);
+			remove_used_rename_src();
+
+			num_create = rename_dst_nr - rename_count;
+			if (!num_create || !rename_src_nr)
+				goto cleanup;
+		}
+	}
+
 	switch (too_many_rename_candidates(num_create, options)) {
 	case 1:
 		goto cleanup;
@@ -590,47 +1115,12 @@ void diffcore_rename(struct diff_options *options)
 	if (options->show_rename_progress) {
 		progress = start_delayed_progress(
 				_("Performing inexact rename detection"),
-				(uint64_t)rename_dst_nr * (uint64_t)rename_src_nr);
+				(uint64_t)num_create * (uint64_t)rename_src_nr);
 	}
 
 	mx = xcalloc(st_mult(NUM_CANDIDATE_PER_DST, num_create), sizeof(*mx));
-	for (dst_cnt = i = 0; i < rename_dst_nr; i++) {
-		struct diff_filespec *two = rename_dst[i].two;
-		struct diff_score *m;
-
-		if (rename_dst[i].pair)
-			continue; /* dealt with exact match already. */
-
-		m = &mx[dst_cnt * NUM_CANDIDATE_PER_DST];
-		for (j = 0; j < NUM_CANDIDATE_PER_DST; j++)
-			m[j].dst = -1;
-
-		for (j = 0; j < rename_src_nr; j++) {
-			struct diff_filespec *one = rename_src[j].p->one;
-			struct diff_score this_src;
-
-			if (skip_unmodified &&
-			    diff_unmodified_pair(rename_src[j].p))
-				continue;
-
-			this_src.score = estimate_similarity(options->repo,
-							     one, two,
-							     minimum_score,
-							     skip_unmodified);
-			this_src.name_score = basename_same(one, two);
-			this_src.dst = i;
-			this_src.src = j;
-			record_if_better(m, &this_src);
-			/*
-			 * Once we run estimate_similarity,
-			 * We do not need the text anymore.
-			 */
-			diff_free_filespec_blob(one);
-			diff_free_filespec_blob(two);
-		}
-		dst_cnt++;
-		display_progress(progress, (uint64_t)(i+1)*(uint64_t)rename_src_nr);
-	}
+	dst_cnt = fill_rename_matrix(options, mx, num_create, minimum_score,
+				     skip_unmodified, progress);
 	stop_progress(&progress);
 
 	/* cost matrix sorted by most to least similar pair */
@@ -88,6 +88,12 @@ void diff_free_filespec_data(struct diff_filespec *);
 void diff_free_filespec_blob(struct diff_filespec *);
 int diff_filespec_is_binary(struct repository *, struct diff_filespec *);
 
+/*
+ * Return 1 or 0 when the attributes force "one" to be treated as binary
+ * or text, and -1 when that is decided by looking at its contents.
+ */
+int diff_filespec_binary_attr(struct repository *, struct diff_filespec *);
+
 /**
  * This records a pair of `struct diff_filespec`; the filespec for a file in
  * the "old" set (i.e. preimage) is called `one`, and the filespec for a file
@@ -6,6 +6,7 @@
 #include "submodule.h"
 #include "progress.h"
 #include "fsmonitor.h"
+#include "parallel-checkout.h"
 
 static void create_directories(const char *path, int path_len,
 			       const struct checkout *state)
@@ -369,18 +370,29 @@ static int write_entry(struct cache_entry *ce,
 	}
 
 finish:
+	return update_ce_after_write(state, ce, fstat_done ? &st : NULL);
+delayed:
+	return 0;
+}
+
+int update_ce_after_write(const struct checkout *state, struct cache_entry *ce,
+			  struct stat *st)
+{
+	struct stat lst;
+
 	if (state->refresh_cache) {
 		assert(state->istate);
-		if (!fstat_done)
-			if (lstat(ce->name, &st) < 0)
+		if (!st) {
+			if (lstat(ce->name, &lst) < 0)
 				return error_errno("unable to stat just-written file %s",
 						   ce->name);
-		fill_stat_cache_info(state->istate, ce, &st);
+			st = &lst;
+		}
+		fill_stat_cache_info(state->istate, ce, st);
 		ce->ce_flags |= CE_UPDATE_IN_BASE;
 		mark_fsmonitor_invalid(state->istate, ce);
 		state->istate->cache_changed |= CE_ENTRY_CHANGED;
 	}
-delayed:
 	return 0;
 }
 
@@ -519,6 +531,16 @@ int checkout_entry(struct cache_entry *ce, const struct checkout *state,
 	create_directories(path.buf, path.len, state);
 	if (nr_checkouts)
 		(*nr_checkouts)++;
+
+	if (parallel_checkout_status() == PC_ACCEPTING_ENTRIES &&
+	    S_ISREG(ce->ce_mode)) {
+		struct conv_attrs ca;
+
+		convert_attrs(state->istate, &ca, ce->name);
+		if (!enqueue_checkout(ce, &ca))
+			return 0;
+	}
+
 	return write_entry(ce, path.buf, state, 0);
 }
 
@@ -0,0 +1,55 @@
+#ifndef FSMONITOR_DAEMON_H
+#define FSMONITOR_DAEMON_H
+
+#ifdef HAVE_FSMONITOR_DAEMON_BACKEND
+
+#include "hashmap.h"
+#include "strbuf.h"
+
+/*
+ * State of a running `git fsmonitor--daemon`.
+ *
+ * The daemon keeps a journal of the paths (relative to the root of the
+ * worktree) that changed, each of them tagged with the epoch in which
+ * its last change was seen.  The epoch is bumped each time a client is
+ * given a token, so a client presenting the token of epoch N is told
+ * about the paths whose epoch is greater than N.
+ */
+struct fsmonitor_daemon_state {
+	struct strbuf path_worktree_watch;
+
+	/* Identifies this instance of the daemon in its tokens. */
+	char *instance_id;
+
+	struct hashmap journal;
+	uint64_t current_epoch;
+
+	/*
+	 * Tokens older than this epoch refer to changes that are no
+	 * longer in the journal; clients presenting them are told to
+	 * check everything.
+	 */
+	uint64_t trivial_before;
+
+	int listen_fd;
+
+	/* Private data of the platform backend. */
+	void *backend_data;
+};
+
+/*
+ * Record that `path` changed.  Paths of directories whose whole
+ * contents should be considered changed end in a slash.  Called by
+ * the platform backend.
+ */
+void fsmonitor_journal_add(struct fsmonitor_daemon_state *state,
+			   const char *path);
+
+/*
+ * Forget everything in the journal, e.g. because the backend knows it
+ * missed some events.  Clients will be told to check everything.
+ */
+void fsmonitor_journal_invalidate(struct fsmonitor_daemon_state *state);
+
+#endif /* HAVE_FSMONITOR_DAEMON_BACKEND */
+#endif /* FSMONITOR_DAEMON_H */
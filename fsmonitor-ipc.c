@@ -0,0 +1,111 @@
+#include "cache.h"
+#include "fsmonitor-ipc.h"
+
+#ifdef HAVE_FSMONITOR_DAEMON_BACKEND
+
+#include "run-command.h"
+#include "trace2.h"
+#include "unix-socket.h"
+
+int fsmonitor_ipc__is_supported(void)
+{
+	return 1;
+}
+
+const char *fsmonitor_ipc__get_path(void)
+{
+	static char *ipc_path;
+
+	if (!ipc_path)
+		ipc_path = git_pathdup("fsmonitor--daemon.ipc");
+	return ipc_path;
+}
+
+int fsmonitor_ipc__is_listening(void)
+{
+	int fd = unix_stream_connect(fsmonitor_ipc__get_path());
+
+	if (fd < 0)
+		return 0;
+	close(fd);
+	return 1;
+}
+
+static int send_request(const char *request, struct strbuf *answer)
+{
+	int fd = unix_stream_connect(fsmonitor_ipc__get_path());
+
+	if (fd < 0)
+		return -1;
+
+	strbuf_reset(answer);
+	if (write_in_full(fd, request, strlen(request)) < 0 ||
+	    shutdown(fd, SHUT_WR) < 0 ||
+	    strbuf_read(answer, fd, 0) < 0) {
+		int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return error_errno(_("unable to talk to fsmonitor--daemon"));
+	}
+	close(fd);
+	return 0;
+}
+
+static void spawn_daemon(void)
+{
+	const char *argv[] = { "fsmonitor--daemon", "start", NULL };
+
+	trace2_region_enter("fsm_client", "spawn", NULL);
+	run_command_v_opt(argv, RUN_GIT_CMD | RUN_COMMAND_NO_STDIN);
+	trace2_region_leave("fsm_client", "spawn", NULL);
+}
+
+int fsmonitor_ipc__send_query(const char *token, struct strbuf *answer)
+{
+	int ret;
+
+	trace2_region_enter("fsm_client", "query", NULL);
+	ret = send_request(token, answer);
+	if (ret < 0 && (errno == ENOENT || errno == ECONNREFUSED)) {
+		spawn_daemon();
+		ret = send_request(token, answer);
+	}
+	trace2_region_leave("fsm_client", "query", NULL);
+	return ret;
+}
+
+int fsmonitor_ipc__send_command(const char *command, struct strbuf *answer)
+{
+	return send_request(command, answer);
+}
+
+#else
+
+int fsmonitor_ipc__is_supported(void)
+{
+	return 0;
+}
+
+const char *fsmonitor_ipc__get_path(void)
+{
+	return NULL;
+}
+
+int fsmonitor_ipc__is_listening(void)
+{
+	return 0;
+}
+
+int fsmonitor_ipc__send_query(const char *token, struct strbuf *answer)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int fsmonitor_ipc__send_command(const char *command, struct strbuf *answer)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+#endif /* HAVE_FSMONITOR_DAEMON_BACKEND */
@@ -0,0 +1,57 @@
+#ifndef FSMONITOR_IPC_H
+#define FSMONITOR_IPC_H
+
+/*
+ * Client side of the protocol spoken by `git fsmonitor--daemon`.
+ *
+ * A client connects to the unix socket of the daemon watching the
+ * current worktree, writes its request, shuts down the writing half of
+ * the connection and reads the response until EOF.  A request is either
+ * one of the commands below or the token returned by an earlier query.
+ *
+ * The response to a token has the same format as the one of a version
+ * 2 fsmonitor hook: a new token, a NUL, and the NUL-terminated list of
+ * paths that changed since the given token was issued.  Paths ending in
+ * a slash name directories whose whole contents must be considered
+ * changed, and a lone "/" means that the daemon cannot tell (e.g. the
+ * token was issued by another instance of the daemon) and that
+ * everything must be checked.
+ */
+
+#define FSMONITOR_IPC_COMMAND_QUIT "quit"
+#define FSMONITOR_IPC_COMMAND_FLUSH "flush"
+
+/*
+ * Returns 1 if this build of Git has a built-in filesystem monitor
+ * for this platform, 0 otherwise.
+ */
+int fsmonitor_ipc__is_supported(void);
+
+/*
+ * Returns the pathname of the socket of the daemon watching the
+ * current worktree.
+ */
+const char *fsmonitor_ipc__get_path(void);
+
+/*
+ * Returns 1 if a daemon is listening on the socket of the current
+ * worktree, 0 otherwise.
+ */
+int fsmonitor_ipc__is_listening(void);
+
+/*
+ * Ask the daemon for the list of paths that changed since `token`,
+ * starting it in the background if it is not running yet.  The raw
+ * response is stored in `answer`.  Returns 0 on success, -1 if the
+ * daemon could not be reached.
+ */
+int fsmonitor_ipc__send_query(const char *token, struct strbuf *answer);
+
+/*
+ * Send `command` to a running daemon, without trying to start one,
+ * and store its response in `answer`.  Returns 0 on success, -1 if
+ * no daemon is listening.
+ */
+int fsmonitor_ipc__send_command(const char *command, struct strbuf *answer);
+
+#endif /* FSMONITOR_IPC_H */
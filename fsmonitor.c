@@ -3,6 +3,7 @@
 #include "dir.h"
 #include "ewah/ewok.h"
 #include "fsmonitor.h"
+#include "fsmonitor-ipc.h"
 #include "run-command.h"
 #include "strbuf.h"
 
@@ -155,10 +156,66 @@ static int query_fsmonitor(int version, const char *last_update, struct strbuf *
 	return capture_command(&cp, query_result, 1024);
 }
 
-static void fsmonitor_refresh_callback(struct index_state *istate, const char *name)
+int fsmonitor_is_builtin(void)
 {
-	int pos = index_name_pos(istate, name, strlen(name));
+	return core_fsmonitor && !strcasecmp(core_fsmonitor, "true");
+}
+
+/*
+ * Ask the built-in daemon for the changes since the last update token.
+ */
+static int query_fsmonitor_daemon(const char *last_update, struct strbuf *query_result)
+{
+	if (!fsmonitor_ipc__is_supported()) {
+		static int warned;
+		if (!warned++)
+			warning(_("core.fsmonitor is true, but this build of Git "
+				  "has no built-in filesystem monitor"));
+		return -1;
+	}
+
+	return fsmonitor_ipc__send_query(last_update, query_result);
+}
+
+/*
+ * A path ending in a slash stands for everything below that directory.
+ */
+static int fsmonitor_refresh_directory(struct index_state *istate, const char *name)
+{
+	size_t len = strlen(name);
+	int pos = index_name_pos(istate, name, len);
+
+	if (pos < 0)
+		pos = -pos - 1;
+
+	for (; pos < istate->cache_nr; pos++) {
+		struct cache_entry *ce = istate->cache[pos];
+
+		if (strncmp(ce->name, name, len))
+			break;
+		ce->ce_flags &= ~CE_FSMONITOR_VALID;
+	}
 
+	/*
+	 * We cannot tell which directories of the untracked cache below
+	 * this one are stale; let it check them itself this time.
+	 */
+	trace_printf_key(&trace_fsmonitor, "fsmonitor_refresh_directory '%s'", name);
+	return 0;
+}
+
+/*
+ * Returns 0 if the untracked cache can no longer rely on fsmonitor
+ * for this refresh, 1 otherwise.
+ */
+static int fsmonitor_refresh_callback(struct index_state *istate, const char *name)
+{
+	int pos;
+
+	if (*name && name[strlen(name) - 1] == '/')
+		return fsmonitor_refresh_directory(istate, name);
+
+	pos = index_name_pos(istate, name, strlen(name));
 	if (pos >= 0) {
 		struct cache_entry *ce = istate->cache[pos];
 		ce->ce_flags &= ~CE_FSMONITOR_VALID;
@@ -170,12 +227,13 @@ static void fsmonitor_refresh_callback(struct index_state *istate, const char *n
 	 */
 	trace_printf_key(&trace_fsmonitor, "fsmonitor_refresh_callback '%s'", name);
 	untracked_cache_invalidate_path(istate, name, 0);
+	return 1;
 }
 
 void refresh_fsmonitor(struct index_state *istate)
 {
 	struct strbuf query_result = STRBUF_INIT;
-	int query_success = 0, hook_version = -1;
+	int query_success = 0, hook_version = -1, untracked_valid = 1;
 	size_t bol = 0; /* beginning of line */
 	uint64_t last_update;
 	struct strbuf last_update_token = STRBUF_INIT;
@@ -185,11 +243,35 @@ void refresh_fsmonitor(struct index_state *istate)
 	if (!core_fsmonitor || istate->fsmonitor_has_run_once)
 		return;
 
-	hook_version = fsmonitor_hook_version();
-
 	istate->fsmonitor_has_run_once = 1;
 
 	trace_printf_key(&trace_fsmonitor, "refresh fsmonitor");
+	if (fsmonitor_is_builtin()) {
+		/*
+		 * The daemon answers like a version 2 hook; the first
+		 * entry is the new token.  If it cannot be reached, keep
+		 * a token it will not recognize so that we check
+		 * everything next time too.
+		 */
+		last_update = getnanotime();
+		if (istate->fsmonitor_last_update)
+			query_success = !query_fsmonitor_daemon(
+				istate->fsmonitor_last_update, &query_result);
+		if (query_success && query_result.len) {
+			strbuf_addstr(&last_update_token, query_result.buf);
+			bol = last_update_token.len + 1;
+		} else {
+			query_success = 0;
+			strbuf_addstr(&last_update_token, "builtin:fake");
+		}
+		trace_performance_since(last_update, "fsmonitor--daemon query");
+		trace_printf_key(&trace_fsmonitor, "fsmonitor--daemon query returned %s",
+			query_success ? "success" : "failure");
+		goto apply_results;
+	}
+
+	hook_version = fsmonitor_hook_version();
+
 	/*
 	 * This could be racy so save the date/time now and query_fsmonitor
 	 * should be inclusive to ensure we don't miss potential changes.
@@ -244,6 +326,7 @@ void refresh_fsmonitor(struct index_state *istate)
 			core_fsmonitor, query_success ? "success" : "failure");
 	}
 
+apply_results:
 	/* a fsmonitor process can return '/' to indicate all entries are invalid */
 	if (query_success && query_result.buf[bol] != '/') {
 		/* Mark all entries returned by the monitor as dirty */
@@ -251,15 +334,15 @@ void refresh_fsmonitor(struct index_state *istate)
 		for (i = bol; i < query_result.len; i++) {
 			if (buf[i] != '\0')
 				continue;
-			fsmonitor_refresh_callback(istate, buf + bol);
+			untracked_valid &= fsmonitor_refresh_callback(istate, buf + bol);
 			bol = i + 1;
 		}
 		if (bol < query_result.len)
-			fsmonitor_refresh_callback(istate, buf + bol);
+			untracked_valid &= fsmonitor_refresh_callback(istate, buf + bol);
 
 		/* Now mark the untracked cache for fsmonitor usage */
 		if (istate->untracked)
-			istate->untracked->use_fsmonitor = 1;
+			istate->untracked->use_fsmonitor = untracked_valid;
 	} else {
 
 		/* We only want to run the post index changed hook if we've actually changed entries, so keep track
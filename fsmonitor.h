@@ -37,8 +37,14 @@ void remove_fsmonitor(struct index_state *istate);
 void tweak_fsmonitor(struct index_state *istate);
 
 /*
- * Run the configured fsmonitor integration script and clear the
- * CE_FSMONITOR_VALID bit for any files returned as dirty.  Also invalidate
+ * Returns 1 if core.fsmonitor asks for the built-in filesystem monitor
+ * (see `git fsmonitor--daemon`) instead of naming a hook, 0 otherwise.
+ */
+int fsmonitor_is_builtin(void);
+
+/*
+ * Run the configured fsmonitor integration script (or query the built-in
+ * daemon) and clear the CE_FSMONITOR_VALID bit for any files returned as dirty.  Also invalidate
  * any corresponding untracked cache directory structures. Optimized to only
  * run the first time it is called.
  */
@@ -868,6 +868,19 @@ FILE *xfopen(const char *path, const char *mode);
 FILE *xfdopen(int fd, const char *mode);
 int xmkstemp(char *temp_filename);
 int xmkstemp_mode(char *temp_filename, int mode);
+
+enum fsync_action {
+	/* start writeback of dirty pages and wait for it, nothing more */
+	FSYNC_WRITEOUT_ONLY,
+	/* make the data durable, including flushing the disk's cache */
+	FSYNC_HARDWARE_FLUSH
+};
+
+/*
+ * Returns 0 on success, or -1 with errno set; ENOSYS means that the
+ * platform cannot perform the requested action.
+ */
+int git_fsync(int fd, enum fsync_action action);
 char *xgetcwd(void);
 FILE *fopen_for_writing(const char *path);
 FILE *fopen_or_warn(const char *path, const char *mode);
@@ -15,6 +15,25 @@
 #include "block-sha1/sha1.h"
 #endif
 
+/*
+ * Optionally, a separate SHA-1 implementation without collision
+ * detection may be used for checksums of data that Git wrote itself
+ * (see the "unsafe_*" functions of struct git_hash_algo below).
+ */
+#if defined(SHA1_OPENSSL_UNSAFE)
+#include <openssl/sha.h>
+#define platform_SHA_CTX_unsafe		SHA_CTX
+#define platform_SHA1_Init_unsafe	SHA1_Init
+#define platform_SHA1_Update_unsafe	SHA1_Update
+#define platform_SHA1_Final_unsafe	SHA1_Final
+#elif defined(SHA1_BLK_UNSAFE)
+#include "block-sha1/sha1.h"
+#define platform_SHA_CTX_unsafe		blk_SHA_CTX
+#define platform_SHA1_Init_unsafe	blk_SHA1_Init
+#define platform_SHA1_Update_unsafe	blk_SHA1_Update
+#define platform_SHA1_Final_unsafe	blk_SHA1_Final
+#endif
+
 #if defined(SHA256_GCRYPT)
 #define SHA256_NEEDS_CLONE_HELPER
 #include "sha256/gcrypt.h"
@@ -43,6 +62,18 @@
 #define git_SHA1_Update		platform_SHA1_Update
 #define git_SHA1_Final		platform_SHA1_Final
 
+#ifdef platform_SHA_CTX_unsafe
+#define git_SHA_CTX_unsafe	platform_SHA_CTX_unsafe
+#define git_SHA1_Init_unsafe	platform_SHA1_Init_unsafe
+#define git_SHA1_Update_unsafe	platform_SHA1_Update_unsafe
+#define git_SHA1_Final_unsafe	platform_SHA1_Final_unsafe
+#else
+#define git_SHA_CTX_unsafe	git_SHA_CTX
+#define git_SHA1_Init_unsafe	git_SHA1_Init
+#define git_SHA1_Update_unsafe	git_SHA1_Update
+#define git_SHA1_Final_unsafe	git_SHA1_Final
+#endif
+
 #ifndef platform_SHA256_CTX
 #define platform_SHA256_CTX	SHA256_CTX
 #define platform_SHA256_Init	SHA256_Init
@@ -70,6 +101,12 @@ static inline void git_SHA1_Clone(git_SHA_CTX *dst, const git_SHA_CTX *src)
 	memcpy(dst, src, sizeof(*dst));
 }
 
+static inline void git_SHA1_Clone_unsafe(git_SHA_CTX_unsafe *dst,
+					 const git_SHA_CTX_unsafe *src)
+{
+	memcpy(dst, src, sizeof(*dst));
+}
+
 #ifndef SHA256_NEEDS_CLONE_HELPER
 static inline void git_SHA256_Clone(git_SHA256_CTX *dst, const git_SHA256_CTX *src)
 {
@@ -97,6 +134,7 @@ static inline void git_SHA256_Clone(git_SHA256_CTX *dst, const git_SHA256_CTX *s
 /* A suitably aligned type for stack allocations of hash contexts. */
 union git_hash_ctx {
 	git_SHA_CTX sha1;
+	git_SHA_CTX_unsafe sha1_unsafe;
 	git_SHA256_CTX sha256;
 };
 typedef union git_hash_ctx git_hash_ctx;
@@ -137,6 +175,19 @@ struct git_hash_algo {
 	/* The hash finalization function. */
 	git_hash_final_fn final_fn;
 
+	/*
+	 * The same as above, but possibly using a faster implementation
+	 * that does not detect collision attacks. These must only be
+	 * used for checksums of data that Git produced itself, such as
+	 * packfile and index trailers, and never to compute object names.
+	 * A context initialized with unsafe_init_fn() must only be used
+	 * with the other unsafe_* functions.
+	 */
+	git_hash_init_fn unsafe_init_fn;
+	git_hash_clone_fn unsafe_clone_fn;
+	git_hash_update_fn unsafe_update_fn;
+	git_hash_final_fn unsafe_final_fn;
+
 	/* The OID of the empty tree. */
 	const struct object_id *empty_tree;
 
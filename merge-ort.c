@@ -0,0 +1,1446 @@
+/*
+ * "Ostensibly Recursive's Twin" merge strategy, or "ort" for short.
+ *
+ * Unlike merge-recursive, which updates the index and the working tree
+ * while it resolves each path (and again for every virtual merge base),
+ * this merge works on trees only: it collects the three trees into a
+ * table of paths, detects renames, resolves every path in memory and
+ * writes out the resulting tree.  Nothing outside the object store is
+ * touched until the caller asks for merge_switch_to_result(), which
+ * checks out the result and records conflicts in the index in one go.
+ */
+#include "cache.h"
+#include "merge-ort.h"
+
+#include "alloc.h"
+#include "blob.h"
+#include "cache-tree.h"
+#include "commit.h"
+#include "commit-reach.h"
+#include "diff.h"
+#include "diffcore.h"
+#include "dir.h"
+#include "ll-merge.h"
+#include "object-store.h"
+#include "string-list.h"
+#include "tree.h"
+#include "tree-walk.h"
+#include "unpack-trees.h"
+#include "xdiff-interface.h"
+
+struct version_info {
+	struct object_id oid;
+	unsigned short mode;
+};
+
+struct conflict_info {
+	/* the resolution of this path, once processed */
+	struct version_info result;
+	unsigned is_null:1;
+	unsigned clean:1;
+	unsigned processed:1;
+
+	/*
+	 * A conflict not visible in the contents, e.g. rename/delete;
+	 * the path is reported as conflicted even if the contents
+	 * merge cleanly.
+	 */
+	unsigned path_conflict:1;
+
+	/* the version of this path in the merge base, side1 and side2 */
+	struct version_info stages[3];
+
+	/* where each version came from; differs from the path for renames */
+	const char *pathnames[3];
+
+	/* which of stages[] are files, and which sides have a directory here */
+	unsigned filemask:3;
+	unsigned dirmask:3;
+
+	/* which sides renamed some other path to this one */
+	unsigned rename_target:3;
+};
+
+struct merge_options_internal {
+	/*
+	 * paths: every path found in any of the three trees (except for
+	 * directories that are recursed into), mapping to a conflict_info.
+	 * Sorted once all trees have been collected.
+	 */
+	struct string_list paths;
+
+	/*
+	 * conflicted: the subset of paths that need higher stage entries
+	 * in the index; the util pointers are shared with paths.
+	 */
+	struct string_list conflicted;
+
+	int call_depth;
+	int needed_rename_limit;
+
+	/*
+	 * Renames found on side1, remembered so that the next merge of a
+	 * sequence (see merge-ort.h) does not have to detect them again:
+	 * maps a rename source to its target, or to NULL if the source
+	 * was deleted without a matching target.
+	 */
+	struct string_list cached_pairs;
+	unsigned cached_pairs_valid:1;
+	struct object_id last_side2;
+	struct object_id last_result;
+};
+
+static void flush_output(struct merge_options *opt)
+{
+	if (opt->buffer_output < 2 && opt->obuf.len) {
+		fputs(opt->obuf.buf, stdout);
+		strbuf_reset(&opt->obuf);
+	}
+}
+
+static int err(struct merge_options *opt, const char *err, ...)
+{
+	va_list params;
+	struct strbuf sb = STRBUF_INIT;
+
+	strbuf_addstr(&sb, "error: ");
+	va_start(params, err);
+	strbuf_vaddf(&sb, err, params);
+	va_end(params);
+
+	error("%s", sb.buf);
+	strbuf_release(&sb);
+
+	return -1;
+}
+
+static int show(struct merge_options *opt, int v)
+{
+	return (!opt->priv->call_depth && opt->verbosity >= v) ||
+		opt->verbosity >= 5;
+}
+
+/*
+ * Unlike merge-recursive, messages are always buffered: nothing is
+ * printed until merge_switch_to_result() is asked to display them.
+ */
+__attribute__((format (printf, 3, 4)))
+static void output(struct merge_options *opt, int v, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!show(opt, v))
+		return;
+
+	strbuf_addchars(&opt->obuf, ' ', opt->priv->call_depth * 2);
+
+	va_start(ap, fmt);
+	strbuf_vaddf(&opt->obuf, fmt, ap);
+	va_end(ap);
+
+	strbuf_addch(&opt->obuf, '\n');
+}
+
+static inline int merge_detect_rename(struct merge_options *opt)
+{
+	return (opt->detect_renames >= 0) ? opt->detect_renames : 1;
+}
+
+static inline int same_version(const struct version_info *a,
+			       const struct version_info *b)
+{
+	return a->mode == b->mode && oideq(&a->oid, &b->oid);
+}
+
+static struct tree *shift_tree_object(struct repository *repo,
+				      struct tree *one, struct tree *two,
+				      const char *subtree_shift)
+{
+	struct object_id shifted;
+
+	if (!*subtree_shift) {
+		shift_tree(repo, &one->object.oid, &two->object.oid, &shifted, 0);
+	} else {
+		shift_tree_by(repo, &one->object.oid, &two->object.oid, &shifted,
+			      subtree_shift);
+	}
+	if (oideq(&two->object.oid, &shifted))
+		return two;
+	return lookup_tree(repo, &shifted);
+}
+
+static inline void set_commit_tree(struct commit *c, struct tree *t)
+{
+	c->maybe_tree = t;
+}
+
+static struct commit *make_virtual_commit(struct repository *repo,
+					  struct tree *tree,
+					  const char *comment)
+{
+	struct commit *commit = alloc_commit_node(repo);
+
+	set_merge_remote_desc(commit, comment, (struct object *)commit);
+	set_commit_tree(commit, tree);
+	commit->object.parsed = 1;
+	return commit;
+}
+
+static struct conflict_info *find_path(struct merge_options_internal *opti,
+				       const char *path)
+{
+	struct string_list_item *item = string_list_lookup(&opti->paths, path);
+	return item ? item->util : NULL;
+}
+
+static void clear_internal_opts(struct merge_options_internal *opti,
+				int partial)
+{
+	string_list_clear(&opti->paths, 1);
+	string_list_clear(&opti->conflicted, 0);
+	opti->needed_rename_limit = 0;
+
+	if (!partial) {
+		string_list_clear(&opti->cached_pairs, 1);
+		opti->cached_pairs_valid = 0;
+	}
+}
+
+static void free_merge_result(struct merge_result *result)
+{
+	struct merge_options_internal *opti = result->priv;
+
+	if (!opti)
+		return;
+	clear_internal_opts(opti, 0);
+	FREE_AND_NULL(result->priv);
+}
+
+/*** Collecting the three trees ***/
+
+static int collect_merge_info_callback(int n,
+				       unsigned long mask,
+				       unsigned long dirmask,
+				       struct name_entry *names,
+				       struct traverse_info *info)
+{
+	struct merge_options *opt = info->data;
+	struct merge_options_internal *opti = opt->priv;
+	struct strbuf fullpath = STRBUF_INIT;
+	struct conflict_info *ci;
+	struct name_entry *p;
+	unsigned filemask = mask & ~dirmask;
+	unsigned mbase_null = !(mask & 1);
+	unsigned side1_null = !(mask & 2);
+	unsigned side2_null = !(mask & 4);
+	unsigned side1_matches_mbase = (!side1_null && !mbase_null &&
+					names[0].mode == names[1].mode &&
+					oideq(&names[0].oid, &names[1].oid));
+	unsigned side2_matches_mbase = (!side2_null && !mbase_null &&
+					names[0].mode == names[2].mode &&
+					oideq(&names[0].oid, &names[2].oid));
+	int i, ret = mask;
+
+	p = names;
+	while (!p->mode)
+		p++;
+	strbuf_make_traverse_path(&fullpath, info, p->path, p->pathlen);
+
+	/*
+	 * If all three versions match, whether files or trees, the merge
+	 * base version is the resolution and there is nothing to recurse
+	 * into.
+	 */
+	if (side1_matches_mbase && side2_matches_mbase) {
+		ci = xcalloc(1, sizeof(*ci));
+		oidcpy(&ci->result.oid, &names[0].oid);
+		ci->result.mode = names[0].mode;
+		ci->clean = 1;
+		ci->processed = 1;
+		string_list_append(&opti->paths, fullpath.buf)->util = ci;
+		strbuf_release(&fullpath);
+		return mask;
+	}
+
+	if (filemask) {
+		ci = xcalloc(1, sizeof(*ci));
+		for (i = 0; i < 3; i++) {
+			if (!(filemask & (1 << i)))
+				continue;
+			oidcpy(&ci->stages[i].oid, &names[i].oid);
+			ci->stages[i].mode = names[i].mode;
+		}
+		ci->filemask = filemask;
+		ci->dirmask = dirmask;
+		string_list_append(&opti->paths, fullpath.buf)->util = ci;
+	}
+
+	if (dirmask) {
+		struct traverse_info newinfo = *info;
+		struct tree_desc t[3];
+		void *buf[3];
+
+		newinfo.prev = info;
+		newinfo.name = p->path;
+		newinfo.namelen = p->pathlen;
+		newinfo.mode = p->mode;
+		newinfo.pathlen = st_add3(newinfo.pathlen, p->pathlen, 1);
+
+		for (i = 0; i < 3; i++) {
+			const struct object_id *oid = NULL;
+			if (dirmask & (1 << i))
+				oid = &names[i].oid;
+			buf[i] = fill_tree_descriptor(opt->repo, t + i, oid);
+		}
+
+		if (traverse_trees(NULL, 3, t, &newinfo) < 0)
+			ret = -1;
+
+		for (i = 0; i < 3; i++)
+			free(buf[i]);
+	}
+
+	strbuf_release(&fullpath);
+	return ret;
+}
+
+static int collect_merge_info(struct merge_options *opt,
+			      struct tree *merge_base,
+			      struct tree *side1,
+			      struct tree *side2)
+{
+	struct merge_options_internal *opti = opt->priv;
+	struct tree_desc t[3];
+	struct traverse_info info;
+	int i, j;
+
+	if (parse_tree(merge_base) < 0 ||
+	    parse_tree(side1) < 0 ||
+	    parse_tree(side2) < 0)
+		return err(opt, _("unable to read tree"));
+
+	setup_traverse_info(&info, "");
+	info.fn = collect_merge_info_callback;
+	info.data = opt;
+	info.show_all_errors = 1;
+
+	init_tree_desc(t + 0, merge_base->buffer, merge_base->size);
+	init_tree_desc(t + 1, side1->buffer, side1->size);
+	init_tree_desc(t + 2, side2->buffer, side2->size);
+
+	if (traverse_trees(NULL, 3, t, &info) < 0)
+		return err(opt, _("collecting merge info failed for trees %s, %s, %s"),
+			   oid_to_hex(&merge_base->object.oid),
+			   oid_to_hex(&side1->object.oid),
+			   oid_to_hex(&side2->object.oid));
+
+	string_list_sort(&opti->paths);
+	for (i = 0; i < opti->paths.nr; i++) {
+		struct conflict_info *ci = opti->paths.items[i].util;
+		for (j = 0; j < 3; j++)
+			ci->pathnames[j] = opti->paths.items[i].string;
+	}
+	return 0;
+}
+
+/*** Rename detection ***/
+
+static int is_rename_source(struct conflict_info *ci, int side)
+{
+	return !ci->processed &&
+		(ci->filemask & 1) && !(ci->filemask & (1 << side)) &&
+		!S_ISGITLINK(ci->stages[0].mode);
+}
+
+static int is_rename_target(struct conflict_info *ci, int side)
+{
+	return !ci->processed &&
+		!(ci->filemask & 1) && (ci->filemask & (1 << side)) &&
+		!S_ISGITLINK(ci->stages[side].mode);
+}
+
+static void record_rename(struct string_list *renames, int side,
+			  struct string_list_item *source,
+			  struct string_list_item *target)
+{
+	struct conflict_info *ci = target->util;
+
+	ci->rename_target |= (1 << side);
+	string_list_append(renames, source->string)->util = target->string;
+}
+
+/*
+ * Find the renames made on the given side, relative to the merge base.
+ * If "cached" is given, the pairs in it are taken as known renames (or
+ * known non-renames) as long as they still describe a deletion and an
+ * addition on this side, and only the remaining paths are handed to
+ * diffcore.  Sources that diffcore could not pair up are appended to
+ * "unmatched", if given.
+ */
+static void detect_renames(struct merge_options *opt, int side,
+			   struct string_list *renames,
+			   struct string_list *cached,
+			   struct string_list *unmatched)
+{
+	struct merge_options_internal *opti = opt->priv;
+	struct string_list_item *item;
+	struct diff_options diff_opts;
+	int nr_sources = 0, nr_targets = 0;
+	int i;
+
+	if (cached) {
+		for_each_string_list_item(item, cached) {
+			struct string_list_item *source, *target;
+
+			source = string_list_lookup(&opti->paths, item->string);
+			if (!source || !is_rename_source(source->util, side))
+				continue;
+			if (!item->util) {
+				/* known to have no rename target */
+				((struct conflict_info *)source->util)->processed = 1;
+				if (unmatched)
+					string_list_append(unmatched, source->string);
+				continue;
+			}
+			target = string_list_lookup(&opti->paths, item->util);
+			if (!target || !is_rename_target(target->util, side) ||
+			    (((struct conflict_info *)target->util)->rename_target & (1 << side)))
+				continue;
+			record_rename(renames, side, source, target);
+			((struct conflict_info *)source->util)->processed = 1;
+		}
+	}
+
+	for_each_string_list_item(item, &opti->paths) {
+		struct conflict_info *ci = item->util;
+		if (is_rename_source(ci, side))
+			nr_sources++;
+		else if (is_rename_target(ci, side) &&
+			 !(ci->rename_target & (1 << side)))
+			nr_targets++;
+	}
+
+	if (!nr_sources || !nr_targets) {
+		if (unmatched)
+			for_each_string_list_item(item, &opti->paths)
+				if (is_rename_source(item->util, side))
+					string_list_append(unmatched, item->string);
+		goto cleanup;
+	}
+
+	repo_diff_setup(opt->repo, &diff_opts);
+	diff_opts.flags.recursive = 1;
+	diff_opts.flags.rename_empty = 0;
+	/*
+	 * Like merge-recursive, we do not detect copies: we would not want
+	 * a change to a base file to be propagated into multiple others.
+	 */
+	diff_opts.detect_rename = DIFF_DETECT_RENAME;
+	diff_opts.rename_limit = (opt->rename_limit >= 0) ? opt->rename_limit : 1000;
+	diff_opts.rename_score = opt->rename_score;
+	diff_opts.show_rename_progress = opt->show_rename_progress;
+	diff_opts.output_format = DIFF_FORMAT_NO_OUTPUT;
+	diff_setup_done(&diff_opts);
+
+	for_each_string_list_item(item, &opti->paths) {
+		struct conflict_info *ci = item->util;
+		struct diff_filespec *one, *two;
+
+		if (is_rename_source(ci, side)) {
+			one = alloc_filespec(item->string);
+			two = alloc_filespec(item->string);
+			fill_filespec(one, &ci->stages[0].oid, 1,
+				      ci->stages[0].mode);
+			diff_queue(&diff_queued_diff, one, two);
+		} else if (is_rename_target(ci, side) &&
+			   !(ci->rename_target & (1 << side))) {
+			one = alloc_filespec(item->string);
+			two = alloc_filespec(item->string);
+			fill_filespec(two, &ci->stages[side].oid, 1,
+				      ci->stages[side].mode);
+			diff_queue(&diff_queued_diff, one, two);
+		}
+	}
+
+	diffcore_std(&diff_opts);
+	if (diff_opts.needed_rename_limit > opti->needed_rename_limit)
+		opti->needed_rename_limit = diff_opts.needed_rename_limit;
+
+	for (i = 0; i < diff_queued_diff.nr; i++) {
+		struct diff_filepair *pair = diff_queued_diff.queue[i];
+		struct string_list_item *source, *target;
+
+		if (pair->status == 'R') {
+			source = string_list_lookup(&opti->paths, pair->one->path);
+			target = string_list_lookup(&opti->paths, pair->two->path);
+			if (!source || !target)
+				BUG("rename %s -> %s of unknown paths",
+				    pair->one->path, pair->two->path);
+			record_rename(renames, side, source, target);
+		} else if (pair->status == 'D' && unmatched) {
+			source = string_list_lookup(&opti->paths, pair->one->path);
+			if (source)
+				string_list_append(unmatched, source->string);
+		}
+	}
+	diff_flush(&diff_opts);
+
+cleanup:
+	/* the "processed" bits above only marked cached sources */
+	for_each_string_list_item(item, &opti->paths) {
+		struct conflict_info *ci = item->util;
+		if (ci->processed && !ci->clean && !ci->is_null)
+			ci->processed = 0;
+	}
+	string_list_sort(renames);
+}
+
+/*** Resolving paths ***/
+
+static void add_flattened_path(struct strbuf *out, const char *s)
+{
+	size_t i = out->len;
+	strbuf_addstr(out, s);
+	for (; i < out->len; i++)
+		if (out->buf[i] == '/')
+			out->buf[i] = '_';
+}
+
+static char *unique_path(struct merge_options *opt,
+			 const char *path,
+			 const char *branch)
+{
+	struct strbuf newpath = STRBUF_INIT;
+	int suffix = 0;
+	size_t base_len;
+
+	strbuf_addf(&newpath, "%s~", path);
+	add_flattened_path(&newpath, branch);
+
+	base_len = newpath.len;
+	while (string_list_has_string(&opt->priv->paths, newpath.buf)) {
+		strbuf_setlen(&newpath, base_len);
+		strbuf_addf(&newpath, "_%d", suffix++);
+	}
+
+	return strbuf_detach(&newpath, NULL);
+}
+
+static int merge_3way(struct merge_options *opt,
+		      const char *path,
+		      mmbuffer_t *result_buf,
+		      const struct version_info *o,
+		      const struct version_info *a,
+		      const struct version_info *b,
+		      const char *pathnames[3],
+		      const int extra_marker_size)
+{
+	mmfile_t orig, src1, src2;
+	struct ll_merge_options ll_opts = {0};
+	char *base, *name1, *name2;
+	int merge_status;
+
+	ll_opts.renormalize = opt->renormalize;
+	ll_opts.extra_marker_size = extra_marker_size;
+	ll_opts.xdl_opts = opt->xdl_opts;
+
+	if (opt->priv->call_depth) {
+		ll_opts.virtual_ancestor = 1;
+		ll_opts.variant = 0;
+	} else {
+		switch (opt->recursive_variant) {
+		case MERGE_VARIANT_OURS:
+			ll_opts.variant = XDL_MERGE_FAVOR_OURS;
+			break;
+		case MERGE_VARIANT_THEIRS:
+			ll_opts.variant = XDL_MERGE_FAVOR_THEIRS;
+			break;
+		default:
+			ll_opts.variant = 0;
+			break;
+		}
+	}
+
+	assert(pathnames[0] && pathnames[1] && pathnames[2] && opt->ancestor);
+	if (strcmp(pathnames[0], pathnames[1]) ||
+	    strcmp(pathnames[1], pathnames[2])) {
+		base  = mkpathdup("%s:%s", opt->ancestor, pathnames[0]);
+		name1 = mkpathdup("%s:%s", opt->branch1, pathnames[1]);
+		name2 = mkpathdup("%s:%s", opt->branch2, pathnames[2]);
+	} else {
+		base  = mkpathdup("%s", opt->ancestor);
+		name1 = mkpathdup("%s", opt->branch1);
+		name2 = mkpathdup("%s", opt->branch2);
+	}
+
+	read_mmblob(&orig, o ? &o->oid : &null_oid);
+	read_mmblob(&src1, &a->oid);
+	read_mmblob(&src2, &b->oid);
+
+	merge_status = ll_merge(result_buf, path, &orig, base,
+				&src1, name1, &src2, name2,
+				opt->repo->index, &ll_opts);
+
+	free(base);
+	free(name1);
+	free(name2);
+	free(orig.ptr);
+	free(src1.ptr);
+	free(src2.ptr);
+	return merge_status;
+}
+
+/*
+ * Merge the three versions of a path, any of which may differ in type,
+ * mode and contents; "o" is NULL if the path was added on both sides.
+ * Returns 1 if clean, 0 if conflicted and -1 on error.
+ */
+static int handle_content_merge(struct merge_options *opt,
+				const char *path,
+				const struct version_info *o,
+				const struct version_info *a,
+				const struct version_info *b,
+				const char *pathnames[3],
+				const int extra_marker_size,
+				struct version_info *result)
+{
+	int clean = 1;
+
+	if ((S_IFMT & a->mode) != (S_IFMT & b->mode)) {
+		/* Not both files, not both symlinks, not both submodules */
+		if (opt->priv->call_depth && o)
+			*result = *o;
+		else if (!S_ISREG(a->mode) && S_ISREG(b->mode))
+			*result = *b;
+		else
+			*result = *a;
+		return 0;
+	}
+
+	result->mode = a->mode;
+	if (a->mode != b->mode) {
+		if (o && a->mode == o->mode)
+			result->mode = b->mode;
+		else if (!o || b->mode != o->mode)
+			clean = 0;
+	}
+
+	if (oideq(&a->oid, &b->oid))
+		oidcpy(&result->oid, &a->oid);
+	else if (o && oideq(&a->oid, &o->oid))
+		oidcpy(&result->oid, &b->oid);
+	else if (o && oideq(&b->oid, &o->oid))
+		oidcpy(&result->oid, &a->oid);
+	else if (S_ISREG(a->mode)) {
+		mmbuffer_t result_buf;
+		int merge_status;
+
+		output(opt, 2, _("Auto-merging %s"), path);
+		merge_status = merge_3way(opt, path, &result_buf, o, a, b,
+					  pathnames, extra_marker_size);
+		if (merge_status < 0 || !result_buf.ptr)
+			return err(opt, _("Failed to execute internal merge"));
+
+		if (write_object_file(result_buf.ptr, result_buf.size,
+				      blob_type, &result->oid))
+			clean = err(opt, _("Unable to add %s to database"),
+				    path);
+		free(result_buf.ptr);
+		if (clean > 0 && merge_status)
+			clean = 0;
+	} else {
+		/*
+		 * Submodules and symlinks cannot be merged line by line;
+		 * unless a variant picks a side, this is a conflict.
+		 */
+		switch (opt->recursive_variant) {
+		case MERGE_VARIANT_OURS:
+			oidcpy(&result->oid, &a->oid);
+			break;
+		case MERGE_VARIANT_THEIRS:
+			oidcpy(&result->oid, &b->oid);
+			break;
+		default:
+			if (opt->priv->call_depth && o)
+				oidcpy(&result->oid, &o->oid);
+			else
+				oidcpy(&result->oid, &a->oid);
+			clean = 0;
+			break;
+		}
+	}
+
+	return clean;
+}
+
+static const char *find_rename_source(struct string_list *renames,
+				      const char *target)
+{
+	struct string_list_item *item;
+
+	for_each_string_list_item(item, renames)
+		if (!strcmp(item->util, target))
+			return item->string;
+	BUG("no rename source for %s", target);
+}
+
+/*
+ * Move the content of rename sources to their targets, so that
+ * process_entry() sees each renamed file as a single path.  Conflicts
+ * involving the paths themselves (rename/delete, rename/rename,
+ * rename/add) are reported here.
+ */
+static int process_renames(struct merge_options *opt,
+			   struct string_list *renames)
+{
+	struct merge_options_internal *opti = opt->priv;
+	int side;
+
+	for (side = 1; side <= 2; side++) {
+		int other = 3 - side;
+		const char *branch = side == 1 ? opt->branch1 : opt->branch2;
+		const char *other_branch = side == 1 ? opt->branch2 : opt->branch1;
+		struct string_list_item *item;
+
+		for_each_string_list_item(item, &renames[side]) {
+			const char *source = item->string;
+			const char *target = item->util;
+			struct conflict_info *oldci = find_path(opti, source);
+			struct conflict_info *newci = find_path(opti, target);
+			struct string_list_item *other_rename;
+
+			other_rename = string_list_lookup(&renames[other], source);
+			if (other_rename) {
+				struct conflict_info *otherci;
+
+				/* both sides renamed the source; handle it once */
+				if (side == 2)
+					continue;
+
+				oldci->processed = oldci->clean = oldci->is_null = 1;
+				if (!strcmp(other_rename->util, target)) {
+					newci->stages[0] = oldci->stages[0];
+					newci->pathnames[0] = source;
+					newci->filemask |= 1;
+					continue;
+				}
+
+				output(opt, 1, _("CONFLICT (rename/rename): "
+						 "Rename \"%s\"->\"%s\" in branch \"%s\" "
+						 "rename \"%s\"->\"%s\" in \"%s\""),
+				       source, target, branch,
+				       source, (char *)other_rename->util,
+				       other_branch);
+
+				otherci = find_path(opti, other_rename->util);
+				newci->stages[0] = otherci->stages[0] = oldci->stages[0];
+				newci->pathnames[0] = otherci->pathnames[0] = source;
+				newci->filemask = 1 | (1 << side);
+				otherci->filemask = 1 | (1 << other);
+				newci->result = newci->stages[side];
+				otherci->result = otherci->stages[other];
+				newci->processed = otherci->processed = 1;
+				newci->clean = otherci->clean = 0;
+				string_list_append(&opti->conflicted, target)->util = newci;
+				string_list_append(&opti->conflicted,
+						   other_rename->util)->util = otherci;
+				continue;
+			}
+
+			if (!(oldci->filemask & (1 << other))) {
+				output(opt, 1, _("CONFLICT (rename/delete): %s deleted in %s "
+						 "and renamed to %s in %s. Version %s of %s left in tree."),
+				       source, other_branch, target, branch,
+				       branch, target);
+				newci->path_conflict = 1;
+				if (!(newci->filemask & (1 << other))) {
+					newci->stages[0] = oldci->stages[0];
+					newci->pathnames[0] = source;
+					newci->filemask |= 1;
+					newci->result = newci->stages[side];
+					newci->processed = 1;
+					newci->clean = 0;
+					string_list_append(&opti->conflicted,
+							   target)->util = newci;
+				}
+				continue;
+			}
+
+			if (newci->filemask & (1 << other)) {
+				struct version_info merged;
+				const char *pathnames[3];
+				int ret;
+
+				/* both renamed to the same path: rename/rename(2to1) */
+				if (newci->rename_target & (1 << other)) {
+					if (side == 1)
+						output(opt, 1, _("CONFLICT (rename/rename): "
+								 "Rename %s->%s in %s. "
+								 "Rename %s->%s in %s"),
+						       source, target, branch,
+						       find_rename_source(&renames[other], target),
+						       target, other_branch);
+					newci->path_conflict = 1;
+					continue;
+				}
+
+				output(opt, 1, _("CONFLICT (rename/add): Rename %s->%s in %s. "
+						 "%s added in %s"),
+				       source, target, branch, target, other_branch);
+
+				pathnames[0] = source;
+				pathnames[side] = target;
+				pathnames[other] = source;
+				if (side == 1)
+					ret = handle_content_merge(opt, target,
+								   &oldci->stages[0],
+								   &newci->stages[side],
+								   &oldci->stages[other],
+								   pathnames, 0, &merged);
+				else
+					ret = handle_content_merge(opt, target,
+								   &oldci->stages[0],
+								   &oldci->stages[other],
+								   &newci->stages[side],
+								   pathnames, 0, &merged);
+				if (ret < 0)
+					return ret;
+				newci->stages[side] = merged;
+				newci->path_conflict = 1;
+				oldci->processed = oldci->clean = oldci->is_null = 1;
+				continue;
+			}
+
+			/* a plain rename */
+			newci->stages[0] = oldci->stages[0];
+			newci->stages[other] = oldci->stages[other];
+			newci->pathnames[0] = newci->pathnames[other] = source;
+			newci->filemask |= 1 | (1 << other);
+			oldci->processed = oldci->clean = oldci->is_null = 1;
+		}
+	}
+
+	return 0;
+}
+
+static int process_entry(struct merge_options *opt,
+			 const char *path,
+			 struct conflict_info *ci)
+{
+	struct version_info *o = (ci->filemask & 1) ? &ci->stages[0] : NULL;
+	struct version_info *a = (ci->filemask & 2) ? &ci->stages[1] : NULL;
+	struct version_info *b = (ci->filemask & 4) ? &ci->stages[2] : NULL;
+
+	if (ci->processed)
+		return 0;
+	ci->processed = 1;
+	ci->clean = 1;
+
+	if (!a && !b) {
+		/* deleted on both sides, or never there */
+		ci->is_null = 1;
+	} else if (a && b && same_version(a, b)) {
+		ci->result = *a;
+	} else if (o && a && same_version(o, a)) {
+		/* only side2 changed (or deleted) it */
+		if (b)
+			ci->result = *b;
+		else
+			ci->is_null = 1;
+	} else if (o && b && same_version(o, b)) {
+		/* only side1 changed (or deleted) it */
+		if (a)
+			ci->result = *a;
+		else
+			ci->is_null = 1;
+	} else if (o && (!a || !b)) {
+		const char *modify_branch = a ? opt->branch1 : opt->branch2;
+		const char *delete_branch = a ? opt->branch2 : opt->branch1;
+
+		output(opt, 1, _("CONFLICT (modify/delete): %s deleted in %s "
+				 "and modified in %s. Version %s of %s left in tree."),
+		       path, delete_branch, modify_branch, modify_branch, path);
+		/*
+		 * There is no true "middle point" between a modification
+		 * and a deletion; for a virtual merge base, simply reuse
+		 * the base version.
+		 */
+		ci->result = opt->priv->call_depth ? *o : *(a ? a : b);
+		ci->clean = 0;
+	} else if (!a || !b) {
+		/* added on one side only */
+		ci->result = *(a ? a : b);
+	} else {
+		int ret = handle_content_merge(opt, path, o, a, b,
+					       ci->pathnames, 0, &ci->result);
+		if (ret < 0)
+			return ret;
+		ci->clean = ret;
+		if (!ci->clean) {
+			if (!o)
+				output(opt, 1, _("CONFLICT (add/add): Merge conflict in %s"),
+				       path);
+			else
+				output(opt, 1, _("CONFLICT (content): Merge conflict in %s"),
+				       path);
+		}
+	}
+
+	if (ci->path_conflict)
+		ci->clean = 0;
+	if (!ci->clean)
+		string_list_append(&opt->priv->conflicted, path)->util = ci;
+	return 0;
+}
+
+static int has_directory_contents(struct merge_options_internal *opti,
+				  const char *path)
+{
+	struct strbuf prefix = STRBUF_INIT;
+	int i, ret = 0;
+
+	strbuf_addf(&prefix, "%s/", path);
+	i = string_list_find_insert_index(&opti->paths, prefix.buf, 1);
+	if (i < 0)
+		i = -1 - i;
+	for (; i < opti->paths.nr; i++) {
+		struct string_list_item *item = &opti->paths.items[i];
+		if (!starts_with(item->string, prefix.buf))
+			break;
+		if (!((struct conflict_info *)item->util)->is_null) {
+			ret = 1;
+			break;
+		}
+	}
+	strbuf_release(&prefix);
+	return ret;
+}
+
+/*
+ * A file and a directory cannot share a path in the result; if both
+ * survived, move the file out of the way.
+ */
+static void resolve_df_conflicts(struct merge_options *opt)
+{
+	struct merge_options_internal *opti = opt->priv;
+	struct string_list moved = STRING_LIST_INIT_NODUP;
+	struct string_list_item *item;
+
+	for_each_string_list_item(item, &opti->paths) {
+		struct conflict_info *ci = item->util, *newci;
+		int side;
+
+		if (!ci->dirmask || ci->is_null ||
+		    !has_directory_contents(opti, item->string))
+			continue;
+
+		side = ((ci->filemask & 2) &&
+			same_version(&ci->result, &ci->stages[1])) ? 1 : 2;
+		newci = xmalloc(sizeof(*newci));
+		*newci = *ci;
+		newci->clean = 0;
+		string_list_append(&moved, unique_path(opt, item->string,
+				   side == 1 ? opt->branch1 : opt->branch2))->util = newci;
+
+		output(opt, 1, _("CONFLICT (%s): There is a directory with name %s in %s. "
+				 "Adding %s as %s"),
+		       side == 1 ? "file/directory" : "directory/file",
+		       item->string, side == 1 ? opt->branch2 : opt->branch1,
+		       item->string, moved.items[moved.nr - 1].string);
+		ci->is_null = 1;
+		ci->clean = 0;
+	}
+
+	for_each_string_list_item(item, &moved) {
+		struct string_list_item *added;
+
+		added = string_list_insert(&opti->paths, item->string);
+		added->util = item->util;
+		string_list_append(&opti->conflicted, added->string)->util = item->util;
+		free(item->string);
+	}
+	string_list_clear(&moved, 0);
+}
+
+/*** Writing out the result ***/
+
+struct result_entry {
+	const char *path;
+	const struct version_info *version;
+};
+
+struct tree_item {
+	const char *name;
+	size_t len;
+	unsigned mode;
+	struct object_id oid;
+};
+
+static int tree_item_cmp(const void *a_, const void *b_)
+{
+	const struct tree_item *a = a_, *b = b_;
+	return base_name_compare(a->name, a->len, a->mode,
+				 b->name, b->len, b->mode);
+}
+
+/*
+ * Write the tree holding entries[0..nr), all of which share the first
+ * prefix_len bytes of their path; the entries are sorted by path, so
+ * those within the same subdirectory are adjacent.
+ */
+static int write_tree(struct object_id *result_oid,
+		      struct result_entry *entries, size_t nr,
+		      size_t prefix_len)
+{
+	struct tree_item *items;
+	size_t i = 0, nr_items = 0;
+	struct strbuf buf = STRBUF_INIT;
+	int ret = 0;
+
+	ALLOC_ARRAY(items, nr);
+	while (i < nr) {
+		const char *name = entries[i].path + prefix_len;
+		const char *slash = strchr(name, '/');
+		struct tree_item *item = &items[nr_items++];
+
+		item->name = name;
+		if (!slash) {
+			item->len = strlen(name);
+			item->mode = entries[i].version->mode;
+			oidcpy(&item->oid, &entries[i].version->oid);
+			i++;
+		} else {
+			size_t j = i + 1;
+
+			item->len = slash - name;
+			item->mode = S_IFDIR;
+			while (j < nr &&
+			       !strncmp(entries[j].path + prefix_len, name,
+					item->len + 1))
+				j++;
+			if (write_tree(&item->oid, entries + i, j - i,
+				       prefix_len + item->len + 1)) {
+				ret = -1;
+				goto cleanup;
+			}
+			i = j;
+		}
+	}
+
+	QSORT(items, nr_items, tree_item_cmp);
+	for (i = 0; i < nr_items; i++) {
+		strbuf_addf(&buf, "%o %.*s%c", canon_mode(items[i].mode),
+			    (int)items[i].len, items[i].name, '\0');
+		strbuf_add(&buf, items[i].oid.hash, the_hash_algo->rawsz);
+	}
+	if (write_object_file(buf.buf, buf.len, tree_type, result_oid))
+		ret = -1;
+
+cleanup:
+	strbuf_release(&buf);
+	free(items);
+	return ret;
+}
+
+static struct tree *write_result_tree(struct merge_options *opt)
+{
+	struct merge_options_internal *opti = opt->priv;
+	struct result_entry *entries;
+	struct object_id oid;
+	size_t nr = 0;
+	int i, ret;
+
+	ALLOC_ARRAY(entries, opti->paths.nr);
+	for (i = 0; i < opti->paths.nr; i++) {
+		struct conflict_info *ci = opti->paths.items[i].util;
+		if (ci->is_null)
+			continue;
+		entries[nr].path = opti->paths.items[i].string;
+		entries[nr].version = &ci->result;
+		nr++;
+	}
+	ret = write_tree(&oid, entries, nr, 0);
+	free(entries);
+
+	if (ret) {
+		err(opt, _("unable to write merged tree"));
+		return NULL;
+	}
+	return lookup_tree(opt->repo, &oid);
+}
+
+/*** The merge itself ***/
+
+static void merge_start(struct merge_options *opt, struct merge_result *result)
+{
+	struct merge_options_internal *opti;
+
+	/* Sanity checks on opt */
+	assert(opt->repo);
+	assert(opt->branch1 && opt->branch2);
+	assert(opt->detect_renames >= -1 &&
+	       opt->detect_renames <= DIFF_DETECT_COPY);
+	assert(opt->rename_limit >= -1);
+	assert(opt->rename_score >= 0 && opt->rename_score <= MAX_SCORE);
+	assert(opt->show_rename_progress >= 0 && opt->show_rename_progress <= 1);
+	assert(opt->xdl_opts >= 0);
+	assert(opt->recursive_variant >= MERGE_VARIANT_NORMAL &&
+	       opt->recursive_variant <= MERGE_VARIANT_THEIRS);
+	assert(opt->verbosity >= 0 && opt->verbosity <= 5);
+	assert(opt->buffer_output <= 2);
+	assert(opt->priv == NULL);
+
+	if (!result->priv) {
+		opti = xcalloc(1, sizeof(*opti));
+		string_list_init(&opti->paths, 1);
+		string_list_init(&opti->conflicted, 0);
+		string_list_init(&opti->cached_pairs, 1);
+		result->priv = opti;
+	} else {
+		opti = result->priv;
+		clear_internal_opts(opti, 1);
+	}
+	opt->priv = opti;
+}
+
+static void remember_renames(struct merge_options_internal *opti,
+			     struct string_list *renames,
+			     struct string_list *unmatched)
+{
+	struct string_list_item *item;
+
+	string_list_clear(&opti->cached_pairs, 1);
+	for_each_string_list_item(item, renames)
+		string_list_append(&opti->cached_pairs,
+				   item->string)->util = xstrdup(item->util);
+	for_each_string_list_item(item, unmatched)
+		string_list_append(&opti->cached_pairs, item->string);
+	string_list_sort(&opti->cached_pairs);
+}
+
+static void merge_ort_nonrecursive_internal(struct merge_options *opt,
+					    struct tree *merge_base,
+					    struct tree *side1,
+					    struct tree *side2,
+					    struct merge_result *result,
+					    int call_depth)
+{
+	struct merge_options_internal *opti;
+	struct string_list renames[3] = {
+		STRING_LIST_INIT_NODUP,
+		STRING_LIST_INIT_NODUP,
+		STRING_LIST_INIT_NODUP
+	};
+	struct string_list unmatched = STRING_LIST_INIT_NODUP;
+	struct string_list *cached = NULL;
+	int i, want_renames;
+
+	merge_start(opt, result);
+	opti = opt->priv;
+	opti->call_depth = call_depth;
+	result->clean = -1;
+	result->tree = NULL;
+
+	if (opt->subtree_shift) {
+		side2 = shift_tree_object(opt->repo, side1, side2,
+					  opt->subtree_shift);
+		merge_base = shift_tree_object(opt->repo, side1, merge_base,
+					       opt->subtree_shift);
+	}
+
+	want_renames = merge_detect_rename(opt);
+	if (opti->cached_pairs_valid && want_renames &&
+	    oideq(&merge_base->object.oid, &opti->last_side2) &&
+	    oideq(&side1->object.oid, &opti->last_result))
+		cached = &opti->cached_pairs;
+
+	if (collect_merge_info(opt, merge_base, side1, side2))
+		goto cleanup;
+
+	if (want_renames) {
+		detect_renames(opt, 1, &renames[1], cached, &unmatched);
+		detect_renames(opt, 2, &renames[2], NULL, NULL);
+		if (process_renames(opt, renames) < 0)
+			goto cleanup;
+	}
+
+	result->clean = 1;
+	for (i = 0; i < opti->paths.nr; i++) {
+		struct conflict_info *ci = opti->paths.items[i].util;
+
+		if (process_entry(opt, opti->paths.items[i].string, ci) < 0) {
+			result->clean = -1;
+			goto cleanup;
+		}
+		if (!ci->clean)
+			result->clean = 0;
+	}
+	resolve_df_conflicts(opt);
+	if (opti->conflicted.nr)
+		result->clean = 0;
+
+	result->tree = write_result_tree(opt);
+	if (!result->tree) {
+		result->clean = -1;
+		goto cleanup;
+	}
+
+	string_list_sort(&opti->conflicted);
+	string_list_remove_duplicates(&opti->conflicted, 0);
+
+cleanup:
+	if (result->clean > 0 && want_renames && !call_depth) {
+		remember_renames(opti, &renames[1], &unmatched);
+		opti->cached_pairs_valid = 1;
+		oidcpy(&opti->last_side2, &side2->object.oid);
+		oidcpy(&opti->last_result, &result->tree->object.oid);
+	} else {
+		string_list_clear(&opti->cached_pairs, 1);
+		opti->cached_pairs_valid = 0;
+	}
+
+	string_list_clear(&renames[1], 0);
+	string_list_clear(&renames[2], 0);
+	string_list_clear(&unmatched, 0);
+	opt->priv = NULL;
+}
+
+static struct commit_list *reverse_commit_list(struct commit_list *list)
+{
+	struct commit_list *next = NULL, *current, *backup;
+	for (current = list; current; current = backup) {
+		backup = current->next;
+		current->next = next;
+		next = current;
+	}
+	return next;
+}
+
+static void merge_ort_internal(struct merge_options *opt,
+			       struct commit_list *merge_bases,
+			       struct commit *h1,
+			       struct commit *h2,
+			       struct merge_result *result,
+			       int call_depth)
+{
+	struct commit *merged_merge_bases;
+	const char *ancestor_name;
+	struct strbuf merge_base_abbrev = STRBUF_INIT;
+
+	if (!merge_bases) {
+		merge_bases = get_merge_bases(h1, h2);
+		/* See merge-recursive.h:merge_recursive() for the order */
+		merge_bases = reverse_commit_list(merge_bases);
+	}
+
+	merged_merge_bases = pop_commit(&merge_bases);
+	if (merged_merge_bases == NULL) {
+		/* if there is no common ancestor, use an empty tree */
+		struct tree *tree;
+
+		tree = lookup_tree(opt->repo, opt->repo->hash_algo->empty_tree);
+		merged_merge_bases = make_virtual_commit(opt->repo, tree,
+							 "ancestor");
+		ancestor_name = "empty tree";
+	} else if (opt->ancestor && !call_depth) {
+		ancestor_name = opt->ancestor;
+	} else if (merge_bases) {
+		ancestor_name = "merged common ancestors";
+	} else {
+		strbuf_add_unique_abbrev(&merge_base_abbrev,
+					 &merged_merge_bases->object.oid,
+					 DEFAULT_ABBREV);
+		ancestor_name = merge_base_abbrev.buf;
+	}
+
+	while (merge_bases) {
+		struct commit *next = pop_commit(&merge_bases);
+		struct commit *prev = merged_merge_bases;
+		struct merge_result inner = { 0 };
+		const char *saved_b1, *saved_b2;
+
+		/*
+		 * When the merge fails, the result contains files
+		 * with conflict markers; that is what the virtual
+		 * merge base is made of.
+		 */
+		saved_b1 = opt->branch1;
+		saved_b2 = opt->branch2;
+		opt->branch1 = "Temporary merge branch 1";
+		opt->branch2 = "Temporary merge branch 2";
+		merge_ort_internal(opt, NULL, prev, next, &inner,
+				   call_depth + 1);
+		opt->branch1 = saved_b1;
+		opt->branch2 = saved_b2;
+
+		if (inner.clean < 0) {
+			free_merge_result(&inner);
+			free_commit_list(merge_bases);
+			strbuf_release(&merge_base_abbrev);
+			result->clean = -1;
+			return;
+		}
+
+		merged_merge_bases = make_virtual_commit(opt->repo, inner.tree,
+							 "merged tree");
+		commit_list_insert(prev, &merged_merge_bases->parents);
+		commit_list_insert(next, &merged_merge_bases->parents->next);
+		free_merge_result(&inner);
+	}
+
+	opt->ancestor = ancestor_name;
+	merge_ort_nonrecursive_internal(opt,
+					repo_get_commit_tree(opt->repo,
+							     merged_merge_bases),
+					repo_get_commit_tree(opt->repo, h1),
+					repo_get_commit_tree(opt->repo, h2),
+					result, call_depth);
+	strbuf_release(&merge_base_abbrev);
+	opt->ancestor = NULL;  /* avoid accidental re-use of opt->ancestor */
+}
+
+void merge_incore_nonrecursive(struct merge_options *opt,
+			       struct tree *merge_base,
+			       struct tree *side1,
+			       struct tree *side2,
+			       struct merge_result *result)
+{
+	assert(opt->ancestor != NULL);
+
+	merge_ort_nonrecursive_internal(opt, merge_base, side1, side2,
+					result, 0);
+}
+
+void merge_incore_recursive(struct merge_options *opt,
+			    struct commit_list *merge_bases,
+			    struct commit *side1,
+			    struct commit *side2,
+			    struct merge_result *result)
+{
+	assert(opt->ancestor == NULL ||
+	       !strcmp(opt->ancestor, "constructed merge base"));
+
+	merge_ort_internal(opt, merge_bases, side1, side2, result, 0);
+}
+
+/*** Updating the index and working tree ***/
+
+static int checkout(struct merge_options *opt,
+		    struct tree *prev,
+		    struct tree *next)
+{
+	/* Switch the index/working copy from old to new */
+	int ret;
+	struct tree_desc trees[2];
+	struct unpack_trees_options unpack_opts;
+
+	memset(&unpack_opts, 0, sizeof(unpack_opts));
+	unpack_opts.head_idx = -1;
+	unpack_opts.src_index = opt->repo->index;
+	unpack_opts.dst_index = opt->repo->index;
+
+	setup_unpack_trees_porcelain(&unpack_opts, "merge");
+
+	/* 2-way merge to the new branch */
+	unpack_opts.update = 1;
+	unpack_opts.merge = 1;
+	unpack_opts.quiet = 0;
+	unpack_opts.verbose_update = (opt->verbosity > 2);
+	unpack_opts.fn = twoway_merge;
+	unpack_opts.dir = xcalloc(1, sizeof(*unpack_opts.dir));
+	unpack_opts.dir->flags |= DIR_SHOW_IGNORED;
+	setup_standard_excludes(unpack_opts.dir);
+
+	parse_tree(prev);
+	init_tree_desc(&trees[0], prev->buffer, prev->size);
+	parse_tree(next);
+	init_tree_desc(&trees[1], next->buffer, next->size);
+
+	ret = unpack_trees(2, trees, &unpack_opts);
+	clear_unpack_trees_porcelain(&unpack_opts);
+	dir_clear(unpack_opts.dir);
+	FREE_AND_NULL(unpack_opts.dir);
+	return ret;
+}
+
+static int record_conflicted_index_entries(struct merge_options *opt,
+					   struct index_state *index,
+					   struct string_list *conflicted)
+{
+	struct string_list_item *item;
+
+	for_each_string_list_item(item, conflicted) {
+		const char *path = item->string;
+		struct conflict_info *ci = item->util;
+		int i;
+
+		/* a file moved out of the way of a directory */
+		if (ci->is_null)
+			continue;
+
+		/*
+		 * The working tree already has the conflicted contents of
+		 * the path; replace the stage #0 entry checkout() gave it
+		 * with the higher stages.
+		 */
+		remove_file_from_index(index, path);
+		for (i = 0; i < 3; i++) {
+			struct cache_entry *ce;
+
+			if (!(ci->filemask & (1 << i)))
+				continue;
+			ce = make_cache_entry(index, ci->stages[i].mode,
+					      &ci->stages[i].oid, path, i + 1, 0);
+			if (!ce)
+				return err(opt, _("add_cacheinfo failed for path '%s'; merge aborting."), path);
+			if (add_index_entry(index, ce,
+					    ADD_CACHE_OK_TO_ADD |
+					    ADD_CACHE_OK_TO_REPLACE |
+					    ADD_CACHE_SKIP_DFCHECK))
+				return err(opt, _("add_cacheinfo failed to refresh for path '%s'; merge aborting."), path);
+		}
+	}
+	return 0;
+}
+
+int merge_switch_to_result(struct merge_options *opt,
+			   struct tree *head,
+			   struct merge_result *result,
+			   int update_worktree_and_index,
+			   int display_update_msgs)
+{
+	struct merge_options_internal *opti = result->priv;
+	int ret = 0;
+
+	assert(opt->priv == NULL);
+
+	if (result->clean >= 0 && update_worktree_and_index) {
+		if (checkout(opt, head, result->tree) ||
+		    record_conflicted_index_entries(opt, opt->repo->index,
+						    &opti->conflicted)) {
+			result->clean = -1;
+			ret = -1;
+		}
+	}
+
+	if (display_update_msgs) {
+		flush_output(opt);
+		if (opti && opti->needed_rename_limit && opt->verbosity >= 2)
+			diff_warn_rename_limit("merge.renamelimit",
+					       opti->needed_rename_limit, 0);
+	} else if (opt->buffer_output < 2) {
+		strbuf_reset(&opt->obuf);
+	}
+
+	return ret;
+}
+
+void merge_finalize(struct merge_options *opt,
+		    struct merge_result *result)
+{
+	assert(opt->priv == NULL);
+
+	if (opt->buffer_output < 2)
+		strbuf_release(&opt->obuf);
+	free_merge_result(result);
+}
@@ -0,0 +1,73 @@
+#ifndef MERGE_ORT_H
+#define MERGE_ORT_H
+
+#include "merge-recursive.h"
+
+struct commit;
+struct tree;
+
+struct merge_result {
+	/* Whether the merge is clean */
+	int clean;
+
+	/*
+	 * Result of merge.  If !clean, represents what would go in worktree
+	 * (thus possibly including files containing conflict markers).
+	 */
+	struct tree *tree;
+
+	/*
+	 * Additional metadata used by merge_switch_to_result() or future calls
+	 * to merge_incore_*().  Includes data needed to update the index (if
+	 * !clean) and to print "CONFLICT" messages.  Not for external use.
+	 */
+	void *priv;
+};
+
+/*
+ * rename-detecting three-way merge with recursive ancestor consolidation.
+ * working tree and index are untouched.
+ *
+ * merge_bases will be consumed (emptied) so make a copy if you need it;
+ * if it is NULL, the merge bases of side1 and side2 are computed.
+ */
+void merge_incore_recursive(struct merge_options *opt,
+			    struct commit_list *merge_bases,
+			    struct commit *side1,
+			    struct commit *side2,
+			    struct merge_result *result);
+
+/*
+ * rename-detecting three-way merge, no recursion.
+ * working tree and index are untouched.
+ *
+ * A caller performing a sequence of merges, where each merge uses the
+ * result tree of the previous one as side1 and the previous side2 as
+ * its merge_base (e.g. a rebase or a cherry-pick of a range), may pass
+ * the same `result` to every call and only call merge_finalize() after
+ * the last one.  Renames detected on side1 are then remembered between
+ * merges instead of being detected anew each time.
+ */
+void merge_incore_nonrecursive(struct merge_options *opt,
+			       struct tree *merge_base,
+			       struct tree *side1,
+			       struct tree *side2,
+			       struct merge_result *result);
+
+/*
+ * Update the working tree and index from head to result after an
+ * incore merge, and print the messages collected during the merge
+ * (subject to opt->buffer_output).  Returns -1 if the working tree
+ * or index could not be updated.
+ */
+int merge_switch_to_result(struct merge_options *opt,
+			   struct tree *head,
+			   struct merge_result *result,
+			   int update_worktree_and_index,
+			   int display_update_msgs);
+
+/* Free everything associated with the result of the merge(s) */
+void merge_finalize(struct merge_options *opt,
+		    struct merge_result *result);
+
+#endif
@@ -10,6 +10,11 @@
 #include "progress.h"
 #include "trace2.h"
 #include "run-command.h"
+#include "refs.h"
+#include "revision.h"
+#include "list-objects.h"
+#include "pack-bitmap.h"
+#include "pack-objects.h"
 
 #define MIDX_SIGNATURE 0x4d494458 /* "MIDX" */
 #define MIDX_VERSION 1
@@ -20,13 +25,14 @@
 #define MIDX_HEADER_SIZE 12
 #define MIDX_MIN_SIZE (MIDX_HEADER_SIZE + the_hash_algo->rawsz)
 
-#define MIDX_MAX_CHUNKS 5
+#define MIDX_MAX_CHUNKS 6
 #define MIDX_CHUNK_ALIGNMENT 4
 #define MIDX_CHUNKID_PACKNAMES 0x504e414d /* "PNAM" */
 #define MIDX_CHUNKID_OIDFANOUT 0x4f494446 /* "OIDF" */
 #define MIDX_CHUNKID_OIDLOOKUP 0x4f49444c /* "OIDL" */
 #define MIDX_CHUNKID_OBJECTOFFSETS 0x4f4f4646 /* "OOFF" */
 #define MIDX_CHUNKID_LARGEOFFSETS 0x4c4f4646 /* "LOFF" */
+#define MIDX_CHUNKID_REVINDEX 0x52494458 /* "RIDX" */
 #define MIDX_CHUNKLOOKUP_WIDTH (sizeof(uint32_t) + sizeof(uint64_t))
 #define MIDX_CHUNK_FANOUT_SIZE (sizeof(uint32_t) * 256)
 #define MIDX_CHUNK_OFFSET_WIDTH (2 * sizeof(uint32_t))
@@ -52,6 +58,18 @@ static char *get_midx_filename(const char *object_dir)
 	return xstrfmt("%s/pack/multi-pack-index", object_dir);
 }
 
+const unsigned char *get_midx_checksum(struct multi_pack_index *m)
+{
+	return m->data + m->data_len - the_hash_algo->rawsz;
+}
+
+char *get_midx_bitmap_filename(const char *object_dir,
+			       const unsigned char *hash)
+{
+	return xstrfmt("%s/pack/multi-pack-index-%s.bitmap",
+		       object_dir, hash_to_hex(hash));
+}
+
 struct multi_pack_index *load_multi_pack_index(const char *object_dir, int local)
 {
 	struct multi_pack_index *m = NULL;
@@ -142,6 +160,10 @@ struct multi_pack_index *load_multi_pack_index(const char *object_dir, int local
 				m->chunk_large_offsets = m->data + chunk_offset;
 				break;
 
+			case MIDX_CHUNKID_REVINDEX:
+				m->chunk_revindex = m->data + chunk_offset;
+				break;
+
 			case 0:
 				die(_("terminating multi-pack-index chunk id appears earlier than expected"));
 				break;
@@ -259,7 +281,7 @@ struct object_id *nth_midxed_object_oid(struct object_id *oid,
 	return oid;
 }
 
-static off_t nth_midxed_offset(struct multi_pack_index *m, uint32_t pos)
+off_t nth_midxed_offset(struct multi_pack_index *m, uint32_t pos)
 {
 	const unsigned char *offset_data;
 	uint32_t offset32;
@@ -278,7 +300,7 @@ static off_t nth_midxed_offset(struct multi_pack_index *m, uint32_t pos)
 	return offset32;
 }
 
-static uint32_t nth_midxed_pack_int_id(struct multi_pack_index *m, uint32_t pos)
+uint32_t nth_midxed_pack_int_id(struct multi_pack_index *m, uint32_t pos)
 {
 	return get_be32(m->chunk_object_offsets + pos * MIDX_CHUNK_OFFSET_WIDTH);
 }
@@ -507,6 +529,7 @@ struct pack_midx_entry {
 	uint32_t pack_int_id;
 	time_t pack_mtime;
 	uint64_t offset;
+	unsigned preferred : 1;
 };
 
 static int midx_oid_compare(const void *_a, const void *_b)
@@ -518,6 +541,12 @@ static int midx_oid_compare(const void *_a, const void *_b)
 	if (cmp)
 		return cmp;
 
+	/* Sort objects in a preferred pack first when multiple copies exist. */
+	if (a->preferred > b->preferred)
+		return -1;
+	if (a->preferred < b->preferred)
+		return 1;
+
 	if (a->pack_mtime > b->pack_mtime)
 		return -1;
 	else if (a->pack_mtime < b->pack_mtime)
@@ -545,7 +574,8 @@ static int nth_midxed_pack_midx_entry(struct multi_pack_index *m,
 static void fill_pack_entry(uint32_t pack_int_id,
 			    struct packed_git *p,
 			    uint32_t cur_object,
-			    struct pack_midx_entry *entry)
+			    struct pack_midx_entry *entry,
+			    int preferred)
 {
 	if (nth_packed_object_id(&entry->oid, p, cur_object) < 0)
 		die(_("failed to locate object %d in packfile"), cur_object);
@@ -554,6 +584,7 @@ static void fill_pack_entry(uint32_t pack_int_id,
 	entry->pack_mtime = p->mtime;
 
 	entry->offset = nth_packed_object_offset(p, cur_object);
+	entry->preferred = !!preferred;
 }
 
 /*
@@ -564,13 +595,15 @@ static void fill_pack_entry(uint32_t pack_int_id,
  * group objects by the first byte of their object id. Use the IDX fanout
  * tables to group the data, copy to a local array, then sort.
  *
- * Copy only the de-duplicated entries (selected by most-recent modified time
- * of a packfile containing the object).
+ * Copy only the de-duplicated entries (selected by the preferred pack, if
+ * any, and then by most-recent modified time of a packfile containing the
+ * object).
  */
 static struct pack_midx_entry *get_sorted_entries(struct multi_pack_index *m,
 						  struct pack_info *info,
 						  uint32_t nr_packs,
-						  uint32_t *nr_objects)
+						  uint32_t *nr_objects,
+						  int preferred_pack)
 {
 	uint32_t cur_fanout, cur_pack, cur_object;
 	uint32_t alloc_fanout, alloc_objects, total_objects = 0;
@@ -607,6 +640,8 @@ static struct pack_midx_entry *get_sorted_entries(struct multi_pack_index *m,
 				nth_midxed_pack_midx_entry(m,
 							   &entries_by_fanout[nr_fanout],
 							   cur_object);
+				entries_by_fanout[nr_fanout].preferred =
+					nth_midxed_pack_int_id(m, cur_object) == preferred_pack;
 				nr_fanout++;
 			}
 		}
@@ -620,7 +655,9 @@ static struct pack_midx_entry *get_sorted_entries(struct multi_pack_index *m,
 
 			for (cur_object = start; cur_object < end; cur_object++) {
 				ALLOC_GROW(entries_by_fanout, nr_fanout + 1, alloc_fanout);
-				fill_pack_entry(cur_pack, info[cur_pack].p, cur_object, &entries_by_fanout[nr_fanout]);
+				fill_pack_entry(cur_pack, info[cur_pack].p, cur_object,
+						&entries_by_fanout[nr_fanout],
+						cur_pack == preferred_pack);
 				nr_fanout++;
 			}
 		}
@@ -800,8 +837,234 @@ static size_t write_midx_large_offsets(struct hashfile *f, uint32_t nr_large_off
 	return written;
 }
 
+struct midx_pack_order_data {
+	uint32_t nr;
+	uint32_t pack;
+	off_t offset;
+};
+
+static int midx_pack_order_cmp(const void *va, const void *vb)
+{
+	const struct midx_pack_order_data *a = va, *b = vb;
+	if (a->pack < b->pack)
+		return -1;
+	else if (a->pack > b->pack)
+		return 1;
+	else if (a->offset < b->offset)
+		return -1;
+	else if (a->offset > b->offset)
+		return 1;
+	else
+		return 0;
+}
+
+/*
+ * Compute the "pseudo-pack" order of the objects in a multi-pack-index:
+ * objects from the preferred pack come first, followed by the objects
+ * of every other pack in pack-int-id order. Within a single pack,
+ * objects are ordered by their offset. The result maps pseudo-pack
+ * positions to lexicographic positions in the multi-pack-index.
+ */
+static uint32_t *midx_pack_order(struct pack_midx_entry *entries,
+				 uint32_t nr_entries,
+				 uint32_t *pack_perm)
+{
+	struct midx_pack_order_data *data;
+	uint32_t *pack_order;
+	uint32_t i;
+
+	ALLOC_ARRAY(data, nr_entries);
+	for (i = 0; i < nr_entries; i++) {
+		struct pack_midx_entry *e = &entries[i];
+		data[i].nr = i;
+		data[i].pack = pack_perm[e->pack_int_id];
+		if (!e->preferred)
+			data[i].pack |= (1U << 31);
+		data[i].offset = e->offset;
+	}
+
+	QSORT(data, nr_entries, midx_pack_order_cmp);
+
+	ALLOC_ARRAY(pack_order, nr_entries);
+	for (i = 0; i < nr_entries; i++)
+		pack_order[i] = data[i].nr;
+	free(data);
+
+	return pack_order;
+}
+
+static size_t write_midx_revindex(struct hashfile *f, uint32_t *pack_order,
+				  uint32_t nr_entries)
+{
+	uint32_t i;
+
+	for (i = 0; i < nr_entries; i++)
+		hashwrite_be32(f, pack_order[i]);
+
+	return nr_entries * sizeof(uint32_t);
+}
+
+static int add_ref_to_pending(const char *refname,
+			      const struct object_id *oid,
+			      int flag, void *cb_data)
+{
+	struct rev_info *revs = (struct rev_info*)cb_data;
+	struct object *object;
+
+	if ((flag & REF_ISSYMREF) && (flag & REF_ISBROKEN)) {
+		warning("symbolic ref is dangling: %s", refname);
+		return 0;
+	}
+
+	object = parse_object_or_die(oid, refname);
+	if (object->type != OBJ_COMMIT && object->type != OBJ_TAG)
+		return 0;
+
+	add_pending_object(revs, object, "");
+	return 0;
+}
+
+struct bitmap_commit_cb {
+	struct commit **commits;
+	size_t commits_nr, commits_alloc;
+
+	struct packing_data *to_pack;
+};
+
+static void bitmap_show_commit(struct commit *commit, void *_data)
+{
+	struct bitmap_commit_cb *data = _data;
+	if (!packlist_find(data->to_pack, &commit->object.oid))
+		return;
+
+	ALLOC_GROW(data->commits, data->commits_nr + 1, data->commits_alloc);
+	data->commits[data->commits_nr++] = commit;
+}
+
+static void bitmap_show_object(struct object *obj, const char *name,
+			       void *_data)
+{
+	/* only commits are candidates for bitmaps */
+}
+
+static struct commit **find_commits_for_midx_bitmap(uint32_t *indexed_commits_nr_p,
+						    struct packing_data *to_pack)
+{
+	struct rev_info revs;
+	struct bitmap_commit_cb cb;
+
+	memset(&cb, 0, sizeof(cb));
+	cb.to_pack = to_pack;
+
+	repo_init_revisions(the_repository, &revs, NULL);
+	for_each_ref(add_ref_to_pending, &revs);
+
+	/*
+	 * Skipping promisor objects here is intentional, since it only excludes
+	 * them from the list of reachable commits that we want to select from
+	 * when computing the selection of MIDX'd commits to receive bitmaps.
+	 *
+	 * Reachability bitmaps do require that their objects be closed under
+	 * reachability, but fetching any objects missing from promisors at this
+	 * point is too late. But, if one of those objects can be reached from
+	 * an another object that is included in the bitmap, then we will
+	 * complain later that we don't have reachability closure (and fail
+	 * appropriately).
+	 */
+	fetch_if_missing = 0;
+	revs.exclude_promisor_objects = 1;
+
+	if (prepare_revision_walk(&revs))
+		die(_("revision walk setup failed"));
+
+	traverse_commit_list(&revs, bitmap_show_commit, bitmap_show_object,
+			     &cb);
+	if (indexed_commits_nr_p)
+		*indexed_commits_nr_p = cb.commits_nr;
+
+	return cb.commits;
+}
+
+static void prepare_midx_packing_data(struct packing_data *pdata,
+				      struct pack_midx_entry *entries,
+				      uint32_t nr_entries,
+				      uint32_t *pack_order)
+{
+	uint32_t i;
+
+	memset(pdata, 0, sizeof(struct packing_data));
+	prepare_packing_data(the_repository, pdata);
+
+	for (i = 0; i < nr_entries; i++) {
+		struct pack_midx_entry *from = &entries[pack_order[i]];
+		struct object_entry *to = packlist_alloc(pdata, &from->oid);
+
+		to->idx.offset = from->offset;
+	}
+}
+
+static int write_midx_bitmap(const char *bitmap_name,
+			     unsigned char *midx_hash,
+			     struct pack_midx_entry *entries,
+			     uint32_t nr_entries,
+			     uint32_t *pack_order,
+			     unsigned flags)
+{
+	struct packing_data pdata;
+	struct pack_idx_entry **index;
+	struct commit **commits;
+	uint32_t i, commits_nr;
+	uint16_t options = 0;
+	int lookup_table;
+
+	if (!git_config_get_bool("pack.writebitmaplookuptable", &lookup_table) &&
+	    lookup_table)
+		options |= BITMAP_OPT_LOOKUP_TABLE;
+
+	prepare_midx_packing_data(&pdata, entries, nr_entries, pack_order);
+
+	commits = find_commits_for_midx_bitmap(&commits_nr, &pdata);
+
+	/*
+	 * Build the type index in pseudo-pack order, which is the order
+	 * in which the objects were added to "pdata" above.
+	 */
+	ALLOC_ARRAY(index, pdata.nr_objects);
+	for (i = 0; i < pdata.nr_objects; i++)
+		index[i] = &pdata.objects[i].idx;
+
+	bitmap_writer_show_progress(flags & MIDX_PROGRESS);
+	bitmap_writer_build_type_index(&pdata, index, pdata.nr_objects);
+
+	/*
+	 * bitmap_writer_finish() expects "index" to be in lexicographic
+	 * order, so rearrange it to match the multi-pack-index.
+	 */
+	for (i = 0; i < pdata.nr_objects; i++)
+		index[pack_order[i]] = &pdata.objects[i].idx;
+
+	bitmap_writer_select_commits(commits, commits_nr, -1);
+	bitmap_writer_build(&pdata);
+	bitmap_writer_set_checksum(midx_hash);
+	bitmap_writer_finish(index, pdata.nr_objects, bitmap_name, options);
+
+	free(index);
+	free(commits);
+	free(pdata.objects);
+	free(pdata.index);
+	free(pdata.in_pack);
+	free(pdata.in_pack_by_idx);
+	free(pdata.in_pack_pos);
+	return 0;
+}
+
+static void clear_midx_files_ext(const char *object_dir, const char *ext,
+				 const unsigned char *keep_hash);
+
 static int write_midx_internal(const char *object_dir, struct multi_pack_index *m,
-			       struct string_list *packs_to_drop, unsigned flags)
+			       struct string_list *packs_to_drop,
+			       const char *preferred_pack_name,
+			       unsigned flags)
 {
 	unsigned char cur_chunk, num_chunks = 0;
 	char *midx_name;
@@ -815,12 +1078,18 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 	uint64_t chunk_offsets[MIDX_MAX_CHUNKS + 1];
 	uint32_t nr_entries, num_large_offsets = 0;
 	struct pack_midx_entry *entries = NULL;
+	uint32_t *pack_order = NULL;
+	unsigned char midx_hash[GIT_MAX_RAWSZ];
 	struct progress *progress = NULL;
 	int large_offsets_needed = 0;
 	int pack_name_concat_len = 0;
 	int dropped_packs = 0;
+	int preferred_pack_idx = -1;
 	int result = 0;
 
+	if (preferred_pack_name || (flags & MIDX_WRITE_BITMAP))
+		flags |= MIDX_WRITE_REV_INDEX;
+
 	midx_name = get_midx_filename(object_dir);
 	if (safe_create_leading_directories(midx_name))
 		die_errno(_("unable to create leading directories of %s"),
@@ -828,6 +1097,13 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 
 	if (m)
 		packs.m = m;
+	else if (flags & MIDX_WRITE_REV_INDEX)
+		/*
+		 * Open every pack ourselves instead of reusing the entries
+		 * of an existing multi-pack-index, so that duplicate objects
+		 * can be resolved in favor of the preferred pack.
+		 */
+		packs.m = NULL;
 	else
 		packs.m = load_multi_pack_index(object_dir, 1);
 
@@ -860,7 +1136,48 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 	if (packs.m && packs.nr == packs.m->num_packs && !packs_to_drop)
 		goto cleanup;
 
-	entries = get_sorted_entries(packs.m, packs.info, packs.nr, &nr_entries);
+	if (preferred_pack_name) {
+		for (i = 0; i < packs.nr; i++) {
+			if (!cmp_idx_or_pack_name(preferred_pack_name,
+						  packs.info[i].pack_name)) {
+				preferred_pack_idx = i;
+				break;
+			}
+		}
+
+		if (preferred_pack_idx < 0) {
+			error(_("unknown preferred pack: '%s'"),
+			      preferred_pack_name);
+			result = 1;
+			goto cleanup;
+		}
+	} else if (flags & MIDX_WRITE_BITMAP) {
+		time_t oldest = 0;
+
+		/* Default to the oldest non-empty pack. */
+		for (i = 0; i < packs.nr; i++) {
+			struct packed_git *p = packs.info[i].p;
+			if (!p || !p->num_objects)
+				continue;
+			if (preferred_pack_idx < 0 || p->mtime < oldest) {
+				preferred_pack_idx = i;
+				oldest = p->mtime;
+			}
+		}
+	}
+
+	if (preferred_pack_idx >= 0) {
+		struct packed_git *p = packs.info[preferred_pack_idx].p;
+		if (p && !p->num_objects) {
+			error(_("cannot select preferred pack %s with no objects"),
+			      packs.info[preferred_pack_idx].pack_name);
+			result = 1;
+			goto cleanup;
+		}
+	}
+
+	entries = get_sorted_entries(packs.m, packs.info, packs.nr, &nr_entries,
+				     preferred_pack_idx);
 
 	for (i = 0; i < nr_entries; i++) {
 		if (entries[i].offset > 0x7fffffff)
@@ -920,6 +1237,9 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 			pack_name_concat_len += strlen(packs.info[i].pack_name) + 1;
 	}
 
+	if (flags & MIDX_WRITE_REV_INDEX)
+		pack_order = midx_pack_order(entries, nr_entries, pack_perm);
+
 	if (pack_name_concat_len % MIDX_CHUNK_ALIGNMENT)
 		pack_name_concat_len += MIDX_CHUNK_ALIGNMENT -
 					(pack_name_concat_len % MIDX_CHUNK_ALIGNMENT);
@@ -932,7 +1252,11 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 		close_midx(packs.m);
 
 	cur_chunk = 0;
-	num_chunks = large_offsets_needed ? 5 : 4;
+	num_chunks = 4;
+	if (large_offsets_needed)
+		num_chunks++;
+	if (flags & MIDX_WRITE_REV_INDEX)
+		num_chunks++;
 
 	if (packs.nr - dropped_packs == 0) {
 		error(_("no pack files to index."));
@@ -967,6 +1291,14 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 					   num_large_offsets * MIDX_CHUNK_LARGE_OFFSET_WIDTH;
 	}
 
+	if (flags & MIDX_WRITE_REV_INDEX) {
+		chunk_ids[cur_chunk] = MIDX_CHUNKID_REVINDEX;
+
+		cur_chunk++;
+		chunk_offsets[cur_chunk] = chunk_offsets[cur_chunk - 1] +
+					   nr_entries * sizeof(uint32_t);
+	}
+
 	chunk_ids[cur_chunk] = 0;
 
 	for (i = 0; i <= num_chunks; i++) {
@@ -1017,6 +1349,10 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 				written += write_midx_large_offsets(f, num_large_offsets, entries, nr_entries);
 				break;
 
+			case MIDX_CHUNKID_REVINDEX:
+				written += write_midx_revindex(f, pack_order, nr_entries);
+				break;
+
 			default:
 				BUG("trying to write unknown chunk id %"PRIx32,
 				    chunk_ids[i]);
@@ -1031,9 +1367,25 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 		    written,
 		    chunk_offsets[num_chunks]);
 
-	finalize_hashfile(f, NULL, CSUM_FSYNC | CSUM_HASH_IN_STREAM);
+	finalize_hashfile(f, midx_hash, CSUM_FSYNC | CSUM_HASH_IN_STREAM);
+
+	if (flags & MIDX_WRITE_BITMAP) {
+		char *bitmap_name = get_midx_bitmap_filename(object_dir, midx_hash);
+		int ret = write_midx_bitmap(bitmap_name, midx_hash, entries,
+					    nr_entries, pack_order, flags);
+		free(bitmap_name);
+		if (ret < 0) {
+			error(_("could not write multi-pack bitmap"));
+			rollback_lock_file(&lk);
+			result = 1;
+			goto cleanup;
+		}
+	}
+
 	commit_lock_file(&lk);
 
+	clear_midx_files_ext(object_dir, ".bitmap", midx_hash);
+
 cleanup:
 	for (i = 0; i < packs.nr; i++) {
 		if (packs.info[i].p) {
@@ -1046,13 +1398,57 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 	free(packs.info);
 	free(entries);
 	free(pack_perm);
+	free(pack_order);
 	free(midx_name);
 	return result;
 }
 
-int write_midx_file(const char *object_dir, unsigned flags)
+int write_midx_file(const char *object_dir,
+		    const char *preferred_pack_name,
+		    unsigned flags)
+{
+	return write_midx_internal(object_dir, NULL, NULL, preferred_pack_name,
+				   flags);
+}
+
+struct clear_midx_data {
+	char *keep;
+	const char *ext;
+};
+
+static void clear_midx_file_ext(const char *full_path, size_t full_path_len,
+				const char *file_name, void *_data)
 {
-	return write_midx_internal(object_dir, NULL, NULL, flags);
+	struct clear_midx_data *data = _data;
+
+	if (!(starts_with(file_name, "multi-pack-index-") &&
+	      ends_with(file_name, data->ext)))
+		return;
+	if (data->keep && !strcmp(data->keep, file_name))
+		return;
+
+	if (unlink(full_path))
+		die_errno(_("failed to remove %s"), full_path);
+}
+
+/*
+ * Remove every "multi-pack-index-<hash><ext>" file in the pack directory
+ * of "object_dir", except for the one matching "keep_hash" (if any).
+ */
+static void clear_midx_files_ext(const char *object_dir, const char *ext,
+				 const unsigned char *keep_hash)
+{
+	struct clear_midx_data data;
+	memset(&data, 0, sizeof(struct clear_midx_data));
+
+	if (keep_hash)
+		data.keep = xstrfmt("multi-pack-index-%s%s",
+				    hash_to_hex(keep_hash), ext);
+	data.ext = ext;
+
+	for_each_file_in_pack_dir(object_dir, clear_midx_file_ext, &data);
+
+	free(data.keep);
 }
 
 void clear_midx_file(struct repository *r)
@@ -1067,6 +1463,8 @@ void clear_midx_file(struct repository *r)
 	if (remove_path(midx))
 		die(_("failed to clear multi-pack-index at %s"), midx);
 
+	clear_midx_files_ext(r->objects->odb->path, ".bitmap", NULL);
+
 	free(midx);
 }
 
@@ -1287,7 +1685,7 @@ int expire_midx_packs(struct repository *r, const char *object_dir, unsigned fla
 	free(count);
 
 	if (packs_to_drop.nr)
-		result = write_midx_internal(object_dir, m, &packs_to_drop, flags);
+		result = write_midx_internal(object_dir, m, &packs_to_drop, NULL, flags);
 
 	string_list_clear(&packs_to_drop, 0);
 	return result;
@@ -1476,7 +1874,7 @@ int midx_repack(struct repository *r, const char *object_dir, size_t batch_size,
 		goto cleanup;
 	}
 
-	result = write_midx_internal(object_dir, m, NULL, flags);
+	result = write_midx_internal(object_dir, m, NULL, NULL, flags);
 	m = NULL;
 
 cleanup:
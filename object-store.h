@@ -82,9 +82,19 @@ struct packed_git {
 		 freshened:1,
 		 do_not_close:1,
 		 pack_promisor:1,
-		 multi_pack_index:1;
+		 multi_pack_index:1,
+		 is_cruft:1;
 	unsigned char hash[GIT_MAX_RAWSZ];
 	struct revindex_entry *revindex;
+	const uint32_t *revindex_data;
+	const uint32_t *revindex_map;
+	size_t revindex_size;
+	/*
+	 * mtimes_map points at the beginning of the memory mapped region of
+	 * this pack's corresponding .mtimes file, if it is a cruft pack.
+	 */
+	const uint32_t *mtimes_map;
+	size_t mtimes_size;
 	/* something like ".git/objects/pack/xxxxx.pack" */
 	char pack_name[FLEX_ARRAY]; /* more */
 };
@@ -209,6 +219,25 @@ int hash_object_file(const struct git_hash_algo *algo, const void *buf,
 int write_object_file(const void *buf, unsigned long len,
 		      const char *type, struct object_id *oid);
 
+/*
+ * A source of object contents for stream_loose_object(): each call to
+ * read() returns the next chunk and stores its length in *len; it sets
+ * is_finished when it has returned the last chunk.
+ */
+struct input_stream {
+	const void *(*read)(struct input_stream *, unsigned long *len);
+	void *data;
+	int is_finished;
+};
+
+/*
+ * Write a blob of "len" bytes read from "in_stream" as a loose object,
+ * compressing and hashing it on the fly so that it never has to be held
+ * in memory as a whole. The object name is returned in "oid".
+ */
+int stream_loose_object(struct input_stream *in_stream, size_t len,
+			struct object_id *oid);
+
 int hash_object_file_literally(const void *buf, unsigned long len,
 			       const char *type, struct object_id *oid,
 			       unsigned flags);
@@ -281,6 +310,12 @@ int repo_has_object_file_with_flags(struct repository *r,
  */
 int has_loose_object_nonlocal(const struct object_id *);
 
+/*
+ * Return true iff the main object database or an alternate has a loose
+ * object with the specified name.
+ */
+int has_loose_object(const struct object_id *);
+
 void assert_oid_type(const struct object_id *oid, enum object_type expect);
 
 /*
@@ -289,15 +324,20 @@ void assert_oid_type(const struct object_id *oid, enum object_type expect);
  * read_object_file_extended(), read_object_with_reference(), read_object(),
  * oid_object_info() and oid_object_info_extended().
  *
+ * The lock only covers looking up objects and reading loose ones. Packed
+ * objects, including the delta resolution and zlib inflation, are read
+ * outside of it, under finer-grained locks protecting the pack windows and a
+ * sharded delta base cache (see enable_pack_read_lock()).
+ *
  * obj_read_lock() and obj_read_unlock() may also be used to protect other
  * section which cannot execute in parallel with object reading. Since the used
  * lock is a recursive mutex, these sections can even contain calls to object
- * reading functions. However, beware that in these cases zlib inflation won't
+ * reading functions. However, beware that in these cases object reading won't
  * be performed in parallel, losing performance.
  *
  * TODO: oid_object_info_extended()'s call stack has a recursive behavior. If
  * any of its callees end up calling it, this recursive call won't benefit from
- * parallel inflation.
+ * parallel reading.
  */
 void enable_obj_read_lock(void);
 void disable_obj_read_lock(void);
@@ -439,6 +479,9 @@ enum for_each_object_flags {
 	 * Visit objects within a pack in packfile order rather than .idx order
 	 */
 	FOR_EACH_OBJECT_PACK_ORDER = (1<<2),
+
+	/* Skip packs marked as kept in core. */
+	FOR_EACH_OBJECT_SKIP_IN_CORE_KEPT_PACKS = (1<<3),
 };
 
 /*
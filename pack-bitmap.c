@@ -1,4 +1,5 @@
 #include "cache.h"
+#include "config.h"
 #include "commit.h"
 #include "tag.h"
 #include "diff.h"
@@ -13,6 +14,7 @@
 #include "repository.h"
 #include "object-store.h"
 #include "list-objects-filter-options.h"
+#include "midx.h"
 
 /*
  * An entry on the bitmap index, representing the bitmap for a given
@@ -28,14 +30,24 @@ struct stored_bitmap {
 /*
  * The active bitmap index for a repository. By design, repositories only have
  * a single bitmap index available (the index for the biggest packfile in
- * the repository), since bitmap indexes need full closure.
+ * the repository, or for the multi-pack-index), since bitmap indexes need
+ * full closure.
  *
  * If there is more than one bitmap index available (e.g. because of alternates),
- * the active bitmap index is the largest one.
+ * the active bitmap index is the largest one. A multi-pack bitmap is always
+ * preferred over a single-pack one.
  */
 struct bitmap_index {
-	/* Packfile to which this bitmap index belongs to */
+	/*
+	 * The pack or multi-pack index (MIDX) that this bitmap index belongs
+	 * to.
+	 *
+	 * Exactly one of these must be non-NULL; this specifies the object
+	 * order used to interpret this bitmap. For a MIDX, bit positions
+	 * refer to its "pseudo-pack" order (see pack-revindex.h).
+	 */
 	struct packed_git *pack;
+	struct multi_pack_index *midx;
 
 	/*
 	 * Mark the first `reuse_objects` in the packfile as reused:
@@ -49,6 +61,9 @@ struct bitmap_index {
 	size_t map_size; /* size of the mmaped buffer */
 	size_t map_pos; /* current position when loading the index */
 
+	/* checksum of the pack or MIDX this bitmap was written for */
+	const unsigned char *checksum;
+
 	/*
 	 * Type indexes.
 	 *
@@ -70,6 +85,13 @@ struct bitmap_index {
 	/* If not NULL, this is a name-hash cache pointing into map. */
 	uint32_t *hashes;
 
+	/*
+	 * If not NULL, this points to the commit lookup table within map.
+	 * The bitmaps of individual commits are then read lazily, and
+	 * "bitmaps" only holds the ones read so far.
+	 */
+	const unsigned char *table_lookup;
+
 	/*
 	 * Extended index.
 	 *
@@ -94,6 +116,13 @@ struct bitmap_index {
 	unsigned int version;
 };
 
+static uint32_t bitmap_num_objects(struct bitmap_index *index)
+{
+	if (index->midx)
+		return index->midx->num_objects;
+	return index->pack->num_objects;
+}
+
 static struct ewah_bitmap *lookup_stored_bitmap(struct stored_bitmap *st)
 {
 	struct ewah_bitmap *parent;
@@ -149,22 +178,36 @@ static int load_bitmap_header(struct bitmap_index *index)
 	if (index->version != 1)
 		return error("Unsupported version for bitmap index file (%d)", index->version);
 
+	index->entry_count = ntohl(header->entry_count);
+	index->checksum = header->checksum;
+	index->map_pos += sizeof(*header) - GIT_MAX_RAWSZ + the_hash_algo->rawsz;
+
 	/* Parse known bitmap format options */
 	{
 		uint32_t flags = ntohs(header->options);
+		unsigned char *end = index->map + index->map_size - the_hash_algo->rawsz;
 
 		if ((flags & BITMAP_OPT_FULL_DAG) == 0)
 			return error("Unsupported options for bitmap index file "
 				"(Git requires BITMAP_OPT_FULL_DAG)");
 
 		if (flags & BITMAP_OPT_HASH_CACHE) {
-			unsigned char *end = index->map + index->map_size - the_hash_algo->rawsz;
-			index->hashes = ((uint32_t *)end) - index->pack->num_objects;
+			index->hashes = ((uint32_t *)end) - bitmap_num_objects(index);
+			end = (unsigned char *)index->hashes;
+		}
+
+		if (flags & BITMAP_OPT_LOOKUP_TABLE) {
+			size_t table_size = st_mult(index->entry_count,
+						    BITMAP_LOOKUP_TABLE_TRIPLET_WIDTH);
+
+			if (end < index->map + index->map_pos ||
+			    table_size > end - (index->map + index->map_pos))
+				return error("Corrupted bitmap index file (too short to fit lookup table)");
+			if (git_env_bool("GIT_TEST_READ_COMMIT_TABLE", 1))
+				index->table_lookup = end - table_size;
 		}
 	}
 
-	index->entry_count = ntohl(header->entry_count);
-	index->map_pos += sizeof(*header) - GIT_MAX_RAWSZ + the_hash_algo->rawsz;
 	return 0;
 }
 
@@ -210,6 +253,16 @@ static inline uint8_t read_u8(const unsigned char *buffer, size_t *pos)
 	return buffer[(*pos)++];
 }
 
+static void nth_bitmap_object_oid(struct bitmap_index *index,
+				  struct object_id *oid,
+				  uint32_t n)
+{
+	if (index->midx)
+		nth_midxed_object_oid(oid, index->midx, n);
+	else
+		nth_packed_object_id(oid, index->pack, n);
+}
+
 #define MAX_XOR_OFFSET 160
 
 static int load_bitmap_entries_v1(struct bitmap_index *index)
@@ -228,7 +281,7 @@ static int load_bitmap_entries_v1(struct bitmap_index *index)
 		xor_offset = read_u8(index->map, &index->map_pos);
 		flags = read_u8(index->map, &index->map_pos);
 
-		nth_packed_object_id(&oid, index->pack, commit_idx_pos);
+		nth_bitmap_object_oid(index, &oid, commit_idx_pos);
 
 		bitmap = read_bitmap_1(index);
 		if (!bitmap)
@@ -251,6 +304,166 @@ static int load_bitmap_entries_v1(struct bitmap_index *index)
 	return 0;
 }
 
+static const unsigned char *bitmap_table_row(struct bitmap_index *index,
+					     uint32_t row)
+{
+	return index->table_lookup +
+		st_mult(row, BITMAP_LOOKUP_TABLE_TRIPLET_WIDTH);
+}
+
+/*
+ * Find the row of the lookup table for the commit at index position
+ * "commit_pos"; the rows are sorted by that position.
+ */
+static int bitmap_table_find_row(struct bitmap_index *index,
+				 uint32_t commit_pos, uint32_t *row)
+{
+	uint32_t lo = 0, hi = index->entry_count;
+
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		uint32_t pos = get_be32(bitmap_table_row(index, mi));
+
+		if (pos == commit_pos) {
+			*row = mi;
+			return 0;
+		}
+		if (pos < commit_pos)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+	return -1;
+}
+
+/*
+ * Load the bitmap in the given row of the lookup table, along with
+ * those of its xor bases that have not been loaded yet.
+ */
+static struct stored_bitmap *load_bitmap_for_row(struct bitmap_index *index,
+						 uint32_t row)
+{
+	struct stored_bitmap *xor_with = NULL;
+	uint32_t *chain = NULL;
+	size_t chain_nr = 0, chain_alloc = 0;
+
+	/*
+	 * Follow the xor bases down until we reach one that is already
+	 * loaded, or one that has no base of its own.
+	 */
+	for (;;) {
+		const unsigned char *p = bitmap_table_row(index, row);
+		struct object_id oid;
+		uint32_t xor_row;
+		khiter_t hash_pos;
+
+		nth_bitmap_object_oid(index, &oid, get_be32(p));
+		hash_pos = kh_get_oid_map(index->bitmaps, oid);
+		if (hash_pos < kh_end(index->bitmaps)) {
+			xor_with = kh_value(index->bitmaps, hash_pos);
+			break;
+		}
+
+		if (chain_nr >= index->entry_count) {
+			error("Corrupted bitmap lookup table (xor cycle)");
+			goto failed;
+		}
+		ALLOC_GROW(chain, chain_nr + 1, chain_alloc);
+		chain[chain_nr++] = row;
+
+		xor_row = get_be32(p + sizeof(uint32_t) + sizeof(uint64_t));
+		if (xor_row == BITMAP_LOOKUP_TABLE_NO_XOR)
+			break;
+		if (xor_row >= index->entry_count) {
+			error("Corrupted bitmap lookup table (xor row %"PRIu32")",
+			      xor_row);
+			goto failed;
+		}
+		row = xor_row;
+	}
+
+	/* Then read them back up, each one on top of its base. */
+	while (chain_nr) {
+		const unsigned char *p = bitmap_table_row(index, chain[--chain_nr]);
+		uint32_t commit_pos = get_be32(p);
+		uint64_t offset = get_be64(p + sizeof(uint32_t));
+		struct ewah_bitmap *bitmap;
+		struct object_id oid;
+		int flags;
+
+		if (offset > index->map_size - the_hash_algo->rawsz ||
+		    index->map_size - the_hash_algo->rawsz - offset < 6) {
+			error("Corrupted bitmap lookup table (offset %"PRIuMAX")",
+			      (uintmax_t)offset);
+			goto failed;
+		}
+
+		index->map_pos = offset;
+		if (read_be32(index->map, &index->map_pos) != commit_pos) {
+			error("Corrupted bitmap lookup table (commit position mismatch)");
+			goto failed;
+		}
+		read_u8(index->map, &index->map_pos); /* xor offset */
+		flags = read_u8(index->map, &index->map_pos);
+
+		bitmap = read_bitmap_1(index);
+		if (!bitmap)
+			goto failed;
+
+		nth_bitmap_object_oid(index, &oid, commit_pos);
+		xor_with = store_bitmap(index, bitmap, &oid, xor_with, flags);
+		if (!xor_with)
+			goto failed;
+	}
+
+	free(chain);
+	return xor_with;
+
+failed:
+	free(chain);
+	return NULL;
+}
+
+static struct stored_bitmap *lazy_bitmap_for_oid(struct bitmap_index *index,
+						 const struct object_id *oid)
+{
+	uint32_t commit_pos, row;
+	int found;
+
+	if (index->midx)
+		found = bsearch_midx(oid, index->midx, &commit_pos);
+	else
+		found = bsearch_pack(oid, index->pack, &commit_pos);
+	if (!found)
+		return NULL;
+
+	if (bitmap_table_find_row(index, commit_pos, &row) < 0)
+		return NULL;
+
+	return load_bitmap_for_row(index, row);
+}
+
+/*
+ * Return the stored bitmap of the given commit, reading it from the
+ * lookup table first if there is one, or NULL if it has none.
+ */
+static struct ewah_bitmap *bitmap_for_oid(struct bitmap_index *index,
+					  const struct object_id *oid)
+{
+	struct stored_bitmap *st = NULL;
+	khiter_t hash_pos;
+
+	hash_pos = kh_get_oid_map(index->bitmaps, *oid);
+	if (hash_pos < kh_end(index->bitmaps))
+		st = kh_value(index->bitmaps, hash_pos);
+	else if (index->table_lookup)
+		st = lazy_bitmap_for_oid(index, oid);
+
+	if (!st)
+		return NULL;
+	return lookup_stored_bitmap(st);
+}
+
 static char *pack_bitmap_filename(struct packed_git *p)
 {
 	size_t len;
@@ -260,6 +473,68 @@ static char *pack_bitmap_filename(struct packed_git *p)
 	return xstrfmt("%.*s.bitmap", (int)len, p->pack_name);
 }
 
+static char *midx_bitmap_filename(struct multi_pack_index *midx)
+{
+	return get_midx_bitmap_filename(midx->object_dir,
+					get_midx_checksum(midx));
+}
+
+static int open_midx_bitmap_1(struct bitmap_index *bitmap_git,
+			      struct multi_pack_index *midx)
+{
+	int fd;
+	struct stat st;
+	char *idx_name;
+
+	idx_name = midx_bitmap_filename(midx);
+	fd = git_open(idx_name);
+	free(idx_name);
+
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+
+	if (bitmap_git->pack || bitmap_git->midx) {
+		warning("ignoring extra bitmap file for multi-pack-index in %s",
+			midx->object_dir);
+		close(fd);
+		return -1;
+	}
+
+	bitmap_git->midx = midx;
+	bitmap_git->map_size = xsize_t(st.st_size);
+	bitmap_git->map = xmmap(NULL, bitmap_git->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	bitmap_git->map_pos = 0;
+	close(fd);
+
+	if (load_bitmap_header(bitmap_git) < 0)
+		goto cleanup;
+
+	if (!hasheq(get_midx_checksum(midx), bitmap_git->checksum)) {
+		error("checksum doesn't match in multi-pack-index and bitmap");
+		goto cleanup;
+	}
+
+	if (load_midx_revindex(midx) < 0) {
+		warning("multi-pack bitmap is missing required reverse index");
+		goto cleanup;
+	}
+
+	return 0;
+
+cleanup:
+	munmap(bitmap_git->map, bitmap_git->map_size);
+	bitmap_git->map = NULL;
+	bitmap_git->map_size = 0;
+	bitmap_git->hashes = NULL;
+	bitmap_git->midx = NULL;
+	return -1;
+}
+
 static int open_pack_bitmap_1(struct bitmap_index *bitmap_git, struct packed_git *packfile)
 {
 	int fd;
@@ -281,7 +556,7 @@ static int open_pack_bitmap_1(struct bitmap_index *bitmap_git, struct packed_git
 		return -1;
 	}
 
-	if (bitmap_git->pack) {
+	if (bitmap_git->pack || bitmap_git->midx) {
 		warning("ignoring extra bitmap file: %s", packfile->pack_name);
 		close(fd);
 		return -1;
@@ -303,13 +578,16 @@ static int open_pack_bitmap_1(struct bitmap_index *bitmap_git, struct packed_git
 	return 0;
 }
 
-static int load_pack_bitmap(struct bitmap_index *bitmap_git)
+static int load_bitmap(struct bitmap_index *bitmap_git)
 {
 	assert(bitmap_git->map);
 
 	bitmap_git->bitmaps = kh_init_oid_map();
 	bitmap_git->ext_index.positions = kh_init_oid_pos();
-	if (load_pack_revindex(bitmap_git->pack))
+	if (bitmap_git->midx) {
+		if (load_midx_revindex(bitmap_git->midx))
+			goto failed;
+	} else if (load_pack_revindex(bitmap_git->pack))
 		goto failed;
 
 	if (!(bitmap_git->commits = read_bitmap_1(bitmap_git)) ||
@@ -318,7 +596,8 @@ static int load_pack_bitmap(struct bitmap_index *bitmap_git)
 		!(bitmap_git->tags = read_bitmap_1(bitmap_git)))
 		goto failed;
 
-	if (load_bitmap_entries_v1(bitmap_git) < 0)
+	if (!bitmap_git->table_lookup &&
+	    load_bitmap_entries_v1(bitmap_git) < 0)
 		goto failed;
 
 	return 0;
@@ -353,11 +632,35 @@ static int open_pack_bitmap(struct repository *r,
 	return ret;
 }
 
+static int open_midx_bitmap(struct repository *r,
+			    struct bitmap_index *bitmap_git)
+{
+	struct multi_pack_index *midx;
+
+	assert(!bitmap_git->map);
+
+	for (midx = get_multi_pack_index(r); midx; midx = midx->next) {
+		if (midx->local && !open_midx_bitmap_1(bitmap_git, midx))
+			return 0;
+	}
+	return -1;
+}
+
+static int open_bitmap(struct repository *r,
+		       struct bitmap_index *bitmap_git)
+{
+	assert(!bitmap_git->map);
+
+	if (!open_midx_bitmap(r, bitmap_git))
+		return 0;
+	return open_pack_bitmap(r, bitmap_git);
+}
+
 struct bitmap_index *prepare_bitmap_git(struct repository *r)
 {
 	struct bitmap_index *bitmap_git = xcalloc(1, sizeof(*bitmap_git));
 
-	if (!open_pack_bitmap(r, bitmap_git) && !load_pack_bitmap(bitmap_git))
+	if (!open_bitmap(r, bitmap_git) && !load_bitmap(bitmap_git))
 		return bitmap_git;
 
 	free_bitmap_index(bitmap_git);
@@ -378,7 +681,7 @@ static inline int bitmap_position_extended(struct bitmap_index *bitmap_git,
 
 	if (pos < kh_end(positions)) {
 		int bitmap_pos = kh_value(positions, pos);
-		return bitmap_pos + bitmap_git->pack->num_objects;
+		return bitmap_pos + bitmap_num_objects(bitmap_git);
 	}
 
 	return -1;
@@ -394,13 +697,45 @@ static inline int bitmap_position_packfile(struct bitmap_index *bitmap_git,
 	return find_revindex_position(bitmap_git->pack, offset);
 }
 
+static int bitmap_position_midx(struct bitmap_index *bitmap_git,
+				const struct object_id *oid)
+{
+	uint32_t want, got;
+	if (!bsearch_midx(oid, bitmap_git->midx, &want))
+		return -1;
+
+	if (midx_to_pack_pos(bitmap_git->midx, want, &got) < 0)
+		return -1;
+	return got;
+}
+
 static int bitmap_position(struct bitmap_index *bitmap_git,
 			   const struct object_id *oid)
 {
-	int pos = bitmap_position_packfile(bitmap_git, oid);
+	int pos;
+	if (bitmap_git->midx)
+		pos = bitmap_position_midx(bitmap_git, oid);
+	else
+		pos = bitmap_position_packfile(bitmap_git, oid);
 	return (pos >= 0) ? pos : bitmap_position_extended(bitmap_git, oid);
 }
 
+/*
+ * Return the pack containing the object at lexicographic position
+ * "midx_pos" in the multi-pack-index of "bitmap_git", opening it if
+ * necessary.
+ */
+static struct packed_git *bitmap_midx_pack(struct bitmap_index *bitmap_git,
+					   uint32_t midx_pos)
+{
+	struct multi_pack_index *m = bitmap_git->midx;
+	uint32_t pack_id = nth_midxed_pack_int_id(m, midx_pos);
+
+	if (prepare_midx_pack(the_repository, m, pack_id))
+		die(_("could not open pack %s"), m->pack_names[pack_id]);
+	return m->packs[pack_id];
+}
+
 static int ext_index_add_object(struct bitmap_index *bitmap_git,
 				struct object *object, const char *name)
 {
@@ -427,7 +762,7 @@ static int ext_index_add_object(struct bitmap_index *bitmap_git,
 		bitmap_pos = kh_value(eindex->positions, hash_pos);
 	}
 
-	return bitmap_pos + bitmap_git->pack->num_objects;
+	return bitmap_pos + bitmap_num_objects(bitmap_git);
 }
 
 struct bitmap_show_data {
@@ -458,7 +793,7 @@ static int add_to_include_set(struct bitmap_index *bitmap_git,
 			      const struct object_id *oid,
 			      int bitmap_pos)
 {
-	khiter_t hash_pos;
+	struct ewah_bitmap *partial;
 
 	if (data->seen && bitmap_get(data->seen, bitmap_pos))
 		return 0;
@@ -466,10 +801,9 @@ static int add_to_include_set(struct bitmap_index *bitmap_git,
 	if (bitmap_get(data->base, bitmap_pos))
 		return 0;
 
-	hash_pos = kh_get_oid_map(bitmap_git->bitmaps, *oid);
-	if (hash_pos < kh_end(bitmap_git->bitmaps)) {
-		struct stored_bitmap *st = kh_value(bitmap_git->bitmaps, hash_pos);
-		bitmap_or_ewah(data->base, lookup_stored_bitmap(st));
+	partial = bitmap_for_oid(bitmap_git, oid);
+	if (partial) {
+		bitmap_or_ewah(data->base, partial);
 		return 0;
 	}
 
@@ -527,12 +861,10 @@ static struct bitmap *find_objects(struct bitmap_index *bitmap_git,
 		roots = roots->next;
 
 		if (object->type == OBJ_COMMIT) {
-			khiter_t pos = kh_get_oid_map(bitmap_git->bitmaps, object->oid);
-
-			if (pos < kh_end(bitmap_git->bitmaps)) {
-				struct stored_bitmap *st = kh_value(bitmap_git->bitmaps, pos);
-				struct ewah_bitmap *or_with = lookup_stored_bitmap(st);
+			struct ewah_bitmap *or_with = bitmap_for_oid(bitmap_git,
+								     &object->oid);
 
+			if (or_with) {
 				if (base == NULL)
 					base = ewah_to_bitmap(or_with);
 				else
@@ -619,7 +951,7 @@ static void show_extended_objects(struct bitmap_index *bitmap_git,
 	for (i = 0; i < eindex->count; ++i) {
 		struct object *obj;
 
-		if (!bitmap_get(objects, bitmap_git->pack->num_objects + i))
+		if (!bitmap_get(objects, bitmap_num_objects(bitmap_git) + i))
 			continue;
 
 		obj = eindex->objects[i];
@@ -683,22 +1015,32 @@ static void show_objects_for_type(
 			continue;
 
 		for (offset = 0; offset < BITS_IN_EWORD; ++offset) {
+			struct packed_git *pack;
 			struct object_id oid;
-			struct revindex_entry *entry;
-			uint32_t hash = 0;
+			uint32_t hash = 0, index_pos;
+			off_t ofs;
 
 			if ((word >> offset) == 0)
 				break;
 
 			offset += ewah_bit_ctz64(word >> offset);
 
-			entry = &bitmap_git->pack->revindex[pos + offset];
-			nth_packed_object_id(&oid, bitmap_git->pack, entry->nr);
+			if (bitmap_git->midx) {
+				index_pos = pack_pos_to_midx(bitmap_git->midx, pos + offset);
+				ofs = nth_midxed_offset(bitmap_git->midx, index_pos);
+				nth_midxed_object_oid(&oid, bitmap_git->midx, index_pos);
+				pack = bitmap_midx_pack(bitmap_git, index_pos);
+			} else {
+				index_pos = pack_pos_to_index(bitmap_git->pack, pos + offset);
+				ofs = pack_pos_to_offset(bitmap_git->pack, pos + offset);
+				nth_packed_object_id(&oid, bitmap_git->pack, index_pos);
+				pack = bitmap_git->pack;
+			}
 
 			if (bitmap_git->hashes)
-				hash = get_be32(bitmap_git->hashes + entry->nr);
+				hash = get_be32(bitmap_git->hashes + index_pos);
 
-			show_reach(&oid, object_type, 0, hash, bitmap_git->pack, entry->offset);
+			show_reach(&oid, object_type, 0, hash, pack, ofs);
 		}
 	}
 }
@@ -710,7 +1052,11 @@ static int in_bitmapped_pack(struct bitmap_index *bitmap_git,
 		struct object *object = roots->item;
 		roots = roots->next;
 
-		if (find_pack_entry_one(object->oid.hash, bitmap_git->pack) > 0)
+		if (bitmap_git->midx) {
+			uint32_t pos;
+			if (bsearch_midx(&object->oid, bitmap_git->midx, &pos))
+				return 1;
+		} else if (find_pack_entry_one(object->oid.hash, bitmap_git->pack) > 0)
 			return 1;
 	}
 
@@ -751,7 +1097,8 @@ static void filter_bitmap_exclude_type(struct bitmap_index *bitmap_git,
 	eword_t mask;
 	uint32_t i;
 
-	if (type != OBJ_BLOB && type != OBJ_TREE)
+	if (type != OBJ_BLOB && type != OBJ_TREE &&
+	    type != OBJ_COMMIT && type != OBJ_TAG)
 		BUG("filter_bitmap_exclude_type: unsupported type '%d'", type);
 
 	/*
@@ -779,7 +1126,7 @@ static void filter_bitmap_exclude_type(struct bitmap_index *bitmap_git,
 	 * individually.
 	 */
 	for (i = 0; i < eindex->count; i++) {
-		uint32_t pos = i + bitmap_git->pack->num_objects;
+		uint32_t pos = i + bitmap_num_objects(bitmap_git);
 		if (eindex->objects[i]->type == type &&
 		    bitmap_get(to_filter, pos) &&
 		    !bitmap_get(tips, pos))
@@ -800,23 +1147,37 @@ static void filter_bitmap_blob_none(struct bitmap_index *bitmap_git,
 static unsigned long get_size_by_pos(struct bitmap_index *bitmap_git,
 				     uint32_t pos)
 {
-	struct packed_git *pack = bitmap_git->pack;
 	unsigned long size;
 	struct object_info oi = OBJECT_INFO_INIT;
 
 	oi.sizep = &size;
 
-	if (pos < pack->num_objects) {
-		struct revindex_entry *entry = &pack->revindex[pos];
-		if (packed_object_info(the_repository, pack,
-				       entry->offset, &oi) < 0) {
+	if (pos < bitmap_num_objects(bitmap_git)) {
+		struct packed_git *pack;
+		off_t ofs;
+		uint32_t index_pos;
+
+		if (bitmap_git->midx) {
+			index_pos = pack_pos_to_midx(bitmap_git->midx, pos);
+			ofs = nth_midxed_offset(bitmap_git->midx, index_pos);
+			pack = bitmap_midx_pack(bitmap_git, index_pos);
+		} else {
+			pack = bitmap_git->pack;
+			index_pos = pack_pos_to_index(pack, pos);
+			ofs = pack_pos_to_offset(pack, pos);
+		}
+
+		if (packed_object_info(the_repository, pack, ofs, &oi) < 0) {
 			struct object_id oid;
-			nth_packed_object_id(&oid, pack, entry->nr);
+			if (bitmap_git->midx)
+				nth_midxed_object_oid(&oid, bitmap_git->midx, index_pos);
+			else
+				nth_packed_object_id(&oid, pack, index_pos);
 			die(_("unable to get size of %s"), oid_to_hex(&oid));
 		}
 	} else {
 		struct eindex *eindex = &bitmap_git->ext_index;
-		struct object *obj = eindex->objects[pos - pack->num_objects];
+		struct object *obj = eindex->objects[pos - bitmap_num_objects(bitmap_git)];
 		if (oid_object_info_extended(the_repository, &obj->oid, &oi, 0) < 0)
 			die(_("unable to get size of %s"), oid_to_hex(&obj->oid));
 	}
@@ -858,7 +1219,7 @@ static void filter_bitmap_blob_limit(struct bitmap_index *bitmap_git,
 	}
 
 	for (i = 0; i < eindex->count; i++) {
-		uint32_t pos = i + bitmap_git->pack->num_objects;
+		uint32_t pos = i + bitmap_num_objects(bitmap_git);
 		if (eindex->objects[i]->type == OBJ_BLOB &&
 		    bitmap_get(to_filter, pos) &&
 		    !bitmap_get(tips, pos) &&
@@ -883,6 +1244,24 @@ static void filter_bitmap_tree_depth(struct bitmap_index *bitmap_git,
 				   OBJ_BLOB);
 }
 
+static void filter_bitmap_object_type(struct bitmap_index *bitmap_git,
+				      struct object_list *tip_objects,
+				      struct bitmap *to_filter,
+				      enum object_type object_type)
+{
+	if (object_type < OBJ_COMMIT || object_type > OBJ_TAG)
+		BUG("filter_bitmap_object_type given invalid object");
+
+	if (object_type != OBJ_TAG)
+		filter_bitmap_exclude_type(bitmap_git, tip_objects, to_filter, OBJ_TAG);
+	if (object_type != OBJ_COMMIT)
+		filter_bitmap_exclude_type(bitmap_git, tip_objects, to_filter, OBJ_COMMIT);
+	if (object_type != OBJ_TREE)
+		filter_bitmap_exclude_type(bitmap_git, tip_objects, to_filter, OBJ_TREE);
+	if (object_type != OBJ_BLOB)
+		filter_bitmap_exclude_type(bitmap_git, tip_objects, to_filter, OBJ_BLOB);
+}
+
 static int filter_bitmap(struct bitmap_index *bitmap_git,
 			 struct object_list *tip_objects,
 			 struct bitmap *to_filter,
@@ -915,6 +1294,29 @@ static int filter_bitmap(struct bitmap_index *bitmap_git,
 		return 0;
 	}
 
+	if (filter->choice == LOFC_OBJECT_TYPE) {
+		if (bitmap_git)
+			filter_bitmap_object_type(bitmap_git, tip_objects,
+						  to_filter,
+						  filter->object_type);
+		return 0;
+	}
+
+	if (filter->choice == LOFC_COMBINE) {
+		size_t i;
+		/*
+		 * Each sub-filter only ever removes objects, so applying
+		 * them one after another yields the intersection that the
+		 * non-bitmap "combine" filter computes.
+		 */
+		for (i = 0; i < filter->sub_nr; i++) {
+			if (filter_bitmap(bitmap_git, tip_objects, to_filter,
+					  &filter->sub[i]) < 0)
+				return -1;
+		}
+		return 0;
+	}
+
 	/* filter choice not handled */
 	return -1;
 }
@@ -951,7 +1353,7 @@ struct bitmap_index *prepare_bitmap_walk(struct rev_info *revs,
 	/* try to open a bitmapped pack, but don't parse it yet
 	 * because we may not need to use it */
 	bitmap_git = xcalloc(1, sizeof(*bitmap_git));
-	if (open_pack_bitmap(revs->repo, bitmap_git) < 0)
+	if (open_bitmap(revs->repo, bitmap_git) < 0)
 		goto cleanup;
 
 	for (i = 0; i < revs->pending.nr; ++i) {
@@ -994,7 +1396,7 @@ struct bitmap_index *prepare_bitmap_walk(struct rev_info *revs,
 	 * from disk. this is the point of no return; after this the rev_list
 	 * becomes invalidated and we must perform the revwalk through bitmaps
 	 */
-	if (load_pack_bitmap(bitmap_git) < 0)
+	if (load_bitmap(bitmap_git) < 0)
 		goto cleanup;
 
 	object_array_clear(&revs->pending);
@@ -1036,22 +1438,20 @@ struct bitmap_index *prepare_bitmap_walk(struct rev_info *revs,
 	return NULL;
 }
 
-static void try_partial_reuse(struct bitmap_index *bitmap_git,
+static void try_partial_reuse(struct packed_git *pack,
 			      size_t pos,
 			      struct bitmap *reuse,
 			      struct pack_window **w_curs)
 {
-	struct revindex_entry *revidx;
-	off_t offset;
+	off_t offset, header;
 	enum object_type type;
 	unsigned long size;
 
-	if (pos >= bitmap_git->pack->num_objects)
+	if (pos >= pack->num_objects)
 		return; /* not actually in the pack */
 
-	revidx = &bitmap_git->pack->revindex[pos];
-	offset = revidx->offset;
-	type = unpack_object_header(bitmap_git->pack, w_curs, &offset, &size);
+	offset = header = pack_pos_to_offset(pack, pos);
+	type = unpack_object_header(pack, w_curs, &offset, &size);
 	if (type < 0)
 		return; /* broken packfile, punt */
 
@@ -1067,11 +1467,11 @@ static void try_partial_reuse(struct bitmap_index *bitmap_git,
 		 * and the normal slow path will complain about it in
 		 * more detail.
 		 */
-		base_offset = get_delta_base(bitmap_git->pack, w_curs,
-					     &offset, type, revidx->offset);
+		base_offset = get_delta_base(pack, w_curs,
+					     &offset, type, header);
 		if (!base_offset)
 			return;
-		base_pos = find_revindex_position(bitmap_git->pack, base_offset);
+		base_pos = find_revindex_position(pack, base_offset);
 		if (base_pos < 0)
 			return;
 
@@ -1113,17 +1513,34 @@ int reuse_partial_packfile_from_bitmap(struct bitmap_index *bitmap_git,
 	struct bitmap *result = bitmap_git->result;
 	struct bitmap *reuse;
 	struct pack_window *w_curs = NULL;
+	struct packed_git *pack;
 	size_t i = 0;
 	uint32_t offset;
 
 	assert(result);
 
+	if (bitmap_git->midx) {
+		/*
+		 * The objects of the preferred pack occupy the first bits of
+		 * a multi-pack bitmap, in the same order as in the pack
+		 * itself, so only that pack is a candidate for verbatim
+		 * reuse.
+		 */
+		if (!bitmap_git->midx->num_objects)
+			return -1;
+		pack = bitmap_midx_pack(bitmap_git,
+					pack_pos_to_midx(bitmap_git->midx, 0));
+		if (load_pack_revindex(pack))
+			return -1;
+	} else
+		pack = bitmap_git->pack;
+
 	while (i < result->word_alloc && result->words[i] == (eword_t)~0)
 		i++;
 
 	/* Don't mark objects not in the packfile */
-	if (i > bitmap_git->pack->num_objects / BITS_IN_EWORD)
-		i = bitmap_git->pack->num_objects / BITS_IN_EWORD;
+	if (i > pack->num_objects / BITS_IN_EWORD)
+		i = pack->num_objects / BITS_IN_EWORD;
 
 	reuse = bitmap_word_alloc(i);
 	memset(reuse->words, 0xFF, i * sizeof(eword_t));
@@ -1137,7 +1554,7 @@ int reuse_partial_packfile_from_bitmap(struct bitmap_index *bitmap_git,
 				break;
 
 			offset += ewah_bit_ctz64(word >> offset);
-			try_partial_reuse(bitmap_git, pos + offset, reuse, &w_curs);
+			try_partial_reuse(pack, pos + offset, reuse, &w_curs);
 		}
 	}
 
@@ -1154,7 +1571,7 @@ int reuse_partial_packfile_from_bitmap(struct bitmap_index *bitmap_git,
 	 * need to be handled separately.
 	 */
 	bitmap_and_not(result, reuse);
-	*packfile_out = bitmap_git->pack;
+	*packfile_out = pack;
 	*reuse_out = reuse;
 	return 0;
 }
@@ -1207,7 +1624,7 @@ static uint32_t count_object_type(struct bitmap_index *bitmap_git,
 
 	for (i = 0; i < eindex->count; ++i) {
 		if (eindex->objects[i]->type == type &&
-			bitmap_get(objects, bitmap_git->pack->num_objects + i))
+			bitmap_get(objects, bitmap_num_objects(bitmap_git) + i))
 			count++;
 	}
 
@@ -1272,7 +1689,7 @@ void test_bitmap_walk(struct rev_info *revs)
 {
 	struct object *root;
 	struct bitmap *result = NULL;
-	khiter_t pos;
+	struct ewah_bitmap *bm;
 	size_t result_popcnt;
 	struct bitmap_test_data tdata;
 	struct bitmap_index *bitmap_git;
@@ -1287,12 +1704,9 @@ void test_bitmap_walk(struct rev_info *revs)
 		bitmap_git->version, bitmap_git->entry_count);
 
 	root = revs->pending.objects[0].item;
-	pos = kh_get_oid_map(bitmap_git->bitmaps, root->oid);
-
-	if (pos < kh_end(bitmap_git->bitmaps)) {
-		struct stored_bitmap *st = kh_value(bitmap_git->bitmaps, pos);
-		struct ewah_bitmap *bm = lookup_stored_bitmap(st);
+	bm = bitmap_for_oid(bitmap_git, &root->oid);
 
+	if (bm) {
 		fprintf(stderr, "Found bitmap for %s. %d bits / %08x checksum\n",
 			oid_to_hex(&root->oid), (int)bm->bit_size, ewah_checksum(bm));
 
@@ -1373,22 +1787,36 @@ int rebuild_existing_bitmaps(struct bitmap_index *bitmap_git,
 	khiter_t hash_pos;
 	int hash_ret;
 
-	num_objects = bitmap_git->pack->num_objects;
+	num_objects = bitmap_num_objects(bitmap_git);
 	reposition = xcalloc(num_objects, sizeof(uint32_t));
 
 	for (i = 0; i < num_objects; ++i) {
 		struct object_id oid;
-		struct revindex_entry *entry;
 		struct object_entry *oe;
 
-		entry = &bitmap_git->pack->revindex[i];
-		nth_packed_object_id(&oid, bitmap_git->pack, entry->nr);
+		if (bitmap_git->midx)
+			nth_midxed_object_oid(&oid, bitmap_git->midx,
+					      pack_pos_to_midx(bitmap_git->midx, i));
+		else
+			nth_packed_object_id(&oid, bitmap_git->pack,
+					     pack_pos_to_index(bitmap_git->pack, i));
 		oe = packlist_find(mapping, &oid);
 
 		if (oe)
 			reposition[i] = oe_in_pack_pos(mapping, oe) + 1;
 	}
 
+	/* Only the bitmaps read so far are in the map; read the rest. */
+	if (bitmap_git->table_lookup) {
+		for (i = 0; i < bitmap_git->entry_count; i++)
+			if (!load_bitmap_for_row(bitmap_git, i))
+				break;
+		if (i < bitmap_git->entry_count) {
+			free(reposition);
+			return -1;
+		}
+	}
+
 	rebuild = bitmap_new();
 	i = 0;
 
@@ -24,10 +24,18 @@ struct bitmap_disk_header {
 #define NEEDS_BITMAP (1u<<22)
 
 enum pack_bitmap_opts {
-	BITMAP_OPT_FULL_DAG = 1,
-	BITMAP_OPT_HASH_CACHE = 4,
+	BITMAP_OPT_FULL_DAG = 0x1,
+	BITMAP_OPT_HASH_CACHE = 0x4,
+	BITMAP_OPT_LOOKUP_TABLE = 0x10,
 };
 
+/*
+ * Each row of the lookup table is a 4-byte commit position, an 8-byte
+ * offset of its entry in the .bitmap, and the 4-byte row of its xor base.
+ */
+#define BITMAP_LOOKUP_TABLE_TRIPLET_WIDTH (sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint32_t))
+#define BITMAP_LOOKUP_TABLE_NO_XOR 0xffffffff
+
 enum pack_bitmap_flags {
 	BITMAP_FLAG_REUSE = 0x1
 };
@@ -0,0 +1,37 @@
+#ifndef PACK_MTIMES_H
+#define PACK_MTIMES_H
+
+#include "git-compat-util.h"
+
+/**
+ * A ".mtimes" file sits next to the ".pack" of a cruft pack, i.e. a pack
+ * holding unreachable objects. Since the objects in it do not share a
+ * single age, it records a modification time for each of them, in the
+ * same (object name) order as the ".idx" file. Code deciding whether an
+ * unreachable object is recent enough to be kept uses these in place of
+ * the mtime of the pack itself.
+ */
+
+#define MTIMES_SIGNATURE 0x4d544d45 /* "MTME" */
+#define MTIMES_VERSION 1
+
+struct packed_git;
+
+/*
+ * load_pack_mtimes maps the ".mtimes" file of the cruft pack "p",
+ * returning zero on success and a negative value otherwise.
+ */
+int load_pack_mtimes(struct packed_git *p);
+
+/*
+ * nth_packed_mtime returns the mtime of the object at index position
+ * "pos" in "p", whose mtimes must already have been loaded.
+ */
+uint32_t nth_packed_mtime(struct packed_git *p, uint32_t pos);
+
+/*
+ * close_pack_mtimes unmaps the ".mtimes" file of "p", if any.
+ */
+void close_pack_mtimes(struct packed_git *p);
+
+#endif
@@ -1,16 +1,126 @@
 #ifndef PACK_REVINDEX_H
 #define PACK_REVINDEX_H
 
+/**
+ * A revindex allows converting efficiently between three properties
+ * of an object within a pack:
+ *
+ * - index position: the numeric position within the list of sorted object ids
+ *   found in the .idx file
+ *
+ * - pack position: the numeric position within the list of objects in their
+ *   order within the actual .pack file (i.e., 0 is the first object in the
+ *   .pack, 1 is the second, and so on)
+ *
+ * - offset: the byte offset within the .pack file at which the object contents
+ *   can be found
+ *
+ * The revindex can either be generated in memory by sorting the offsets
+ * found in the .idx file, or loaded from a ".rev" file stored next to the
+ * pack, which contains the index positions of every object in pack order.
+ */
+
+#define RIDX_SIGNATURE 0x52494458 /* "RIDX" */
+#define RIDX_VERSION 1
+
+#define GIT_TEST_WRITE_REV_INDEX "GIT_TEST_WRITE_REV_INDEX"
+#define GIT_TEST_REV_INDEX_DIE_IN_MEMORY "GIT_TEST_REV_INDEX_DIE_IN_MEMORY"
+
 struct packed_git;
+struct multi_pack_index;
 
 struct revindex_entry {
 	off_t offset;
 	unsigned int nr;
 };
 
+/*
+ * load_pack_revindex populates the revindex's internal data-structures for the
+ * given pack, returning zero on success and a negative value otherwise.
+ *
+ * If a '.rev' file is present it is mmap'd, and the in-memory sort is
+ * skipped entirely.
+ */
 int load_pack_revindex(struct packed_git *p);
+
+/*
+ * close_pack_revindex frees any memory associated with the reverse index of
+ * the given pack, and unmaps its '.rev' file (if any).
+ */
+void close_pack_revindex(struct packed_git *p);
+
+/*
+ * find_revindex_position returns the pack position of the object at offset
+ * "ofs" in "p", or -1 (after emitting an error) if no object starts at that
+ * offset. The special offset at the end of the pack data (where the pack
+ * trailer begins) maps to position "p->num_objects".
+ *
+ * This function runs in time O(log N) with the number of objects in the pack.
+ * The revindex must already be loaded.
+ */
 int find_revindex_position(struct packed_git *p, off_t ofs);
 
-struct revindex_entry *find_pack_revindex(struct packed_git *p, off_t ofs);
+/*
+ * pack_pos_to_index converts the given pack-relative position 'pos' by
+ * returning an index-relative position.
+ *
+ * If the reverse index has not yet been loaded, or the position is out of
+ * bounds, this function aborts.
+ *
+ * This function runs in constant time.
+ */
+uint32_t pack_pos_to_index(struct packed_git *p, uint32_t pos);
+
+/*
+ * pack_pos_to_offset converts the given pack-relative position 'pos' into a
+ * pack offset. For a pack with 'N' objects, asking for position 'N' will return
+ * the offset of the end of the pack.
+ *
+ * If the reverse index has not yet been loaded, or the position is out of
+ * bounds, this function aborts.
+ *
+ * This function runs in constant time.
+ */
+off_t pack_pos_to_offset(struct packed_git *p, uint32_t pos);
+
+/*
+ * find_pack_revindex loads the revindex if necessary, and fills "entry" with
+ * the offset and index position of the object at offset "ofs". On success,
+ * the offset of the next object (or of the pack trailer) is stored in
+ * "next_ofs" if it is non-NULL.
+ *
+ * Returns 0 on success, and -1 if the revindex could not be loaded or no
+ * object starts at "ofs".
+ */
+int find_pack_revindex(struct packed_git *p, off_t ofs,
+		       struct revindex_entry *entry, off_t *next_ofs);
+
+/*
+ * The multi-pack-index has its own reverse index, stored in its "RIDX"
+ * chunk, which orders objects in "pseudo-pack" order: the objects of the
+ * preferred pack come first, followed by those of every other pack in
+ * pack-int-id order, each pack's objects sorted by offset.
+ *
+ * load_midx_revindex checks that "m" carries such a chunk, returning zero
+ * if so and a negative value otherwise.
+ */
+int load_midx_revindex(struct multi_pack_index *m);
+
+/*
+ * pack_pos_to_midx converts the pseudo-pack position "pos" into the
+ * lexicographic position of that object within the MIDX.
+ *
+ * This function runs in constant time.
+ */
+uint32_t pack_pos_to_midx(struct multi_pack_index *m, uint32_t pos);
+
+/*
+ * midx_to_pack_pos converts the object at lexicographic position "at" in
+ * the MIDX into its pseudo-pack position, storing it in "pos". Returns
+ * zero on success and a negative value otherwise.
+ *
+ * This function runs in time O(log N) with the number of objects in the MIDX.
+ */
+int midx_to_pack_pos(struct multi_pack_index *m, uint32_t at, uint32_t *pos);
 
 #endif
@@ -17,6 +17,7 @@
 #include "midx.h"
 #include "commit-graph.h"
 #include "promisor-remote.h"
+#include "pack-mtimes.h"
 
 char *odb_pack_name(struct strbuf *buf,
 		    const unsigned char *hash,
@@ -52,6 +53,27 @@ static size_t pack_mapped;
 #define SZ_FMT PRIuMAX
 static inline uintmax_t sz_fmt(size_t s) { return s; }
 
+/*
+ * While the object read lock is enabled, pack_mutex protects the pack
+ * windows and file descriptors along with the other pack data that is
+ * loaded lazily, so that packed objects can be read without holding
+ * obj_read_mutex. It is only ever held for short stretches inside this
+ * file, and never while taking obj_read_mutex, which would deadlock.
+ */
+static pthread_mutex_t pack_mutex;
+
+static inline void pack_lock(void)
+{
+	if (obj_read_use_lock)
+		pthread_mutex_lock(&pack_mutex);
+}
+
+static inline void pack_unlock(void)
+{
+	if (obj_read_use_lock)
+		pthread_mutex_unlock(&pack_mutex);
+}
+
 void pack_report(void)
 {
 	fprintf(stderr,
@@ -182,9 +204,10 @@ int load_idx(const char *path, const unsigned int hashsz, void *idx_map,
 	}
 
 	p->index_version = version;
-	p->index_data = idx_map;
 	p->index_size = idx_size;
 	p->num_objects = nr;
+	/* set last; open_pack_index() checks it without pack_mutex */
+	p->index_data = idx_map;
 	return 0;
 }
 
@@ -192,16 +215,20 @@ int open_pack_index(struct packed_git *p)
 {
 	char *idx_name;
 	size_t len;
-	int ret;
+	int ret = 0;
 
 	if (p->index_data)
 		return 0;
 
-	if (!strip_suffix(p->pack_name, ".pack", &len))
-		BUG("pack_name does not end in .pack");
-	idx_name = xstrfmt("%.*s.idx", (int)len, p->pack_name);
-	ret = check_packed_git_idx(idx_name, p);
-	free(idx_name);
+	pack_lock();
+	if (!p->index_data) {
+		if (!strip_suffix(p->pack_name, ".pack", &len))
+			BUG("pack_name does not end in .pack");
+		idx_name = xstrfmt("%.*s.idx", (int)len, p->pack_name);
+		ret = check_packed_git_idx(idx_name, p);
+		free(idx_name);
+	}
+	pack_unlock();
 	return ret;
 }
 
@@ -290,6 +317,7 @@ static int unuse_one_window(struct packed_git *current)
 
 void close_pack_windows(struct packed_git *p)
 {
+	pack_lock();
 	while (p->windows) {
 		struct pack_window *w = p->windows;
 
@@ -302,26 +330,33 @@ void close_pack_windows(struct packed_git *p)
 		p->windows = w->next;
 		free(w);
 	}
+	pack_unlock();
 }
 
 int close_pack_fd(struct packed_git *p)
 {
-	if (p->pack_fd < 0)
-		return 0;
+	int ret = 0;
 
-	close(p->pack_fd);
-	pack_open_fds--;
-	p->pack_fd = -1;
+	pack_lock();
+	if (p->pack_fd >= 0) {
+		close(p->pack_fd);
+		pack_open_fds--;
+		p->pack_fd = -1;
+		ret = 1;
+	}
+	pack_unlock();
 
-	return 1;
+	return ret;
 }
 
 void close_pack_index(struct packed_git *p)
 {
+	pack_lock();
 	if (p->index_data) {
 		munmap((void *)p->index_data, p->index_size);
 		p->index_data = NULL;
 	}
+	pack_unlock();
 }
 
 void close_pack(struct packed_git *p)
@@ -329,6 +364,8 @@ void close_pack(struct packed_git *p)
 	close_pack_windows(p);
 	close_pack_fd(p);
 	close_pack_index(p);
+	close_pack_revindex(p);
+	close_pack_mtimes(p);
 }
 
 void close_object_store(struct raw_object_store *o)
@@ -351,7 +388,8 @@ void close_object_store(struct raw_object_store *o)
 
 void unlink_pack_path(const char *pack_name, int force_delete)
 {
-	static const char *exts[] = {".pack", ".idx", ".keep", ".bitmap", ".promisor"};
+	static const char *exts[] = {".pack", ".idx", ".rev", ".keep", ".bitmap", ".promisor",
+				      ".mtimes"};
 	int i;
 	struct strbuf buf = STRBUF_INIT;
 	size_t plen;
@@ -617,19 +655,27 @@ unsigned char *use_pack(struct packed_git *p,
 {
 	struct pack_window *win = *w_cursor;
 
-	/* Since packfiles end in a hash of their content and it's
-	 * pointless to ask for an offset into the middle of that
-	 * hash, and the in_window function above wouldn't match
-	 * don't allow an offset too close to the end of the file.
+	/*
+	 * The window under the cursor is pinned by its inuse_cnt, so it
+	 * can be used without taking pack_mutex. Since it holds at least
+	 * one full hash after the offset, the checks against the size of
+	 * the pack below are implied, too.
 	 */
-	if (!p->pack_size && p->pack_fd == -1 && open_packed_git(p))
-		die("packfile %s cannot be accessed", p->pack_name);
-	if (offset > (p->pack_size - the_hash_algo->rawsz))
-		die("offset beyond end of packfile (truncated pack?)");
-	if (offset < 0)
-		die(_("offset before end of packfile (broken .idx?)"));
-
 	if (!win || !in_window(win, offset)) {
+		pack_lock();
+
+		/* Since packfiles end in a hash of their content and it's
+		 * pointless to ask for an offset into the middle of that
+		 * hash, and the in_window function above wouldn't match
+		 * don't allow an offset too close to the end of the file.
+		 */
+		if (!p->pack_size && p->pack_fd == -1 && open_packed_git(p))
+			die("packfile %s cannot be accessed", p->pack_name);
+		if (offset > (p->pack_size - the_hash_algo->rawsz))
+			die("offset beyond end of packfile (truncated pack?)");
+		if (offset < 0)
+			die(_("offset before end of packfile (broken .idx?)"));
+
 		if (win)
 			win->inuse_cnt--;
 		for (win = p->windows; win; win = win->next) {
@@ -671,11 +717,11 @@ unsigned char *use_pack(struct packed_git *p,
 			win->next = p->windows;
 			p->windows = win;
 		}
-	}
-	if (win != *w_cursor) {
 		win->last_used = pack_used_ctr++;
 		win->inuse_cnt++;
 		*w_cursor = win;
+
+		pack_unlock();
 	}
 	offset -= win->offset;
 	if (left)
@@ -687,7 +733,9 @@ void unuse_pack(struct pack_window **w_cursor)
 {
 	struct pack_window *w = *w_cursor;
 	if (w) {
+		pack_lock();
 		w->inuse_cnt--;
+		pack_unlock();
 		*w_cursor = NULL;
 	}
 }
@@ -721,6 +769,10 @@ struct packed_git *add_packed_git(const char *path, size_t path_len, int local)
 	if (!access(p->pack_name, F_OK))
 		p->pack_promisor = 1;
 
+	xsnprintf(p->pack_name + path_len, alloc - path_len, ".mtimes");
+	if (!access(p->pack_name, F_OK))
+		p->is_cruft = 1;
+
 	xsnprintf(p->pack_name + path_len, alloc - path_len, ".pack");
 	if (stat(p->pack_name, &st) || !S_ISREG(st.st_mode)) {
 		free(p);
@@ -741,6 +793,7 @@ struct packed_git *add_packed_git(const char *path, size_t path_len, int local)
 
 void install_packed_git(struct repository *r, struct packed_git *pack)
 {
+	pack_lock();
 	if (pack->pack_fd != -1)
 		pack_open_fds++;
 
@@ -749,6 +802,7 @@ void install_packed_git(struct repository *r, struct packed_git *pack)
 
 	hashmap_entry_init(&pack->packmap_ent, strhash(pack->pack_name));
 	hashmap_add(&r->objects->pack_map, &pack->packmap_ent);
+	pack_unlock();
 }
 
 void (*report_garbage)(unsigned seen_bits, const char *path);
@@ -867,11 +921,16 @@ static void prepare_pack(const char *full_name, size_t full_name_len,
 
 	if (!strcmp(file_name, "multi-pack-index"))
 		return;
+	if (starts_with(file_name, "multi-pack-index") &&
+	    ends_with(file_name, ".bitmap"))
+		return;
 	if (ends_with(file_name, ".idx") ||
+	    ends_with(file_name, ".rev") ||
 	    ends_with(file_name, ".pack") ||
 	    ends_with(file_name, ".bitmap") ||
 	    ends_with(file_name, ".keep") ||
-	    ends_with(file_name, ".promisor"))
+	    ends_with(file_name, ".promisor") ||
+	    ends_with(file_name, ".mtimes"))
 		string_list_append(data->garbage, full_name);
 	else
 		report_garbage(PACKDIR_FILE_GARBAGE, full_name);
@@ -990,6 +1049,11 @@ static void prepare_packed_git(struct repository *r)
 	if (r->objects->packed_git_initialized)
 		return;
 
+	/*
+	 * Threads reading packed objects may walk the list of packs to
+	 * find a window or a file descriptor to close.
+	 */
+	pack_lock();
 	prepare_alt_odb(r);
 	for (odb = r->objects->odb; odb; odb = odb->next) {
 		int local = (odb == r->objects->odb);
@@ -1000,6 +1064,7 @@ static void prepare_packed_git(struct repository *r)
 
 	prepare_packed_git_mru(r);
 	r->objects->packed_git_initialized = 1;
+	pack_unlock();
 }
 
 void reprepare_packed_git(struct repository *r)
@@ -1103,11 +1168,12 @@ unsigned long get_size_from_delta(struct packed_git *p,
 		stream.next_in = in;
 		/*
 		 * Note: the window section returned by use_pack() must be
-		 * available throughout git_inflate()'s unlocked execution. To
-		 * ensure no other thread will modify the window in the
-		 * meantime, we rely on the packed_window.inuse_cnt. This
-		 * counter is incremented before window reading and checked
-		 * before window disposal.
+		 * available throughout git_inflate()'s execution, while other
+		 * threads may be using the same pack. To ensure no other
+		 * thread will modify the window in the meantime, we rely on
+		 * the packed_window.inuse_cnt. This counter is incremented
+		 * (under pack_mutex) before window reading and checked before
+		 * window disposal.
 		 *
 		 * Other worrying sections could be the call to close_pack_fd(),
 		 * which can close packs even with in-use windows, and to
@@ -1115,9 +1181,7 @@ unsigned long get_size_from_delta(struct packed_git *p,
 		 * "closing the file descriptor does not unmap the region". And
 		 * for the latter, it won't re-open already available packs.
 		 */
-		obj_read_unlock();
 		st = git_inflate(&stream, Z_FINISH);
-		obj_read_lock();
 		curpos += stream.next_in - in;
 	} while ((st == Z_OK || st == Z_BUF_ERROR) &&
 		 stream.total_out < sizeof(delta_head));
@@ -1169,30 +1233,67 @@ void mark_bad_packed_object(struct packed_git *p, const unsigned char *sha1)
 {
 	unsigned i;
 	const unsigned hashsz = the_hash_algo->rawsz;
+
+	pack_lock();
 	for (i = 0; i < p->num_bad_objects; i++)
 		if (hasheq(sha1, p->bad_object_sha1 + hashsz * i))
-			return;
+			goto out;
 	p->bad_object_sha1 = xrealloc(p->bad_object_sha1,
 				      st_mult(GIT_MAX_RAWSZ,
 					      st_add(p->num_bad_objects, 1)));
 	hashcpy(p->bad_object_sha1 + hashsz * p->num_bad_objects, sha1);
 	p->num_bad_objects++;
+out:
+	pack_unlock();
+}
+
+static int is_bad_packed_object(struct packed_git *p, const unsigned char *sha1)
+{
+	unsigned i;
+	int ret = 0;
+
+	if (!p->num_bad_objects)
+		return 0;
+
+	pack_lock();
+	for (i = 0; i < p->num_bad_objects; i++)
+		if (hasheq(sha1, p->bad_object_sha1 + the_hash_algo->rawsz * i)) {
+			ret = 1;
+			break;
+		}
+	pack_unlock();
+	return ret;
 }
 
 const struct packed_git *has_packed_and_bad(struct repository *r,
 					    const unsigned char *sha1)
 {
 	struct packed_git *p;
-	unsigned i;
 
 	for (p = r->objects->packed_git; p; p = p->next)
-		for (i = 0; i < p->num_bad_objects; i++)
-			if (hasheq(sha1,
-				   p->bad_object_sha1 + the_hash_algo->rawsz * i))
-				return p;
+		if (is_bad_packed_object(p, sha1))
+			return p;
 	return NULL;
 }
 
+/*
+ * Like find_pack_revindex(), but the reverse index is loaded under
+ * pack_mutex, as other threads may be reading from the same pack.
+ */
+static int find_pack_revindex_threadsafe(struct packed_git *p, off_t ofs,
+					 struct revindex_entry *entry,
+					 off_t *next_ofs)
+{
+	int ret;
+
+	pack_lock();
+	ret = load_pack_revindex(p);
+	pack_unlock();
+	if (ret)
+		return -1;
+	return find_pack_revindex(p, ofs, entry, next_ofs);
+}
+
 off_t get_delta_base(struct packed_git *p,
 		     struct pack_window **w_curs,
 		     off_t *curpos,
@@ -1250,18 +1351,17 @@ static int get_delta_base_oid(struct packed_git *p,
 		oidread(oid, base);
 		return 0;
 	} else if (type == OBJ_OFS_DELTA) {
-		struct revindex_entry *revidx;
+		struct revindex_entry revidx;
 		off_t base_offset = get_delta_base(p, w_curs, &curpos,
 						   type, delta_obj_offset);
 
 		if (!base_offset)
 			return -1;
 
-		revidx = find_pack_revindex(p, base_offset);
-		if (!revidx)
+		if (find_pack_revindex_threadsafe(p, base_offset, &revidx, NULL))
 			return -1;
 
-		return nth_packed_object_id(oid, p, revidx->nr);
+		return nth_packed_object_id(oid, p, revidx.nr);
 	} else
 		return -1;
 }
@@ -1271,12 +1371,11 @@ static int retry_bad_packed_offset(struct repository *r,
 				   off_t obj_offset)
 {
 	int type;
-	struct revindex_entry *revidx;
+	struct revindex_entry revidx;
 	struct object_id oid;
-	revidx = find_pack_revindex(p, obj_offset);
-	if (!revidx)
+	if (find_pack_revindex_threadsafe(p, obj_offset, &revidx, NULL))
 		return OBJ_BAD;
-	nth_packed_object_id(&oid, p, revidx->nr);
+	nth_packed_object_id(&oid, p, revidx.nr);
 	mark_bad_packed_object(p, oid.hash);
 	type = oid_object_info(r, &oid, NULL);
 	if (type <= OBJ_NONE)
@@ -1354,10 +1453,23 @@ static enum object_type packed_to_object_type(struct repository *r,
 	goto out;
 }
 
-static struct hashmap delta_base_cache;
-static size_t delta_base_cached;
+/*
+ * The delta base cache is split into shards, each with its own lock and
+ * its own share of delta_base_cache_limit, so that threads unpacking
+ * unrelated objects do not have to wait for each other. Without threads
+ * a single shard is used, which behaves exactly like one global cache.
+ */
+#define DELTA_BASE_CACHE_SHARDS 16
+
+struct delta_base_cache_shard {
+	struct hashmap map;
+	struct list_head lru;
+	size_t cached;
+	pthread_mutex_t mutex;
+};
 
-static LIST_HEAD(delta_base_cache_lru);
+static struct delta_base_cache_shard delta_base_cache[DELTA_BASE_CACHE_SHARDS];
+static unsigned int delta_base_cache_nr = 1;
 
 struct delta_base_cache_key {
 	struct packed_git *p;
@@ -1382,22 +1494,6 @@ static unsigned int pack_entry_hash(struct packed_git *p, off_t base_offset)
 	return hash;
 }
 
-static struct delta_base_cache_entry *
-get_delta_base_cache_entry(struct packed_git *p, off_t base_offset)
-{
-	struct hashmap_entry entry, *e;
-	struct delta_base_cache_key key;
-
-	if (!delta_base_cache.cmpfn)
-		return NULL;
-
-	hashmap_entry_init(&entry, pack_entry_hash(p, base_offset));
-	key.p = p;
-	key.base_offset = base_offset;
-	e = hashmap_get(&delta_base_cache, &entry, &key);
-	return e ? container_of(e, struct delta_base_cache_entry, ent) : NULL;
-}
-
 static int delta_base_cache_key_eq(const struct delta_base_cache_key *a,
 				   const struct delta_base_cache_key *b)
 {
@@ -1421,9 +1517,55 @@ static int delta_base_cache_hash_cmp(const void *unused_cmp_data,
 		return !delta_base_cache_key_eq(&a->key, &b->key);
 }
 
+/*
+ * Find the shard responsible for the given entry and lock it; the caller
+ * must release it with unlock_delta_base_cache().
+ */
+static struct delta_base_cache_shard *
+lock_delta_base_cache(struct packed_git *p, off_t base_offset)
+{
+	unsigned int hash = pack_entry_hash(p, base_offset);
+	struct delta_base_cache_shard *shard;
+
+	shard = &delta_base_cache[hash % delta_base_cache_nr];
+	if (obj_read_use_lock)
+		pthread_mutex_lock(&shard->mutex);
+	if (!shard->map.cmpfn) {
+		hashmap_init(&shard->map, delta_base_cache_hash_cmp, NULL, 0);
+		INIT_LIST_HEAD(&shard->lru);
+	}
+	return shard;
+}
+
+static void unlock_delta_base_cache(struct delta_base_cache_shard *shard)
+{
+	if (obj_read_use_lock)
+		pthread_mutex_unlock(&shard->mutex);
+}
+
+static struct delta_base_cache_entry *
+get_delta_base_cache_entry(struct delta_base_cache_shard *shard,
+			   struct packed_git *p, off_t base_offset)
+{
+	struct hashmap_entry entry, *e;
+	struct delta_base_cache_key key;
+
+	hashmap_entry_init(&entry, pack_entry_hash(p, base_offset));
+	key.p = p;
+	key.base_offset = base_offset;
+	e = hashmap_get(&shard->map, &entry, &key);
+	return e ? container_of(e, struct delta_base_cache_entry, ent) : NULL;
+}
+
 static int in_delta_base_cache(struct packed_git *p, off_t base_offset)
 {
-	return !!get_delta_base_cache_entry(p, base_offset);
+	struct delta_base_cache_shard *shard;
+	int ret;
+
+	shard = lock_delta_base_cache(p, base_offset);
+	ret = !!get_delta_base_cache_entry(shard, p, base_offset);
+	unlock_delta_base_cache(shard);
+	return ret;
 }
 
 /*
@@ -1431,11 +1573,12 @@ static int in_delta_base_cache(struct packed_git *p, off_t base_offset)
  * entry data. The caller takes ownership of the "data" buffer, and
  * should copy out any fields it wants before detaching.
  */
-static void detach_delta_base_cache_entry(struct delta_base_cache_entry *ent)
+static void detach_delta_base_cache_entry(struct delta_base_cache_shard *shard,
+					  struct delta_base_cache_entry *ent)
 {
-	hashmap_remove(&delta_base_cache, &ent->ent, &ent->key);
+	hashmap_remove(&shard->map, &ent->ent, &ent->key);
 	list_del(&ent->lru);
-	delta_base_cached -= ent->size;
+	shard->cached -= ent->size;
 	free(ent);
 }
 
@@ -1443,59 +1586,106 @@ static void *cache_or_unpack_entry(struct repository *r, struct packed_git *p,
 				   off_t base_offset, unsigned long *base_size,
 				   enum object_type *type)
 {
+	struct delta_base_cache_shard *shard;
 	struct delta_base_cache_entry *ent;
+	void *data;
 
-	ent = get_delta_base_cache_entry(p, base_offset);
-	if (!ent)
+	shard = lock_delta_base_cache(p, base_offset);
+	ent = get_delta_base_cache_entry(shard, p, base_offset);
+	if (!ent) {
+		unlock_delta_base_cache(shard);
 		return unpack_entry(r, p, base_offset, type, base_size);
+	}
 
 	if (type)
 		*type = ent->type;
 	if (base_size)
 		*base_size = ent->size;
-	return xmemdupz(ent->data, ent->size);
+	data = xmemdupz(ent->data, ent->size);
+	unlock_delta_base_cache(shard);
+	return data;
 }
 
-static inline void release_delta_base_cache(struct delta_base_cache_entry *ent)
+static inline void release_delta_base_cache(struct delta_base_cache_shard *shard,
+					    struct delta_base_cache_entry *ent)
 {
 	free(ent->data);
-	detach_delta_base_cache_entry(ent);
+	detach_delta_base_cache_entry(shard, ent);
 }
 
 void clear_delta_base_cache(void)
 {
-	struct list_head *lru, *tmp;
-	list_for_each_safe(lru, tmp, &delta_base_cache_lru) {
-		struct delta_base_cache_entry *entry =
-			list_entry(lru, struct delta_base_cache_entry, lru);
-		release_delta_base_cache(entry);
+	int i;
+
+	for (i = 0; i < DELTA_BASE_CACHE_SHARDS; i++) {
+		struct delta_base_cache_shard *shard = &delta_base_cache[i];
+		struct list_head *lru, *tmp;
+
+		if (!shard->map.cmpfn)
+			continue;
+		if (obj_read_use_lock)
+			pthread_mutex_lock(&shard->mutex);
+		list_for_each_safe(lru, tmp, &shard->lru) {
+			struct delta_base_cache_entry *entry =
+				list_entry(lru, struct delta_base_cache_entry, lru);
+			release_delta_base_cache(shard, entry);
+		}
+		if (obj_read_use_lock)
+			pthread_mutex_unlock(&shard->mutex);
 	}
 }
 
+void enable_pack_read_lock(void)
+{
+	int i;
+
+	clear_delta_base_cache();
+	init_recursive_mutex(&pack_mutex);
+	for (i = 0; i < DELTA_BASE_CACHE_SHARDS; i++)
+		pthread_mutex_init(&delta_base_cache[i].mutex, NULL);
+	delta_base_cache_nr = DELTA_BASE_CACHE_SHARDS;
+}
+
+void disable_pack_read_lock(void)
+{
+	int i;
+
+	clear_delta_base_cache();
+	delta_base_cache_nr = 1;
+	for (i = 0; i < DELTA_BASE_CACHE_SHARDS; i++)
+		pthread_mutex_destroy(&delta_base_cache[i].mutex);
+	pthread_mutex_destroy(&pack_mutex);
+}
+
 static void add_delta_base_cache(struct packed_git *p, off_t base_offset,
 	void *base, unsigned long base_size, enum object_type type)
 {
+	struct delta_base_cache_shard *shard;
 	struct delta_base_cache_entry *ent;
 	struct list_head *lru, *tmp;
+	size_t limit = delta_base_cache_limit / delta_base_cache_nr;
+
+	shard = lock_delta_base_cache(p, base_offset);
 
 	/*
 	 * Check required to avoid redundant entries when more than one thread
 	 * is unpacking the same object, in unpack_entry() (since its phases I
 	 * and III might run concurrently across multiple threads).
 	 */
-	if (in_delta_base_cache(p, base_offset)) {
+	if (get_delta_base_cache_entry(shard, p, base_offset)) {
+		unlock_delta_base_cache(shard);
 		free(base);
 		return;
 	}
 
-	delta_base_cached += base_size;
+	shard->cached += base_size;
 
-	list_for_each_safe(lru, tmp, &delta_base_cache_lru) {
+	list_for_each_safe(lru, tmp, &shard->lru) {
 		struct delta_base_cache_entry *f =
 			list_entry(lru, struct delta_base_cache_entry, lru);
-		if (delta_base_cached <= delta_base_cache_limit)
+		if (shard->cached <= limit)
 			break;
-		release_delta_base_cache(f);
+		release_delta_base_cache(shard, f);
 	}
 
 	ent = xmalloc(sizeof(*ent));
@@ -1504,12 +1694,12 @@ static void add_delta_base_cache(struct packed_git *p, off_t base_offset,
 	ent->type = type;
 	ent->data = base;
 	ent->size = base_size;
-	list_add_tail(&ent->lru, &delta_base_cache_lru);
+	list_add_tail(&ent->lru, &shard->lru);
 
-	if (!delta_base_cache.cmpfn)
-		hashmap_init(&delta_base_cache, delta_base_cache_hash_cmp, NULL, 0);
 	hashmap_entry_init(&ent->ent, pack_entry_hash(p, base_offset));
-	hashmap_add(&delta_base_cache, &ent->ent);
+	hashmap_add(&shard->map, &ent->ent);
+
+	unlock_delta_base_cache(shard);
 }
 
 int packed_object_info(struct repository *r, struct packed_git *p,
@@ -1553,8 +1743,14 @@ int packed_object_info(struct repository *r, struct packed_git *p,
 	}
 
 	if (oi->disk_sizep) {
-		struct revindex_entry *revidx = find_pack_revindex(p, obj_offset);
-		*oi->disk_sizep = revidx[1].offset - obj_offset;
+		struct revindex_entry revidx;
+		off_t next_ofs;
+
+		if (find_pack_revindex_threadsafe(p, obj_offset, &revidx, &next_ofs)) {
+			type = OBJ_BAD;
+			goto out;
+		}
+		*oi->disk_sizep = next_ofs - obj_offset;
 	}
 
 	if (oi->typep || oi->type_name) {
@@ -1617,12 +1813,10 @@ static void *unpack_compressed_entry(struct packed_git *p,
 		/*
 		 * Note: we must ensure the window section returned by
 		 * use_pack() will be available throughout git_inflate()'s
-		 * unlocked execution. Please refer to the comment at
+		 * execution. Please refer to the comment at
 		 * get_size_from_delta() to see how this is done.
 		 */
-		obj_read_unlock();
 		st = git_inflate(&stream, Z_FINISH);
-		obj_read_lock();
 		if (!stream.avail_out)
 			break; /* the payload is larger than it should be */
 		curpos += stream.next_in - in;
@@ -1690,24 +1884,34 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 	for (;;) {
 		off_t base_offset;
 		int i;
+		struct delta_base_cache_shard *shard;
 		struct delta_base_cache_entry *ent;
 
-		ent = get_delta_base_cache_entry(p, curpos);
+		shard = lock_delta_base_cache(p, curpos);
+		ent = get_delta_base_cache_entry(shard, p, curpos);
 		if (ent) {
 			type = ent->type;
 			data = ent->data;
 			size = ent->size;
-			detach_delta_base_cache_entry(ent);
+			detach_delta_base_cache_entry(shard, ent);
 			base_from_cache = 1;
-			break;
 		}
+		unlock_delta_base_cache(shard);
+		if (base_from_cache)
+			break;
 
 		if (do_check_packed_object_crc && p->index_version > 1) {
-			struct revindex_entry *revidx = find_pack_revindex(p, obj_offset);
-			off_t len = revidx[1].offset - obj_offset;
-			if (check_pack_crc(p, &w_curs, obj_offset, len, revidx->nr)) {
+			struct revindex_entry revidx;
+			off_t next_ofs, len;
+
+			if (find_pack_revindex_threadsafe(p, obj_offset, &revidx, &next_ofs)) {
+				data = NULL;
+				goto out;
+			}
+			len = next_ofs - obj_offset;
+			if (check_pack_crc(p, &w_curs, obj_offset, len, revidx.nr)) {
 				struct object_id oid;
-				nth_packed_object_id(&oid, p, revidx->nr);
+				nth_packed_object_id(&oid, p, revidx.nr);
 				error("bad packed object CRC for %s",
 				      oid_to_hex(&oid));
 				mark_bad_packed_object(p, oid.hash);
@@ -1790,11 +1994,10 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 			 * This is costly but should happen only in the presence
 			 * of a corrupted pack, and is better than failing outright.
 			 */
-			struct revindex_entry *revidx;
+			struct revindex_entry revidx;
 			struct object_id base_oid;
-			revidx = find_pack_revindex(p, obj_offset);
-			if (revidx) {
-				nth_packed_object_id(&base_oid, p, revidx->nr);
+			if (!find_pack_revindex_threadsafe(p, obj_offset, &revidx, NULL)) {
+				nth_packed_object_id(&base_oid, p, revidx.nr);
 				error("failed to read delta base object %s"
 				      " at offset %"PRIuMAX" from %s",
 				      oid_to_hex(&base_oid), (uintmax_t)obj_offset,
@@ -1839,11 +2042,10 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 
 		/*
 		 * We delay adding `base` to the cache until the end of the loop
-		 * because unpack_compressed_entry() momentarily releases the
-		 * obj_read_mutex, giving another thread the chance to access
-		 * the cache. Therefore, if `base` was already there, this other
-		 * thread could free() it (e.g. to make space for another entry)
-		 * before we are done using it.
+		 * because other threads may access the cache concurrently.
+		 * Therefore, if `base` was already there, another thread could
+		 * free() it (e.g. to make space for another entry) before we
+		 * are done using it.
 		 */
 		if (!external_base)
 			add_delta_base_cache(p, base_obj_offset, base, base_size, type);
@@ -1966,9 +2168,13 @@ off_t find_pack_entry_one(const unsigned char *sha1,
 
 int is_pack_valid(struct packed_git *p)
 {
+	int ret = 1;
+
+	pack_lock();
+
 	/* An already open pack is known to be valid. */
 	if (p->pack_fd != -1)
-		return 1;
+		goto out;
 
 	/* If the pack has one window completely covering the
 	 * file size, the pack is known to be valid even if
@@ -1978,11 +2184,14 @@ int is_pack_valid(struct packed_git *p)
 		struct pack_window *w = p->windows;
 
 		if (!w->offset && w->len == p->pack_size)
-			return 1;
+			goto out;
 	}
 
 	/* Force the pack to open to prove its valid. */
-	return !open_packed_git(p);
+	ret = !open_packed_git(p);
+out:
+	pack_unlock();
+	return ret;
 }
 
 struct packed_git *find_sha1_pack(const unsigned char *sha1,
@@ -2004,13 +2213,8 @@ static int fill_pack_entry(const struct object_id *oid,
 {
 	off_t offset;
 
-	if (p->num_bad_objects) {
-		unsigned i;
-		for (i = 0; i < p->num_bad_objects; i++)
-			if (hasheq(oid->hash,
-				   p->bad_object_sha1 + the_hash_algo->rawsz * i))
-				return 0;
-	}
+	if (is_bad_packed_object(p, oid->hash))
+		return 0;
 
 	offset = find_pack_entry_one(oid->hash, p);
 	if (!offset)
@@ -2085,7 +2289,7 @@ int for_each_object_in_pack(struct packed_git *p,
 		struct object_id oid;
 
 		if (flags & FOR_EACH_OBJECT_PACK_ORDER)
-			pos = p->revindex[i].nr;
+			pos = pack_pos_to_index(p, i);
 		else
 			pos = i;
 
@@ -2114,6 +2318,9 @@ int for_each_packed_object(each_packed_object_fn cb, void *data,
 		if ((flags & FOR_EACH_OBJECT_PROMISOR_ONLY) &&
 		    !p->pack_promisor)
 			continue;
+		if ((flags & FOR_EACH_OBJECT_SKIP_IN_CORE_KEPT_PACKS) &&
+		    p->pack_keep_in_core)
+			continue;
 		if (open_pack_index(p)) {
 			pack_errors = 1;
 			continue;
@@ -94,6 +94,15 @@ void close_pack(struct packed_git *);
 void close_object_store(struct raw_object_store *o);
 void unuse_pack(struct pack_window **);
 void clear_delta_base_cache(void);
+
+/*
+ * Set up (or tear down) the locks that let several threads read packed
+ * objects at once without holding obj_read_mutex. These are called by
+ * enable_obj_read_lock() and disable_obj_read_lock() respectively, while
+ * obj_read_use_lock is unset.
+ */
+void enable_pack_read_lock(void);
+void disable_pack_read_lock(void);
 struct packed_git *add_packed_git(const char *path, size_t path_len, int local);
 
 /*
@@ -0,0 +1,312 @@
+#include "cache.h"
+#include "config.h"
+#include "convert.h"
+#include "object-store.h"
+#include "parallel-checkout.h"
+#include "thread-utils.h"
+
+enum pc_item_status {
+	PC_ITEM_PENDING = 0,
+	PC_ITEM_WRITTEN,
+	/*
+	 * The path was already taken by another entry of the same checkout
+	 * (e.g. a case-insensitive collision), so the entry has to be
+	 * written sequentially to get the same result as a sequential
+	 * checkout.
+	 */
+	PC_ITEM_COLLIDED,
+	/*
+	 * The blob is too large to be read in-core; it is written
+	 * sequentially, which streams it to the file.
+	 */
+	PC_ITEM_TOO_LARGE,
+	PC_ITEM_FAILED,
+};
+
+struct parallel_checkout_item {
+	struct cache_entry *ce;
+	struct conv_attrs ca;
+	enum pc_item_status status;
+	unsigned fstat_done:1;
+	struct stat st;
+};
+
+struct parallel_checkout {
+	enum pc_status status;
+	struct parallel_checkout_item *items;
+	size_t nr, alloc;
+};
+
+static struct parallel_checkout parallel_checkout;
+
+enum pc_status parallel_checkout_status(void)
+{
+	return parallel_checkout.status;
+}
+
+#define DEFAULT_THRESHOLD_FOR_PARALLELISM 100
+
+void get_parallel_checkout_configs(int *num_workers, int *threshold)
+{
+	char *env_workers = getenv("GIT_TEST_CHECKOUT_WORKERS");
+
+	if (env_workers && *env_workers) {
+		if (strtol_i(env_workers, 10, num_workers))
+			die(_("invalid value for '%s': '%s'"),
+			    "GIT_TEST_CHECKOUT_WORKERS", env_workers);
+		if (*num_workers < 1)
+			*num_workers = online_cpus();
+		if (!HAVE_THREADS)
+			*num_workers = 1;
+		*threshold = 0;
+		return;
+	}
+
+	if (git_config_get_int("checkout.workers", num_workers))
+		*num_workers = 1;
+	else if (*num_workers < 1)
+		*num_workers = online_cpus();
+
+	if (!HAVE_THREADS)
+		*num_workers = 1;
+
+	if (git_config_get_int("checkout.thresholdForParallelism", threshold))
+		*threshold = DEFAULT_THRESHOLD_FOR_PARALLELISM;
+}
+
+void init_parallel_checkout(void)
+{
+	if (parallel_checkout.status != PC_UNINITIALIZED)
+		BUG("parallel checkout already initialized");
+
+	parallel_checkout.status = PC_ACCEPTING_ENTRIES;
+}
+
+static void finish_parallel_checkout(void)
+{
+	if (parallel_checkout.status == PC_UNINITIALIZED)
+		BUG("cannot finish parallel checkout: not initialized yet");
+
+	FREE_AND_NULL(parallel_checkout.items);
+	memset(&parallel_checkout, 0, sizeof(parallel_checkout));
+}
+
+int enqueue_checkout(struct cache_entry *ce, const struct conv_attrs *ca)
+{
+	struct parallel_checkout_item *pc_item;
+
+	if (parallel_checkout.status != PC_ACCEPTING_ENTRIES ||
+	    !S_ISREG(ce->ce_mode) || conv_attrs_need_external_filter(ca))
+		return -1;
+
+	ALLOC_GROW(parallel_checkout.items, parallel_checkout.nr + 1,
+		   parallel_checkout.alloc);
+
+	pc_item = &parallel_checkout.items[parallel_checkout.nr++];
+	memset(pc_item, 0, sizeof(*pc_item));
+	pc_item->ce = ce;
+	memcpy(&pc_item->ca, ca, sizeof(pc_item->ca));
+
+	return 0;
+}
+
+/*
+ * Write one queued entry.  This runs in the worker threads, so it only
+ * reads objects through the thread-safe object reading functions and
+ * only touches pc_item; errors are reported but otherwise just recorded
+ * in the item status.
+ */
+static void write_pc_item(struct parallel_checkout_item *pc_item,
+			  const struct checkout *state)
+{
+	struct cache_entry *ce = pc_item->ce;
+	struct checkout_metadata meta;
+	struct strbuf path = STRBUF_INIT;
+	struct strbuf buf = STRBUF_INIT;
+	enum object_type type;
+	unsigned long size;
+	void *blob;
+	int fd;
+
+	strbuf_add(&path, state->base_dir, state->base_dir_len);
+	strbuf_add(&path, ce->name, ce_namelen(ce));
+
+	if (oid_object_info(the_repository, &ce->oid, &size) == OBJ_BLOB &&
+	    size > big_file_threshold) {
+		pc_item->status = PC_ITEM_TOO_LARGE;
+		strbuf_release(&path);
+		return;
+	}
+
+	blob = read_object_file(&ce->oid, &type, &size);
+	if (!blob || type != OBJ_BLOB) {
+		char hex[GIT_MAX_HEXSZ + 1];
+
+		error("unable to read sha1 file of %s (%s)",
+		      path.buf, oid_to_hex_r(hex, &ce->oid));
+		pc_item->status = PC_ITEM_FAILED;
+		goto out;
+	}
+
+	clone_checkout_metadata(&meta, &state->meta, &ce->oid);
+	if (convert_to_working_tree_ca(&pc_item->ca, ce->name, blob, size,
+				       &buf, &meta)) {
+		size_t newsize;
+
+		free(blob);
+		blob = strbuf_detach(&buf, &newsize);
+		size = newsize;
+	}
+
+	fd = open(path.buf, O_WRONLY | O_CREAT | O_EXCL,
+		  (ce->ce_mode & 0100) ? 0777 : 0666);
+	if (fd < 0) {
+		if (errno == EEXIST) {
+			pc_item->status = PC_ITEM_COLLIDED;
+		} else {
+			error_errno("unable to create file %s", path.buf);
+			pc_item->status = PC_ITEM_FAILED;
+		}
+		goto out;
+	}
+
+	if (write_in_full(fd, blob, size) < 0) {
+		error_errno("unable to write file %s", path.buf);
+		close(fd);
+		unlink(path.buf);
+		pc_item->status = PC_ITEM_FAILED;
+		goto out;
+	}
+
+	/* use fstat() only when path == ce->name, as write_entry() does */
+	if (fstat_is_reliable() && state->refresh_cache &&
+	    !state->base_dir_len)
+		pc_item->fstat_done = !fstat(fd, &pc_item->st);
+
+	if (close(fd)) {
+		error_errno("unable to write file %s", path.buf);
+		pc_item->status = PC_ITEM_FAILED;
+		goto out;
+	}
+	pc_item->status = PC_ITEM_WRITTEN;
+
+out:
+	free(blob);
+	strbuf_release(&buf);
+	strbuf_release(&path);
+}
+
+struct pc_worker_data {
+	pthread_t pthread;
+	const struct checkout *state;
+	size_t offset, stride;
+};
+
+static void *pc_worker(void *data_)
+{
+	struct pc_worker_data *data = data_;
+	size_t i;
+
+	/*
+	 * Interleave the items between workers, rather than giving each
+	 * worker a contiguous range, so that a directory full of large
+	 * files does not end up on a single worker.
+	 */
+	for (i = data->offset; i < parallel_checkout.nr; i += data->stride)
+		write_pc_item(&parallel_checkout.items[i], data->state);
+	return NULL;
+}
+
+static void write_items_in_parallel(const struct checkout *state,
+				    int num_workers)
+{
+	struct pc_worker_data *workers;
+	int i, err;
+
+	enable_obj_read_lock();
+
+	CALLOC_ARRAY(workers, num_workers);
+	for (i = 0; i < num_workers; i++) {
+		workers[i].state = state;
+		workers[i].offset = i;
+		workers[i].stride = num_workers;
+		err = pthread_create(&workers[i].pthread, NULL, pc_worker,
+				     &workers[i]);
+		if (err)
+			die(_("unable to create parallel checkout thread: %s"),
+			    strerror(err));
+	}
+	for (i = 0; i < num_workers; i++) {
+		err = pthread_join(workers[i].pthread, NULL);
+		if (err)
+			die(_("unable to join parallel checkout thread: %s"),
+			    strerror(err));
+	}
+	free(workers);
+
+	disable_obj_read_lock();
+}
+
+int run_parallel_checkout(struct checkout *state, int num_workers, int threshold)
+{
+	size_t i;
+	int errs = 0;
+
+	if (parallel_checkout.status != PC_ACCEPTING_ENTRIES)
+		BUG("cannot run parallel checkout: uninitialized or already running");
+
+	parallel_checkout.status = PC_RUNNING;
+
+	if (parallel_checkout.nr < num_workers)
+		num_workers = parallel_checkout.nr;
+
+	trace2_region_enter("checkout", "parallel_checkout", the_repository);
+	if (num_workers <= 1 || parallel_checkout.nr < threshold) {
+		for (i = 0; i < parallel_checkout.nr; i++)
+			write_pc_item(&parallel_checkout.items[i], state);
+	} else {
+		trace2_data_intmax("checkout", the_repository,
+				   "parallel_checkout/workers", num_workers);
+		write_items_in_parallel(state, num_workers);
+	}
+	trace2_region_leave("checkout", "parallel_checkout", the_repository);
+
+	for (i = 0; i < parallel_checkout.nr; i++) {
+		struct parallel_checkout_item *pc_item = &parallel_checkout.items[i];
+
+		switch (pc_item->status) {
+		case PC_ITEM_WRITTEN:
+			errs |= update_ce_after_write(state, pc_item->ce,
+						      pc_item->fstat_done ?
+						      &pc_item->st : NULL);
+			break;
+		case PC_ITEM_COLLIDED:
+		case PC_ITEM_TOO_LARGE:
+			/* handled sequentially below */
+			break;
+		case PC_ITEM_FAILED:
+			errs = 1;
+			break;
+		case PC_ITEM_PENDING:
+			BUG("parallel checkout finished with pending entries");
+		}
+	}
+
+	/*
+	 * Write the remaining entries in index order, the same way
+	 * checkout_entry() would have done without parallel checkout.
+	 * For collided entries, the existing file is removed and replaced
+	 * (and reported as a collision when cloning).
+	 */
+	for (i = 0; i < parallel_checkout.nr; i++) {
+		struct parallel_checkout_item *pc_item = &parallel_checkout.items[i];
+
+		if (pc_item->status != PC_ITEM_COLLIDED &&
+		    pc_item->status != PC_ITEM_TOO_LARGE)
+			continue;
+		errs |= checkout_entry(pc_item->ce, state, NULL, NULL);
+	}
+
+	finish_parallel_checkout();
+	return errs;
+}
@@ -0,0 +1,50 @@
+#ifndef PARALLEL_CHECKOUT_H
+#define PARALLEL_CHECKOUT_H
+
+struct cache_entry;
+struct checkout;
+struct conv_attrs;
+
+enum pc_status {
+	PC_UNINITIALIZED = 0,
+	PC_ACCEPTING_ENTRIES,
+	PC_RUNNING,
+};
+
+enum pc_status parallel_checkout_status(void);
+
+/*
+ * Read checkout.workers and checkout.thresholdForParallelism.  A
+ * num_workers of 1 means the checkout should be done sequentially.
+ */
+void get_parallel_checkout_configs(int *num_workers, int *threshold);
+
+/*
+ * Start accepting entries for parallel checkout.  Entries that cannot be
+ * written concurrently (see enqueue_checkout()) are still checked out
+ * right away by checkout_entry().
+ */
+void init_parallel_checkout(void);
+
+/*
+ * Queue ce to be written by run_parallel_checkout(), with the conversion
+ * attributes ca looked up by the caller.  Returns 0 if the entry was
+ * queued and -1 if it has to be checked out sequentially: only regular
+ * files that need no external smudge or process filter are eligible.
+ * The entry's leading directories must already exist.
+ */
+int enqueue_checkout(struct cache_entry *ce, const struct conv_attrs *ca);
+
+/*
+ * Write all queued entries with up to num_workers threads (sequentially
+ * if fewer than threshold entries were queued), then update their stat
+ * information in the index if state->refresh_cache is set.  Blobs larger
+ * than core.bigFileThreshold, and entries whose path was taken by another
+ * entry in the meantime (e.g. case insensitive collisions), are checked
+ * out sequentially afterwards, so that the outcome matches a sequential
+ * checkout.  Returns non-zero if any
+ * entry could not be written.
+ */
+int run_parallel_checkout(struct checkout *state, int num_workers, int threshold);
+
+#endif /* PARALLEL_CHECKOUT_H */
@@ -131,6 +131,7 @@ static struct common_dir common_list[] = {
 	{ 0, 0, 1, "config" },
 	{ 1, 0, 1, "gc.pid" },
 	{ 0, 0, 1, "packed-refs" },
+	{ 0, 0, 1, "rename-cache" },
 	{ 0, 0, 1, "shallow" },
 	{ 0, 0, 0, NULL }
 };
@@ -3,9 +3,29 @@
 
 struct progress;
 struct rev_info;
+struct object;
+struct packed_git;
 
+/*
+ * Called for each recent object added to the traversal, with the pack
+ * and offset it was found at (NULL and 0 for loose objects) and its
+ * mtime.
+ */
+typedef void report_recent_object_fn(const struct object *obj,
+				     struct packed_git *pack,
+				     off_t offset, time_t mtime);
+
+/*
+ * Add objects younger than "timestamp" that have not been SEEN to the
+ * pending list of "revs". Objects in cruft packs are judged by their own
+ * mtime, other packed objects by the mtime of their pack. When
+ * "ignore_in_core_kept_packs" is set, packs marked as kept in core are
+ * not looked at.
+ */
 int add_unseen_recent_objects_to_traversal(struct rev_info *revs,
-					   timestamp_t timestamp);
+					   timestamp_t timestamp,
+					   report_recent_object_fn *cb,
+					   int ignore_in_core_kept_packs);
 void mark_reachable_objects(struct rev_info *revs, int mark_reflog,
 			    timestamp_t mark_recent, struct progress *);
 
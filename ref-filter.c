@@ -2123,8 +2123,6 @@ static int filter_ref_kind(struct ref_filter *filter, const char *refname)
 struct ref_filter_cbdata {
 	struct ref_array *array;
 	struct ref_filter *filter;
-	struct contains_cache contains_cache;
-	struct contains_cache no_contains_cache;
 };
 
 /*
@@ -2161,23 +2159,16 @@ static int ref_filter_handler(const char *refname, const struct object_id *oid,
 		return 0;
 
 	/*
-	 * A merge filter is applied on refs pointing to commits. Hence
-	 * obtain the commit using the 'oid' available and discard all
-	 * non-commits early. The actual filtering is done later.
+	 * The merge and contains filters are applied on refs pointing
+	 * to commits. Hence obtain the commit using the 'oid' available
+	 * and discard all non-commits early. The actual filtering is
+	 * done later, for all refs at once.
 	 */
 	if (filter->reachable_from || filter->unreachable_from ||
 	    filter->with_commit || filter->no_commit || filter->verbose) {
 		commit = lookup_commit_reference_gently(the_repository, oid, 1);
 		if (!commit)
 			return 0;
-		/* We perform the filtering for the '--contains' option... */
-		if (filter->with_commit &&
-		    !commit_contains(filter, commit, filter->with_commit, &ref_cbdata->contains_cache))
-			return 0;
-		/* ...or for the `--no-contains' option */
-		if (filter->no_commit &&
-		    commit_contains(filter, commit, filter->no_commit, &ref_cbdata->no_contains_cache))
-			return 0;
 	}
 
 	/*
@@ -2231,61 +2222,96 @@ void ref_array_clear(struct ref_array *array)
 
 #define EXCLUDE_REACHED 0
 #define INCLUDE_REACHED 1
-static void reach_filter(struct ref_array *array,
-			 struct commit_list *check_reachable,
-			 int include_reached)
-{
-	struct rev_info revs;
-	int i, old_nr;
-	struct commit **to_clear;
-	struct commit_list *cr;
 
-	if (!check_reachable)
-		return;
-
-	to_clear = xcalloc(sizeof(struct commit *), array->nr);
+/* Remember to update object flag allocation in object.h */
+#define REACHED (1u<<27)
 
-	repo_init_revisions(the_repository, &revs, NULL);
+/*
+ * Keep the items whose commit is (or, with EXCLUDE_REACHED, is not)
+ * marked with REACHED, and clear the mark from 'commits', the commits
+ * of all items.
+ */
+static void filter_reached(struct ref_array *array, struct commit **commits,
+			   int include_reached)
+{
+	int i, old_nr = array->nr;
 
-	for (i = 0; i < array->nr; i++) {
+	array->nr = 0;
+	for (i = 0; i < old_nr; i++) {
 		struct ref_array_item *item = array->items[i];
-		add_pending_object(&revs, &item->commit->object, item->refname);
-		to_clear[i] = item->commit;
-	}
+		int is_reached = !!(item->commit->object.flags & REACHED);
 
-	for (cr = check_reachable; cr; cr = cr->next) {
-		struct commit *merge_commit = cr->item;
-		merge_commit->object.flags |= UNINTERESTING;
-		add_pending_object(&revs, &merge_commit->object, "");
+		if (is_reached == include_reached)
+			array->items[array->nr++] = item;
+		else
+			free_array_item(item);
 	}
 
-	revs.limited = 1;
-	if (prepare_revision_walk(&revs))
-		die(_("revision walk setup failed"));
+	for (i = 0; i < old_nr; i++)
+		commits[i]->object.flags &= ~REACHED;
+}
 
-	old_nr = array->nr;
-	array->nr = 0;
+static struct commit **array_commits(struct ref_array *array)
+{
+	struct commit **commits;
+	int i;
 
-	for (i = 0; i < old_nr; i++) {
-		struct ref_array_item *item = array->items[i];
-		struct commit *commit = item->commit;
+	ALLOC_ARRAY(commits, array->nr);
+	for (i = 0; i < array->nr; i++)
+		commits[i] = array->items[i]->commit;
+	return commits;
+}
 
-		int is_merged = !!(commit->object.flags & UNINTERESTING);
+/*
+ * Filter for "--merged" and "--no-merged": whether the commit of each
+ * ref is reachable from one of 'check_reachable'. All refs are
+ * answered by a single walk from 'check_reachable' in generation
+ * order, which stops as soon as all of them are found or it goes
+ * below the lowest generation among them.
+ */
+static void reach_filter(struct ref_array *array,
+			 struct commit_list *check_reachable,
+			 int include_reached)
+{
+	struct commit **tips, **bases;
+	struct commit_list *cr, *reached;
+	int nr_bases = 0;
 
-		if (is_merged == include_reached)
-			array->items[array->nr++] = array->items[i];
-		else
-			free_array_item(item);
-	}
+	if (!check_reachable)
+		return;
 
-	clear_commit_marks_many(old_nr, to_clear, ALL_REV_FLAGS);
+	tips = array_commits(array);
+	ALLOC_ARRAY(bases, commit_list_count(check_reachable));
+	for (cr = check_reachable; cr; cr = cr->next)
+		bases[nr_bases++] = cr->item;
 
-	while (check_reachable) {
-		struct commit *merge_commit = pop_commit(&check_reachable);
-		clear_commit_marks(merge_commit, ALL_REV_FLAGS);
-	}
+	reached = get_reachable_subset(bases, nr_bases, tips, array->nr,
+				       REACHED);
+	free_commit_list(reached);
+
+	filter_reached(array, tips, include_reached);
+
+	free(bases);
+	free(tips);
+}
+
+/*
+ * Filter for "--contains" and "--no-contains": whether the commit of
+ * each ref can reach one of 'want'. See tips_reaching_bases().
+ */
+static void contains_filter(struct ref_array *array,
+			    struct commit_list *want,
+			    int include_reached)
+{
+	struct commit **tips;
+
+	if (!want)
+		return;
 
-	free(to_clear);
+	tips = array_commits(array);
+	tips_reaching_bases(want, tips, array->nr, REACHED);
+	filter_reached(array, tips, include_reached);
+	free(tips);
 }
 
 /*
@@ -2307,9 +2333,6 @@ int filter_refs(struct ref_array *array, struct ref_filter *filter, unsigned int
 		broken = 1;
 	filter->kind = type & FILTER_REFS_KIND_MASK;
 
-	init_contains_cache(&ref_cbdata.contains_cache);
-	init_contains_cache(&ref_cbdata.no_contains_cache);
-
 	/*  Simple per-ref filtering */
 	if (!filter->kind)
 		die("filter_refs: invalid type");
@@ -2332,10 +2355,9 @@ int filter_refs(struct ref_array *array, struct ref_filter *filter, unsigned int
 			head_ref(ref_filter_handler, &ref_cbdata);
 	}
 
-	clear_contains_cache(&ref_cbdata.contains_cache);
-	clear_contains_cache(&ref_cbdata.no_contains_cache);
-
 	/*  Filters that need revision walking */
+	contains_filter(array, filter->with_commit, INCLUDE_REACHED);
+	contains_filter(array, filter->no_commit, EXCLUDE_REACHED);
 	reach_filter(array, filter->reachable_from, INCLUDE_REACHED);
 	reach_filter(array, filter->unreachable_from, EXCLUDE_REACHED);
 
@@ -1752,12 +1752,15 @@ static struct ref_store *lookup_ref_store_map(struct hashmap *map,
  * gitdir.
  */
 static struct ref_store *ref_store_init(const char *gitdir,
+					const char *be_name,
 					unsigned int flags)
 {
-	const char *be_name = "files";
-	struct ref_storage_be *be = find_ref_storage_backend(be_name);
+	struct ref_storage_be *be;
 	struct ref_store *refs;
 
+	if (!be_name)
+		be_name = "files";
+	be = find_ref_storage_backend(be_name);
 	if (!be)
 		BUG("reference backend %s is unknown", be_name);
 
@@ -1773,7 +1776,8 @@ struct ref_store *get_main_ref_store(struct repository *r)
 	if (!r->gitdir)
 		BUG("attempting to get main_ref_store outside of repository");
 
-	r->refs_private = ref_store_init(r->gitdir, REF_STORE_ALL_CAPS);
+	r->refs_private = ref_store_init(r->gitdir, r->ref_storage_format,
+					 REF_STORE_ALL_CAPS);
 	r->refs_private = maybe_debug_wrap_ref_store(r->gitdir, r->refs_private);
 	return r->refs_private;
 }
@@ -1797,6 +1801,26 @@ static void register_ref_store_map(struct hashmap *map,
 		BUG("%s ref_store '%s' initialized twice", type, name);
 }
 
+/*
+ * Return the reference storage format of the submodule repository in
+ * `gitdir`, or NULL for the default.
+ */
+static const char *submodule_ref_storage_format(const char *gitdir)
+{
+	struct repository_format format = REPOSITORY_FORMAT_INIT;
+	struct strbuf sb = STRBUF_INIT;
+	const char *ret = NULL;
+
+	get_common_dir_noenv(&sb, gitdir);
+	strbuf_addstr(&sb, "/config");
+	read_repository_format(&format, sb.buf);
+	if (format.version >= 1 && format.ref_storage_format)
+		ret = find_ref_storage_backend(format.ref_storage_format)->name;
+	clear_repository_format(&format);
+	strbuf_release(&sb);
+	return ret;
+}
+
 struct ref_store *get_submodule_ref_store(const char *submodule)
 {
 	struct strbuf submodule_sb = STRBUF_INIT;
@@ -1830,6 +1854,7 @@ struct ref_store *get_submodule_ref_store(const char *submodule)
 
 	/* assume that add_submodule_odb() has been called */
 	refs = ref_store_init(submodule_sb.buf,
+			      submodule_ref_storage_format(submodule_sb.buf),
 			      REF_STORE_READ | REF_STORE_ODB);
 	register_ref_store_map(&submodule_ref_stores, "submodule",
 			       refs, submodule);
@@ -1856,9 +1881,11 @@ struct ref_store *get_worktree_ref_store(const struct worktree *wt)
 
 	if (wt->id)
 		refs = ref_store_init(git_common_path("worktrees/%s", wt->id),
+				      the_repository->ref_storage_format,
 				      REF_STORE_ALL_CAPS);
 	else
 		refs = ref_store_init(get_git_common_dir(),
+				      the_repository->ref_storage_format,
 				      REF_STORE_ALL_CAPS);
 
 	if (refs)
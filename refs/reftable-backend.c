@@ -0,0 +1,1697 @@
+#include "../cache.h"
+#include "../config.h"
+#include "../refs.h"
+#include "refs-internal.h"
+#include "reftable.h"
+#include "../iterator.h"
+#include "../lockfile.h"
+#include "../object.h"
+#include "../dir.h"
+
+/*
+ * The reftable backend keeps the references and their reflogs in
+ * stacks of reftables (see reftable.h). The references shared by all
+ * worktrees live in "$GIT_COMMON_DIR/reftable"; HEAD and the other
+ * per-worktree references of a linked worktree live in the
+ * "reftable" directory of its own $GIT_DIR. The main worktree keeps
+ * them in the common stack.
+ *
+ * Pseudorefs other than HEAD (ORIG_HEAD, CHERRY_PICK_HEAD and
+ * friends) are transient, and quite a bit of code reads or writes
+ * them as files, so they are still stored in $GIT_DIR through a
+ * "files" ref store.
+ */
+
+/*
+ * Used as a flag in ref_update::flags when the reference should be
+ * deleted.
+ */
+#define REF_DELETING (1 << 5)
+
+/*
+ * Used as a flag in ref_update::flags when the reference has to be
+ * written to the new table.
+ */
+#define REF_NEEDS_COMMIT (1 << 6)
+
+/*
+ * Used as a flag in ref_update::flags when we want to log a ref
+ * update but not actually perform it. Set for the updates of
+ * references pointed to by HEAD, see split_symref_update().
+ */
+#define REF_UPDATE_VIA_HEAD (1 << 8)
+
+struct reftable_ref_store {
+	struct ref_store base;
+	unsigned int store_flags;
+
+	/* absolute, as are the directories of the stacks */
+	char *gitcommondir;
+
+	struct reftable_stack *worktree_stack;
+	struct reftable_stack *common_stack;
+
+	/* all stacks we looked at, by directory */
+	struct string_list stacks;
+
+	/* the pseudorefs other than HEAD */
+	struct ref_store *files;
+};
+
+static struct reftable_stack *get_stack(struct reftable_ref_store *refs,
+					const char *gitdir)
+{
+	struct strbuf dir = STRBUF_INIT;
+	struct string_list_item *item;
+
+	strbuf_addf(&dir, "%s/reftable", gitdir);
+	item = string_list_insert(&refs->stacks, dir.buf);
+	if (!item->util) {
+		struct reftable_stack *st;
+
+		st = reftable_stack_new(dir.buf, the_hash_algo);
+		st->lock_timeout_ms = get_files_ref_lock_timeout_ms();
+		item->util = st;
+	}
+	strbuf_release(&dir);
+	return item->util;
+}
+
+static struct ref_store *reftable_ref_store_create(const char *gitdir,
+						   unsigned int flags)
+{
+	struct reftable_ref_store *refs = xcalloc(1, sizeof(*refs));
+	struct ref_store *ref_store = (struct ref_store *)refs;
+	struct strbuf sb = STRBUF_INIT;
+	char *abs_gitdir;
+
+	ref_store->gitdir = xstrdup(gitdir);
+	base_ref_store_init(ref_store, &refs_be_reftable);
+	refs->store_flags = flags;
+	string_list_init(&refs->stacks, 1);
+
+	get_common_dir_noenv(&sb, gitdir);
+	refs->gitcommondir = absolute_pathdup(sb.buf);
+	strbuf_release(&sb);
+
+	abs_gitdir = absolute_pathdup(gitdir);
+	refs->common_stack = get_stack(refs, refs->gitcommondir);
+	refs->worktree_stack = get_stack(refs, abs_gitdir);
+	free(abs_gitdir);
+
+	refs->files = refs_be_files.init(gitdir, flags);
+
+	return ref_store;
+}
+
+static struct reftable_ref_store *reftable_downcast(struct ref_store *ref_store,
+						    unsigned int required_flags,
+						    const char *caller)
+{
+	struct reftable_ref_store *refs;
+
+	if (ref_store->be != &refs_be_reftable)
+		BUG("ref_store is type \"%s\" not \"reftable\" in %s",
+		    ref_store->be->name, caller);
+
+	refs = (struct reftable_ref_store *)ref_store;
+
+	if ((refs->store_flags & required_flags) != required_flags)
+		BUG("operation %s requires abilities 0x%x, but only have 0x%x",
+		    caller, required_flags, refs->store_flags);
+
+	return refs;
+}
+
+/*
+ * Return the stack holding `refname` and set `*name` to the name the
+ * reference is stored under in there. Return NULL for the pseudorefs
+ * that are kept as files.
+ */
+static struct reftable_stack *stack_for(struct reftable_ref_store *refs,
+					const char *refname, const char **name)
+{
+	struct reftable_stack *st;
+	struct strbuf sb = STRBUF_INIT;
+	const char *id, *slash;
+
+	*name = refname;
+	switch (ref_type(refname)) {
+	case REF_TYPE_PER_WORKTREE:
+		return refs->worktree_stack;
+	case REF_TYPE_PSEUDOREF:
+		return strcmp(refname, "HEAD") ? NULL : refs->worktree_stack;
+	case REF_TYPE_MAIN_PSEUDOREF:
+		skip_prefix(refname, "main-worktree/", name);
+		return strcmp(*name, "HEAD") ? NULL : refs->common_stack;
+	case REF_TYPE_OTHER_PSEUDOREF:
+		if (!skip_prefix(refname, "worktrees/", &id) ||
+		    !(slash = strchr(id, '/')))
+			BUG("unexpected worktree ref '%s'", refname);
+		*name = slash + 1;
+		if (strcmp(*name, "HEAD"))
+			return NULL;
+		strbuf_addf(&sb, "%s/worktrees/%.*s", refs->gitcommondir,
+			    (int)(slash - id), id);
+		st = get_stack(refs, sb.buf);
+		strbuf_release(&sb);
+		return st;
+	default:
+		return refs->common_stack;
+	}
+}
+
+static int reftable_read_raw_ref(struct ref_store *ref_store,
+				 const char *refname, struct object_id *oid,
+				 struct strbuf *referent, unsigned int *type)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ, "read_raw_ref");
+	struct reftable_ref_record rec = { NULL };
+	struct reftable_stack *st;
+	const char *name;
+	int ret;
+
+	st = stack_for(refs, refname, &name);
+	if (!st)
+		return refs_read_raw_ref(refs->files, refname, oid,
+					 referent, type);
+
+	*type = 0;
+	ret = reftable_stack_read_ref(st, name, &rec);
+	if (ret) {
+		errno = ret < 0 ? EIO : ENOENT;
+		return -1;
+	}
+
+	if (rec.value_type == REFTABLE_REF_SYMREF) {
+		strbuf_reset(referent);
+		strbuf_addstr(referent, rec.target);
+		*type |= REF_ISSYMREF;
+	} else {
+		oidcpy(oid, &rec.value);
+	}
+	reftable_ref_record_release(&rec);
+	return 0;
+}
+
+static int stack_reflog_exists(struct reftable_stack *st, const char *name)
+{
+	struct reftable_iterator it;
+	struct reftable_log_record log = { NULL };
+	int ret;
+
+	if (reftable_stack_init_log_iterator(st, &it, name))
+		return 0;
+	ret = !reftable_iterator_next_log(&it, &log) &&
+		!strcmp(log.refname, name);
+	reftable_log_record_release(&log);
+	reftable_iterator_release(&it);
+	return ret;
+}
+
+/*
+ * Whether an update of `name` in `st` should be logged; see
+ * files_log_ref_write().
+ */
+static int should_write_log(struct reftable_stack *st, const char *name,
+			    unsigned int flags)
+{
+	if (log_all_ref_updates == LOG_REFS_UNSET)
+		log_all_ref_updates = is_bare_repository() ? LOG_REFS_NONE : LOG_REFS_NORMAL;
+
+	return (flags & REF_FORCE_CREATE_REFLOG) ||
+		should_autocreate_reflog(name) ||
+		stack_reflog_exists(st, name);
+}
+
+static void add_log_entry(struct reftable_addition *add, const char *name,
+			  const struct object_id *old_oid,
+			  const struct object_id *new_oid, const char *msg)
+{
+	struct reftable_log_record log = { NULL };
+	const char *info = git_committer_info(0);
+	struct ident_split ident;
+
+	log.refname = (char *)name;
+	log.update_index = add->update_index;
+	oidcpy(&log.old_oid, old_oid);
+	oidcpy(&log.new_oid, new_oid);
+	if (!split_ident_line(&ident, info, strlen(info))) {
+		log.name = xmemdupz(ident.name_begin,
+				    ident.name_end - ident.name_begin);
+		log.email = xmemdupz(ident.mail_begin,
+				     ident.mail_end - ident.mail_begin);
+		if (ident.date_begin)
+			log.time = parse_timestamp(ident.date_begin, NULL, 10);
+		if (ident.tz_begin)
+			log.tz = atoi(ident.tz_begin);
+	}
+	log.message = (char *)(msg ? msg : "");
+
+	reftable_addition_add_log(add, &log);
+	free(log.name);
+	free(log.email);
+}
+
+/*
+ * A reflog without entries is kept as a marker entry with update
+ * index 0, which readers skip.
+ */
+static int is_reflog_marker(const struct reftable_log_record *log)
+{
+	return !log->update_index;
+}
+
+static void add_reflog_marker(struct reftable_addition *add, const char *name)
+{
+	struct reftable_log_record log = { NULL };
+
+	log.refname = (char *)name;
+	log.name = log.email = log.message = (char *)"";
+	reftable_addition_add_log(add, &log);
+}
+
+/*
+ * Read all entries of the reflog of `name`, newest first. Returns the
+ * number of entries, or -1 on errors.
+ */
+static ssize_t read_reflog(struct reftable_stack *st, const char *name,
+			   struct reftable_log_record **logs)
+{
+	struct reftable_iterator it;
+	struct reftable_log_record log = { NULL };
+	size_t nr = 0, alloc = 0;
+	int ret;
+
+	*logs = NULL;
+	if (reftable_stack_init_log_iterator(st, &it, name))
+		return -1;
+	while (!(ret = reftable_iterator_next_log(&it, &log))) {
+		if (strcmp(log.refname, name))
+			break;
+		ALLOC_GROW(*logs, nr + 1, alloc);
+		memset(&(*logs)[nr], 0, sizeof(**logs));
+		reftable_log_record_copy(&(*logs)[nr++], &log);
+	}
+	reftable_log_record_release(&log);
+	reftable_iterator_release(&it);
+	return ret < 0 ? -1 : nr;
+}
+
+static void free_reflog(struct reftable_log_record *logs, ssize_t nr)
+{
+	ssize_t i;
+
+	for (i = 0; i < nr; i++)
+		reftable_log_record_release(&logs[i]);
+	free(logs);
+}
+
+/* Hide all entries of the reflog of `name` with tombstones. */
+static int delete_reflog_entries(struct reftable_addition *add,
+				 const char *name)
+{
+	struct reftable_log_record *logs;
+	ssize_t i, nr = read_reflog(add->stack, name, &logs);
+
+	if (nr < 0)
+		return -1;
+	for (i = 0; i < nr; i++) {
+		struct reftable_log_record tombstone = { NULL };
+
+		tombstone.refname = logs[i].refname;
+		tombstone.update_index = logs[i].update_index;
+		tombstone.deletion = 1;
+		reftable_addition_add_log(add, &tombstone);
+	}
+	free_reflog(logs, nr);
+	return 0;
+}
+
+static void set_ref_value(struct reftable_addition *add, const char *name,
+			  const struct object_id *oid)
+{
+	struct reftable_ref_record rec = { NULL };
+
+	rec.refname = (char *)name;
+	rec.update_index = add->update_index;
+	oidcpy(&rec.value, oid);
+	if (!peel_object(oid, &rec.peeled))
+		rec.value_type = REFTABLE_REF_VAL2;
+	else
+		rec.value_type = REFTABLE_REF_VAL1;
+	reftable_addition_add_ref(add, &rec);
+}
+
+static void delete_ref_value(struct reftable_addition *add, const char *name)
+{
+	struct reftable_ref_record rec = { NULL };
+
+	rec.refname = (char *)name;
+	rec.update_index = add->update_index;
+	rec.value_type = REFTABLE_REF_DELETION;
+	reftable_addition_add_ref(add, &rec);
+}
+
+struct reftable_ref_iterator {
+	struct ref_iterator base;
+	struct reftable_ref_store *refs;
+	struct reftable_iterator iter;
+	struct reftable_ref_record rec;
+	struct object_id oid;
+	char *prefix;
+	unsigned int flags;
+	/* whether to leave out the per-worktree references */
+	int common_only;
+};
+
+static int reftable_ref_iterator_advance(struct ref_iterator *ref_iterator)
+{
+	struct reftable_ref_iterator *iter =
+		(struct reftable_ref_iterator *)ref_iterator;
+	int ret;
+
+	while (!(ret = reftable_iterator_next_ref(&iter->iter, &iter->rec))) {
+		const char *refname = iter->rec.refname;
+		int flags = 0;
+
+		if (!starts_with(refname, iter->prefix))
+			break;
+		if (!starts_with(refname, "refs/"))
+			continue;
+		if ((iter->flags & DO_FOR_EACH_PER_WORKTREE_ONLY) &&
+		    ref_type(refname) != REF_TYPE_PER_WORKTREE)
+			continue;
+		if (iter->common_only &&
+		    ref_type(refname) == REF_TYPE_PER_WORKTREE)
+			continue;
+
+		if (iter->rec.value_type == REFTABLE_REF_SYMREF) {
+			flags |= REF_ISSYMREF;
+			if (!refs_resolve_ref_unsafe(&iter->refs->base, refname,
+						     RESOLVE_REF_READING,
+						     &iter->oid, NULL)) {
+				oidclr(&iter->oid);
+				flags |= REF_ISBROKEN;
+			}
+		} else {
+			oidcpy(&iter->oid, &iter->rec.value);
+		}
+
+		if (check_refname_format(refname, REFNAME_ALLOW_ONELEVEL)) {
+			oidclr(&iter->oid);
+			flags |= REF_BAD_NAME | REF_ISBROKEN;
+		}
+
+		if (!(iter->flags & DO_FOR_EACH_INCLUDE_BROKEN) &&
+		    !ref_resolves_to_object(refname, &iter->oid, flags))
+			continue;
+
+		iter->base.refname = refname;
+		iter->base.oid = &iter->oid;
+		iter->base.flags = flags;
+		return ITER_OK;
+	}
+
+	if (ref_iterator_abort(ref_iterator) != ITER_DONE || ret < 0)
+		return ITER_ERROR;
+	return ITER_DONE;
+}
+
+static int reftable_ref_iterator_peel(struct ref_iterator *ref_iterator,
+				      struct object_id *peeled)
+{
+	struct reftable_ref_iterator *iter =
+		(struct reftable_ref_iterator *)ref_iterator;
+
+	if (iter->rec.value_type == REFTABLE_REF_VAL2) {
+		oidcpy(peeled, &iter->rec.peeled);
+		return 0;
+	}
+	return peel_object(&iter->oid, peeled) ? -1 : 0;
+}
+
+static int reftable_ref_iterator_abort(struct ref_iterator *ref_iterator)
+{
+	struct reftable_ref_iterator *iter =
+		(struct reftable_ref_iterator *)ref_iterator;
+
+	reftable_iterator_release(&iter->iter);
+	reftable_ref_record_release(&iter->rec);
+	free(iter->prefix);
+	base_ref_iterator_free(ref_iterator);
+	return ITER_DONE;
+}
+
+static struct ref_iterator_vtable reftable_ref_iterator_vtable = {
+	reftable_ref_iterator_advance,
+	reftable_ref_iterator_peel,
+	reftable_ref_iterator_abort
+};
+
+static struct ref_iterator *stack_ref_iterator_begin(
+		struct reftable_ref_store *refs, struct reftable_stack *st,
+		const char *prefix, unsigned int flags, int common_only)
+{
+	struct reftable_ref_iterator *iter;
+
+	iter = xcalloc(1, sizeof(*iter));
+	base_ref_iterator_init(&iter->base, &reftable_ref_iterator_vtable, 1);
+	iter->refs = refs;
+	iter->prefix = xstrdup(prefix);
+	iter->flags = flags;
+	iter->common_only = common_only;
+	if (reftable_stack_init_ref_iterator(st, &iter->iter, prefix) < 0) {
+		error(_("unable to read references from '%s'"), st->dir);
+		memset(&iter->iter, 0, sizeof(iter->iter));
+	}
+	return &iter->base;
+}
+
+static struct ref_iterator *reftable_ref_iterator_begin(
+		struct ref_store *ref_store,
+		const char *prefix, unsigned int flags)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ, "ref_iterator_begin");
+	struct ref_iterator *worktree_iter, *common_iter;
+
+	if (refs->worktree_stack == refs->common_stack)
+		return stack_ref_iterator_begin(refs, refs->common_stack,
+						prefix, flags, 0);
+
+	worktree_iter = stack_ref_iterator_begin(refs, refs->worktree_stack,
+						 prefix, flags, 0);
+	if (flags & DO_FOR_EACH_PER_WORKTREE_ONLY)
+		return worktree_iter;
+	common_iter = stack_ref_iterator_begin(refs, refs->common_stack,
+					       prefix, flags, 1);
+	return overlay_ref_iterator_begin(worktree_iter, common_iter);
+}
+
+struct reftable_update_data {
+	struct reftable_stack *stack;
+	const char *name;
+	int exists;
+	struct object_id old_oid;
+};
+
+struct reftable_transaction_data {
+	/* one addition for each stack we write to */
+	struct reftable_addition **additions;
+	size_t additions_nr, additions_alloc;
+
+	/* the updates of pseudorefs kept as files */
+	struct ref_transaction *files_transaction;
+};
+
+static struct reftable_addition *get_addition(struct reftable_transaction_data *data,
+					      struct reftable_stack *st,
+					      struct strbuf *err)
+{
+	struct reftable_addition *add;
+	size_t i;
+
+	for (i = 0; i < data->additions_nr; i++)
+		if (data->additions[i]->stack == st)
+			return data->additions[i];
+
+	add = reftable_stack_new_addition(st, err);
+	if (!add)
+		return NULL;
+	ALLOC_GROW(data->additions, data->additions_nr + 1,
+		   data->additions_alloc);
+	data->additions[data->additions_nr++] = add;
+	return add;
+}
+
+static void reftable_transaction_cleanup(struct reftable_ref_store *refs,
+					 struct ref_transaction *transaction)
+{
+	struct reftable_transaction_data *data = transaction->backend_data;
+	size_t i;
+
+	for (i = 0; i < transaction->nr; i++)
+		FREE_AND_NULL(transaction->updates[i]->backend_data);
+
+	if (data) {
+		for (i = 0; i < data->additions_nr; i++)
+			reftable_addition_abort(data->additions[i]);
+		free(data->additions);
+		if (data->files_transaction) {
+			struct ref_transaction *files_transaction =
+				data->files_transaction;
+
+			if (files_transaction->state == REF_TRANSACTION_PREPARED)
+				refs->files->be->transaction_abort(refs->files,
+								   files_transaction,
+								   NULL);
+			ref_transaction_free(files_transaction);
+		}
+		FREE_AND_NULL(transaction->backend_data);
+	}
+
+	transaction->state = REF_TRANSACTION_CLOSED;
+}
+
+static const char *original_update_refname(struct ref_update *update)
+{
+	while (update->parent_update)
+		update = update->parent_update;
+
+	return update->refname;
+}
+
+static int check_old_oid(struct ref_update *update, struct object_id *oid,
+			 struct strbuf *err)
+{
+	if (!(update->flags & REF_HAVE_OLD) ||
+		   oideq(oid, &update->old_oid))
+		return 0;
+
+	if (is_null_oid(&update->old_oid))
+		strbuf_addf(err, "cannot lock ref '%s': "
+			    "reference already exists",
+			    original_update_refname(update));
+	else if (is_null_oid(oid))
+		strbuf_addf(err, "cannot lock ref '%s': "
+			    "reference is missing but expected %s",
+			    original_update_refname(update),
+			    oid_to_hex(&update->old_oid));
+	else
+		strbuf_addf(err, "cannot lock ref '%s': "
+			    "is at %s but expected %s",
+			    original_update_refname(update),
+			    oid_to_hex(oid),
+			    oid_to_hex(&update->old_oid));
+
+	return -1;
+}
+
+static int check_new_object(struct ref_update *update, struct strbuf *err)
+{
+	struct object *o = parse_object(the_repository, &update->new_oid);
+
+	if (!o)
+		strbuf_addf(err, "cannot update ref '%s': "
+			    "trying to write ref '%s' with nonexistent object %s",
+			    update->refname, update->refname,
+			    oid_to_hex(&update->new_oid));
+	else if (o->type != OBJ_COMMIT && is_branch(update->refname))
+		strbuf_addf(err, "cannot update ref '%s': "
+			    "trying to write non-commit object %s to branch '%s'",
+			    update->refname, oid_to_hex(&update->new_oid),
+			    update->refname);
+	else
+		return 0;
+	return -1;
+}
+
+/*
+ * If update is a direct update of head_ref (the reference pointed to
+ * by HEAD), then add an extra REF_LOG_ONLY update for HEAD.
+ */
+static int split_head_update(struct ref_update *update,
+			     struct ref_transaction *transaction,
+			     const char *head_ref,
+			     struct string_list *affected_refnames,
+			     struct strbuf *err)
+{
+	struct string_list_item *item;
+	struct ref_update *new_update;
+
+	if ((update->flags & REF_LOG_ONLY) ||
+	    (update->flags & REF_UPDATE_VIA_HEAD))
+		return 0;
+
+	if (strcmp(update->refname, head_ref))
+		return 0;
+
+	if (string_list_has_string(affected_refnames, "HEAD")) {
+		strbuf_addf(err,
+			    "multiple updates for 'HEAD' (including one "
+			    "via its referent '%s') are not allowed",
+			    update->refname);
+		return TRANSACTION_NAME_CONFLICT;
+	}
+
+	new_update = ref_transaction_add_update(
+			transaction, "HEAD",
+			update->flags | REF_LOG_ONLY | REF_NO_DEREF,
+			&update->new_oid, &update->old_oid,
+			update->msg);
+
+	item = string_list_insert(affected_refnames, new_update->refname);
+	item->util = new_update;
+
+	return 0;
+}
+
+/*
+ * update is for a symref that points at referent and doesn't have
+ * REF_NO_DEREF set. Split it into a REF_LOG_ONLY update of the symref
+ * and a separate update for the referent, which is processed (and
+ * maybe split again) later in the loop.
+ */
+static int split_symref_update(struct ref_update *update,
+			       const char *referent,
+			       struct ref_transaction *transaction,
+			       struct string_list *affected_refnames,
+			       struct strbuf *err)
+{
+	struct string_list_item *item;
+	struct ref_update *new_update;
+	unsigned int new_flags;
+
+	if (string_list_has_string(affected_refnames, referent)) {
+		strbuf_addf(err,
+			    "multiple updates for '%s' (including one "
+			    "via symref '%s') are not allowed",
+			    referent, update->refname);
+		return TRANSACTION_NAME_CONFLICT;
+	}
+
+	new_flags = update->flags;
+	if (!strcmp(update->refname, "HEAD"))
+		new_flags |= REF_UPDATE_VIA_HEAD;
+
+	new_update = ref_transaction_add_update(
+			transaction, referent, new_flags,
+			&update->new_oid, &update->old_oid,
+			update->msg);
+
+	new_update->parent_update = update;
+
+	update->flags |= REF_LOG_ONLY | REF_NO_DEREF;
+	update->flags &= ~REF_HAVE_OLD;
+
+	item = string_list_insert(affected_refnames, new_update->refname);
+	if (item->util)
+		BUG("%s unexpectedly found in affected_refnames",
+		    new_update->refname);
+	item->util = new_update;
+
+	return 0;
+}
+
+/*
+ * Lock the stack of the reference that `update` is about, read its
+ * current value and check it; see lock_ref_for_update() in the files
+ * backend.
+ */
+static int prepare_update(struct reftable_ref_store *refs,
+			  struct ref_transaction *transaction,
+			  struct ref_update *update,
+			  const char *head_ref,
+			  struct string_list *affected_refnames,
+			  struct strbuf *err)
+{
+	struct reftable_transaction_data *data = transaction->backend_data;
+	struct reftable_ref_record rec = { NULL };
+	struct reftable_update_data *ud;
+	struct reftable_stack *st;
+	const char *name;
+	int mustexist = (update->flags & REF_HAVE_OLD) &&
+		!is_null_oid(&update->old_oid);
+	int ret = 0;
+
+	if ((update->flags & REF_HAVE_NEW) && is_null_oid(&update->new_oid))
+		update->flags |= REF_DELETING;
+
+	if (head_ref) {
+		ret = split_head_update(update, transaction, head_ref,
+					affected_refnames, err);
+		if (ret)
+			return ret;
+	}
+
+	st = stack_for(refs, update->refname, &name);
+	if (!st) {
+		if (!data->files_transaction) {
+			data->files_transaction =
+				ref_store_transaction_begin(refs->files, err);
+			if (!data->files_transaction)
+				return TRANSACTION_GENERIC_ERROR;
+		}
+		ref_transaction_add_update(data->files_transaction,
+					   update->refname,
+					   update->flags & (REF_TRANSACTION_UPDATE_ALLOWED_FLAGS |
+							    REF_HAVE_NEW | REF_HAVE_OLD),
+					   &update->new_oid, &update->old_oid,
+					   update->msg);
+		return 0;
+	}
+
+	if (!get_addition(data, st, err)) {
+		char *reason = strbuf_detach(err, NULL);
+
+		strbuf_addf(err, "cannot lock ref '%s': %s",
+			    original_update_refname(update), reason);
+		free(reason);
+		return TRANSACTION_GENERIC_ERROR;
+	}
+
+	ud = xcalloc(1, sizeof(*ud));
+	ud->stack = st;
+	ud->name = name;
+	update->backend_data = ud;
+
+	ret = reftable_stack_read_ref(st, name, &rec);
+	if (ret < 0) {
+		strbuf_addf(err, "cannot lock ref '%s': error reading reference",
+			    original_update_refname(update));
+		return TRANSACTION_GENERIC_ERROR;
+	}
+	ud->exists = !ret;
+	ret = 0;
+
+	if (!ud->exists) {
+		if (mustexist) {
+			strbuf_addf(err, "cannot lock ref '%s': "
+				    "unable to resolve reference '%s'",
+				    original_update_refname(update),
+				    update->refname);
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto out;
+		}
+		if (!(update->flags & REF_DELETING) &&
+		    refs_verify_refname_available(&refs->base, update->refname,
+						  affected_refnames, NULL, err)) {
+			char *reason = strbuf_detach(err, NULL);
+
+			strbuf_addf(err, "cannot lock ref '%s': %s",
+				    original_update_refname(update), reason);
+			free(reason);
+			ret = TRANSACTION_NAME_CONFLICT;
+			goto out;
+		}
+	}
+
+	update->type = 0;
+	if (ud->exists && rec.value_type == REFTABLE_REF_SYMREF) {
+		update->type |= REF_ISSYMREF;
+		if (update->flags & REF_NO_DEREF) {
+			/*
+			 * We won't be reading the referent as part of
+			 * the transaction, so we have to read it here
+			 * to record and possibly check old_oid:
+			 */
+			if (refs_read_ref_full(&refs->base, rec.target, 0,
+					       &ud->old_oid, NULL)) {
+				if (update->flags & REF_HAVE_OLD) {
+					strbuf_addf(err, "cannot lock ref '%s': "
+						    "error reading reference",
+						    original_update_refname(update));
+					ret = TRANSACTION_GENERIC_ERROR;
+					goto out;
+				}
+			} else if (check_old_oid(update, &ud->old_oid, err)) {
+				ret = TRANSACTION_GENERIC_ERROR;
+				goto out;
+			}
+		} else {
+			ret = split_symref_update(update, rec.target,
+						  transaction,
+						  affected_refnames, err);
+			if (ret)
+				goto out;
+		}
+	} else {
+		struct ref_update *parent_update;
+
+		if (ud->exists)
+			oidcpy(&ud->old_oid, &rec.value);
+		if (check_old_oid(update, &ud->old_oid, err)) {
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto out;
+		}
+
+		/*
+		 * If this update is happening indirectly because of a
+		 * symref update, record the old OID in the parent
+		 * update:
+		 */
+		for (parent_update = update->parent_update;
+		     parent_update;
+		     parent_update = parent_update->parent_update) {
+			struct reftable_update_data *parent_data =
+				parent_update->backend_data;
+
+			oidcpy(&parent_data->old_oid, &ud->old_oid);
+		}
+	}
+
+	if ((update->flags & REF_HAVE_NEW) &&
+	    !(update->flags & REF_DELETING) &&
+	    !(update->flags & REF_LOG_ONLY)) {
+		if (!(update->type & REF_ISSYMREF) &&
+		    oideq(&ud->old_oid, &update->new_oid)) {
+			/*
+			 * The reference already has the desired
+			 * value, so we don't need to write it.
+			 */
+		} else if (check_new_object(update, err)) {
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto out;
+		} else {
+			update->flags |= REF_NEEDS_COMMIT;
+		}
+	}
+
+out:
+	reftable_ref_record_release(&rec);
+	return ret;
+}
+
+static int reftable_transaction_prepare(struct ref_store *ref_store,
+					struct ref_transaction *transaction,
+					struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE,
+				  "ref_transaction_prepare");
+	struct string_list affected_refnames = STRING_LIST_INIT_NODUP;
+	struct reftable_transaction_data *data;
+	char *head_ref = NULL;
+	int head_type;
+	size_t i;
+	int ret = 0;
+
+	assert(err);
+
+	data = xcalloc(1, sizeof(*data));
+	transaction->backend_data = data;
+
+	/*
+	 * Fail if a refname appears more than once in the
+	 * transaction. (If we end up splitting up any updates using
+	 * split_symref_update() or split_head_update(), those
+	 * functions will check that the new updates don't have the
+	 * same refname as any existing ones.) Also fail if any of the
+	 * updates use REF_IS_PRUNING without REF_NO_DEREF.
+	 */
+	for (i = 0; i < transaction->nr; i++) {
+		struct ref_update *update = transaction->updates[i];
+		struct string_list_item *item =
+			string_list_append(&affected_refnames, update->refname);
+
+		/*
+		 * We store a pointer to update in item->util, but at
+		 * the moment we never use the value of this field
+		 * except to check whether it is non-NULL.
+		 */
+		item->util = update;
+	}
+	string_list_sort(&affected_refnames);
+	if (ref_update_reject_duplicates(&affected_refnames, err)) {
+		ret = TRANSACTION_GENERIC_ERROR;
+		goto cleanup;
+	}
+
+	/*
+	 * Special hack: If a branch is updated directly and HEAD
+	 * points to it (may happen on the remote side of a push
+	 * for example) then logically the HEAD reflog should be
+	 * updated too.
+	 */
+	head_ref = refs_resolve_refdup(ref_store, "HEAD",
+				       RESOLVE_REF_NO_RECURSE,
+				       NULL, &head_type);
+
+	if (head_ref && !(head_type & REF_ISSYMREF))
+		FREE_AND_NULL(head_ref);
+
+	/*
+	 * Lock the stacks of the references and check their current
+	 * values. Note that transaction->nr may grow as we go.
+	 */
+	for (i = 0; i < transaction->nr; i++) {
+		struct ref_update *update = transaction->updates[i];
+
+		ret = prepare_update(refs, transaction, update, head_ref,
+				     &affected_refnames, err);
+		if (ret)
+			goto cleanup;
+	}
+
+	if (data->files_transaction &&
+	    refs->files->be->transaction_prepare(refs->files,
+						 data->files_transaction,
+						 err)) {
+		ret = TRANSACTION_GENERIC_ERROR;
+		goto cleanup;
+	}
+
+cleanup:
+	free(head_ref);
+	string_list_clear(&affected_refnames, 0);
+
+	if (ret)
+		reftable_transaction_cleanup(refs, transaction);
+	else
+		transaction->state = REF_TRANSACTION_PREPARED;
+
+	return ret;
+}
+
+static int reftable_transaction_finish(struct ref_store *ref_store,
+				       struct ref_transaction *transaction,
+				       struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, 0, "ref_transaction_finish");
+	struct reftable_transaction_data *data = transaction->backend_data;
+	size_t i;
+	int ret = 0;
+
+	if (!data)
+		goto cleanup;
+
+	for (i = 0; i < transaction->nr; i++) {
+		struct ref_update *update = transaction->updates[i];
+		struct reftable_update_data *ud = update->backend_data;
+		struct reftable_addition *add;
+
+		if (!ud)
+			continue;
+		add = get_addition(data, ud->stack, err);
+
+		if (update->flags & REF_NEEDS_COMMIT)
+			set_ref_value(add, ud->name, &update->new_oid);
+
+		if ((update->flags & REF_DELETING) &&
+		    !(update->flags & REF_LOG_ONLY)) {
+			if (ud->exists)
+				delete_ref_value(add, ud->name);
+			if (delete_reflog_entries(add, ud->name)) {
+				strbuf_addf(err, "unable to delete the reflog of '%s'",
+					    update->refname);
+				ret = TRANSACTION_GENERIC_ERROR;
+				goto cleanup;
+			}
+		} else if (((update->flags & REF_NEEDS_COMMIT) ||
+			    (update->flags & REF_LOG_ONLY)) &&
+			   should_write_log(ud->stack, ud->name, update->flags)) {
+			add_log_entry(add, ud->name, &ud->old_oid,
+				      &update->new_oid, update->msg);
+		}
+	}
+
+	/*
+	 * Write the new tables. An addition is freed when committed,
+	 * so take it off the list first.
+	 */
+	while (data->additions_nr) {
+		struct reftable_addition *add = data->additions[0];
+
+		MOVE_ARRAY(data->additions, data->additions + 1,
+			   --data->additions_nr);
+		if (reftable_addition_commit(add, err)) {
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto cleanup;
+		}
+	}
+
+	if (data->files_transaction) {
+		ret = refs->files->be->transaction_finish(refs->files,
+							  data->files_transaction,
+							  err);
+		ref_transaction_free(data->files_transaction);
+		data->files_transaction = NULL;
+	}
+
+cleanup:
+	reftable_transaction_cleanup(refs, transaction);
+	return ret;
+}
+
+static int reftable_transaction_abort(struct ref_store *ref_store,
+				      struct ref_transaction *transaction,
+				      struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, 0, "ref_transaction_abort");
+
+	reftable_transaction_cleanup(refs, transaction);
+	return 0;
+}
+
+static int reftable_initial_transaction_commit(struct ref_store *ref_store,
+					       struct ref_transaction *transaction,
+					       struct strbuf *err)
+{
+	int ret = reftable_transaction_prepare(ref_store, transaction, err);
+
+	if (ret)
+		return ret;
+	return reftable_transaction_finish(ref_store, transaction, err);
+}
+
+static int reftable_pack_refs(struct ref_store *ref_store, unsigned int flags)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE | REF_STORE_ODB,
+				  "pack_refs");
+	struct strbuf err = STRBUF_INIT;
+	int ret = 0;
+
+	if (reftable_stack_compact_all(refs->common_stack, &err) ||
+	    (refs->worktree_stack != refs->common_stack &&
+	     reftable_stack_compact_all(refs->worktree_stack, &err)))
+		ret = error("%s", err.buf);
+
+	strbuf_release(&err);
+	return ret;
+}
+
+static int reftable_create_symref(struct ref_store *ref_store,
+				  const char *refname, const char *target,
+				  const char *logmsg)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "create_symref");
+	struct reftable_ref_record rec = { NULL };
+	struct reftable_addition *add;
+	struct reftable_stack *st;
+	struct strbuf err = STRBUF_INIT;
+	struct object_id old_oid, new_oid;
+	const char *name;
+	int ret = 0;
+
+	st = stack_for(refs, refname, &name);
+	if (!st)
+		return refs_create_symref(refs->files, refname, target, logmsg);
+
+	add = reftable_stack_new_addition(st, &err);
+	if (!add) {
+		ret = error("unable to lock ref '%s': %s", refname, err.buf);
+		goto out;
+	}
+
+	if (!refs_resolve_ref_unsafe(ref_store, refname, RESOLVE_REF_READING,
+				     &old_oid, NULL))
+		oidclr(&old_oid);
+
+	rec.refname = (char *)name;
+	rec.update_index = add->update_index;
+	rec.value_type = REFTABLE_REF_SYMREF;
+	rec.target = (char *)target;
+	reftable_addition_add_ref(add, &rec);
+
+	if (logmsg &&
+	    !refs_read_ref_full(ref_store, target, RESOLVE_REF_READING,
+				&new_oid, NULL) &&
+	    should_write_log(st, name, 0))
+		add_log_entry(add, name, &old_oid, &new_oid, logmsg);
+
+	if (reftable_addition_commit(add, &err))
+		ret = error("%s", err.buf);
+
+out:
+	strbuf_release(&err);
+	return ret;
+}
+
+static int reftable_delete_refs(struct ref_store *ref_store, const char *msg,
+				struct string_list *refnames, unsigned int flags)
+{
+	struct ref_transaction *transaction;
+	struct strbuf err = STRBUF_INIT;
+	struct string_list_item *item;
+	int ret;
+
+	if (!refnames->nr)
+		return 0;
+
+	transaction = ref_store_transaction_begin(ref_store, &err);
+	if (!transaction)
+		goto error;
+
+	for_each_string_list_item(item, refnames) {
+		if (ref_transaction_delete(transaction, item->string, NULL,
+					   flags, msg, &err)) {
+			ref_transaction_free(transaction);
+			goto error;
+		}
+	}
+
+	ret = ref_transaction_commit(transaction, &err);
+	ref_transaction_free(transaction);
+	if (!ret) {
+		strbuf_release(&err);
+		return 0;
+	}
+
+error:
+	if (refnames->nr == 1)
+		error(_("could not delete reference %s: %s"),
+		      refnames->items[0].string, err.buf);
+	else
+		error(_("could not delete references: %s"), err.buf);
+
+	strbuf_release(&err);
+	return -1;
+}
+
+static int reftable_copy_or_rename_ref(struct ref_store *ref_store,
+				       const char *oldrefname,
+				       const char *newrefname,
+				       const char *logmsg, int copy)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "rename_ref");
+	struct reftable_stack *st, *new_st;
+	struct reftable_addition *add;
+	struct reftable_log_record *logs = NULL;
+	ssize_t i, logs_nr = 0;
+	struct strbuf err = STRBUF_INIT;
+	struct object_id orig_oid;
+	const char *oldname, *newname, *head_ref;
+	int flag = 0, ret = 0;
+
+	if (!refs_resolve_ref_unsafe(ref_store, oldrefname,
+				     RESOLVE_REF_READING | RESOLVE_REF_NO_RECURSE,
+				     &orig_oid, &flag))
+		return error("refname %s not found", oldrefname);
+
+	if (flag & REF_ISSYMREF) {
+		if (copy)
+			return error("refname %s is a symbolic ref, copying it is not supported",
+				     oldrefname);
+		else
+			return error("refname %s is a symbolic ref, renaming it is not supported",
+				     oldrefname);
+	}
+	if (!refs_rename_ref_available(ref_store, oldrefname, newrefname))
+		return 1;
+
+	st = stack_for(refs, oldrefname, &oldname);
+	new_st = stack_for(refs, newrefname, &newname);
+	if (!st || st != new_st)
+		return error("cannot move '%s' to '%s'", oldrefname, newrefname);
+
+	add = reftable_stack_new_addition(st, &err);
+	if (!add) {
+		ret = error("unable to lock ref '%s': %s", newrefname, err.buf);
+		goto out;
+	}
+
+	/* The reflog of the new name replaces whatever was there. */
+	logs_nr = read_reflog(st, oldname, &logs);
+	if (logs_nr < 0 || delete_reflog_entries(add, newname)) {
+		reftable_addition_abort(add);
+		ret = error("unable to read the reflog of '%s'", oldrefname);
+		goto out;
+	}
+	for (i = 0; i < logs_nr; i++) {
+		struct reftable_log_record log = logs[i];
+
+		log.refname = (char *)newname;
+		reftable_addition_add_log(add, &log);
+		if (!copy) {
+			struct reftable_log_record tombstone = { NULL };
+
+			tombstone.refname = (char *)oldname;
+			tombstone.update_index = logs[i].update_index;
+			tombstone.deletion = 1;
+			reftable_addition_add_log(add, &tombstone);
+		}
+	}
+
+	if (!copy)
+		delete_ref_value(add, oldname);
+	set_ref_value(add, newname, &orig_oid);
+
+	if (logs_nr || should_write_log(st, newname, 0))
+		add_log_entry(add, newname, &orig_oid, &orig_oid, logmsg);
+
+	/*
+	 * Update HEAD's reflog as well if HEAD points at the new name,
+	 * like commit_ref_update() does.
+	 */
+	head_ref = refs_resolve_ref_unsafe(ref_store, "HEAD",
+					   RESOLVE_REF_READING, NULL, &flag);
+	if (head_ref && (flag & REF_ISSYMREF) &&
+	    !strcmp(head_ref, newrefname)) {
+		const char *head_name;
+		struct reftable_stack *head_st =
+			stack_for(refs, "HEAD", &head_name);
+
+		if (head_st == st)
+			add_log_entry(add, head_name, &orig_oid, &orig_oid,
+				      logmsg);
+	}
+
+	if (reftable_addition_commit(add, &err))
+		ret = error("unable to write '%s': %s", newrefname, err.buf);
+
+out:
+	free_reflog(logs, logs_nr);
+	strbuf_release(&err);
+	return ret;
+}
+
+static int reftable_rename_ref(struct ref_store *ref_store,
+			       const char *oldrefname, const char *newrefname,
+			       const char *logmsg)
+{
+	return reftable_copy_or_rename_ref(ref_store, oldrefname, newrefname,
+					   logmsg, 0);
+}
+
+static int reftable_copy_ref(struct ref_store *ref_store,
+			     const char *oldrefname, const char *newrefname,
+			     const char *logmsg)
+{
+	return reftable_copy_or_rename_ref(ref_store, oldrefname, newrefname,
+					   logmsg, 1);
+}
+
+struct reftable_reflog_iterator {
+	struct ref_iterator base;
+	struct ref_store *ref_store;
+	struct reftable_iterator iter;
+	struct reftable_log_record log;
+	char *last_name;
+	struct object_id oid;
+	/* whether to leave out HEAD and the per-worktree references */
+	int common_only;
+};
+
+static int reftable_reflog_iterator_advance(struct ref_iterator *ref_iterator)
+{
+	struct reftable_reflog_iterator *iter =
+		(struct reftable_reflog_iterator *)ref_iterator;
+	int ret;
+
+	while (!(ret = reftable_iterator_next_log(&iter->iter, &iter->log))) {
+		int flags;
+
+		if (iter->last_name && !strcmp(iter->last_name, iter->log.refname))
+			continue;
+		free(iter->last_name);
+		iter->last_name = xstrdup(iter->log.refname);
+
+		if (iter->common_only &&
+		    ref_type(iter->last_name) != REF_TYPE_NORMAL)
+			continue;
+		if (refs_read_ref_full(iter->ref_store, iter->last_name, 0,
+				       &iter->oid, &flags)) {
+			error("bad ref for %s", iter->last_name);
+			continue;
+		}
+
+		iter->base.refname = iter->last_name;
+		iter->base.oid = &iter->oid;
+		iter->base.flags = flags;
+		return ITER_OK;
+	}
+
+	if (ref_iterator_abort(ref_iterator) != ITER_DONE || ret < 0)
+		return ITER_ERROR;
+	return ITER_DONE;
+}
+
+static int reftable_reflog_iterator_peel(struct ref_iterator *ref_iterator,
+					 struct object_id *peeled)
+{
+	BUG("ref_iterator_peel() called for reflog_iterator");
+}
+
+static int reftable_reflog_iterator_abort(struct ref_iterator *ref_iterator)
+{
+	struct reftable_reflog_iterator *iter =
+		(struct reftable_reflog_iterator *)ref_iterator;
+
+	reftable_iterator_release(&iter->iter);
+	reftable_log_record_release(&iter->log);
+	free(iter->last_name);
+	base_ref_iterator_free(ref_iterator);
+	return ITER_DONE;
+}
+
+static struct ref_iterator_vtable reftable_reflog_iterator_vtable = {
+	reftable_reflog_iterator_advance,
+	reftable_reflog_iterator_peel,
+	reftable_reflog_iterator_abort
+};
+
+static struct ref_iterator *stack_reflog_iterator_begin(
+		struct ref_store *ref_store, struct reftable_stack *st,
+		int common_only)
+{
+	struct reftable_reflog_iterator *iter = xcalloc(1, sizeof(*iter));
+
+	base_ref_iterator_init(&iter->base, &reftable_reflog_iterator_vtable, 1);
+	iter->ref_store = ref_store;
+	iter->common_only = common_only;
+	if (reftable_stack_init_log_iterator(st, &iter->iter, NULL) < 0) {
+		error(_("unable to read reflogs from '%s'"), st->dir);
+		memset(&iter->iter, 0, sizeof(iter->iter));
+	}
+	return &iter->base;
+}
+
+static struct ref_iterator *reftable_reflog_iterator_begin(struct ref_store *ref_store)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ,
+				  "reflog_iterator_begin");
+
+	if (refs->worktree_stack == refs->common_stack)
+		return stack_reflog_iterator_begin(ref_store,
+						   refs->common_stack, 0);
+
+	return overlay_ref_iterator_begin(
+		stack_reflog_iterator_begin(ref_store, refs->worktree_stack, 0),
+		stack_reflog_iterator_begin(ref_store, refs->common_stack, 1));
+}
+
+static int show_log_entry(struct reftable_log_record *log,
+			  each_reflog_ent_fn fn, void *cb_data)
+{
+	struct strbuf committer = STRBUF_INIT, message = STRBUF_INIT;
+	int ret;
+
+	strbuf_addf(&committer, "%s <%s>", log->name, log->email);
+	strbuf_addf(&message, "%s\n", log->message);
+	ret = fn(&log->old_oid, &log->new_oid, committer.buf,
+		 log->time, log->tz, message.buf, cb_data);
+	strbuf_release(&committer);
+	strbuf_release(&message);
+	return ret;
+}
+
+static int reftable_for_each_reflog_ent_reverse(struct ref_store *ref_store,
+						const char *refname,
+						each_reflog_ent_fn fn,
+						void *cb_data)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ,
+				  "for_each_reflog_ent_reverse");
+	struct reftable_log_record *logs;
+	struct reftable_stack *st;
+	const char *name;
+	ssize_t i, nr;
+	int ret = 0;
+
+	st = stack_for(refs, refname, &name);
+	if (!st)
+		return refs_for_each_reflog_ent_reverse(refs->files, refname,
+							fn, cb_data);
+
+	nr = read_reflog(st, name, &logs);
+	if (nr < 0)
+		return -1;
+	for (i = 0; !ret && i < nr; i++)
+		if (!is_reflog_marker(&logs[i]))
+			ret = show_log_entry(&logs[i], fn, cb_data);
+	free_reflog(logs, nr);
+	return ret;
+}
+
+static int reftable_for_each_reflog_ent(struct ref_store *ref_store,
+					const char *refname,
+					each_reflog_ent_fn fn, void *cb_data)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ,
+				  "for_each_reflog_ent");
+	struct reftable_log_record *logs;
+	struct reftable_stack *st;
+	const char *name;
+	ssize_t i, nr;
+	int ret = 0;
+
+	st = stack_for(refs, refname, &name);
+	if (!st)
+		return refs_for_each_reflog_ent(refs->files, refname,
+						fn, cb_data);
+
+	nr = read_reflog(st, name, &logs);
+	if (nr < 0)
+		return -1;
+	for (i = nr - 1; !ret && i >= 0; i--)
+		if (!is_reflog_marker(&logs[i]))
+			ret = show_log_entry(&logs[i], fn, cb_data);
+	free_reflog(logs, nr);
+	return ret;
+}
+
+static int reftable_reflog_exists(struct ref_store *ref_store,
+				  const char *refname)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ, "reflog_exists");
+	struct reftable_stack *st;
+	const char *name;
+
+	st = stack_for(refs, refname, &name);
+	if (!st)
+		return refs_reflog_exists(refs->files, refname);
+	return stack_reflog_exists(st, name);
+}
+
+static int reftable_create_reflog(struct ref_store *ref_store,
+				  const char *refname, int force_create,
+				  struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "create_reflog");
+	struct reftable_addition *add;
+	struct reftable_stack *st;
+	const char *name;
+
+	st = stack_for(refs, refname, &name);
+	if (!st)
+		return refs_create_reflog(refs->files, refname, force_create,
+					  err);
+
+	if (!force_create && !should_autocreate_reflog(name))
+		return 0;
+
+	add = reftable_stack_new_addition(st, err);
+	if (!add)
+		return -1;
+	if (!stack_reflog_exists(st, name))
+		add_reflog_marker(add, name);
+	return reftable_addition_commit(add, err);
+}
+
+static int reftable_delete_reflog(struct ref_store *ref_store,
+				  const char *refname)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "delete_reflog");
+	struct reftable_addition *add;
+	struct reftable_stack *st;
+	struct strbuf err = STRBUF_INIT;
+	const char *name;
+	int ret = 0;
+
+	st = stack_for(refs, refname, &name);
+	if (!st)
+		return refs_delete_reflog(refs->files, refname);
+
+	add = reftable_stack_new_addition(st, &err);
+	if (!add)
+		ret = error("%s", err.buf);
+	else if (delete_reflog_entries(add, name)) {
+		reftable_addition_abort(add);
+		ret = error("unable to read the reflog of '%s'", refname);
+	} else if (reftable_addition_commit(add, &err))
+		ret = error("%s", err.buf);
+
+	strbuf_release(&err);
+	return ret;
+}
+
+static int reftable_reflog_expire(struct ref_store *ref_store,
+				  const char *refname, const struct object_id *oid,
+				  unsigned int flags,
+				  reflog_expiry_prepare_fn prepare_fn,
+				  reflog_expiry_should_prune_fn should_prune_fn,
+				  reflog_expiry_cleanup_fn cleanup_fn,
+				  void *policy_cb_data)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "reflog_expire");
+	struct reftable_ref_record rec = { NULL };
+	struct reftable_log_record *logs = NULL;
+	struct reftable_addition *add;
+	struct reftable_stack *st;
+	struct strbuf err = STRBUF_INIT;
+	struct strbuf committer = STRBUF_INIT, message = STRBUF_INIT;
+	struct object_id last_kept_oid;
+	const char *name;
+	ssize_t i, nr = 0;
+	int is_symref, kept = 0, ret = 0;
+
+	st = stack_for(refs, refname, &name);
+	if (!st)
+		return refs_reflog_expire(refs->files, refname, oid, flags,
+					  prepare_fn, should_prune_fn,
+					  cleanup_fn, policy_cb_data);
+
+	/*
+	 * The reflog is locked by holding the lock on the stack, which
+	 * we also need if we are to update the reference:
+	 */
+	add = reftable_stack_new_addition(st, &err);
+	if (!add) {
+		ret = error("cannot lock ref '%s': %s", refname, err.buf);
+		goto out;
+	}
+	nr = read_reflog(st, name, &logs);
+	if (nr <= 0) {
+		reftable_addition_abort(add);
+		if (nr < 0)
+			ret = error("unable to read the reflog of '%s'", refname);
+		goto out;
+	}
+	is_symref = !reftable_stack_read_ref(st, name, &rec) &&
+		rec.value_type == REFTABLE_REF_SYMREF;
+
+	oidclr(&last_kept_oid);
+	(*prepare_fn)(refname, oid, policy_cb_data);
+	for (i = nr - 1; i >= 0; i--) {
+		struct reftable_log_record *log = &logs[i];
+		struct object_id *ooid = &log->old_oid;
+
+		if (is_reflog_marker(log))
+			continue;
+		if (flags & EXPIRE_REFLOGS_REWRITE)
+			ooid = &last_kept_oid;
+
+		strbuf_reset(&committer);
+		strbuf_addf(&committer, "%s <%s>", log->name, log->email);
+		strbuf_reset(&message);
+		strbuf_addf(&message, "%s\n", log->message);
+
+		if ((*should_prune_fn)(ooid, &log->new_oid, committer.buf,
+				       log->time, log->tz, message.buf,
+				       policy_cb_data)) {
+			if (flags & EXPIRE_REFLOGS_DRY_RUN)
+				printf("would prune %s", message.buf);
+			else if (flags & EXPIRE_REFLOGS_VERBOSE)
+				printf("prune %s", message.buf);
+
+			log->deletion = 1;
+			reftable_addition_add_log(add, log);
+		} else {
+			if (!oideq(ooid, &log->old_oid)) {
+				oidcpy(&log->old_oid, ooid);
+				reftable_addition_add_log(add, log);
+			}
+			oidcpy(&last_kept_oid, &log->new_oid);
+			kept++;
+			if (flags & EXPIRE_REFLOGS_VERBOSE)
+				printf("keep %s", message.buf);
+		}
+	}
+	(*cleanup_fn)(policy_cb_data);
+
+	if (flags & EXPIRE_REFLOGS_DRY_RUN) {
+		reftable_addition_abort(add);
+		goto out;
+	}
+
+	/* An expired reflog still exists, if empty. */
+	if (!kept)
+		add_reflog_marker(add, name);
+
+	/*
+	 * It doesn't make sense to adjust a reference pointed to by a
+	 * symbolic ref based on expiring entries in the symbolic
+	 * reference's reflog. Nor can we update a reference if there
+	 * are no remaining reflog entries.
+	 */
+	if ((flags & EXPIRE_REFLOGS_UPDATE_REF) && !is_symref &&
+	    !is_null_oid(&last_kept_oid))
+		set_ref_value(add, name, &last_kept_oid);
+
+	if (reftable_addition_commit(add, &err))
+		ret = error("unable to write reflog '%s': %s", refname, err.buf);
+
+out:
+	free_reflog(logs, nr);
+	reftable_ref_record_release(&rec);
+	strbuf_release(&committer);
+	strbuf_release(&message);
+	strbuf_release(&err);
+	return ret;
+}
+
+static int reftable_init_db(struct ref_store *ref_store, struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "init_db");
+	struct strbuf sb = STRBUF_INIT;
+	int i;
+
+	/*
+	 * The object format may have been decided after the store was
+	 * set up, e.g. by "git clone" once it talked to the remote.
+	 */
+	for (i = 0; i < refs->stacks.nr; i++) {
+		struct reftable_stack *st = refs->stacks.items[i].util;
+		st->algo = the_hash_algo;
+	}
+
+	/*
+	 * Create an empty stack.
+	 */
+	safe_create_dir(refs->common_stack->dir, 1);
+	if (!file_exists(refs->common_stack->list_file))
+		write_file_buf(refs->common_stack->list_file, "", 0);
+
+	/*
+	 * Older versions of Git only consider a directory a repository
+	 * if it has a "refs" directory and a HEAD pointing into refs/.
+	 * Make them recognize the repository, and fail to use it as
+	 * "refs/heads" is a file.
+	 */
+	strbuf_addf(&sb, "%s/refs", refs->gitcommondir);
+	safe_create_dir(sb.buf, 1);
+	strbuf_addstr(&sb, "/heads");
+	if (!file_exists(sb.buf))
+		write_file(sb.buf, "this repository uses the reftable format");
+
+	strbuf_reset(&sb);
+	strbuf_addf(&sb, "%s/HEAD", ref_store->gitdir);
+	if (!file_exists(sb.buf))
+		write_file(sb.buf, "ref: refs/heads/.invalid");
+
+	strbuf_release(&sb);
+	return 0;
+}
+
+struct ref_storage_be refs_be_reftable = {
+	NULL,
+	"reftable",
+	reftable_ref_store_create,
+	reftable_init_db,
+	reftable_transaction_prepare,
+	reftable_transaction_finish,
+	reftable_transaction_abort,
+	reftable_initial_transaction_commit,
+
+	reftable_pack_refs,
+	reftable_create_symref,
+	reftable_delete_refs,
+	reftable_rename_ref,
+	reftable_copy_ref,
+
+	reftable_ref_iterator_begin,
+	reftable_read_raw_ref,
+
+	reftable_reflog_iterator_begin,
+	reftable_for_each_reflog_ent,
+	reftable_for_each_reflog_ent_reverse,
+	reftable_reflog_exists,
+	reftable_create_reflog,
+	reftable_delete_reflog,
+	reftable_reflog_expire
+};
@@ -0,0 +1,1728 @@
+#include "../cache.h"
+#include "../tempfile.h"
+#include "../varint.h"
+#include "reftable.h"
+
+#define REFTABLE_MAGIC "REFT"
+
+#define BLOCK_TYPE_REF 'r'
+#define BLOCK_TYPE_LOG 'g'
+#define BLOCK_TYPE_INDEX 'i'
+#define BLOCK_TYPE_OBJ 'o'
+
+/* Every this many records, a key is stored in full. */
+#define RESTART_INTERVAL 16
+
+static size_t header_size(int version)
+{
+	return version == 1 ? 24 : 28;
+}
+
+static size_t footer_size(int version)
+{
+	return header_size(version) + 5 * 8 + 4;
+}
+
+static void put_be24(unsigned char *p, uint32_t value)
+{
+	p[0] = (value >> 16) & 0xff;
+	p[1] = (value >> 8) & 0xff;
+	p[2] = value & 0xff;
+}
+
+static uint32_t get_be24(const unsigned char *p)
+{
+	return (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+}
+
+/*
+ * Bounded version of decode_varint(), for reading records that we
+ * cannot trust to be well-formed.
+ */
+static int get_varint(const unsigned char **pp, const unsigned char *end,
+		      uint64_t *out)
+{
+	const unsigned char *p = *pp;
+	uint64_t val;
+
+	if (p >= end)
+		return -1;
+	val = *p & 127;
+	while (*p++ & 128) {
+		if (p >= end)
+			return -1;
+		val += 1;
+		if (!val || MSB(val, 7))
+			return -1; /* overflow */
+		val = (val << 7) + (*p & 127);
+	}
+	*pp = p;
+	*out = val;
+	return 0;
+}
+
+static void put_varint(struct strbuf *sb, uint64_t value)
+{
+	unsigned char buf[16];
+
+	strbuf_add(sb, buf, encode_varint(value, buf));
+}
+
+static void put_string(struct strbuf *sb, const char *s)
+{
+	size_t len = s ? strlen(s) : 0;
+
+	put_varint(sb, len);
+	strbuf_add(sb, s, len);
+}
+
+/*
+ * The key of a reflog entry: the refname, a NUL and the update index
+ * in reverse order, so that the newest entry of a reflog comes first.
+ */
+static void log_key(struct strbuf *key, const char *refname,
+		    uint64_t update_index)
+{
+	unsigned char buf[8];
+
+	strbuf_reset(key);
+	strbuf_addstr(key, refname);
+	strbuf_addch(key, '\0');
+	put_be64(buf, ~update_index);
+	strbuf_add(key, buf, sizeof(buf));
+}
+
+static int key_cmp(const struct strbuf *a, const struct strbuf *b)
+{
+	int cmp = memcmp(a->buf, b->buf, a->len < b->len ? a->len : b->len);
+
+	if (cmp)
+		return cmp;
+	return a->len < b->len ? -1 : a->len > b->len;
+}
+
+void reftable_ref_record_release(struct reftable_ref_record *rec)
+{
+	free(rec->refname);
+	free(rec->target);
+	memset(rec, 0, sizeof(*rec));
+}
+
+void reftable_ref_record_copy(struct reftable_ref_record *dst,
+			      const struct reftable_ref_record *src)
+{
+	reftable_ref_record_release(dst);
+	*dst = *src;
+	dst->refname = xstrdup_or_null(src->refname);
+	dst->target = xstrdup_or_null(src->target);
+}
+
+void reftable_log_record_release(struct reftable_log_record *rec)
+{
+	free(rec->refname);
+	free(rec->name);
+	free(rec->email);
+	free(rec->message);
+	memset(rec, 0, sizeof(*rec));
+}
+
+void reftable_log_record_copy(struct reftable_log_record *dst,
+			      const struct reftable_log_record *src)
+{
+	reftable_log_record_release(dst);
+	*dst = *src;
+	dst->refname = xstrdup_or_null(src->refname);
+	dst->name = xstrdup_or_null(src->name);
+	dst->email = xstrdup_or_null(src->email);
+	dst->message = xstrdup_or_null(src->message);
+}
+
+/*
+ * Writing tables.
+ *
+ * The records of a section are written into blocks of at most
+ * REFTABLE_BLOCK_SIZE bytes. Each record shares a prefix with the key
+ * of the record before it, except at restart points, whose offsets are
+ * listed at the end of the block so that readers can bisect it. When
+ * a section needs more than one block, an index block listing the last
+ * key of each block follows it.
+ */
+
+struct index_record {
+	struct strbuf key;
+	uint64_t offset;
+};
+
+struct table_writer {
+	struct strbuf *out;
+	const struct git_hash_algo *algo;
+	size_t header_size;
+	uint64_t min_update_index;
+
+	/* the block being written */
+	unsigned char type;
+	uint64_t block_start;
+	size_t hdr_off;
+	size_t limit;
+	struct strbuf block;
+	uint32_t *restarts;
+	size_t restarts_nr, restarts_alloc;
+	size_t entries;
+	struct strbuf last_key;
+
+	/* the blocks of the current section */
+	struct index_record *index;
+	size_t index_nr, index_alloc;
+};
+
+static void writer_begin_block(struct table_writer *w, unsigned char type,
+			       size_t limit)
+{
+	/*
+	 * The first block of the file starts at offset 0, and includes
+	 * the file header.
+	 */
+	w->block_start = w->out->len == w->header_size ? 0 : w->out->len;
+	w->hdr_off = w->block_start ? 0 : w->header_size;
+	w->type = type;
+	w->limit = limit;
+	strbuf_reset(&w->block);
+	strbuf_addch(&w->block, type);
+	strbuf_add(&w->block, "\0\0\0", 3);
+	w->restarts_nr = 0;
+	w->entries = 0;
+	strbuf_reset(&w->last_key);
+}
+
+/*
+ * Add a record to the current block. Returns -1 if the block is full,
+ * in which case nothing was written.
+ */
+static int writer_add(struct table_writer *w, const struct strbuf *key,
+		      unsigned extra, const struct strbuf *value)
+{
+	int restart = !(w->entries % RESTART_INTERVAL);
+	size_t prefix = 0, len;
+
+	if (!restart)
+		while (prefix < key->len && prefix < w->last_key.len &&
+		       key->buf[prefix] == w->last_key.buf[prefix])
+			prefix++;
+
+	len = encode_varint(prefix, NULL) +
+		encode_varint((key->len - prefix) << 3 | extra, NULL) +
+		key->len - prefix + value->len;
+	if (w->entries && w->limit &&
+	    w->hdr_off + w->block.len + len +
+	    3 * (w->restarts_nr + restart) + 2 > w->limit)
+		return -1;
+
+	if (restart) {
+		ALLOC_GROW(w->restarts, w->restarts_nr + 1, w->restarts_alloc);
+		w->restarts[w->restarts_nr++] = w->hdr_off + w->block.len;
+	}
+	put_varint(&w->block, prefix);
+	put_varint(&w->block, (key->len - prefix) << 3 | extra);
+	strbuf_add(&w->block, key->buf + prefix, key->len - prefix);
+	strbuf_addbuf(&w->block, value);
+	w->entries++;
+	strbuf_reset(&w->last_key);
+	strbuf_addbuf(&w->last_key, key);
+	return 0;
+}
+
+static void deflate_into(struct strbuf *out, const void *data, size_t len)
+{
+	git_zstream stream;
+	unsigned long bound;
+	int status;
+
+	git_deflate_init(&stream, zlib_compression_level);
+	bound = git_deflate_bound(&stream, len);
+	strbuf_grow(out, bound);
+	stream.next_in = (unsigned char *)data;
+	stream.avail_in = len;
+	stream.next_out = (unsigned char *)out->buf + out->len;
+	stream.avail_out = bound;
+	do {
+		status = git_deflate(&stream, Z_FINISH);
+	} while (status == Z_OK);
+	if (status != Z_STREAM_END)
+		die(_("unable to deflate reftable block (%d)"), status);
+	strbuf_setlen(out, out->len + stream.total_out);
+	git_deflate_end(&stream);
+}
+
+static void writer_finish_block(struct table_writer *w)
+{
+	unsigned char buf[3];
+	size_t i, len;
+
+	if (w->restarts_nr > 0xffff)
+		die(_("too many restart points in reftable block"));
+	for (i = 0; i < w->restarts_nr; i++) {
+		put_be24(buf, w->restarts[i]);
+		strbuf_add(&w->block, buf, 3);
+	}
+	strbuf_addch(&w->block, (w->restarts_nr >> 8) & 0xff);
+	strbuf_addch(&w->block, w->restarts_nr & 0xff);
+
+	len = w->hdr_off + w->block.len;
+	if (len >= 1 << 24)
+		die(_("reftable block too large"));
+	put_be24((unsigned char *)w->block.buf + 1, len);
+
+	if (w->type != BLOCK_TYPE_INDEX) {
+		struct index_record *ir;
+
+		ALLOC_GROW(w->index, w->index_nr + 1, w->index_alloc);
+		ir = &w->index[w->index_nr++];
+		strbuf_init(&ir->key, 0);
+		strbuf_addbuf(&ir->key, &w->last_key);
+		ir->offset = w->block_start;
+	}
+
+	if (w->type == BLOCK_TYPE_LOG) {
+		/* Log blocks are compressed, except for their header. */
+		strbuf_add(w->out, w->block.buf, 4);
+		deflate_into(w->out, w->block.buf + 4, w->block.len - 4);
+	} else {
+		strbuf_addbuf(w->out, &w->block);
+	}
+}
+
+/*
+ * Write the index of the section just finished, if it has more than
+ * one block, and return its offset (or 0).
+ */
+static uint64_t writer_finish_section(struct table_writer *w)
+{
+	struct strbuf value = STRBUF_INIT;
+	uint64_t offset = 0;
+	size_t i;
+
+	if (w->index_nr > 1) {
+		writer_begin_block(w, BLOCK_TYPE_INDEX, 0);
+		offset = w->block_start;
+		for (i = 0; i < w->index_nr; i++) {
+			strbuf_reset(&value);
+			put_varint(&value, w->index[i].offset);
+			writer_add(w, &w->index[i].key, 0, &value);
+		}
+		writer_finish_block(w);
+	}
+
+	for (i = 0; i < w->index_nr; i++)
+		strbuf_release(&w->index[i].key);
+	w->index_nr = 0;
+	strbuf_release(&value);
+	return offset;
+}
+
+static void writer_add_record(struct table_writer *w, const struct strbuf *key,
+			      unsigned extra, const struct strbuf *value)
+{
+	if (!writer_add(w, key, extra, value))
+		return;
+	writer_finish_block(w);
+	writer_begin_block(w, w->type, w->limit);
+	writer_add(w, key, extra, value);
+}
+
+static void encode_ref_value(struct table_writer *w, struct strbuf *value,
+			     const struct reftable_ref_record *rec)
+{
+	if (rec->update_index < w->min_update_index)
+		BUG("update index of '%s' out of range", rec->refname);
+	put_varint(value, rec->update_index - w->min_update_index);
+	switch (rec->value_type) {
+	case REFTABLE_REF_DELETION:
+		break;
+	case REFTABLE_REF_VAL2:
+		strbuf_add(value, rec->value.hash, w->algo->rawsz);
+		strbuf_add(value, rec->peeled.hash, w->algo->rawsz);
+		break;
+	case REFTABLE_REF_VAL1:
+		strbuf_add(value, rec->value.hash, w->algo->rawsz);
+		break;
+	case REFTABLE_REF_SYMREF:
+		put_string(value, rec->target);
+		break;
+	}
+}
+
+static void encode_log_value(struct table_writer *w, struct strbuf *value,
+			     const struct reftable_log_record *rec)
+{
+	unsigned char tz[2];
+
+	if (rec->deletion)
+		return;
+	strbuf_add(value, rec->old_oid.hash, w->algo->rawsz);
+	strbuf_add(value, rec->new_oid.hash, w->algo->rawsz);
+	put_string(value, rec->name);
+	put_string(value, rec->email);
+	put_varint(value, rec->time);
+	tz[0] = ((uint16_t)rec->tz >> 8) & 0xff;
+	tz[1] = (uint16_t)rec->tz & 0xff;
+	strbuf_add(value, tz, 2);
+	put_string(value, rec->message);
+}
+
+static void write_header(struct strbuf *out, const struct git_hash_algo *algo,
+			 uint64_t min_update_index, uint64_t max_update_index)
+{
+	int version = hash_algo_by_ptr(algo) == GIT_HASH_SHA1 ? 1 : 2;
+	unsigned char buf[8];
+
+	strbuf_add(out, REFTABLE_MAGIC, 4);
+	strbuf_addch(out, version);
+	put_be24(buf, REFTABLE_BLOCK_SIZE);
+	strbuf_add(out, buf, 3);
+	put_be64(buf, min_update_index);
+	strbuf_add(out, buf, 8);
+	put_be64(buf, max_update_index);
+	strbuf_add(out, buf, 8);
+	if (version > 1) {
+		put_be32(buf, algo->format_id);
+		strbuf_add(out, buf, 4);
+	}
+}
+
+void reftable_write_table(struct strbuf *out, const struct git_hash_algo *algo,
+			  uint64_t min_update_index, uint64_t max_update_index,
+			  const struct reftable_ref_record *refs, size_t refs_nr,
+			  const struct reftable_log_record *logs, size_t logs_nr)
+{
+	struct table_writer w = {
+		.out = out,
+		.algo = algo,
+		.min_update_index = min_update_index,
+		.block = STRBUF_INIT,
+		.last_key = STRBUF_INIT,
+	};
+	struct strbuf key = STRBUF_INIT, value = STRBUF_INIT;
+	uint64_t ref_index_pos = 0, log_pos = 0, log_index_pos = 0;
+	unsigned char header[28], buf[8];
+	size_t i, footer_start;
+
+	strbuf_reset(out);
+	write_header(out, algo, min_update_index, max_update_index);
+	w.header_size = out->len;
+
+	if (refs_nr) {
+		writer_begin_block(&w, BLOCK_TYPE_REF, REFTABLE_BLOCK_SIZE);
+		for (i = 0; i < refs_nr; i++) {
+			strbuf_reset(&key);
+			strbuf_addstr(&key, refs[i].refname);
+			strbuf_reset(&value);
+			encode_ref_value(&w, &value, &refs[i]);
+			writer_add_record(&w, &key, refs[i].value_type, &value);
+		}
+		writer_finish_block(&w);
+		ref_index_pos = writer_finish_section(&w);
+	}
+
+	if (logs_nr) {
+		writer_begin_block(&w, BLOCK_TYPE_LOG, REFTABLE_BLOCK_SIZE);
+		log_pos = w.block_start;
+		for (i = 0; i < logs_nr; i++) {
+			log_key(&key, logs[i].refname, logs[i].update_index);
+			strbuf_reset(&value);
+			encode_log_value(&w, &value, &logs[i]);
+			writer_add_record(&w, &key, !logs[i].deletion, &value);
+		}
+		writer_finish_block(&w);
+		log_index_pos = writer_finish_section(&w);
+	}
+
+	footer_start = out->len;
+	memcpy(header, out->buf, w.header_size);
+	strbuf_add(out, header, w.header_size);
+	put_be64(buf, ref_index_pos);
+	strbuf_add(out, buf, 8);
+	put_be64(buf, 0); /* no object blocks */
+	strbuf_add(out, buf, 8);
+	strbuf_add(out, buf, 8);
+	put_be64(buf, log_pos);
+	strbuf_add(out, buf, 8);
+	put_be64(buf, log_index_pos);
+	strbuf_add(out, buf, 8);
+	put_be32(buf, crc32(0, (unsigned char *)out->buf + footer_start,
+			    out->len - footer_start));
+	strbuf_add(out, buf, 4);
+
+	strbuf_release(&key);
+	strbuf_release(&value);
+	strbuf_release(&w.block);
+	strbuf_release(&w.last_key);
+	free(w.restarts);
+	free(w.index);
+}
+
+/*
+ * Reading tables.
+ */
+
+struct reftable_reader {
+	int refcount;
+	char *name;
+	unsigned char *map;
+	size_t size;
+	const struct git_hash_algo *algo;
+	size_t header_size, footer_size;
+	size_t block_size;
+	uint64_t min_update_index, max_update_index;
+	uint64_t ref_index_pos, log_pos, log_index_pos;
+};
+
+static int corrupt(struct reftable_reader *r)
+{
+	return error(_("reftable '%s' is corrupt"), r->name);
+}
+
+static struct reftable_reader *reader_open(const char *dir, const char *name,
+					   const struct git_hash_algo *algo)
+{
+	struct reftable_reader *r = xcalloc(1, sizeof(*r));
+	char *path = xstrfmt("%s/%s", dir, name);
+	const unsigned char *footer;
+	struct stat st;
+	int fd, version;
+
+	r->refcount = 1;
+	r->name = xstrdup(name);
+	r->algo = algo;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		goto fail;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		goto fail;
+	}
+	r->size = xsize_t(st.st_size);
+	if (r->size < footer_size(1)) {
+		close(fd);
+		corrupt(r);
+		errno = EINVAL;
+		goto fail;
+	}
+	r->map = xmmap(NULL, r->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	version = r->map[4];
+	if (memcmp(r->map, REFTABLE_MAGIC, 4) ||
+	    (version != 1 && version != 2) ||
+	    r->size < header_size(version) + footer_size(version))
+		goto corrupt;
+	r->header_size = header_size(version);
+	r->footer_size = footer_size(version);
+	footer = r->map + r->size - r->footer_size;
+	if (memcmp(footer, r->map, r->header_size) ||
+	    get_be32(footer + r->footer_size - 4) !=
+	    crc32(0, footer, r->footer_size - 4))
+		goto corrupt;
+
+	if (version == 1 ? hash_algo_by_ptr(algo) != GIT_HASH_SHA1 :
+	    get_be32(r->map + 24) != algo->format_id) {
+		error(_("reftable '%s' uses another hash algorithm"), name);
+		errno = EINVAL;
+		goto fail;
+	}
+
+	r->block_size = get_be24(r->map + 5);
+	r->min_update_index = get_be64(r->map + 8);
+	r->max_update_index = get_be64(r->map + 16);
+	footer += r->header_size;
+	r->ref_index_pos = get_be64(footer);
+	r->log_pos = get_be64(footer + 24);
+	r->log_index_pos = get_be64(footer + 32);
+
+	free(path);
+	return r;
+
+corrupt:
+	corrupt(r);
+	errno = EINVAL;
+fail:
+	if (r->map)
+		munmap(r->map, r->size);
+	free(r->name);
+	free(r);
+	free(path);
+	return NULL;
+}
+
+static void reader_decref(struct reftable_reader *r)
+{
+	if (--r->refcount)
+		return;
+	munmap(r->map, r->size);
+	free(r->name);
+	free(r);
+}
+
+struct block {
+	const unsigned char *data;
+	unsigned char *inflated;
+	unsigned char type;
+	size_t len;
+	size_t hdr_off;
+	size_t restarts_pos;
+	size_t restarts_nr;
+	uint64_t next;
+};
+
+static void block_release(struct block *b)
+{
+	FREE_AND_NULL(b->inflated);
+	b->data = NULL;
+}
+
+/*
+ * Read the block at offset `pos`. Returns 1 if there are no more blocks
+ * there, -1 if the table is corrupt, and 0 otherwise.
+ */
+static int read_block(struct reftable_reader *r, uint64_t pos, struct block *b)
+{
+	size_t hdr_off = pos ? 0 : r->header_size;
+	size_t end = r->size - r->footer_size;
+	const unsigned char *p;
+
+	block_release(b);
+	if (pos + hdr_off + 4 > end)
+		return 1;
+
+	p = r->map + pos;
+	b->type = p[hdr_off];
+	b->len = get_be24(p + hdr_off + 1);
+	b->hdr_off = hdr_off;
+	if (b->len < hdr_off + 4 + 2)
+		return corrupt(r);
+
+	switch (b->type) {
+	case BLOCK_TYPE_REF:
+	case BLOCK_TYPE_INDEX:
+	case BLOCK_TYPE_OBJ:
+		if (pos + b->len > end)
+			return corrupt(r);
+		b->data = p;
+		b->next = pos + b->len;
+		break;
+	case BLOCK_TYPE_LOG: {
+		git_zstream stream;
+		int status;
+
+		b->inflated = xmalloc(b->len);
+		memcpy(b->inflated, p, hdr_off + 4);
+		memset(&stream, 0, sizeof(stream));
+		git_inflate_init(&stream);
+		stream.next_in = (unsigned char *)p + hdr_off + 4;
+		stream.avail_in = end - pos - hdr_off - 4;
+		stream.next_out = b->inflated + hdr_off + 4;
+		stream.avail_out = b->len - hdr_off - 4;
+		status = git_inflate(&stream, Z_FINISH);
+		git_inflate_end(&stream);
+		if (status != Z_STREAM_END || stream.avail_out) {
+			block_release(b);
+			return corrupt(r);
+		}
+		b->data = b->inflated;
+		b->next = pos + hdr_off + 4 + stream.total_in;
+		break;
+	}
+	default:
+		return corrupt(r);
+	}
+
+	/*
+	 * Other writers pad blocks with zeros up to the block size of the
+	 * table; a block type is never zero.
+	 */
+	if (r->block_size && b->next < end && !r->map[b->next] &&
+	    b->next < pos + r->block_size && pos + r->block_size <= end)
+		b->next = pos + r->block_size;
+
+	b->restarts_nr = get_be16(b->data + b->len - 2);
+	if (!b->restarts_nr ||
+	    3 * b->restarts_nr + 2 > b->len - hdr_off - 4) {
+		block_release(b);
+		return corrupt(r);
+	}
+	b->restarts_pos = b->len - 2 - 3 * b->restarts_nr;
+	return 0;
+}
+
+struct block_iter {
+	struct block block;
+	size_t pos;
+	struct strbuf key;
+};
+
+struct raw_record {
+	unsigned extra;
+	const unsigned char *value;
+	size_t value_len;
+};
+
+static int skip_string(const unsigned char **pp, const unsigned char *end)
+{
+	uint64_t len;
+
+	if (get_varint(pp, end, &len) || len > end - *pp)
+		return -1;
+	*pp += len;
+	return 0;
+}
+
+static int skip_value(struct reftable_reader *r, unsigned char type,
+		      unsigned extra, const unsigned char **pp,
+		      const unsigned char *end)
+{
+	size_t rawsz = r->algo->rawsz;
+	uint64_t val;
+
+	switch (type) {
+	case BLOCK_TYPE_REF:
+		if (get_varint(pp, end, &val))
+			return -1;
+		switch (extra) {
+		case REFTABLE_REF_DELETION:
+			return 0;
+		case REFTABLE_REF_VAL1:
+		case REFTABLE_REF_VAL2:
+			if (extra * rawsz > end - *pp)
+				return -1;
+			*pp += extra * rawsz;
+			return 0;
+		case REFTABLE_REF_SYMREF:
+			return skip_string(pp, end);
+		}
+		return -1;
+	case BLOCK_TYPE_LOG:
+		if (!extra)
+			return 0;
+		if (extra != 1 || 2 * rawsz > end - *pp)
+			return -1;
+		*pp += 2 * rawsz;
+		if (skip_string(pp, end) || skip_string(pp, end) ||
+		    get_varint(pp, end, &val) || 2 > end - *pp)
+			return -1;
+		*pp += 2;
+		return skip_string(pp, end);
+	case BLOCK_TYPE_INDEX:
+		return get_varint(pp, end, &val);
+	}
+	return -1;
+}
+
+/*
+ * Decode the next record of the block into bi->key and `raw`. Returns 1
+ * at the end of the block, -1 if the block is corrupt, and 0 otherwise.
+ */
+static int block_iter_next(struct reftable_reader *r, struct block_iter *bi,
+			   struct raw_record *raw)
+{
+	const unsigned char *data = bi->block.data;
+	const unsigned char *p = data + bi->pos;
+	const unsigned char *end = data + bi->block.restarts_pos;
+	uint64_t prefix, suffix;
+
+	if (p >= end)
+		return 1;
+	if (get_varint(&p, end, &prefix) || get_varint(&p, end, &suffix) ||
+	    prefix > bi->key.len || (suffix >> 3) > end - p)
+		return corrupt(r);
+	strbuf_setlen(&bi->key, prefix);
+	strbuf_add(&bi->key, p, suffix >> 3);
+	p += suffix >> 3;
+
+	raw->extra = suffix & 7;
+	raw->value = p;
+	if (skip_value(r, bi->block.type, raw->extra, &p, end))
+		return corrupt(r);
+	raw->value_len = p - raw->value;
+	bi->pos = p - data;
+	return 0;
+}
+
+static void block_iter_rewind(struct block_iter *bi)
+{
+	bi->pos = bi->block.hdr_off + 4;
+	strbuf_reset(&bi->key);
+}
+
+/*
+ * Position the iterator before the first record whose key is not
+ * smaller than `want`.
+ */
+static int block_iter_seek(struct reftable_reader *r, struct block_iter *bi,
+			   const struct strbuf *want)
+{
+	const unsigned char *restarts = bi->block.data + bi->block.restarts_pos;
+	struct strbuf saved_key = STRBUF_INIT;
+	struct raw_record raw;
+	size_t lo = 0, hi = bi->block.restarts_nr, saved_pos;
+	int ret = 0;
+
+	/* Find the first restart point with a key greater than `want`. */
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		bi->pos = get_be24(restarts + 3 * mid);
+		strbuf_reset(&bi->key);
+		if (bi->pos >= bi->block.restarts_pos ||
+		    block_iter_next(r, bi, &raw) < 0) {
+			ret = corrupt(r);
+			goto out;
+		}
+		if (key_cmp(&bi->key, want) > 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	if (lo) {
+		bi->pos = get_be24(restarts + 3 * (lo - 1));
+		strbuf_reset(&bi->key);
+	} else {
+		block_iter_rewind(bi);
+	}
+
+	for (;;) {
+		saved_pos = bi->pos;
+		strbuf_reset(&saved_key);
+		strbuf_addbuf(&saved_key, &bi->key);
+		ret = block_iter_next(r, bi, &raw);
+		if (ret) {
+			if (ret > 0)
+				ret = 0;
+			break;
+		}
+		if (key_cmp(&bi->key, want) >= 0) {
+			bi->pos = saved_pos;
+			strbuf_swap(&bi->key, &saved_key);
+			break;
+		}
+	}
+
+out:
+	strbuf_release(&saved_key);
+	return ret;
+}
+
+struct reftable_table_iter {
+	struct reftable_reader *r;
+	unsigned char type;
+	struct block_iter bi;
+	int done;
+
+	/* the record read ahead, if any */
+	int pending;
+	struct reftable_ref_record ref;
+	struct reftable_log_record log;
+};
+
+static int table_iter_first_key(struct reftable_table_iter *ti, uint64_t pos,
+				struct strbuf *key)
+{
+	struct block_iter bi = { .key = STRBUF_INIT };
+	struct raw_record raw;
+	int ret = read_block(ti->r, pos, &bi.block);
+
+	if (!ret && bi.block.type != ti->type)
+		ret = 1;
+	if (!ret) {
+		block_iter_rewind(&bi);
+		ret = block_iter_next(ti->r, &bi, &raw);
+		strbuf_swap(key, &bi.key);
+	}
+	block_release(&bi.block);
+	strbuf_release(&bi.key);
+	return ret;
+}
+
+static int table_iter_seek(struct reftable_table_iter *ti,
+			   struct reftable_reader *r, unsigned char type,
+			   const struct strbuf *want)
+{
+	struct strbuf key = STRBUF_INIT;
+	uint64_t pos, index_pos;
+	int ret;
+
+	ti->r = r;
+	ti->type = type;
+	strbuf_init(&ti->bi.key, 0);
+
+	/*
+	 * A section at the very start of the file is not recorded in
+	 * the footer; look at the first block to find out what it is.
+	 */
+	if (type == BLOCK_TYPE_LOG && r->log_pos) {
+		pos = r->log_pos;
+	} else {
+		pos = 0;
+		ret = table_iter_first_key(ti, 0, &key);
+		if (ret) {
+			ti->done = 1;
+			if (ret > 0)
+				ret = 0;
+			goto out;
+		}
+	}
+	index_pos = type == BLOCK_TYPE_REF ? r->ref_index_pos : r->log_index_pos;
+
+	if (index_pos && want->len) {
+		struct block_iter index = { .key = STRBUF_INIT };
+		struct raw_record raw;
+		uint64_t level_pos = index_pos;
+
+		ret = read_block(r, index_pos, &index.block);
+		if (!ret && index.block.type != BLOCK_TYPE_INDEX)
+			ret = corrupt(r);
+
+		/*
+		 * A large index has several levels, whose records point to
+		 * the index blocks of the level below, written before them.
+		 * Walk down until we reach a block of the section itself.
+		 */
+		while (!ret) {
+			ret = block_iter_seek(r, &index, want);
+			if (!ret)
+				ret = block_iter_next(r, &index, &raw);
+			if (!ret)
+				ret = get_varint(&raw.value,
+						 raw.value + raw.value_len,
+						 &pos) || pos >= level_pos ?
+					corrupt(r) : 0;
+			if (ret)
+				break;
+			ret = read_block(r, pos, &index.block);
+			if (ret > 0)
+				ret = corrupt(r);
+			if (!ret && index.block.type != BLOCK_TYPE_INDEX)
+				break;
+			level_pos = pos;
+		}
+		block_release(&index.block);
+		strbuf_release(&index.key);
+		if (ret) {
+			/* all keys are smaller than what we want */
+			ti->done = 1;
+			if (ret > 0)
+				ret = 0;
+			goto out;
+		}
+	} else if (want->len) {
+		struct block b = { NULL };
+
+		/* Skip blocks whose successor starts at or before `want`. */
+		for (;;) {
+			ret = read_block(r, pos, &b);
+			if (ret < 0)
+				goto out;
+			if (ret > 0 || b.type != type)
+				break;
+			if (table_iter_first_key(ti, b.next, &key) ||
+			    key_cmp(&key, want) > 0)
+				break;
+			pos = b.next;
+		}
+		block_release(&b);
+	}
+
+	ret = read_block(r, pos, &ti->bi.block);
+	if (!ret && ti->bi.block.type != type)
+		ret = 1;
+	if (ret) {
+		ti->done = 1;
+		if (ret > 0)
+			ret = 0;
+		goto out;
+	}
+	ret = block_iter_seek(r, &ti->bi, want);
+
+out:
+	strbuf_release(&key);
+	return ret;
+}
+
+/*
+ * Read the next record of the table into ti->bi.key and `raw`. Returns
+ * 1 at the end of the section.
+ */
+static int table_iter_next(struct reftable_table_iter *ti,
+			   struct raw_record *raw)
+{
+	int ret;
+
+	for (;;) {
+		if (ti->done)
+			return 1;
+		ret = block_iter_next(ti->r, &ti->bi, raw);
+		if (ret <= 0)
+			return ret;
+
+		ret = read_block(ti->r, ti->bi.block.next, &ti->bi.block);
+		if (ret < 0)
+			return ret;
+		if (ret > 0 || ti->bi.block.type != ti->type) {
+			ti->done = 1;
+			return 1;
+		}
+		block_iter_rewind(&ti->bi);
+	}
+}
+
+static const unsigned char *read_string(const unsigned char *p, char **out)
+{
+	uint64_t len;
+
+	/* the length was checked by skip_value() */
+	get_varint(&p, p + 16, &len);
+	free(*out);
+	*out = xmemdupz(p, len);
+	return p + len;
+}
+
+static int table_iter_next_ref(struct reftable_table_iter *ti,
+			       struct reftable_ref_record *rec)
+{
+	size_t rawsz = ti->r->algo->rawsz;
+	struct raw_record raw;
+	const unsigned char *p;
+	uint64_t delta;
+	int ret = table_iter_next(ti, &raw);
+
+	if (ret)
+		return ret;
+
+	p = raw.value;
+	get_varint(&p, raw.value + raw.value_len, &delta);
+	free(rec->refname);
+	rec->refname = xmemdupz(ti->bi.key.buf, ti->bi.key.len);
+	rec->update_index = ti->r->min_update_index + delta;
+	rec->value_type = raw.extra;
+	FREE_AND_NULL(rec->target);
+	switch (rec->value_type) {
+	case REFTABLE_REF_VAL2:
+		memcpy(rec->peeled.hash, p + rawsz, rawsz);
+		/* fallthrough */
+	case REFTABLE_REF_VAL1:
+		memcpy(rec->value.hash, p, rawsz);
+		break;
+	case REFTABLE_REF_SYMREF:
+		read_string(p, &rec->target);
+		break;
+	case REFTABLE_REF_DELETION:
+		break;
+	}
+	return 0;
+}
+
+static int table_iter_next_log(struct reftable_table_iter *ti,
+			       struct reftable_log_record *rec)
+{
+	size_t rawsz = ti->r->algo->rawsz;
+	struct strbuf *key = &ti->bi.key;
+	struct raw_record raw;
+	const unsigned char *p;
+	uint64_t time;
+	int ret = table_iter_next(ti, &raw);
+
+	if (ret)
+		return ret;
+
+	if (key->len < 9 || key->buf[key->len - 9] ||
+	    memchr(key->buf, '\0', key->len - 9))
+		return corrupt(ti->r);
+	free(rec->refname);
+	rec->refname = xmemdupz(key->buf, key->len - 9);
+	rec->update_index = ~get_be64(key->buf + key->len - 8);
+	rec->deletion = !raw.extra;
+	if (rec->deletion)
+		return 0;
+
+	p = raw.value;
+	memcpy(rec->old_oid.hash, p, rawsz);
+	memcpy(rec->new_oid.hash, p + rawsz, rawsz);
+	p = read_string(p + 2 * rawsz, &rec->name);
+	p = read_string(p, &rec->email);
+	get_varint(&p, raw.value + raw.value_len, &time);
+	rec->time = time;
+	rec->tz = (int16_t)get_be16(p);
+	read_string(p + 2, &rec->message);
+	return 0;
+}
+
+static void table_iter_release(struct reftable_table_iter *ti)
+{
+	block_release(&ti->bi.block);
+	strbuf_release(&ti->bi.key);
+	reftable_ref_record_release(&ti->ref);
+	reftable_log_record_release(&ti->log);
+}
+
+/*
+ * Find the table holding the next record of the merged iteration. All
+ * other tables' records with the same key are shadowed by it and
+ * dropped. Returns -1 at the end.
+ */
+static int merged_iter_select(struct reftable_iterator *it, int logs)
+{
+	int best = -1;
+	size_t i;
+
+	for (i = 0; i < it->nr; i++) {
+		struct reftable_table_iter *ti = &it->subs[i];
+		int ret;
+
+		if (ti->pending)
+			continue;
+		ret = logs ? table_iter_next_log(ti, &ti->log) :
+			table_iter_next_ref(ti, &ti->ref);
+		if (ret < 0)
+			return -2;
+		ti->pending = !ret;
+	}
+
+	/* On ties, the newer table (which comes later) wins. */
+	for (i = 0; i < it->nr; i++)
+		if (it->subs[i].pending &&
+		    (best < 0 ||
+		     key_cmp(&it->subs[i].bi.key, &it->subs[best].bi.key) <= 0))
+			best = i;
+	if (best < 0)
+		return -1;
+
+	for (i = 0; i < it->nr; i++)
+		if (i != best && it->subs[i].pending &&
+		    !key_cmp(&it->subs[i].bi.key, &it->subs[best].bi.key))
+			it->subs[i].pending = 0;
+	it->subs[best].pending = 0;
+	return best;
+}
+
+int reftable_iterator_next_ref(struct reftable_iterator *it,
+			       struct reftable_ref_record *rec)
+{
+	for (;;) {
+		int i = merged_iter_select(it, 0);
+
+		if (i == -1)
+			return 1;
+		if (i < 0)
+			return -1;
+		if (it->subs[i].ref.value_type == REFTABLE_REF_DELETION &&
+		    !it->include_deletions)
+			continue;
+		SWAP(*rec, it->subs[i].ref);
+		return 0;
+	}
+}
+
+int reftable_iterator_next_log(struct reftable_iterator *it,
+			       struct reftable_log_record *rec)
+{
+	for (;;) {
+		int i = merged_iter_select(it, 1);
+
+		if (i == -1)
+			return 1;
+		if (i < 0)
+			return -1;
+		if (it->subs[i].log.deletion && !it->include_deletions)
+			continue;
+		SWAP(*rec, it->subs[i].log);
+		return 0;
+	}
+}
+
+static int merged_iter_init(struct reftable_iterator *it,
+			    struct reftable_reader **readers, size_t nr,
+			    unsigned char type, const struct strbuf *want)
+{
+	size_t i;
+
+	memset(it, 0, sizeof(*it));
+	ALLOC_ARRAY(it->readers, nr);
+	COPY_ARRAY(it->readers, readers, nr);
+	it->nr = nr;
+	it->subs = xcalloc(nr, sizeof(*it->subs));
+	for (i = 0; i < nr; i++)
+		it->readers[i]->refcount++;
+
+	for (i = 0; i < nr; i++)
+		if (table_iter_seek(&it->subs[i], readers[i], type, want) < 0) {
+			reftable_iterator_release(it);
+			return -1;
+		}
+	return 0;
+}
+
+void reftable_iterator_release(struct reftable_iterator *it)
+{
+	size_t i;
+
+	for (i = 0; i < it->nr; i++) {
+		table_iter_release(&it->subs[i]);
+		reader_decref(it->readers[i]);
+	}
+	free(it->subs);
+	free(it->readers);
+	memset(it, 0, sizeof(*it));
+}
+
+/*
+ * Stacks.
+ *
+ * The tables of a stack are listed, oldest first, in "tables.list".
+ * That file is replaced (under its lock) whenever a table is added or
+ * tables are merged; tables are never modified once they are listed.
+ */
+
+struct reftable_stack *reftable_stack_new(const char *dir,
+					  const struct git_hash_algo *algo)
+{
+	struct reftable_stack *st = xcalloc(1, sizeof(*st));
+
+	st->dir = xstrdup(dir);
+	st->list_file = xstrfmt("%s/tables.list", dir);
+	st->algo = algo;
+	return st;
+}
+
+static void stack_set_readers(struct reftable_stack *st,
+			      struct reftable_reader **readers, size_t nr)
+{
+	size_t i;
+
+	for (i = 0; i < st->nr; i++)
+		reader_decref(st->readers[i]);
+	free(st->readers);
+	st->readers = readers;
+	st->nr = st->alloc = nr;
+}
+
+void reftable_stack_free(struct reftable_stack *st)
+{
+	if (!st)
+		return;
+	stack_set_readers(st, NULL, 0);
+	free(st->list);
+	free(st->dir);
+	free(st->list_file);
+	free(st);
+}
+
+static struct reftable_reader *stack_find_reader(struct reftable_stack *st,
+						 const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < st->nr; i++)
+		if (!strcmp(st->readers[i]->name, name))
+			return st->readers[i];
+	return NULL;
+}
+
+static int stack_reload_once(struct reftable_stack *st)
+{
+	struct strbuf list = STRBUF_INIT;
+	struct string_list names = STRING_LIST_INIT_NODUP;
+	struct reftable_reader **readers = NULL;
+	size_t i, nr = 0;
+	int ret = 0;
+
+	if (strbuf_read_file(&list, st->list_file, 0) < 0) {
+		if (errno != ENOENT)
+			return error_errno(_("unable to read '%s'"),
+					   st->list_file);
+		FREE_AND_NULL(st->list);
+		stack_set_readers(st, NULL, 0);
+		return 0;
+	}
+	if (st->list && !strcmp(st->list, list.buf)) {
+		strbuf_release(&list);
+		return 0;
+	}
+	free(st->list);
+	st->list = xstrdup(list.buf);
+
+	string_list_split_in_place(&names, list.buf, '\n', -1);
+	ALLOC_ARRAY(readers, names.nr);
+	for (i = 0; i < names.nr; i++) {
+		const char *name = names.items[i].string;
+		struct reftable_reader *r;
+
+		if (!*name)
+			continue;
+		r = stack_find_reader(st, name);
+		if (r) {
+			r->refcount++;
+		} else {
+			r = reader_open(st->dir, name, st->algo);
+			if (!r) {
+				/* maybe it was merged away under us */
+				ret = errno == ENOENT ? 1 : -1;
+				goto out;
+			}
+		}
+		readers[nr++] = r;
+	}
+
+	stack_set_readers(st, readers, nr);
+	readers = NULL;
+	nr = 0;
+
+out:
+	for (i = 0; i < nr; i++)
+		reader_decref(readers[i]);
+	free(readers);
+	if (ret)
+		FREE_AND_NULL(st->list);
+	string_list_clear(&names, 0);
+	strbuf_release(&list);
+	return ret;
+}
+
+int reftable_stack_reload(struct reftable_stack *st)
+{
+	int tries = 5, ret;
+
+	while ((ret = stack_reload_once(st)) > 0 && --tries)
+		; /* try again */
+	if (ret > 0)
+		ret = error_errno(_("unable to open the tables of '%s'"),
+				  st->list_file);
+	return ret;
+}
+
+static uint64_t stack_next_update_index(struct reftable_stack *st)
+{
+	return st->nr ? st->readers[st->nr - 1]->max_update_index + 1 : 1;
+}
+
+int reftable_stack_init_ref_iterator(struct reftable_stack *st,
+				     struct reftable_iterator *it,
+				     const char *prefix)
+{
+	struct strbuf want = STRBUF_INIT;
+	int ret;
+
+	if (reftable_stack_reload(st))
+		return -1;
+	if (prefix)
+		strbuf_addstr(&want, prefix);
+	ret = merged_iter_init(it, st->readers, st->nr, BLOCK_TYPE_REF, &want);
+	strbuf_release(&want);
+	return ret;
+}
+
+int reftable_stack_init_log_iterator(struct reftable_stack *st,
+				     struct reftable_iterator *it,
+				     const char *refname)
+{
+	struct strbuf want = STRBUF_INIT;
+	int ret;
+
+	if (reftable_stack_reload(st))
+		return -1;
+	if (refname)
+		strbuf_add(&want, refname, strlen(refname) + 1);
+	ret = merged_iter_init(it, st->readers, st->nr, BLOCK_TYPE_LOG, &want);
+	strbuf_release(&want);
+	return ret;
+}
+
+int reftable_stack_read_ref(struct reftable_stack *st, const char *refname,
+			    struct reftable_ref_record *rec)
+{
+	struct reftable_iterator it;
+	int ret;
+
+	if (reftable_stack_init_ref_iterator(st, &it, refname))
+		return -1;
+	ret = reftable_iterator_next_ref(&it, rec);
+	if (!ret && strcmp(rec->refname, refname))
+		ret = 1;
+	reftable_iterator_release(&it);
+	return ret;
+}
+
+static int lock_stack(struct reftable_stack *st, long timeout_ms,
+		      struct strbuf *err)
+{
+	if (mkdir(st->dir, 0777) < 0) {
+		if (errno != EEXIST) {
+			strbuf_addf(err, _("unable to create directory '%s': %s"),
+				    st->dir, strerror(errno));
+			return -1;
+		}
+	} else {
+		adjust_shared_perm(st->dir);
+	}
+
+	if (hold_lock_file_for_update_timeout(&st->lock, st->list_file, 0,
+					      timeout_ms) < 0) {
+		unable_to_lock_message(st->list_file, errno, err);
+		return -1;
+	}
+	if (reftable_stack_reload(st)) {
+		rollback_lock_file(&st->lock);
+		strbuf_addf(err, _("unable to read '%s'"), st->list_file);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Write the table in `data` into the stack directory and return its
+ * name, or NULL on errors.
+ */
+static char *write_table_file(struct reftable_stack *st,
+			      const struct strbuf *data,
+			      uint64_t min_update_index,
+			      uint64_t max_update_index,
+			      struct strbuf *err)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct tempfile *tmp;
+	char *name;
+
+	strbuf_addf(&path, "%s/tmp_table_XXXXXX", st->dir);
+	tmp = mks_tempfile(path.buf);
+	if (!tmp) {
+		strbuf_addf(err, _("unable to create '%s': %s"),
+			    path.buf, strerror(errno));
+		strbuf_release(&path);
+		return NULL;
+	}
+
+	name = xstrfmt("0x%012"PRIx64"-0x%012"PRIx64"-%08"PRIx32".ref",
+		       min_update_index, max_update_index,
+		       (uint32_t)crc32(0, (unsigned char *)data->buf, data->len));
+	strbuf_reset(&path);
+	strbuf_addf(&path, "%s/%s", st->dir, name);
+
+	if (write_in_full(get_tempfile_fd(tmp), data->buf, data->len) < 0 ||
+	    close_tempfile_gently(tmp) < 0 ||
+	    adjust_shared_perm(get_tempfile_path(tmp)) < 0 ||
+	    rename_tempfile(&tmp, path.buf) < 0) {
+		strbuf_addf(err, _("unable to write '%s': %s"),
+			    path.buf, strerror(errno));
+		delete_tempfile(&tmp);
+		FREE_AND_NULL(name);
+	}
+	strbuf_release(&path);
+	return name;
+}
+
+/*
+ * Replace the tables first..last (inclusive) of the locked stack by
+ * `name`, or add it on top if first > last. Releases the lock.
+ */
+static int commit_table_list(struct reftable_stack *st, size_t first,
+			     size_t last, const char *name, struct strbuf *err)
+{
+	struct strbuf list = STRBUF_INIT;
+	size_t i;
+	int ret = 0;
+
+	for (i = 0; i < st->nr; i++) {
+		if (i == first)
+			strbuf_addf(&list, "%s\n", name);
+		if (i < first || i > last)
+			strbuf_addf(&list, "%s\n", st->readers[i]->name);
+	}
+	if (first >= st->nr)
+		strbuf_addf(&list, "%s\n", name);
+
+	if (write_in_full(get_lock_file_fd(&st->lock), list.buf, list.len) < 0 ||
+	    commit_lock_file(&st->lock) < 0) {
+		strbuf_addf(err, _("unable to write '%s': %s"),
+			    st->list_file, strerror(errno));
+		rollback_lock_file(&st->lock);
+		ret = -1;
+	}
+	strbuf_release(&list);
+	return ret;
+}
+
+static void unlink_table(struct reftable_stack *st, const char *name)
+{
+	char *path = xstrfmt("%s/%s", st->dir, name);
+
+	unlink_or_warn(path);
+	free(path);
+}
+
+/*
+ * Merge the tables first..last (inclusive) of the locked stack into
+ * one. Tombstones can only be dropped when nothing is below them.
+ * Releases the lock.
+ */
+static int stack_compact_locked(struct reftable_stack *st, size_t first,
+				size_t last, struct strbuf *err)
+{
+	struct reftable_iterator it;
+	struct reftable_ref_record *refs = NULL;
+	struct reftable_log_record *logs = NULL;
+	size_t refs_nr = 0, refs_alloc = 0, logs_nr = 0, logs_alloc = 0;
+	struct strbuf all = STRBUF_INIT, table = STRBUF_INIT;
+	struct string_list obsolete = STRING_LIST_INIT_DUP;
+	size_t i;
+	char *name = NULL;
+	int ret = -1;
+
+	if (merged_iter_init(&it, st->readers + first, last - first + 1,
+			     BLOCK_TYPE_REF, &all) < 0)
+		goto out;
+	it.include_deletions = !!first;
+	for (;;) {
+		ALLOC_GROW(refs, refs_nr + 1, refs_alloc);
+		memset(&refs[refs_nr], 0, sizeof(*refs));
+		ret = reftable_iterator_next_ref(&it, &refs[refs_nr]);
+		if (ret)
+			break;
+		refs_nr++;
+	}
+	reftable_ref_record_release(&refs[refs_nr]);
+	reftable_iterator_release(&it);
+	if (ret < 0)
+		goto out;
+
+	if (merged_iter_init(&it, st->readers + first, last - first + 1,
+			     BLOCK_TYPE_LOG, &all) < 0) {
+		ret = -1;
+		goto out;
+	}
+	it.include_deletions = !!first;
+	for (;;) {
+		ALLOC_GROW(logs, logs_nr + 1, logs_alloc);
+		memset(&logs[logs_nr], 0, sizeof(*logs));
+		ret = reftable_iterator_next_log(&it, &logs[logs_nr]);
+		if (ret)
+			break;
+		logs_nr++;
+	}
+	reftable_log_record_release(&logs[logs_nr]);
+	reftable_iterator_release(&it);
+	if (ret < 0)
+		goto out;
+
+	reftable_write_table(&table, st->algo,
+			     st->readers[first]->min_update_index,
+			     st->readers[last]->max_update_index,
+			     refs, refs_nr, logs, logs_nr);
+	name = write_table_file(st, &table,
+				st->readers[first]->min_update_index,
+				st->readers[last]->max_update_index, err);
+	ret = -1;
+	if (!name)
+		goto out;
+
+	for (i = first; i <= last; i++)
+		if (strcmp(st->readers[i]->name, name))
+			string_list_append(&obsolete, st->readers[i]->name);
+	ret = commit_table_list(st, first, last, name, err);
+	if (ret < 0) {
+		unlink_table(st, name);
+		goto out;
+	}
+
+	/* Readers that still use them keep their mappings. */
+	for (i = 0; i < obsolete.nr; i++)
+		unlink_table(st, obsolete.items[i].string);
+
+out:
+	if (is_lock_file_locked(&st->lock))
+		rollback_lock_file(&st->lock);
+	for (i = 0; i < refs_nr; i++)
+		reftable_ref_record_release(&refs[i]);
+	for (i = 0; i < logs_nr; i++)
+		reftable_log_record_release(&logs[i]);
+	free(refs);
+	free(logs);
+	free(name);
+	string_list_clear(&obsolete, 0);
+	strbuf_release(&table);
+	return ret;
+}
+
+/*
+ * Keep the sizes of the tables geometric: merge the tables on top of
+ * the stack as long as the one below them is not more than twice as
+ * large as all of them together. This way each record is rewritten
+ * only a logarithmic number of times.
+ */
+static size_t compaction_start(struct reftable_stack *st)
+{
+	size_t i, sum;
+
+	if (st->nr < 2)
+		return st->nr;
+	i = st->nr - 1;
+	sum = st->readers[i]->size;
+	while (i > 0 && st->readers[i - 1]->size <= 2 * sum)
+		sum += st->readers[--i]->size;
+	return i;
+}
+
+static void stack_auto_compact(struct reftable_stack *st)
+{
+	struct strbuf err = STRBUF_INIT;
+	size_t first;
+
+	if (compaction_start(st) + 1 >= st->nr)
+		return;
+
+	/* Somebody else is busy with the stack; let them do it. */
+	if (lock_stack(st, 0, &err) < 0)
+		goto out;
+	first = compaction_start(st);
+	if (first + 1 >= st->nr) {
+		rollback_lock_file(&st->lock);
+		goto out;
+	}
+	if (stack_compact_locked(st, first, st->nr - 1, &err) < 0)
+		warning("%s", err.buf);
+
+out:
+	strbuf_release(&err);
+}
+
+int reftable_stack_compact_all(struct reftable_stack *st, struct strbuf *err)
+{
+	if (lock_stack(st, st->lock_timeout_ms, err) < 0)
+		return -1;
+	if (st->nr < 2) {
+		rollback_lock_file(&st->lock);
+		return 0;
+	}
+	return stack_compact_locked(st, 0, st->nr - 1, err);
+}
+
+struct reftable_addition *reftable_stack_new_addition(struct reftable_stack *st,
+						      struct strbuf *err)
+{
+	struct reftable_addition *add;
+
+	if (lock_stack(st, st->lock_timeout_ms, err) < 0)
+		return NULL;
+	add = xcalloc(1, sizeof(*add));
+	add->stack = st;
+	add->update_index = stack_next_update_index(st);
+	return add;
+}
+
+void reftable_addition_add_ref(struct reftable_addition *add,
+			       const struct reftable_ref_record *rec)
+{
+	ALLOC_GROW(add->refs, add->refs_nr + 1, add->refs_alloc);
+	memset(&add->refs[add->refs_nr], 0, sizeof(*add->refs));
+	reftable_ref_record_copy(&add->refs[add->refs_nr++], rec);
+}
+
+void reftable_addition_add_log(struct reftable_addition *add,
+			       const struct reftable_log_record *rec)
+{
+	ALLOC_GROW(add->logs, add->logs_nr + 1, add->logs_alloc);
+	memset(&add->logs[add->logs_nr], 0, sizeof(*add->logs));
+	reftable_log_record_copy(&add->logs[add->logs_nr++], rec);
+}
+
+static int ref_record_cmp(const void *va, const void *vb)
+{
+	const struct reftable_ref_record *a = va, *b = vb;
+
+	return strcmp(a->refname, b->refname);
+}
+
+static int log_record_cmp(const void *va, const void *vb)
+{
+	const struct reftable_log_record *a = va, *b = vb;
+	int cmp = strcmp(a->refname, b->refname);
+
+	if (cmp)
+		return cmp;
+	return a->update_index < b->update_index ? 1 :
+		a->update_index > b->update_index ? -1 : 0;
+}
+
+/*
+ * Sort the records added to an addition, keeping only the last one
+ * added for each key.
+ */
+#define SORT_AND_DEDUP(recs, nr, cmp, release) do { \
+	size_t i_, j_ = 0; \
+	STABLE_QSORT((recs), (nr), (cmp)); \
+	for (i_ = 0; i_ < (nr); i_++) { \
+		if (i_ + 1 < (nr) && !cmp(&(recs)[i_], &(recs)[i_ + 1])) { \
+			release(&(recs)[i_]); \
+			continue; \
+		} \
+		(recs)[j_++] = (recs)[i_]; \
+	} \
+	(nr) = j_; \
+} while (0)
+
+static void addition_free(struct reftable_addition *add)
+{
+	size_t i;
+
+	for (i = 0; i < add->refs_nr; i++)
+		reftable_ref_record_release(&add->refs[i]);
+	for (i = 0; i < add->logs_nr; i++)
+		reftable_log_record_release(&add->logs[i]);
+	free(add->refs);
+	free(add->logs);
+	free(add);
+}
+
+void reftable_addition_abort(struct reftable_addition *add)
+{
+	if (!add)
+		return;
+	rollback_lock_file(&add->stack->lock);
+	addition_free(add);
+}
+
+int reftable_addition_commit(struct reftable_addition *add, struct strbuf *err)
+{
+	struct reftable_stack *st = add->stack;
+	struct strbuf table = STRBUF_INIT;
+	char *name;
+	int ret = 0;
+
+	SORT_AND_DEDUP(add->refs, add->refs_nr, ref_record_cmp,
+		       reftable_ref_record_release);
+	SORT_AND_DEDUP(add->logs, add->logs_nr, log_record_cmp,
+		       reftable_log_record_release);
+	if (!add->refs_nr && !add->logs_nr) {
+		reftable_addition_abort(add);
+		return 0;
+	}
+
+	reftable_write_table(&table, st->algo,
+			     add->update_index, add->update_index,
+			     add->refs, add->refs_nr, add->logs, add->logs_nr);
+	name = write_table_file(st, &table, add->update_index,
+				add->update_index, err);
+	if (!name) {
+		rollback_lock_file(&st->lock);
+		ret = -1;
+	} else if (commit_table_list(st, st->nr, st->nr, name, err) < 0) {
+		unlink_table(st, name);
+		ret = -1;
+	}
+
+	if (!ret && !reftable_stack_reload(st))
+		stack_auto_compact(st);
+
+	free(name);
+	strbuf_release(&table);
+	addition_free(add);
+	return ret;
+}
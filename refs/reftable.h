@@ -0,0 +1,188 @@
+#ifndef REFS_REFTABLE_H
+#define REFS_REFTABLE_H
+
+#include "../cache.h"
+#include "../lockfile.h"
+
+/*
+ * Support for reading and writing reftables, the block-based file
+ * format used by the "reftable" reference backend (see
+ * Documentation/technical/reftable.txt for the format itself).
+ *
+ * A reftable is an immutable file holding references and reflog
+ * entries, sorted by name and split into prefix-compressed blocks.
+ * A repository keeps a stack of them: each change to the references
+ * adds a small table on top of the stack, and the tables on top are
+ * merged from time to time to keep the stack short. A record in a
+ * table shadows the records with the same key in the tables below it.
+ */
+
+#define REFTABLE_BLOCK_SIZE 4096
+
+enum reftable_ref_value_type {
+	REFTABLE_REF_DELETION = 0, /* a tombstone */
+	REFTABLE_REF_VAL1 = 1,     /* an object name */
+	REFTABLE_REF_VAL2 = 2,     /* an object name and its peeled value */
+	REFTABLE_REF_SYMREF = 3,   /* a symbolic reference */
+};
+
+struct reftable_ref_record {
+	char *refname;
+	uint64_t update_index;
+	enum reftable_ref_value_type value_type;
+	struct object_id value;
+	struct object_id peeled;
+	char *target;
+};
+
+/*
+ * A reflog entry of `refname`, keyed by the update index of the change
+ * that wrote it. Entries of a reflog are iterated newest first.
+ */
+struct reftable_log_record {
+	char *refname;
+	uint64_t update_index;
+	int deletion; /* a tombstone hiding the older entry with this key */
+	struct object_id old_oid;
+	struct object_id new_oid;
+	char *name;
+	char *email;
+	timestamp_t time;
+	int tz;
+	char *message;
+};
+
+void reftable_ref_record_release(struct reftable_ref_record *rec);
+void reftable_ref_record_copy(struct reftable_ref_record *dst,
+			      const struct reftable_ref_record *src);
+void reftable_log_record_release(struct reftable_log_record *rec);
+void reftable_log_record_copy(struct reftable_log_record *dst,
+			      const struct reftable_log_record *src);
+
+/*
+ * Serialize a table holding the given records into `out`. The records
+ * must be sorted: references by name, reflog entries by name and then
+ * by decreasing update index. Keys must be unique.
+ */
+void reftable_write_table(struct strbuf *out, const struct git_hash_algo *algo,
+			  uint64_t min_update_index, uint64_t max_update_index,
+			  const struct reftable_ref_record *refs, size_t refs_nr,
+			  const struct reftable_log_record *logs, size_t logs_nr);
+
+/*
+ * A table of the stack, mapped into memory. Readers are reference
+ * counted, so that iterators keep working on a consistent snapshot
+ * while the stack is reloaded under them.
+ */
+struct reftable_reader;
+
+/*
+ * A merged iterator over the tables of a stack, returning the newest
+ * record for each key. Tombstones are skipped unless
+ * `include_deletions` is set.
+ */
+struct reftable_iterator {
+	struct reftable_reader **readers;
+	size_t nr;
+	struct reftable_table_iter *subs;
+	int include_deletions;
+};
+
+/*
+ * Return the next reference or reflog entry, depending on how the
+ * iterator was initialized. Returns 0 if `rec` was filled in, 1 at the
+ * end of the iteration and -1 (after reporting an error) if a table
+ * turned out to be corrupt. `rec` is owned by the caller and can be
+ * reused from call to call.
+ */
+int reftable_iterator_next_ref(struct reftable_iterator *it,
+			       struct reftable_ref_record *rec);
+int reftable_iterator_next_log(struct reftable_iterator *it,
+			       struct reftable_log_record *rec);
+void reftable_iterator_release(struct reftable_iterator *it);
+
+struct reftable_stack {
+	char *dir;
+	char *list_file;
+	const struct git_hash_algo *algo;
+
+	/* the tables, oldest first */
+	struct reftable_reader **readers;
+	size_t nr, alloc;
+
+	char *list; /* contents of tables.list when last read */
+	struct lock_file lock;
+	long lock_timeout_ms;
+};
+
+/*
+ * Prepare to use the stack in `dir`. Nothing is read or written
+ * until the stack is used; a missing directory is an empty stack.
+ */
+struct reftable_stack *reftable_stack_new(const char *dir,
+					  const struct git_hash_algo *algo);
+void reftable_stack_free(struct reftable_stack *st);
+
+/*
+ * Make sure that we look at the current tables of the stack. Returns 0
+ * on success and -1 (after reporting an error) on failure.
+ */
+int reftable_stack_reload(struct reftable_stack *st);
+
+/*
+ * Look up a reference. Returns 0 if it was found, 1 if it does not
+ * exist and -1 on errors.
+ */
+int reftable_stack_read_ref(struct reftable_stack *st, const char *refname,
+			    struct reftable_ref_record *rec);
+
+/*
+ * Iterate over the references starting at `prefix` (or over all
+ * references if it is NULL), or over the reflog entries of `refname`
+ * (or all of them). The iteration ends with the last key of the
+ * stack; callers stop when they are past the names they want.
+ */
+int reftable_stack_init_ref_iterator(struct reftable_stack *st,
+				     struct reftable_iterator *it,
+				     const char *prefix);
+int reftable_stack_init_log_iterator(struct reftable_stack *st,
+				     struct reftable_iterator *it,
+				     const char *refname);
+
+/*
+ * A new table in the making. Creating an addition locks the stack
+ * until it is committed or aborted; records are added in any order,
+ * and a record replaces an earlier one with the same key.
+ */
+struct reftable_addition {
+	struct reftable_stack *stack;
+	uint64_t update_index;
+
+	struct reftable_ref_record *refs;
+	size_t refs_nr, refs_alloc;
+	struct reftable_log_record *logs;
+	size_t logs_nr, logs_alloc;
+};
+
+struct reftable_addition *reftable_stack_new_addition(struct reftable_stack *st,
+						      struct strbuf *err);
+void reftable_addition_add_ref(struct reftable_addition *add,
+			       const struct reftable_ref_record *rec);
+void reftable_addition_add_log(struct reftable_addition *add,
+			       const struct reftable_log_record *rec);
+
+/*
+ * Write the new table, add it to the stack and release the lock. The
+ * addition is freed in any case. After a successful commit, the top of
+ * the stack is compacted if it grew out of shape.
+ */
+int reftable_addition_commit(struct reftable_addition *add, struct strbuf *err);
+void reftable_addition_abort(struct reftable_addition *add);
+
+/*
+ * Merge all tables of the stack into one, dropping tombstones and
+ * whatever they hide. Returns 0 on success and -1 on errors.
+ */
+int reftable_stack_compact_all(struct reftable_stack *st, struct strbuf *err);
+
+#endif /* REFS_REFTABLE_H */
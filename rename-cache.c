@@ -0,0 +1,502 @@
+#include "cache.h"
+#include "config.h"
+#include "csum-file.h"
+#include "dir.h"
+#include "hashmap.h"
+#include "lockfile.h"
+#include "object-store.h"
+#include "rename-cache.h"
+#include "repository.h"
+#include "trace2.h"
+
+/*
+ * The file starts with a header made of the signature, the version, the
+ * id of the hash function and the number of entries, all 4-byte network
+ * order integers. It is followed by the entries, sorted by their key,
+ * and the checksum of everything before it.
+ *
+ * Each entry is made of:
+ *
+ *   - the key: the object name of the source blob, the object name of
+ *     the destination blob and a byte of flags;
+ *   - the score, as a 2-byte network order integer;
+ *   - the sizes of the source and the destination, as 8-byte network
+ *     order integers;
+ *   - the time the entry was last used, as a 4-byte network order
+ *     integer.
+ */
+#define RENAME_CACHE_SIGNATURE 0x524e4341 /* "RNCA" */
+#define RENAME_CACHE_VERSION 1
+#define RENAME_CACHE_HEADER_SIZE 16
+#define RENAME_CACHE_MAX_KEY (2 * GIT_MAX_RAWSZ + 1)
+
+#define RENAME_CACHE_DEFAULT_LIMIT 100000
+
+/*
+ * The time an entry was last used is only updated when it is older
+ * than this, so that looking up the same entries over and over again
+ * does not rewrite the file every time.
+ */
+#define RENAME_CACHE_TOUCH_INTERVAL (24 * 60 * 60)
+
+struct rename_cache_entry {
+	struct hashmap_entry ent;
+	unsigned char key[RENAME_CACHE_MAX_KEY];
+	struct rename_cache_score score;
+	uint32_t used;
+};
+
+struct rename_cache_file {
+	unsigned char *map;
+	size_t map_size;
+	uint32_t nr;
+	const unsigned char *entries;
+};
+
+static struct rename_cache {
+	int initialized;
+	int enabled;
+	int limit;
+	struct rename_cache_file file;
+	/* entries to write out, either new or recently used */
+	struct hashmap pending;
+	int hits;
+	int stored;
+} rename_cache;
+
+static size_t key_size(void)
+{
+	return 2 * the_hash_algo->rawsz + 1;
+}
+
+static size_t entry_size(void)
+{
+	return key_size() + 2 + 8 + 8 + 4;
+}
+
+static void make_key(unsigned char *key,
+		     const struct object_id *src,
+		     const struct object_id *dst,
+		     unsigned flags)
+{
+	size_t rawsz = the_hash_algo->rawsz;
+
+	memcpy(key, src->hash, rawsz);
+	memcpy(key + rawsz, dst->hash, rawsz);
+	key[2 * rawsz] = flags;
+}
+
+static void decode_entry(struct rename_cache_entry *e,
+			 const unsigned char *data)
+{
+	size_t len = key_size();
+
+	memcpy(e->key, data, len);
+	data += len;
+	e->score.score = get_be16(data);
+	e->score.src_size = get_be64(data + 2);
+	e->score.dst_size = get_be64(data + 10);
+	e->used = get_be32(data + 18);
+}
+
+static void encode_entry(unsigned char *data,
+			 const struct rename_cache_entry *e)
+{
+	size_t len = key_size();
+
+	memcpy(data, e->key, len);
+	data += len;
+	put_be16(data, e->score.score);
+	put_be64(data + 2, e->score.src_size);
+	put_be64(data + 10, e->score.dst_size);
+	put_be32(data + 18, e->used);
+}
+
+static int pending_entry_cmp(const void *unused_cmp_data,
+			     const struct hashmap_entry *eptr,
+			     const struct hashmap_entry *entry_or_key,
+			     const void *unused_keydata)
+{
+	const struct rename_cache_entry *a, *b;
+
+	a = container_of(eptr, const struct rename_cache_entry, ent);
+	b = container_of(entry_or_key, const struct rename_cache_entry, ent);
+	return memcmp(a->key, b->key, key_size());
+}
+
+static uint32_t now(void)
+{
+	return (uint32_t)time(NULL);
+}
+
+static char *rename_cache_path(struct repository *r)
+{
+	return repo_git_path(r, "rename-cache");
+}
+
+/*
+ * Map the cache file of the repository. A missing file is an empty
+ * cache; a file that does not look right is treated the same way, so
+ * that the next write replaces it, and reported unless "quiet".
+ */
+static void open_rename_cache_file(struct repository *r,
+				   struct rename_cache_file *f,
+				   int quiet)
+{
+	char *path = rename_cache_path(r);
+	const unsigned char *data;
+	struct stat st;
+	size_t size;
+	int fd;
+
+	memset(f, 0, sizeof(*f));
+
+	fd = git_open(path);
+	if (fd < 0) {
+		if (errno != ENOENT && !quiet)
+			warning_errno(_("could not open '%s'"), path);
+		goto out;
+	}
+	if (fstat(fd, &st)) {
+		if (!quiet)
+			warning_errno(_("could not stat '%s'"), path);
+		close(fd);
+		goto out;
+	}
+	size = xsize_t(st.st_size);
+	if (size < RENAME_CACHE_HEADER_SIZE + the_hash_algo->rawsz) {
+		if (!quiet)
+			warning(_("rename cache '%s' is too small"), path);
+		close(fd);
+		goto out;
+	}
+	f->map = xmmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	f->map_size = size;
+	close(fd);
+
+	data = f->map;
+	if (get_be32(data) != RENAME_CACHE_SIGNATURE ||
+	    get_be32(data + 4) != RENAME_CACHE_VERSION ||
+	    get_be32(data + 8) != the_hash_algo->format_id) {
+		if (!quiet)
+			warning(_("ignoring rename cache '%s' of unknown format"), path);
+		goto bad;
+	}
+	f->nr = get_be32(data + 12);
+	if (size != RENAME_CACHE_HEADER_SIZE + st_mult(f->nr, entry_size()) +
+		    the_hash_algo->rawsz) {
+		if (!quiet)
+			warning(_("rename cache '%s' has the wrong size"), path);
+		goto bad;
+	}
+	f->entries = data + RENAME_CACHE_HEADER_SIZE;
+	goto out;
+
+bad:
+	munmap(f->map, f->map_size);
+	memset(f, 0, sizeof(*f));
+out:
+	free(path);
+}
+
+static void close_rename_cache_file(struct rename_cache_file *f)
+{
+	if (f->map)
+		munmap(f->map, f->map_size);
+	memset(f, 0, sizeof(*f));
+}
+
+static const unsigned char *find_file_entry(const struct rename_cache_file *f,
+					    const unsigned char *key)
+{
+	size_t len = key_size(), width = entry_size();
+	uint32_t first = 0, last = f->nr;
+
+	while (first < last) {
+		uint32_t next = first + ((last - first) >> 1);
+		const unsigned char *data = f->entries + st_mult(next, width);
+		int cmp = memcmp(key, data, len);
+
+		if (!cmp)
+			return data;
+		if (cmp < 0)
+			last = next;
+		else
+			first = next + 1;
+	}
+	return NULL;
+}
+
+static int entry_key_cmp(const void *a_, const void *b_)
+{
+	const struct rename_cache_entry *a = *(const struct rename_cache_entry **)a_;
+	const struct rename_cache_entry *b = *(const struct rename_cache_entry **)b_;
+
+	return memcmp(a->key, b->key, key_size());
+}
+
+static int entry_used_cmp(const void *a_, const void *b_)
+{
+	const struct rename_cache_entry *a = *(const struct rename_cache_entry **)a_;
+	const struct rename_cache_entry *b = *(const struct rename_cache_entry **)b_;
+
+	/* most recently used first */
+	if (a->used != b->used)
+		return a->used < b->used ? 1 : -1;
+	return memcmp(a->key, b->key, key_size());
+}
+
+static int entry_is_missing(struct repository *r,
+			    const struct rename_cache_entry *e)
+{
+	unsigned flags = OBJECT_INFO_SKIP_FETCH_OBJECT | OBJECT_INFO_QUICK;
+	struct object_id src, dst;
+
+	oidread(&src, e->key);
+	oidread(&dst, e->key + the_hash_algo->rawsz);
+	return !repo_has_object_file_with_flags(r, &src, flags) ||
+	       !repo_has_object_file_with_flags(r, &dst, flags);
+}
+
+static int rename_cache_limit(struct repository *r)
+{
+	int limit = RENAME_CACHE_DEFAULT_LIMIT;
+
+	repo_config_get_int(r, "diff.renamecachelimit", &limit);
+	return limit;
+}
+
+/*
+ * Merge the "pending" entries into the cache file of the repository as
+ * it is on disk now, evict the least recently used entries above
+ * "limit" (when it is positive), and write the result out. With
+ * "prune_missing", also drop the entries whose blobs are gone.
+ *
+ * When the file is locked by another process, the pending entries are
+ * dropped silently unless "report" is set; they are only a cache.
+ */
+static int write_rename_cache(struct repository *r, struct hashmap *pending,
+			      int limit, int prune_missing, int report)
+{
+	struct lock_file lk = LOCK_INIT;
+	struct rename_cache_file f;
+	struct rename_cache_entry *file_entries, **list;
+	struct rename_cache_entry *e;
+	struct hashmap_iter iter;
+	struct hashfile *out;
+	unsigned char header[RENAME_CACHE_HEADER_SIZE];
+	unsigned char *buf;
+	size_t nr = 0, i, j, width = entry_size();
+	char *path = rename_cache_path(r);
+	int ret = 0;
+
+	if (hold_lock_file_for_update(&lk, path, 0) < 0) {
+		if (report)
+			ret = error_errno(_("unable to lock '%s'"), path);
+		free(path);
+		return ret;
+	}
+
+	open_rename_cache_file(r, &f, !report);
+	ALLOC_ARRAY(file_entries, f.nr);
+	ALLOC_ARRAY(list, st_add(f.nr, pending ? hashmap_get_size(pending) : 0));
+	for (i = 0; i < f.nr; i++) {
+		decode_entry(&file_entries[i], f.entries + st_mult(i, width));
+		list[nr++] = &file_entries[i];
+	}
+	close_rename_cache_file(&f);
+	if (pending)
+		hashmap_for_each_entry(pending, &iter, e, ent)
+			list[nr++] = e;
+
+	/*
+	 * Keep the most recently used copy of an entry that is both in
+	 * the file and pending, and the entries whose blobs still exist.
+	 */
+	QSORT(list, nr, entry_key_cmp);
+	for (i = j = 0; i < nr; i++) {
+		if (j && !memcmp(list[j - 1]->key, list[i]->key, key_size())) {
+			if (list[j - 1]->used < list[i]->used)
+				list[j - 1] = list[i];
+			continue;
+		}
+		if (prune_missing && entry_is_missing(r, list[i]))
+			continue;
+		list[j++] = list[i];
+	}
+	nr = j;
+
+	if (limit > 0 && nr > (size_t)limit) {
+		QSORT(list, nr, entry_used_cmp);
+		nr = limit;
+		QSORT(list, nr, entry_key_cmp);
+	}
+
+	out = hashfd(get_lock_file_fd(&lk), get_lock_file_path(&lk));
+	put_be32(header, RENAME_CACHE_SIGNATURE);
+	put_be32(header + 4, RENAME_CACHE_VERSION);
+	put_be32(header + 8, the_hash_algo->format_id);
+	put_be32(header + 12, nr);
+	hashwrite(out, header, sizeof(header));
+	buf = xmalloc(width);
+	for (i = 0; i < nr; i++) {
+		encode_entry(buf, list[i]);
+		hashwrite(out, buf, width);
+	}
+	finalize_hashfile(out, NULL, CSUM_HASH_IN_STREAM);
+
+	if (commit_lock_file(&lk))
+		ret = error_errno(_("unable to write '%s'"), path);
+
+	free(buf);
+	free(list);
+	free(file_entries);
+	free(path);
+	return ret;
+}
+
+static void flush_rename_cache(void)
+{
+	struct repository *r = the_repository;
+
+	trace2_data_intmax("diff", r, "rename-cache/hits", rename_cache.hits);
+	trace2_data_intmax("diff", r, "rename-cache/stored", rename_cache.stored);
+
+	if (!rename_cache.stored)
+		return;
+
+	/* the file may be replaced, which some platforms refuse while mapped */
+	close_rename_cache_file(&rename_cache.file);
+	write_rename_cache(r, &rename_cache.pending, rename_cache.limit, 0, 0);
+	hashmap_free_entries(&rename_cache.pending, struct rename_cache_entry, ent);
+	rename_cache.stored = 0;
+}
+
+int rename_cache_enabled(struct repository *r)
+{
+	if (r != the_repository)
+		return 0;
+	if (rename_cache.initialized)
+		return rename_cache.enabled;
+
+	rename_cache.initialized = 1;
+	if (repo_config_get_bool(r, "diff.renamecache", &rename_cache.enabled))
+		rename_cache.enabled = 0;
+	if (!rename_cache.enabled || !r->gitdir)
+		return rename_cache.enabled = 0;
+
+	rename_cache.limit = rename_cache_limit(r);
+	open_rename_cache_file(r, &rename_cache.file, 0);
+	hashmap_init(&rename_cache.pending, pending_entry_cmp, NULL, 0);
+	atexit(flush_rename_cache);
+	return 1;
+}
+
+unsigned rename_cache_flags(int src_binary, int dst_binary)
+{
+	return (src_binary + 1) | ((dst_binary + 1) << 2);
+}
+
+static struct rename_cache_entry *add_pending(const unsigned char *key)
+{
+	struct rename_cache_entry *e, k;
+	size_t len = key_size();
+
+	memcpy(k.key, key, len);
+	hashmap_entry_init(&k.ent, memhash(key, len));
+	e = hashmap_get_entry(&rename_cache.pending, &k, ent, NULL);
+	if (!e) {
+		e = xmalloc(sizeof(*e));
+		*e = k;
+		hashmap_add(&rename_cache.pending, &e->ent);
+	}
+	rename_cache.stored++;
+	return e;
+}
+
+int rename_cache_lookup(struct repository *r,
+			const struct object_id *src,
+			const struct object_id *dst,
+			unsigned flags,
+			struct rename_cache_score *out)
+{
+	struct rename_cache_entry *e, k;
+	const unsigned char *data;
+	size_t len = key_size();
+
+	if (!rename_cache_enabled(r))
+		return 0;
+
+	make_key(k.key, src, dst, flags);
+	hashmap_entry_init(&k.ent, memhash(k.key, len));
+	e = hashmap_get_entry(&rename_cache.pending, &k, ent, NULL);
+	if (e) {
+		*out = e->score;
+		rename_cache.hits++;
+		return 1;
+	}
+
+	data = find_file_entry(&rename_cache.file, k.key);
+	if (!data)
+		return 0;
+
+	decode_entry(&k, data);
+	*out = k.score;
+	rename_cache.hits++;
+	if (k.used + RENAME_CACHE_TOUCH_INTERVAL < now()) {
+		e = add_pending(k.key);
+		e->score = k.score;
+		e->used = now();
+	}
+	return 1;
+}
+
+void rename_cache_store(struct repository *r,
+			const struct object_id *src,
+			const struct object_id *dst,
+			unsigned flags,
+			const struct rename_cache_score *score)
+{
+	struct rename_cache_entry *e;
+	unsigned char key[RENAME_CACHE_MAX_KEY];
+
+	if (!rename_cache_enabled(r))
+		return;
+
+	make_key(key, src, dst, flags);
+	e = add_pending(key);
+	e->score = *score;
+	e->used = now();
+}
+
+int for_each_rename_cache_entry(struct repository *r,
+				rename_cache_fn fn, void *data)
+{
+	struct rename_cache_file f;
+	struct rename_cache_entry e;
+	struct object_id src, dst;
+	size_t rawsz = the_hash_algo->rawsz;
+	uint32_t i;
+	int ret = 0;
+
+	open_rename_cache_file(r, &f, 0);
+	for (i = 0; !ret && i < f.nr; i++) {
+		decode_entry(&e, f.entries + st_mult(i, entry_size()));
+		oidread(&src, e.key);
+		oidread(&dst, e.key + rawsz);
+		ret = fn(&src, &dst, e.key[2 * rawsz], &e.score, data);
+	}
+	close_rename_cache_file(&f);
+	return ret;
+}
+
+int rename_cache_prune(struct repository *r)
+{
+	char *path = rename_cache_path(r);
+	int exists = file_exists(path);
+
+	free(path);
+	if (!exists)
+		return 0;
+	return write_rename_cache(r, NULL, rename_cache_limit(r), 1, 1);
+}
@@ -0,0 +1,79 @@
+#ifndef RENAME_CACHE_H
+#define RENAME_CACHE_H
+
+struct repository;
+struct object_id;
+
+/*
+ * The rename cache remembers the similarity score that diffcore-rename
+ * computed for a pair of blobs, so that running rename detection over
+ * the same history again does not have to load and compare them again.
+ * It is stored in "$GIT_DIR/rename-cache" and only used when
+ * "diff.renameCache" is enabled.
+ *
+ * A score only depends on the contents of the two blobs and on whether
+ * the attributes force either side to be treated as text or binary;
+ * "flags" is made from the latter with rename_cache_flags().
+ */
+
+struct rename_cache_score {
+	int score;
+	unsigned long src_size;
+	unsigned long dst_size;
+};
+
+/*
+ * Turn the binary setting of the diff driver of the source and the
+ * destination (1, 0 or -1, see diff_filespec_binary_attr()) into the
+ * flags that are part of the key of an entry.
+ */
+unsigned rename_cache_flags(int src_binary, int dst_binary);
+
+/*
+ * Return 1 if the cache is enabled for the repository, 0 otherwise.
+ */
+int rename_cache_enabled(struct repository *r);
+
+/*
+ * Look up the score of renaming "src" to "dst". Returns 1 and fills
+ * "out" when it is known, 0 otherwise.
+ */
+int rename_cache_lookup(struct repository *r,
+			const struct object_id *src,
+			const struct object_id *dst,
+			unsigned flags,
+			struct rename_cache_score *out);
+
+/*
+ * Remember the score of renaming "src" to "dst". The new entries are
+ * written out when the process exits.
+ */
+void rename_cache_store(struct repository *r,
+			const struct object_id *src,
+			const struct object_id *dst,
+			unsigned flags,
+			const struct rename_cache_score *score);
+
+typedef int rename_cache_fn(const struct object_id *src,
+			    const struct object_id *dst,
+			    unsigned flags,
+			    const struct rename_cache_score *score,
+			    void *data);
+
+/*
+ * Call "fn" for each entry of the cache file of the repository, in the
+ * order they are stored, stopping early when it returns non-zero. The
+ * entries that are not written out yet are not included.
+ */
+int for_each_rename_cache_entry(struct repository *r,
+				rename_cache_fn fn, void *data);
+
+/*
+ * Rewrite the cache of the repository, dropping the entries whose blobs
+ * no longer exist and the least recently used ones above the limit set
+ * by "diff.renameCacheLimit". Returns 0 on success (including when
+ * there is no cache to rewrite) and -1 on error.
+ */
+int rename_cache_prune(struct repository *r);
+
+#endif /* RENAME_CACHE_H */
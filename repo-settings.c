@@ -19,14 +19,19 @@ void prepare_repo_settings(struct repository *r)
 		r->settings.core_commit_graph = value;
 	if (!repo_config_get_bool(r, "commitgraph.readchangedpaths", &value))
 		r->settings.commit_graph_read_changed_paths = value;
+	if (!repo_config_get_int(r, "commitgraph.generationversion", &value))
+		r->settings.commit_graph_generation_version = value;
 	if (!repo_config_get_bool(r, "gc.writecommitgraph", &value))
 		r->settings.gc_write_commit_graph = value;
 	UPDATE_DEFAULT_BOOL(r->settings.core_commit_graph, 1);
 	UPDATE_DEFAULT_BOOL(r->settings.commit_graph_read_changed_paths, 1);
+	UPDATE_DEFAULT_BOOL(r->settings.commit_graph_generation_version, 2);
 	UPDATE_DEFAULT_BOOL(r->settings.gc_write_commit_graph, 1);
 
 	if (!repo_config_get_int(r, "index.version", &value))
 		r->settings.index_version = value;
+	if (!repo_config_get_bool(r, "index.skiphash", &value))
+		r->settings.index_skip_hash = value;
 	if (!repo_config_get_maybe_bool(r, "core.untrackedcache", &value)) {
 		if (value == 0)
 			r->settings.core_untracked_cache = UNTRACKED_CACHE_REMOVE;
@@ -39,6 +44,11 @@ void prepare_repo_settings(struct repository *r)
 		free(strval);
 	}
 
+	if (!repo_config_get_bool(r, "index.sparse", &value))
+		r->settings.sparse_index = value;
+	UPDATE_DEFAULT_BOOL(r->settings.sparse_index, 0);
+	UPDATE_DEFAULT_BOOL(r->settings.command_requires_full_index, 1);
+
 	if (!repo_config_get_string(r, "fetch.negotiationalgorithm", &strval)) {
 		if (!strcasecmp(strval, "skipping"))
 			r->settings.fetch_negotiation_algorithm = FETCH_NEGOTIATION_SKIPPING;
@@ -54,9 +64,12 @@ void prepare_repo_settings(struct repository *r)
 
 	if (!repo_config_get_bool(r, "feature.manyfiles", &value) && value) {
 		UPDATE_DEFAULT_BOOL(r->settings.index_version, 4);
+		UPDATE_DEFAULT_BOOL(r->settings.index_skip_hash, 1);
 		UPDATE_DEFAULT_BOOL(r->settings.core_untracked_cache, UNTRACKED_CACHE_WRITE);
 	}
 
+	UPDATE_DEFAULT_BOOL(r->settings.index_skip_hash, 0);
+
 	if (!repo_config_get_bool(r, "fetch.writecommitgraph", &value))
 		r->settings.fetch_write_commit_graph = value;
 	UPDATE_DEFAULT_BOOL(r->settings.fetch_write_commit_graph, 0);
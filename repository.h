@@ -31,11 +31,21 @@ struct repo_settings {
 
 	int core_commit_graph;
 	int commit_graph_read_changed_paths;
+	int commit_graph_generation_version;
 	int gc_write_commit_graph;
 	int fetch_write_commit_graph;
 
 	int index_version;
+	int index_skip_hash;
 	enum untracked_cache_setting core_untracked_cache;
+	int sparse_index;
+
+	/*
+	 * Expand a sparse index when it is read.  Commands that know how
+	 * to work with sparse directory entries clear this before they
+	 * read the index.
+	 */
+	int command_requires_full_index;
 
 	int pack_use_sparse;
 	enum fetch_negotiation_setting fetch_negotiation_algorithm;
@@ -128,6 +138,12 @@ struct repository {
 	/* Repository's current hash algorithm, as serialized on disk. */
 	const struct git_hash_algo *hash_algo;
 
+	/*
+	 * Repository's reference storage format ("files" or
+	 * "reftable"), or NULL for the default "files".
+	 */
+	char *ref_storage_format;
+
 	/* A unique-id for tracing purposes. */
 	int trace2_repo_id;
 
@@ -158,6 +174,7 @@ void repo_set_gitdir(struct repository *repo, const char *root,
 		     const struct set_gitdir_args *extra_args);
 void repo_set_worktree(struct repository *repo, const char *path);
 void repo_set_hash_algo(struct repository *repo, int algo);
+void repo_set_ref_storage_format(struct repository *repo, const char *format);
 void initialize_the_repository(void);
 int repo_init(struct repository *r, const char *gitdir, const char *worktree);
 
@@ -15,6 +15,7 @@
 #include "revision.h"
 #include "rerere.h"
 #include "merge-recursive.h"
+#include "merge-ort.h"
 #include "refs.h"
 #include "strvec.h"
 #include "quote.h"
@@ -322,6 +323,13 @@ int sequencer_remove_state(struct replay_opts *opts)
 		free(opts->xopts[i]);
 	free(opts->xopts);
 	strbuf_release(&opts->current_fixups);
+	if (opts->ort_result) {
+		struct merge_options o;
+
+		init_merge_options(&o, the_repository);
+		merge_finalize(&o, opts->ort_result);
+		FREE_AND_NULL(opts->ort_result);
+	}
 
 	strbuf_reset(&buf);
 	strbuf_addstr(&buf, get_dir(opts));
@@ -620,9 +628,34 @@ static int do_recursive_merge(struct repository *r,
 	for (i = 0; i < opts->xopts_nr; i++)
 		parse_merge_opt(&o, opts->xopts[i]);
 
-	clean = merge_trees(&o,
-			    head_tree,
-			    next_tree, base_tree);
+	if (opts->strategy && !strcmp(opts->strategy, "ort")) {
+		struct strbuf sb = STRBUF_INIT;
+
+		/*
+		 * Keep the merge result across picks, so that renames
+		 * made by the branch we are replaying onto are only
+		 * detected once per sequence.
+		 */
+		if (!opts->ort_result)
+			opts->ort_result = xcalloc(1, sizeof(*opts->ort_result));
+
+		if (repo_index_has_changes(r, head_tree, &sb)) {
+			error(_("Your local changes to the following files would be overwritten by merge:\n  %s"),
+			      sb.buf);
+			strbuf_release(&sb);
+			clean = -1;
+		} else {
+			merge_incore_nonrecursive(&o, base_tree, head_tree,
+						  next_tree, opts->ort_result);
+			clean = opts->ort_result->clean;
+			if (merge_switch_to_result(&o, head_tree,
+						   opts->ort_result, 1, 1))
+				clean = -1;
+		}
+	} else
+		clean = merge_trees(&o,
+				    head_tree,
+				    next_tree, base_tree);
 	if (is_rebase_i(opts) && clean <= 0)
 		fputs(o.obuf.buf, stdout);
 	strbuf_release(&o.obuf);
@@ -1991,7 +2024,10 @@ static int do_pick_commit(struct repository *r,
 
 	if (is_rebase_i(opts) && write_author_script(msg.message) < 0)
 		res = -1;
-	else if (!opts->strategy || !strcmp(opts->strategy, "recursive") || command == TODO_REVERT) {
+	else if (!opts->strategy ||
+		 !strcmp(opts->strategy, "recursive") ||
+		 !strcmp(opts->strategy, "ort") ||
+		 command == TODO_REVERT) {
 		res = do_recursive_merge(r, base, next, base_label, next_label,
 					 &head, &msgbuf, opts);
 		if (res < 0)
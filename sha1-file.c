@@ -89,6 +89,27 @@ static void git_hash_sha1_final(unsigned char *hash, git_hash_ctx *ctx)
 	git_SHA1_Final(hash, &ctx->sha1);
 }
 
+static void git_hash_sha1_init_unsafe(git_hash_ctx *ctx)
+{
+	git_SHA1_Init_unsafe(&ctx->sha1_unsafe);
+}
+
+static void git_hash_sha1_clone_unsafe(git_hash_ctx *dst, const git_hash_ctx *src)
+{
+	git_SHA1_Clone_unsafe(&dst->sha1_unsafe, &src->sha1_unsafe);
+}
+
+static void git_hash_sha1_update_unsafe(git_hash_ctx *ctx, const void *data,
+					size_t len)
+{
+	git_SHA1_Update_unsafe(&ctx->sha1_unsafe, data, len);
+}
+
+static void git_hash_sha1_final_unsafe(unsigned char *hash, git_hash_ctx *ctx)
+{
+	git_SHA1_Final_unsafe(hash, &ctx->sha1_unsafe);
+}
+
 
 static void git_hash_sha256_init(git_hash_ctx *ctx)
 {
@@ -141,6 +162,10 @@ const struct git_hash_algo hash_algos[GIT_HASH_NALGOS] = {
 		git_hash_unknown_clone,
 		git_hash_unknown_update,
 		git_hash_unknown_final,
+		git_hash_unknown_init,
+		git_hash_unknown_clone,
+		git_hash_unknown_update,
+		git_hash_unknown_final,
 		NULL,
 		NULL,
 	},
@@ -155,6 +180,10 @@ const struct git_hash_algo hash_algos[GIT_HASH_NALGOS] = {
 		git_hash_sha1_clone,
 		git_hash_sha1_update,
 		git_hash_sha1_final,
+		git_hash_sha1_init_unsafe,
+		git_hash_sha1_clone_unsafe,
+		git_hash_sha1_update_unsafe,
+		git_hash_sha1_final_unsafe,
 		&empty_tree_oid,
 		&empty_blob_oid,
 	},
@@ -169,6 +198,10 @@ const struct git_hash_algo hash_algos[GIT_HASH_NALGOS] = {
 		git_hash_sha256_clone,
 		git_hash_sha256_update,
 		git_hash_sha256_final,
+		git_hash_sha256_init,
+		git_hash_sha256_clone,
+		git_hash_sha256_update,
+		git_hash_sha256_final,
 		&empty_tree_oid_sha256,
 		&empty_blob_oid_sha256,
 	}
@@ -937,7 +970,7 @@ int has_loose_object_nonlocal(const struct object_id *oid)
 	return check_and_freshen_nonlocal(oid, 0);
 }
 
-static int has_loose_object(const struct object_id *oid)
+int has_loose_object(const struct object_id *oid)
 {
 	return check_and_freshen(oid, 0);
 }
@@ -1441,6 +1474,7 @@ void enable_obj_read_lock(void)
 	if (obj_read_use_lock)
 		return;
 
+	enable_pack_read_lock();
 	obj_read_use_lock = 1;
 	init_recursive_mutex(&obj_read_mutex);
 }
@@ -1452,6 +1486,7 @@ void disable_obj_read_lock(void)
 
 	obj_read_use_lock = 0;
 	pthread_mutex_destroy(&obj_read_mutex);
+	disable_pack_read_lock();
 }
 
 int fetch_if_missing = 1;
@@ -1538,7 +1573,14 @@ static int do_oid_object_info_extended(struct repository *r,
 		 * information below, so return early.
 		 */
 		return 0;
+
+	/*
+	 * Reading from the pack is protected by the locks in packfile.c,
+	 * so let other threads look up and read objects in the meantime.
+	 */
+	obj_read_unlock();
 	rtype = packed_object_info(r, e.p, e.offset, oi);
+	obj_read_lock();
 	if (rtype < 0) {
 		mark_bad_packed_object(e.p, real->hash);
 		return do_oid_object_info_extended(r, real, oi, 0);
@@ -1783,10 +1825,15 @@ int hash_object_file(const struct git_hash_algo *algo, const void *buf,
 	return 0;
 }
 
-/* Finalize a file on disk, and close it. */
-static void close_loose_object(int fd)
+/*
+ * Finalize a file on disk, and close it. A "batched" object only needs its
+ * writeback started; unplug_bulk_checkin() makes the whole batch durable.
+ */
+static void close_loose_object(int fd, int batched)
 {
-	if (fsync_object_files)
+	if (batched)
+		fsync_loose_object_bulk_checkin(fd, "loose object file");
+	else if (fsync_object_files)
 		fsync_or_die(fd, "loose object file");
 	if (close(fd) != 0)
 		die_errno(_("error when closing loose object file"));
@@ -1837,6 +1884,21 @@ static int create_tmpfile(struct strbuf *tmp, const char *filename)
 	return fd;
 }
 
+/*
+ * Compute where the loose object "oid" goes: into "bulk_dir" when it is
+ * part of a batched bulk checkin, or into the object directory.
+ */
+static void loose_object_write_path(struct strbuf *buf, const char *bulk_dir,
+				    const struct object_id *oid)
+{
+	if (bulk_dir) {
+		strbuf_reset(buf);
+		strbuf_addf(buf, "%s/", bulk_dir);
+		fill_loose_path(buf, oid);
+	} else
+		loose_object_path(the_repository, buf, oid);
+}
+
 static int write_loose_object(const struct object_id *oid, char *hdr,
 			      int hdrlen, const void *buf, unsigned long len,
 			      time_t mtime)
@@ -1848,8 +1910,9 @@ static int write_loose_object(const struct object_id *oid, char *hdr,
 	struct object_id parano_oid;
 	static struct strbuf tmp_file = STRBUF_INIT;
 	static struct strbuf filename = STRBUF_INIT;
+	const char *bulk_dir = prepare_loose_object_bulk_checkin();
 
-	loose_object_path(the_repository, &filename, oid);
+	loose_object_write_path(&filename, bulk_dir, oid);
 
 	fd = create_tmpfile(&tmp_file, filename.buf);
 	if (fd < 0) {
@@ -1897,7 +1960,7 @@ static int write_loose_object(const struct object_id *oid, char *hdr,
 		die(_("confused by unstable object source data for %s"),
 		    oid_to_hex(oid));
 
-	close_loose_object(fd);
+	close_loose_object(fd, !!bulk_dir);
 
 	if (mtime) {
 		struct utimbuf utb;
@@ -1920,6 +1983,13 @@ static int freshen_packed_object(const struct object_id *oid)
 	struct pack_entry e;
 	if (!find_pack_entry(the_repository, oid, &e))
 		return 0;
+	/*
+	 * Objects in a cruft pack expire according to their own mtime
+	 * recorded in the .mtimes file, not that of the pack; have the
+	 * caller write a loose copy instead.
+	 */
+	if (e.p->is_cruft)
+		return 0;
 	if (e.p->freshened)
 		return 1;
 	if (!freshen_file(e.p->pack_name))
@@ -1944,6 +2014,122 @@ int write_object_file(const void *buf, unsigned long len, const char *type,
 	return write_loose_object(oid, hdr, hdrlen, buf, len, 0);
 }
 
+int stream_loose_object(struct input_stream *in_stream, size_t len,
+			struct object_id *oid)
+{
+	int fd, ret, err = 0, flush = 0;
+	unsigned char compressed[4096];
+	git_zstream stream;
+	git_hash_ctx c;
+	struct strbuf tmp_file = STRBUF_INIT;
+	struct strbuf filename = STRBUF_INIT;
+	int dirlen;
+	char hdr[MAX_HEADER_LEN];
+	int hdrlen;
+	const char *bulk_dir = prepare_loose_object_bulk_checkin();
+
+	/*
+	 * The object name is not known until all of the data has been
+	 * seen, so the temporary file goes to the top of the object
+	 * directory rather than into its fan-out subdirectory.
+	 */
+	strbuf_addf(&filename, "%s/",
+		    bulk_dir ? bulk_dir : get_object_directory());
+	hdrlen = xsnprintf(hdr, sizeof(hdr), "%s %"PRIuMAX,
+			   type_name(OBJ_BLOB), (uintmax_t)len) + 1;
+
+	fd = create_tmpfile(&tmp_file, filename.buf);
+	if (fd < 0) {
+		if (errno == EACCES)
+			err = error(_("insufficient permission for adding an object to repository database %s"), get_object_directory());
+		else
+			err = error_errno(_("unable to create temporary file"));
+		goto cleanup;
+	}
+
+	/* Set it up and write the header */
+	git_deflate_init(&stream, zlib_compression_level);
+	stream.next_out = compressed;
+	stream.avail_out = sizeof(compressed);
+	the_hash_algo->init_fn(&c);
+
+	stream.next_in = (unsigned char *)hdr;
+	stream.avail_in = hdrlen;
+	while (git_deflate(&stream, 0) == Z_OK)
+		; /* nothing */
+	the_hash_algo->update_fn(&c, hdr, hdrlen);
+
+	/* Then the data itself, one chunk at a time */
+	do {
+		unsigned char *in0 = stream.next_in;
+
+		if (!stream.avail_in && !in_stream->is_finished) {
+			const void *in = in_stream->read(in_stream,
+							 &stream.avail_in);
+			stream.next_in = (void *)in;
+			in0 = (unsigned char *)in;
+			/* All data has been read. */
+			if (in_stream->is_finished)
+				flush = Z_FINISH;
+		}
+		ret = git_deflate(&stream, flush);
+		the_hash_algo->update_fn(&c, in0, stream.next_in - in0);
+		if (write_buffer(fd, compressed, stream.next_out - compressed) < 0)
+			die(_("unable to write loose object file"));
+		stream.next_out = compressed;
+		stream.avail_out = sizeof(compressed);
+		/*
+		 * Unlike write_loose_object(), we do not have the entire
+		 * buffer. If we get Z_BUF_ERROR due to too few input bytes,
+		 * then we'll replenish them in the next input_stream->read()
+		 * call when we loop.
+		 */
+	} while (ret == Z_OK || ret == Z_BUF_ERROR);
+
+	if (stream.total_in != len + hdrlen)
+		die(_("write stream object %"PRIuMAX" != %"PRIuMAX),
+		    (uintmax_t)stream.total_in, (uintmax_t)len + hdrlen);
+
+	if (ret != Z_STREAM_END)
+		die(_("unable to stream deflate new object (%d)"), ret);
+	ret = git_deflate_end_gently(&stream);
+	if (ret != Z_OK)
+		die(_("deflateEnd on stream object failed (%d)"), ret);
+	the_hash_algo->final_fn(oid->hash, &c);
+
+	close_loose_object(fd, !!bulk_dir);
+
+	if (freshen_packed_object(oid) || freshen_loose_object(oid)) {
+		unlink_or_warn(tmp_file.buf);
+		goto cleanup;
+	}
+
+	loose_object_write_path(&filename, bulk_dir, oid);
+
+	/* We finally know the object path, and create the missing dir. */
+	dirlen = directory_size(filename.buf);
+	if (dirlen) {
+		struct strbuf dir = STRBUF_INIT;
+		strbuf_add(&dir, filename.buf, dirlen - 1);
+
+		if (mkdir(dir.buf, 0777) && errno != EEXIST)
+			err = error_errno(_("unable to create directory %s"), dir.buf);
+		else if (adjust_shared_perm(dir.buf))
+			err = error(_("unable to set permission to '%s'"), dir.buf);
+		strbuf_release(&dir);
+		if (err) {
+			unlink_or_warn(tmp_file.buf);
+			goto cleanup;
+		}
+	}
+
+	err = finalize_object_file(tmp_file.buf, filename.buf);
+cleanup:
+	strbuf_release(&tmp_file);
+	strbuf_release(&filename);
+	return err;
+}
+
 int hash_object_file_literally(const void *buf, unsigned long len,
 			       const char *type, struct object_id *oid,
 			       unsigned flags)
@@ -1,13 +1,34 @@
 #include "git-compat-util.h"
 #include "./sha256.h"
 
+/*
+ * On x86-64 with GCC or clang, we can use the SHA extensions (SHA-NI)
+ * when the CPU supports them. The code is compiled with the "target"
+ * attribute rather than global compiler flags, so that the same binary
+ * still runs on CPUs without them; we pick the implementation at
+ * runtime.
+ */
+#if defined(__x86_64__) && !defined(NO_SHA256_SHANI) && \
+	(defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define SHA256_SHANI
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 #undef RND
 #undef BLKSIZE
 
 #define BLKSIZE blk_SHA256_BLKSIZE
 
+typedef void (*sha256_blocks_fn)(uint32_t *state, const unsigned char *buf,
+				 size_t nr);
+
+static void sha256_select_blocks(void);
+
 void blk_SHA256_Init(blk_SHA256_CTX *ctx)
 {
+	sha256_select_blocks();
+
 	ctx->offset = 0;
 	ctx->size = 0;
 	ctx->state[0] = 0x6a09e667ul;
@@ -148,6 +169,141 @@ static void blk_SHA256_Transform(blk_SHA256_CTX *ctx, const unsigned char *buf)
 		ctx->state[i] += S[i];
 }
 
+static void blk_SHA256_Blocks(uint32_t *state, const unsigned char *buf,
+			      size_t nr)
+{
+	blk_SHA256_CTX ctx;
+
+	memcpy(ctx.state, state, sizeof(ctx.state));
+	for (; nr; nr--, buf += BLKSIZE)
+		blk_SHA256_Transform(&ctx, buf);
+	memcpy(state, ctx.state, sizeof(ctx.state));
+}
+
+#ifdef SHA256_SHANI
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/*
+ * Four rounds, consuming the message words in "msg". The sha256rnds2
+ * instruction does two rounds on the state split as ABEF/CDGH.
+ */
+#define SHANI_ROUNDS(msg, k) do { \
+	__m128i wk = _mm_add_epi32((msg), \
+		_mm_loadu_si128((const __m128i *)(k))); \
+	state1 = _mm_sha256rnds2_epu32(state1, state0, wk); \
+	wk = _mm_shuffle_epi32(wk, 0x0e); \
+	state0 = _mm_sha256rnds2_epu32(state0, state1, wk); \
+} while (0)
+
+/* Compute the next four message words w[i..i+3] into m0 (= w[i-16..i-13]). */
+#define SHANI_SCHEDULE(m0, m1, m2, m3) do { \
+	(m0) = _mm_sha256msg1_epu32((m0), (m1)); \
+	(m0) = _mm_add_epi32((m0), _mm_alignr_epi8((m3), (m2), 4)); \
+	(m0) = _mm_sha256msg2_epu32((m0), (m3)); \
+} while (0)
+
+__attribute__((target("sha,sse4.1")))
+static void shani_SHA256_Blocks(uint32_t *state, const unsigned char *buf,
+				size_t nr)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+					     0x0405060700010203ULL);
+	__m128i state0, state1, tmp;
+
+	/* Rearrange ABCD/EFGH into the ABEF/CDGH layout of sha256rnds2. */
+	tmp = _mm_loadu_si128((const __m128i *)&state[0]);
+	state1 = _mm_loadu_si128((const __m128i *)&state[4]);
+	tmp = _mm_shuffle_epi32(tmp, 0xb1);
+	state1 = _mm_shuffle_epi32(state1, 0x1b);
+	state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+	for (; nr; nr--, buf += BLKSIZE) {
+		__m128i abef = state0, cdgh = state1;
+		__m128i m0, m1, m2, m3;
+		int i;
+
+		m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 0)), bswap);
+		m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 16)), bswap);
+		m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 32)), bswap);
+		m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 48)), bswap);
+
+		for (i = 0; i < 64; i += 16) {
+			SHANI_ROUNDS(m0, &sha256_k[i]);
+			SHANI_ROUNDS(m1, &sha256_k[i + 4]);
+			SHANI_ROUNDS(m2, &sha256_k[i + 8]);
+			SHANI_ROUNDS(m3, &sha256_k[i + 12]);
+			if (i == 48)
+				break;
+			SHANI_SCHEDULE(m0, m1, m2, m3);
+			SHANI_SCHEDULE(m1, m2, m3, m0);
+			SHANI_SCHEDULE(m2, m3, m0, m1);
+			SHANI_SCHEDULE(m3, m0, m1, m2);
+		}
+
+		state0 = _mm_add_epi32(state0, abef);
+		state1 = _mm_add_epi32(state1, cdgh);
+	}
+
+	/* And back from ABEF/CDGH to ABCD/EFGH. */
+	tmp = _mm_shuffle_epi32(state0, 0x1b);
+	state1 = _mm_shuffle_epi32(state1, 0xb1);
+	state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+	state1 = _mm_alignr_epi8(state1, tmp, 8);
+	_mm_storeu_si128((__m128i *)&state[0], state0);
+	_mm_storeu_si128((__m128i *)&state[4], state1);
+}
+
+static int cpu_has_shani(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) ||
+	    !(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+		return 0;
+	if (__get_cpuid_max(0, NULL) < 7)
+		return 0;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return !!(ebx & (1 << 29));
+}
+#endif
+
+static sha256_blocks_fn sha256_blocks;
+
+/*
+ * Pick the block function on first use. This is racy if two threads
+ * get here at the same time, but they would both store the same value.
+ */
+static void sha256_select_blocks(void)
+{
+	if (sha256_blocks)
+		return;
+#ifdef SHA256_SHANI
+	if (cpu_has_shani() && !getenv("GIT_TEST_SHA256_PORTABLE")) {
+		sha256_blocks = shani_SHA256_Blocks;
+		return;
+	}
+#endif
+	sha256_blocks = blk_SHA256_Blocks;
+}
+
 void blk_SHA256_Update(blk_SHA256_CTX *ctx, const void *data, size_t len)
 {
 	unsigned int len_buf = ctx->size & 63;
@@ -165,12 +321,13 @@ void blk_SHA256_Update(blk_SHA256_CTX *ctx, const void *data, size_t len)
 		data = ((const char *)data + left);
 		if (len_buf)
 			return;
-		blk_SHA256_Transform(ctx, ctx->buf);
+		sha256_blocks(ctx->state, ctx->buf, 1);
 	}
-	while (len >= 64) {
-		blk_SHA256_Transform(ctx, data);
-		data = ((const char *)data + 64);
-		len -= 64;
+	if (len >= 64) {
+		size_t nr = len / 64;
+		sha256_blocks(ctx->state, data, nr);
+		data = ((const char *)data + nr * 64);
+		len -= nr * 64;
 	}
 	if (len)
 		memcpy(ctx->buf, data, len);
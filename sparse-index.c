@@ -0,0 +1,296 @@
+#include "cache.h"
+#include "repository.h"
+#include "sparse-index.h"
+#include "tree.h"
+#include "pathspec.h"
+#include "trace2.h"
+#include "cache-tree.h"
+#include "config.h"
+#include "dir.h"
+#include "ewah/ewok.h"
+
+static struct cache_entry *construct_sparse_dir_entry(
+				struct index_state *istate,
+				const char *sparse_dir,
+				struct cache_tree *tree)
+{
+	struct cache_entry *de;
+	size_t len = strlen(sparse_dir);
+
+	de = make_empty_cache_entry(istate, len);
+	memcpy(de->name, sparse_dir, len);
+	de->ce_namelen = len;
+	de->ce_mode = S_IFDIR;
+	de->ce_flags = create_ce_flags(0) | CE_SKIP_WORKTREE;
+	oidcpy(&de->oid, &tree->oid);
+	return de;
+}
+
+/*
+ * Replace the entries istate->cache[start..end), which all live in the
+ * directory 'ct_path' described by 'ct', by sparse directory entries
+ * wherever possible, writing the result from istate->cache[num_converted]
+ * on.  Returns the number of entries written.
+ */
+static int convert_to_sparse_rec(struct index_state *istate,
+				 int num_converted,
+				 int start, int end,
+				 const char *ct_path, size_t ct_pathlen,
+				 struct cache_tree *ct)
+{
+	int i, can_convert = 1;
+	int start_converted = num_converted;
+	enum pattern_match_result match;
+	int dtype = DT_UNKNOWN;
+	struct strbuf child_path = STRBUF_INIT;
+	struct pattern_list *pl = istate->sparse_checkout_patterns;
+
+	/*
+	 * A directory outside of the cone can be collapsed if all of
+	 * its entries are merged and not checked out.  The root
+	 * directory is always in the cone.
+	 */
+	if (!ct_pathlen)
+		can_convert = 0;
+	else {
+		match = path_matches_pattern_list(ct_path, ct_pathlen,
+						  NULL, &dtype, pl, istate);
+		if (match != NOT_MATCHED)
+			can_convert = 0;
+	}
+
+	for (i = start; can_convert && i < end; i++) {
+		struct cache_entry *ce = istate->cache[i];
+
+		if (ce_stage(ce) ||
+		    S_ISGITLINK(ce->ce_mode) ||
+		    !(ce->ce_flags & CE_SKIP_WORKTREE))
+			can_convert = 0;
+	}
+
+	if (can_convert) {
+		for (i = start; i < end; i++)
+			discard_cache_entry(istate->cache[i]);
+		istate->cache[num_converted++] =
+			construct_sparse_dir_entry(istate, ct_path, ct);
+		return 1;
+	}
+
+	for (i = start; i < end; ) {
+		int count, span, pos = -1;
+		struct cache_entry *ce = istate->cache[i];
+		const char *base = ce->name + ct_pathlen;
+		const char *slash = strchr(base, '/');
+
+		if (slash)
+			pos = cache_tree_subtree_pos(ct, base, slash - base);
+
+		if (pos < 0) {
+			istate->cache[num_converted++] = ce;
+			i++;
+			continue;
+		}
+
+		strbuf_reset(&child_path);
+		strbuf_add(&child_path, ce->name, slash - ce->name + 1);
+
+		span = ct->down[pos]->cache_tree->entry_count;
+		count = convert_to_sparse_rec(istate,
+					      num_converted, i, i + span,
+					      child_path.buf, child_path.len,
+					      ct->down[pos]->cache_tree);
+		num_converted += count;
+		i += span;
+	}
+
+	strbuf_release(&child_path);
+	return num_converted - start_converted;
+}
+
+static int index_can_be_sparse(struct index_state *istate)
+{
+	int i;
+
+	for (i = 0; i < istate->cache_nr; i++) {
+		struct cache_entry *ce = istate->cache[i];
+
+		/*
+		 * Unmerged, intent-to-add and removed entries leave the
+		 * cache-tree incomplete; keep such an index full until
+		 * they are gone.
+		 */
+		if (ce_stage(ce) || ce_intent_to_add(ce) ||
+		    (ce->ce_flags & CE_REMOVE))
+			return 0;
+	}
+	return 1;
+}
+
+static int load_sparse_checkout_patterns(struct index_state *istate)
+{
+	struct pattern_list *pl;
+	char *sparse_filename;
+	int res;
+
+	if (istate->sparse_checkout_patterns)
+		return 0;
+
+	pl = xcalloc(1, sizeof(*pl));
+	pl->use_cone_patterns = core_sparse_checkout_cone;
+	sparse_filename = git_pathdup("info/sparse-checkout");
+	res = add_patterns_from_file_to_list(sparse_filename, "", 0, pl, NULL);
+	free(sparse_filename);
+
+	if (res < 0) {
+		clear_pattern_list(pl);
+		free(pl);
+		return -1;
+	}
+	istate->sparse_checkout_patterns = pl;
+	return 0;
+}
+
+int convert_to_sparse(struct index_state *istate)
+{
+	if (istate->split_index || istate->sparse_index ||
+	    !core_apply_sparse_checkout || !core_sparse_checkout_cone)
+		return 0;
+
+	prepare_repo_settings(the_repository);
+	if (!the_repository->settings.sparse_index)
+		return 0;
+
+	/*
+	 * Sparse directories are only defined by cone-mode patterns;
+	 * stay full if the sparse-checkout file is missing or does
+	 * not use them.
+	 */
+	if (load_sparse_checkout_patterns(istate) ||
+	    !istate->sparse_checkout_patterns->use_cone_patterns)
+		return 0;
+
+	if (!index_can_be_sparse(istate))
+		return 0;
+
+	/* Clear and recompute the cache-tree */
+	cache_tree_free(&istate->cache_tree);
+	istate->cache_tree = cache_tree();
+	if (cache_tree_update(istate, WRITE_TREE_SILENT)) {
+		warning(_("unable to update cache-tree, staying full"));
+		return -1;
+	}
+
+	trace2_region_enter("index", "convert_to_sparse", the_repository);
+	free_name_hash(istate);
+
+	istate->cache_nr = convert_to_sparse_rec(istate,
+						 0, 0, istate->cache_nr,
+						 "", 0, istate->cache_tree);
+	istate->sparse_index = 1;
+
+	/* The sparse directories now stand for their subtrees. */
+	cache_tree_free(&istate->cache_tree);
+	istate->cache_tree = cache_tree();
+	cache_tree_update(istate, WRITE_TREE_SILENT);
+
+	trace2_region_leave("index", "convert_to_sparse", the_repository);
+	return 0;
+}
+
+static int add_path_to_index(const struct object_id *oid,
+			     struct strbuf *base, const char *path,
+			     unsigned int mode, int stage, void *context)
+{
+	struct index_state *istate = (struct index_state *)context;
+	struct cache_entry *ce;
+	size_t len = base->len;
+
+	if (S_ISDIR(mode))
+		return READ_TREE_RECURSIVE;
+
+	strbuf_addstr(base, path);
+
+	ce = make_cache_entry(istate, mode, oid, base->buf, 0, 0);
+	ce->ce_flags |= CE_SKIP_WORKTREE;
+	add_index_entry(istate, ce, ADD_CACHE_JUST_APPEND);
+
+	strbuf_setlen(base, len);
+	return 0;
+}
+
+void ensure_full_index(struct index_state *istate)
+{
+	int i;
+	struct cache_entry **sparse_cache;
+	unsigned int sparse_nr, cache_changed;
+	struct pathspec ps;
+
+	if (!istate || !istate->sparse_index)
+		return;
+
+	trace2_region_enter("index", "ensure_full_index", the_repository);
+
+	sparse_cache = istate->cache;
+	sparse_nr = istate->cache_nr;
+	cache_changed = istate->cache_changed;
+	free_name_hash(istate);
+
+	istate->cache = NULL;
+	istate->cache_nr = istate->cache_alloc = 0;
+	ALLOC_GROW(istate->cache, sparse_nr, istate->cache_alloc);
+
+	memset(&ps, 0, sizeof(ps));
+
+	for (i = 0; i < sparse_nr; i++) {
+		struct cache_entry *ce = sparse_cache[i];
+		struct tree *tree;
+
+		if (!S_ISSPARSEDIR(ce->ce_mode)) {
+			add_index_entry(istate, ce, ADD_CACHE_JUST_APPEND);
+			continue;
+		}
+
+		tree = parse_tree_indirect(&ce->oid);
+		if (!tree ||
+		    read_tree_recursive(the_repository, tree,
+					ce->name, ce_namelen(ce),
+					0, &ps, add_path_to_index, istate))
+			die(_("unable to expand sparse directory '%s'"),
+			    ce->name);
+
+		discard_cache_entry(ce);
+	}
+
+	free(sparse_cache);
+	istate->cache_changed = cache_changed;
+	istate->sparse_index = 0;
+
+	/*
+	 * The fsmonitor bitmap read from disk refers to positions in
+	 * the sparse index; forget it and let every entry be checked.
+	 */
+	if (istate->fsmonitor_dirty) {
+		ewah_free(istate->fsmonitor_dirty);
+		istate->fsmonitor_dirty = NULL;
+	}
+
+	cache_tree_free(&istate->cache_tree);
+	istate->cache_tree = cache_tree();
+	cache_tree_update(istate, WRITE_TREE_SILENT);
+
+	trace2_region_leave("index", "ensure_full_index", the_repository);
+}
+
+int set_sparse_index_config(struct repository *repo, int enable)
+{
+	int res;
+	char *config_path = repo_git_path(repo, "config.worktree");
+
+	res = git_config_set_in_file_gently(config_path, "index.sparse",
+					    enable ? "true" : NULL);
+	free(config_path);
+
+	prepare_repo_settings(repo);
+	repo->settings.sparse_index = enable;
+	return res;
+}
@@ -0,0 +1,30 @@
+#ifndef SPARSE_INDEX_H__
+#define SPARSE_INDEX_H__
+
+struct index_state;
+
+/*
+ * Replace every directory outside of the cone-mode sparse-checkout
+ * definition, whose entries are all skip-worktree and merged, by a
+ * single "sparse directory" entry naming its tree.  Does nothing
+ * unless index.sparse is enabled and the sparse-checkout uses cone
+ * mode.  Returns 0 if the index was converted or left alone, -1 on
+ * error.
+ */
+int convert_to_sparse(struct index_state *istate);
+
+/*
+ * Expand all sparse directory entries of a sparse index back into the
+ * entries of their trees.  Commands that have not been taught about
+ * sparse directories get a full index this way when it is read (see
+ * `command_requires_full_index` in `struct repo_settings`).
+ */
+void ensure_full_index(struct index_state *istate);
+
+/*
+ * Enable or disable index.sparse in the worktree configuration of
+ * the repository.
+ */
+int set_sparse_index_config(struct repository *repo, int enable);
+
+#endif
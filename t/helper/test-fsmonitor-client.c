@@ -0,0 +1,71 @@
+#include "test-tool.h"
+#include "cache.h"
+#include "parse-options.h"
+#include "fsmonitor-ipc.h"
+
+static const char * const fsmonitor_client_usage[] = {
+	"test-tool fsmonitor-client query --token <token>",
+	"test-tool fsmonitor-client flush",
+	"test-tool fsmonitor-client is-supported",
+	NULL
+};
+
+/*
+ * Send a raw request to the daemon of the current worktree and print
+ * its response, with the NULs turned into newlines.
+ */
+static int do_send(const char *request, int query)
+{
+	struct strbuf answer = STRBUF_INIT;
+	int ret;
+	size_t i;
+
+	if (query)
+		ret = fsmonitor_ipc__send_query(request, &answer);
+	else
+		ret = fsmonitor_ipc__send_command(request, &answer);
+	if (ret < 0)
+		die("could not talk to fsmonitor--daemon");
+
+	for (i = 0; i < answer.len; i++)
+		if (!answer.buf[i])
+			answer.buf[i] = '\n';
+	fwrite(answer.buf, 1, answer.len, stdout);
+	if (answer.len && answer.buf[answer.len - 1] != '\n')
+		putchar('\n');
+
+	strbuf_release(&answer);
+	return 0;
+}
+
+int cmd__fsmonitor_client(int argc, const char **argv)
+{
+	const char *subcmd;
+	const char *token = NULL;
+	struct option options[] = {
+		OPT_STRING(0, "token", &token, "token",
+			   "token to send with the query"),
+		OPT_END()
+	};
+
+	argc = parse_options(argc, argv, NULL, options,
+			     fsmonitor_client_usage, 0);
+	if (argc != 1)
+		usage_with_options(fsmonitor_client_usage, options);
+	subcmd = argv[0];
+
+	if (!strcmp(subcmd, "is-supported"))
+		return !fsmonitor_ipc__is_supported();
+
+	setup_git_directory();
+
+	if (!strcmp(subcmd, "query")) {
+		if (!token)
+			usage_with_options(fsmonitor_client_usage, options);
+		return do_send(token, 1);
+	}
+	if (!strcmp(subcmd, "flush"))
+		return do_send(FSMONITOR_IPC_COMMAND_FLUSH, 0);
+
+	die("unknown subcommand '%s'", subcmd);
+}
@@ -10,6 +10,13 @@ static inline void compute_hash(const struct git_hash_algo *algo, git_hash_ctx *
 	algo->final_fn(final, ctx);
 }
 
+static inline void compute_hash_unsafe(const struct git_hash_algo *algo, git_hash_ctx *ctx, uint8_t *final, const void *p, size_t len)
+{
+	algo->unsafe_init_fn(ctx);
+	algo->unsafe_update_fn(ctx, p, len);
+	algo->unsafe_final_fn(final, ctx);
+}
+
 int cmd__hash_speed(int ac, const char **av)
 {
 	git_hash_ctx ctx;
@@ -19,6 +26,13 @@ int cmd__hash_speed(int ac, const char **av)
 	int i;
 	void *p;
 	const struct git_hash_algo *algo = NULL;
+	int unsafe = 0;
+
+	if (ac == 3 && !strcmp(av[1], "--unsafe")) {
+		unsafe = 1;
+		ac--;
+		av++;
+	}
 
 	if (ac == 2) {
 		for (i = 1; i < GIT_HASH_NALGOS; i++) {
@@ -29,12 +43,12 @@ int cmd__hash_speed(int ac, const char **av)
 		}
 	}
 	if (!algo)
-		die("usage: test-tool hash-speed algo_name");
+		die("usage: test-tool hash-speed [--unsafe] algo_name");
 
 	/* Use this as an offset to make overflow less likely. */
 	initial = clock();
 
-	printf("algo: %s\n", algo->name);
+	printf("algo: %s%s\n", algo->name, unsafe ? " (unsafe)" : "");
 
 	for (i = 0; i < ARRAY_SIZE(bufsizes); i++) {
 		unsigned long j, kb;
@@ -42,7 +56,10 @@ int cmd__hash_speed(int ac, const char **av)
 		p = xcalloc(1, bufsizes[i]);
 		start = end = clock() - initial;
 		for (j = 0; ((end - start) / CLOCKS_PER_SEC) < NUM_SECONDS; j++) {
-			compute_hash(algo, &ctx, hash, p, bufsizes[i]);
+			if (unsafe)
+				compute_hash_unsafe(algo, &ctx, hash, p, bufsizes[i]);
+			else
+				compute_hash(algo, &ctx, hash, p, bufsizes[i]);
 
 			/*
 			 * Only check elapsed time every 128 iterations to avoid
@@ -4,7 +4,6 @@
 #include "commit-reach.h"
 #include "config.h"
 #include "parse-options.h"
-#include "ref-filter.h"
 #include "string-list.h"
 #include "tag.h"
 
@@ -130,17 +129,18 @@ int cmd__reach(int ac, const char **av)
 		}
 
 		printf("%s(X,_,_,0,0):%d\n", av[1], can_all_from_reach_with_flag(&X_obj, 2, 4, 0, 0));
-	} else if (!strcmp(av[1], "commit_contains")) {
-		struct ref_filter filter;
-		struct contains_cache cache;
-		init_contains_cache(&cache);
+	} else if (!strcmp(av[1], "tips_reaching_bases")) {
+		const unsigned int mark = 1;
+		int i;
+		struct commit_list *list = NULL;
 
-		if (ac > 2 && !strcmp(av[2], "--tag"))
-			filter.with_commit_tag_algo = 1;
-		else
-			filter.with_commit_tag_algo = 0;
+		tips_reaching_bases(X, Y_array, Y_nr, mark);
+		for (i = 0; i < Y_nr; i++)
+			if (Y_array[i]->object.flags & mark)
+				commit_list_insert(Y_array[i], &list);
 
-		printf("%s(_,A,X,_):%d\n", av[1], commit_contains(&filter, A, X, &cache));
+		printf("%s(X,Y)\n", av[1]);
+		print_sorted_commit_ids(list);
 	} else if (!strcmp(av[1], "get_reachable_subset")) {
 		const int reachable_flag = 1;
 		int i, count = 0;
@@ -0,0 +1,222 @@
+#include "test-tool.h"
+#include "cache.h"
+#include "varint.h"
+
+/*
+ * Write a table using parts of the reftable format that Git's own
+ * writer does not produce, as other implementations do: blocks padded
+ * to the block size, an index with two levels, and an object index
+ * ('o' blocks).
+ */
+
+#define FIXTURE_BLOCK_SIZE 256
+#define REFS_PER_BLOCK 4
+#define ENTRIES_PER_INDEX 3
+#define OBJ_ID_LEN 4
+
+struct block_entry {
+	char *last_key;
+	uint64_t pos;
+};
+
+static void put_varint(struct strbuf *sb, uint64_t value)
+{
+	unsigned char buf[16];
+
+	strbuf_add(sb, buf, encode_varint(value, buf));
+}
+
+static void put_be24(struct strbuf *sb, uint32_t value)
+{
+	strbuf_addch(sb, (value >> 16) & 0xff);
+	strbuf_addch(sb, (value >> 8) & 0xff);
+	strbuf_addch(sb, value & 0xff);
+}
+
+static void put_be(struct strbuf *sb, uint64_t value, int bytes)
+{
+	while (bytes--)
+		strbuf_addch(sb, (value >> (8 * bytes)) & 0xff);
+}
+
+/* Every record is a restart point, so no key shares a prefix. */
+static void add_record(struct strbuf *records, size_t *offsets, size_t *nr,
+		       const char *key, size_t key_len, unsigned extra,
+		       const struct strbuf *value)
+{
+	offsets[(*nr)++] = records->len;
+	put_varint(records, 0);
+	put_varint(records, key_len << 3 | extra);
+	strbuf_add(records, key, key_len);
+	strbuf_addbuf(records, value);
+}
+
+/*
+ * Append a block holding the given records, padded to the block size,
+ * and return its offset.
+ */
+static uint64_t write_block(struct strbuf *out, size_t header_size,
+			    unsigned char type, const struct strbuf *records,
+			    const size_t *offsets, size_t nr)
+{
+	uint64_t pos = out->len == header_size ? 0 : out->len;
+	size_t start = out->len, len, i;
+
+	strbuf_addch(out, type);
+	put_be24(out, 0);
+	strbuf_addbuf(out, records);
+	for (i = 0; i < nr; i++)
+		put_be24(out, start - pos + 4 + offsets[i]);
+	put_be(out, nr, 2);
+
+	len = out->len - pos;
+	if (len > FIXTURE_BLOCK_SIZE)
+		die("fixture block too large");
+	out->buf[start + 1] = (len >> 16) & 0xff;
+	out->buf[start + 2] = (len >> 8) & 0xff;
+	out->buf[start + 3] = len & 0xff;
+	strbuf_addchars(out, 0, pos + FIXTURE_BLOCK_SIZE - out->len);
+	return pos;
+}
+
+/*
+ * Write index blocks for `blocks`, and then for the index blocks
+ * themselves, until a single block is left. Returns its offset.
+ */
+static uint64_t write_index(struct strbuf *out, size_t header_size,
+			    struct block_entry *blocks, size_t nr)
+{
+	struct strbuf records = STRBUF_INIT, value = STRBUF_INIT;
+	size_t offsets[ENTRIES_PER_INDEX];
+
+	while (nr > 1) {
+		size_t i, j, level_nr = 0;
+
+		for (i = 0; i < nr; i += ENTRIES_PER_INDEX) {
+			size_t n = 0;
+			char *last_key = NULL;
+
+			strbuf_reset(&records);
+			for (j = i; j < nr && j < i + ENTRIES_PER_INDEX; j++) {
+				strbuf_reset(&value);
+				put_varint(&value, blocks[j].pos);
+				add_record(&records, offsets, &n,
+					   blocks[j].last_key,
+					   strlen(blocks[j].last_key), 0,
+					   &value);
+				free(last_key);
+				last_key = blocks[j].last_key;
+			}
+			blocks[level_nr].pos = write_block(out, header_size,
+							   'i', &records,
+							   offsets, n);
+			blocks[level_nr++].last_key = last_key;
+		}
+		nr = level_nr;
+	}
+
+	strbuf_release(&records);
+	strbuf_release(&value);
+	free(blocks[0].last_key);
+	return blocks[0].pos;
+}
+
+static int write_fixture(const char *path, uint64_t update_index,
+			 const struct object_id *oid, size_t refs_nr)
+{
+	const struct git_hash_algo *algo = the_hash_algo;
+	int version = hash_algo_by_ptr(algo) == GIT_HASH_SHA1 ? 1 : 2;
+	struct strbuf out = STRBUF_INIT, header = STRBUF_INIT;
+	struct strbuf records = STRBUF_INIT, value = STRBUF_INIT;
+	struct block_entry *blocks;
+	size_t offsets[REFS_PER_BLOCK];
+	size_t blocks_nr = 0, i, footer_start;
+	uint64_t ref_index_pos, obj_pos, prev;
+	uint32_t crc;
+
+	if (refs_nr <= REFS_PER_BLOCK)
+		die("need more than %d refs to fill several blocks",
+		    REFS_PER_BLOCK);
+
+	strbuf_addstr(&header, "REFT");
+	strbuf_addch(&header, version);
+	put_be24(&header, FIXTURE_BLOCK_SIZE);
+	put_be(&header, update_index, 8);
+	put_be(&header, update_index, 8);
+	if (version > 1)
+		put_be(&header, algo->format_id, 4);
+	strbuf_addbuf(&out, &header);
+
+	ALLOC_ARRAY(blocks, DIV_ROUND_UP(refs_nr, REFS_PER_BLOCK));
+	for (i = 0; i < refs_nr; i += REFS_PER_BLOCK) {
+		size_t j, n = 0;
+		char *key = NULL;
+
+		strbuf_reset(&records);
+		for (j = i; j < refs_nr && j < i + REFS_PER_BLOCK; j++) {
+			free(key);
+			key = xstrfmt("refs/heads/fixture-%03"PRIuMAX,
+				      (uintmax_t)j);
+			strbuf_reset(&value);
+			put_varint(&value, 0);
+			strbuf_add(&value, oid->hash, algo->rawsz);
+			add_record(&records, offsets, &n, key, strlen(key),
+				   1, &value);
+		}
+		blocks[blocks_nr].pos = write_block(&out, header.len, 'r',
+						    &records, offsets, n);
+		blocks[blocks_nr++].last_key = key;
+	}
+
+	/* a single object record listing every ref block */
+	strbuf_reset(&records);
+	strbuf_reset(&value);
+	put_varint(&value, blocks_nr);
+	for (i = 0, prev = 0; i < blocks_nr; i++) {
+		put_varint(&value, blocks[i].pos - prev);
+		prev = blocks[i].pos;
+	}
+	i = 0;
+	add_record(&records, offsets, &i, (const char *)oid->hash,
+		   OBJ_ID_LEN, 0, &value);
+	obj_pos = write_block(&out, header.len, 'o', &records, offsets, 1);
+
+	ref_index_pos = write_index(&out, header.len, blocks, blocks_nr);
+
+	footer_start = out.len;
+	strbuf_addbuf(&out, &header);
+	put_be(&out, ref_index_pos, 8);
+	put_be(&out, obj_pos << 5 | OBJ_ID_LEN, 8);
+	put_be(&out, 0, 8); /* no object index */
+	put_be(&out, 0, 8); /* no logs */
+	put_be(&out, 0, 8);
+	crc = crc32(0, (unsigned char *)out.buf + footer_start,
+		    out.len - footer_start);
+	put_be(&out, crc, 4);
+
+	write_file_buf(path, out.buf, out.len);
+
+	free(blocks);
+	strbuf_release(&out);
+	strbuf_release(&header);
+	strbuf_release(&records);
+	strbuf_release(&value);
+	return 0;
+}
+
+static const char *usage_str =
+	"test-tool reftable write-fixture <file> <update-index> <oid> <nr>";
+
+int cmd__reftable(int argc, const char **argv)
+{
+	struct object_id oid;
+
+	if (argc != 6 || strcmp(argv[1], "write-fixture"))
+		usage(usage_str);
+
+	setup_git_directory();
+	if (get_oid_hex(argv[4], &oid))
+		die("not an object name: %s", argv[4]);
+	return write_fixture(argv[2], strtoull(argv[3], NULL, 10), &oid,
+			     strtoul(argv[5], NULL, 10));
+}
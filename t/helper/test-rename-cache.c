@@ -0,0 +1,25 @@
+#include "test-tool.h"
+#include "cache.h"
+#include "rename-cache.h"
+#include "repository.h"
+
+static int print_entry(const struct object_id *src,
+		       const struct object_id *dst,
+		       unsigned flags,
+		       const struct rename_cache_score *score,
+		       void *data)
+{
+	printf("%s ", oid_to_hex(src));
+	printf("%s %u %d %lu %lu\n", oid_to_hex(dst), flags,
+	       score->score, score->src_size, score->dst_size);
+	return 0;
+}
+
+int cmd__rename_cache(int argc, const char **argv)
+{
+	if (argc != 2 || strcmp(argv[1], "dump"))
+		die("usage: test-tool rename-cache dump");
+
+	setup_git_directory();
+	return for_each_rename_cache_entry(the_repository, print_entry, NULL);
+}
@@ -6,6 +6,20 @@ test_description="Tests diff generation performance"
 
 test_perf_default_repo
 
+# Generated code: long files of long, similar lines with a few changes.
+generate () {
+	awk -v changed="$1" '
+	BEGIN {
+		for (i = 0; i < 200000; i++) {
+			if (changed && i % 101 == 0)
+				printf "\tchanged_%d =  other(%d);\n", i, i
+			else
+				printf "\tvalue_%d = compute(%d, %d, \"%040d\");\n",
+					i, i, i * 7, i
+		}
+	}'
+}
+
 test_perf 'log -3000 (baseline)' '
 	git log -3000 >/dev/null
 '
@@ -26,4 +40,26 @@ test_perf 'log -p -3000 --patience' '
 	git log -p -3000 --patience >/dev/null
 '
 
+test_expect_success 'setup generated files' '
+	generate 0 >generated-a &&
+	generate 1 >generated-b
+'
+
+test_perf 'diff --no-index generated files' '
+	test_expect_code 1 git diff --no-index generated-a generated-b >/dev/null
+'
+
+test_perf 'diff --no-index -w generated files' '
+	test_expect_code 1 git diff --no-index -w generated-a generated-b >/dev/null
+'
+
+test_perf 'diff --no-index -b generated files' '
+	test_expect_code 1 git diff --no-index -b generated-a generated-b >/dev/null
+'
+
+test_perf 'diff --no-index --ignore-space-at-eol generated files' '
+	test_expect_code 1 git diff --no-index --ignore-space-at-eol \
+		generated-a generated-b >/dev/null
+'
+
 test_done
@@ -26,6 +26,18 @@ test_expect_success 'test basic SHA-1 hash values' '
 	grep 4b825dc642cb6eb9a060e54bf8d69288fbee4904 actual
 '
 
+test_expect_success 'test basic SHA-1 hash values with the unsafe implementation' '
+	test-tool sha1-unsafe </dev/null >actual &&
+	grep da39a3ee5e6b4b0d3255bfef95601890afd80709 actual &&
+	printf "abc" | test-tool sha1-unsafe >actual &&
+	grep a9993e364706816aba3e25717850c26c9cd0d89d actual &&
+	perl -e "$| = 1; print q{aaaaaaaaaa} for 1..100000;" | \
+		test-tool sha1-unsafe >actual &&
+	grep 34aa973cd4c4daa4f61eeb2bdbad27316534016f actual &&
+	printf "blob 3\0abc" | test-tool sha1-unsafe >actual &&
+	grep f2ba8f84ab5c1bce84a7b441cb1959cfc7093b7f actual
+'
+
 test_expect_success 'test basic SHA-256 hash values' '
 	test-tool sha256 </dev/null >actual &&
 	grep e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855 actual &&
@@ -52,4 +64,15 @@ test_expect_success 'test basic SHA-256 hash values' '
 	grep 6ef19b41225c5369f1c104d45d8d85efa9b057b53b14b4b9b939dd74decc5321 actual
 '
 
+test_expect_success 'accelerated and portable SHA-256 agree' '
+	test-tool genrandom sha256 100000 >random &&
+	for len in 0 1 55 56 63 64 65 127 128 129 1000 100000
+	do
+		test_copy_bytes $len <random >in &&
+		test-tool sha256 <in >expect &&
+		GIT_TEST_SHA256_PORTABLE=1 test-tool sha256 <in >actual &&
+		test_cmp expect actual || return 1
+	done
+'
+
 test_done
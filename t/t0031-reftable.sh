@@ -0,0 +1,254 @@
+#!/bin/sh
+
+test_description='reftable reference backend'
+
+. ./test-lib.sh
+
+INVALID_OID=$(test_oid 001)
+
+test_expect_success 'init creates a reftable repository' '
+	git init --ref-format=reftable repo &&
+	test_path_is_file repo/.git/reftable/tables.list &&
+	test_path_is_file repo/.git/refs/heads &&
+	test "$(git -C repo config extensions.refstorage)" = reftable &&
+	test "$(git -C repo config core.repositoryformatversion)" = 1 &&
+	test "$(git -C repo symbolic-ref HEAD)" = refs/heads/master
+'
+
+test_expect_success 'init honors GIT_DEFAULT_REF_FORMAT' '
+	GIT_DEFAULT_REF_FORMAT=reftable git init env &&
+	test_path_is_file env/.git/reftable/tables.list &&
+	GIT_DEFAULT_REF_FORMAT=files git init files &&
+	test_path_is_missing files/.git/reftable
+'
+
+test_expect_success 'init rejects unknown and changed formats' '
+	test_must_fail git init --ref-format=bogus bogus 2>err &&
+	test_i18ngrep "unknown ref storage format" err &&
+	test_must_fail git init --ref-format=files repo 2>err &&
+	test_i18ngrep "different reference storage format" err &&
+	git init --ref-format=reftable repo
+'
+
+test_expect_success 'update and delete references' '
+	(
+		cd repo &&
+		test_commit first &&
+		git branch topic &&
+		git tag -a -m tag annotated &&
+		cat >expect <<-EOF &&
+		$(git rev-parse first) commit	refs/heads/master
+		$(git rev-parse first) commit	refs/heads/topic
+		$(git rev-parse annotated) tag	refs/tags/annotated
+		$(git rev-parse first) commit	refs/tags/first
+		EOF
+		git for-each-ref >actual &&
+		test_cmp expect actual &&
+		git show-ref -d annotated >actual &&
+		test_line_count = 2 actual &&
+		git update-ref -d refs/heads/topic &&
+		test_must_fail git rev-parse --verify topic &&
+		test_must_fail git update-ref refs/heads/master $INVALID_OID 2>err &&
+		test_i18ngrep "nonexistent object" err
+	)
+'
+
+test_expect_success 'old values are checked' '
+	(
+		cd repo &&
+		test_must_fail git update-ref refs/heads/master HEAD HEAD~0^{tree} 2>err &&
+		test_i18ngrep "cannot lock ref" err &&
+		test_must_fail git update-ref refs/heads/new HEAD HEAD 2>err &&
+		test_i18ngrep "unable to resolve reference" err
+	)
+'
+
+test_expect_success 'directory/file conflicts are rejected' '
+	(
+		cd repo &&
+		test_must_fail git branch master/sub 2>err &&
+		test_i18ngrep "exists; cannot create" err &&
+		git branch dir/sub &&
+		test_must_fail git branch dir &&
+		git branch -D dir/sub &&
+		git branch dir
+	)
+'
+
+test_expect_success 'symbolic refs' '
+	(
+		cd repo &&
+		git symbolic-ref refs/heads/alias refs/heads/master &&
+		test "$(git symbolic-ref refs/heads/alias)" = refs/heads/master &&
+		test_commit second &&
+		git update-ref refs/heads/alias HEAD^ &&
+		test "$(git rev-parse master)" = "$(git rev-parse first)" &&
+		git update-ref --no-deref -d refs/heads/alias &&
+		test "$(git rev-parse master)" = "$(git rev-parse first)" &&
+		git reset --hard second
+	)
+'
+
+test_expect_success 'reflogs' '
+	(
+		cd repo &&
+		git reflog exists refs/heads/master &&
+		git reflog exists HEAD &&
+		git reflog refs/heads/master >actual &&
+		test_line_count = 4 actual &&
+		git update-ref -m "by hand" refs/heads/master first &&
+		git reflog -1 refs/heads/master >actual &&
+		grep "by hand" actual &&
+		git reflog -1 HEAD >actual &&
+		grep "by hand" actual &&
+		git reset --hard second &&
+		git reflog expire --expire=all refs/heads/master &&
+		git reflog exists refs/heads/master &&
+		git reflog refs/heads/master >actual &&
+		test_must_be_empty actual &&
+		git reflog HEAD >before &&
+		git reflog delete HEAD@{0} &&
+		git reflog HEAD >after &&
+		sed 1d before | cut -d" " -f1 >expect &&
+		cut -d" " -f1 after >actual &&
+		test_cmp expect actual
+	)
+'
+
+test_expect_success 'rename and copy branches with their reflogs' '
+	(
+		cd repo &&
+		git branch --create-reflog old &&
+		git branch -m old new &&
+		test_must_fail git rev-parse --verify old &&
+		test_must_fail git reflog exists refs/heads/old &&
+		git reflog refs/heads/new >actual &&
+		test_line_count = 2 actual &&
+		git branch -c new copy &&
+		git reflog refs/heads/copy >actual &&
+		test_line_count = 3 actual &&
+		git rev-parse --verify new
+	)
+'
+
+test_expect_success 'pseudorefs other than HEAD are files' '
+	(
+		cd repo &&
+		git update-ref ORIG_HEAD HEAD &&
+		test_path_is_file .git/ORIG_HEAD &&
+		git rev-parse --verify ORIG_HEAD &&
+		git update-ref -d ORIG_HEAD &&
+		test_path_is_missing .git/ORIG_HEAD
+	)
+'
+
+test_expect_success 'many refs span several blocks and stay compacted' '
+	(
+		cd repo &&
+		test_seq 2000 |
+		sed "s|.*|create refs/heads/branch-& HEAD|" >input &&
+		git update-ref --stdin <input &&
+		git for-each-ref refs/heads/branch-* >refs &&
+		test_line_count = 2000 refs &&
+		git rev-parse --verify branch-1234 &&
+		test "$(git for-each-ref --count=1 refs/heads/branch-2*)" = \
+			"$(git rev-parse HEAD) commit	refs/heads/branch-2" &&
+		for i in $(test_seq 20)
+		do
+			git update-ref refs/heads/loop-$i HEAD || return 1
+		done &&
+		test_line_count -lt 10 .git/reftable/tables.list &&
+		git pack-refs &&
+		test_line_count = 1 .git/reftable/tables.list &&
+		git rev-parse --verify loop-20 &&
+		git for-each-ref refs/heads/branch-* >refs &&
+		test_line_count = 2000 refs
+	)
+'
+
+test_expect_success 'tables with padding, object blocks and a deep index' '
+	test_when_finished "rm -rf fixture" &&
+	git init --ref-format=reftable fixture &&
+	(
+		cd fixture &&
+		test_commit first &&
+		oid=$(git rev-parse HEAD) &&
+		test-tool reftable write-fixture .git/reftable/fixture.ref \
+			1000 $oid 40 &&
+		echo fixture.ref >>.git/reftable/tables.list &&
+		git for-each-ref refs/heads/fixture-* >refs &&
+		test_line_count = 40 refs &&
+		for ref in fixture-000 fixture-013 fixture-027 fixture-039
+		do
+			echo $oid >expect &&
+			git rev-parse --verify $ref >actual &&
+			test_cmp expect actual || return 1
+		done &&
+		test_must_fail git rev-parse --verify fixture-040 &&
+		git for-each-ref --format="%(refname)" refs/heads/fixture-03* >refs &&
+		test_line_count = 10 refs &&
+		git update-ref -d refs/heads/fixture-013 &&
+		git pack-refs &&
+		git for-each-ref refs/heads/fixture-* >refs &&
+		test_line_count = 39 refs
+	)
+'
+
+test_expect_success 'lock contention fails cleanly' '
+	(
+		cd repo &&
+		>.git/reftable/tables.list.lock &&
+		test_must_fail git update-ref refs/heads/locked HEAD 2>err &&
+		test_i18ngrep "Unable to create" err &&
+		rm .git/reftable/tables.list.lock &&
+		git update-ref refs/heads/locked HEAD
+	)
+'
+
+test_expect_success 'worktrees keep HEAD and per-worktree refs apart' '
+	(
+		cd repo &&
+		git worktree add ../wt &&
+		test_path_is_dir .git/worktrees/wt/reftable &&
+		test "$(git -C ../wt symbolic-ref HEAD)" = refs/heads/wt &&
+		test "$(git symbolic-ref HEAD)" = refs/heads/master &&
+		git -C ../wt update-ref refs/bisect/wt-only HEAD &&
+		test_must_fail git rev-parse --verify refs/bisect/wt-only &&
+		git -C ../wt rev-parse --verify refs/bisect/wt-only &&
+		git rev-parse --verify worktrees/wt/HEAD &&
+		git -C ../wt rev-parse --verify main-worktree/HEAD &&
+		git -C ../wt commit --allow-empty -m in-worktree &&
+		git rev-parse --verify wt >actual &&
+		git -C ../wt rev-parse HEAD >expect &&
+		test_cmp expect actual &&
+		git reflog wt >actual &&
+		grep in-worktree actual
+	)
+'
+
+test_expect_success 'clone into a reftable repository' '
+	GIT_DEFAULT_REF_FORMAT=reftable git clone repo clone &&
+	test_path_is_file clone/.git/reftable/tables.list &&
+	git -C repo for-each-ref refs/heads/ --format="%(objectname) %(refname:lstrip=2)" >expect &&
+	git -C clone for-each-ref refs/remotes/origin/ --format="%(objectname) %(refname:lstrip=3)" |
+		grep -v "^.* HEAD$" >actual &&
+	test_cmp expect actual &&
+	git -C clone fsck
+'
+
+test_expect_success 'clone a repository using another object format' '
+	case "$(test_oid algo)" in
+	sha1) other=sha256 ;;
+	*) other=sha1 ;;
+	esac &&
+	git init --object-format=$other other &&
+	test_commit -C other one &&
+	GIT_DEFAULT_REF_FORMAT=reftable git clone other other-clone &&
+	test "$(git -C other-clone rev-parse --show-object-format)" = $other &&
+	git -C other rev-parse HEAD >expect &&
+	git -C other-clone rev-parse HEAD >actual &&
+	test_cmp expect actual &&
+	git -C other-clone fsck
+'
+
+test_done
@@ -0,0 +1,235 @@
+#!/bin/sh
+
+test_description='compare full workdir to sparse workdir'
+
+. ./test-lib.sh
+
+# A sparse index cannot be combined with a split index.
+sane_unset GIT_TEST_SPLIT_INDEX
+
+test_expect_success 'setup' '
+	git init initial-repo &&
+	(
+		cd initial-repo &&
+		echo a >a &&
+		echo "after deep" >e &&
+		echo "after folder1" >g &&
+		echo "after x" >z &&
+		mkdir folder1 folder2 deep x &&
+		mkdir deep/deeper1 deep/deeper2 &&
+		mkdir deep/deeper1/deepest &&
+		cp a folder1 &&
+		cp a folder2 &&
+		cp a x &&
+		cp a deep &&
+		cp a deep/deeper1 &&
+		cp a deep/deeper2 &&
+		cp a deep/deeper1/deepest &&
+		git add . &&
+		git commit -m "initial commit" &&
+		git checkout -b base &&
+		for dir in folder1 folder2 deep
+		do
+			git checkout -b update-$dir &&
+			echo "updated $dir" >$dir/a &&
+			git commit -a -m "update $dir" &&
+			git checkout base || return 1
+		done &&
+
+		git checkout -b update-outside &&
+		echo "updated folder1" >folder1/a &&
+		echo "updated x" >x/a &&
+		echo "new file" >folder2/b &&
+		git add . &&
+		git commit -m "update outside of the cone" &&
+		git checkout base
+	)
+'
+
+init_repos () {
+	rm -rf full-checkout sparse-checkout sparse-index &&
+
+	# create repos in initial state
+	cp -r initial-repo full-checkout &&
+	git -C full-checkout reset --hard &&
+
+	cp -r initial-repo sparse-checkout &&
+	git -C sparse-checkout reset --hard &&
+	git -C sparse-checkout sparse-checkout init --cone &&
+
+	cp -r initial-repo sparse-index &&
+	git -C sparse-index reset --hard &&
+	git -C sparse-index sparse-checkout init --cone --sparse-index &&
+
+	# initialize sparse-checkout definitions
+	git -C sparse-checkout sparse-checkout set deep &&
+	git -C sparse-index sparse-checkout set deep
+}
+
+run_on_sparse () {
+	(
+		cd sparse-checkout &&
+		"$@" >../sparse-checkout-out 2>../sparse-checkout-err
+	) &&
+	(
+		cd sparse-index &&
+		"$@" >../sparse-index-out 2>../sparse-index-err
+	)
+}
+
+run_on_all () {
+	(
+		cd full-checkout &&
+		"$@" >../full-checkout-out 2>../full-checkout-err
+	) &&
+	run_on_sparse "$@"
+}
+
+test_all_match () {
+	run_on_all "$@" &&
+	test_cmp full-checkout-out sparse-checkout-out &&
+	test_cmp full-checkout-out sparse-index-out
+}
+
+test_sparse_match () {
+	run_on_sparse "$@" &&
+	test_cmp sparse-checkout-out sparse-index-out
+}
+
+test_expect_success 'sparse-index contents' '
+	init_repos &&
+
+	test-tool -C sparse-index read-cache --table >cache &&
+	for dir in folder1 folder2 x
+	do
+		TREE=$(git -C sparse-index rev-parse HEAD:$dir) &&
+		grep "040000 tree $TREE	$dir/" cache \
+			|| return 1
+	done &&
+	! grep "	deep/" cache | grep tree &&
+
+	git -C sparse-index sparse-checkout set folder1 &&
+
+	test-tool -C sparse-index read-cache --table >cache &&
+	for dir in deep folder2 x
+	do
+		TREE=$(git -C sparse-index rev-parse HEAD:$dir) &&
+		grep "040000 tree $TREE	$dir/" cache \
+			|| return 1
+	done &&
+
+	git -C sparse-index sparse-checkout set deep/deeper1 &&
+
+	test-tool -C sparse-index read-cache --table >cache &&
+	for dir in deep/deeper2 folder1 folder2 x
+	do
+		TREE=$(git -C sparse-index rev-parse HEAD:$dir) &&
+		grep "040000 tree $TREE	$dir/" cache \
+			|| return 1
+	done &&
+	grep "100644 blob .*	deep/a$" cache
+'
+
+test_expect_success 'expanded in-memory index matches full index' '
+	init_repos &&
+	test_sparse_match test-tool read-cache --expand --table
+'
+
+test_expect_success 'status with options' '
+	init_repos &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git status --porcelain=v2 -z -u &&
+	test_all_match git status --porcelain=v2 -uno &&
+	run_on_all touch README.md &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git status --porcelain=v2 -z -u &&
+	test_all_match git status --porcelain=v2 -uno &&
+	test_all_match git add README.md &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git status --porcelain=v2 -z -u &&
+	test_all_match git status --porcelain=v2 -uno
+'
+
+test_expect_success 'status and commit within the cone' '
+	init_repos &&
+
+	write_script edit-contents <<-\EOF &&
+	echo text >>$1
+	EOF
+	run_on_all ../edit-contents deep/a &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git add deep/a &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git commit -m "edit deep/a" &&
+	test_all_match git rev-parse HEAD^{tree} &&
+	test_all_match git status --porcelain=v2
+'
+
+test_expect_success 'status compares sparse directories with HEAD' '
+	init_repos &&
+
+	# The index now differs from HEAD outside of the cone.
+	test_all_match git reset --soft update-outside &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git diff --cached --name-status &&
+	test_all_match git commit -m "undo update-outside" &&
+	test_all_match git rev-parse HEAD^{tree} &&
+
+	test_all_match git reset --soft update-folder1 &&
+	test_all_match git status --porcelain=v2
+'
+
+test_expect_success 'checkout and reset keep the index sparse' '
+	init_repos &&
+
+	test_all_match git checkout update-deep &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git checkout update-outside &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git reset --hard update-folder2 &&
+	test_all_match git status --porcelain=v2 &&
+
+	test-tool -C sparse-index read-cache --table >cache &&
+	grep "040000 tree .*	folder1/" cache
+'
+
+test_expect_success 'status and as-is commit do not expand the index' '
+	init_repos &&
+
+	echo text >>sparse-index/deep/a &&
+	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" GIT_TRACE2_EVENT_NESTING=10 \
+		git -C sparse-index status --porcelain=v2 &&
+	! grep ensure_full_index trace2.txt &&
+
+	git -C sparse-index add deep/a &&
+	rm trace2.txt &&
+	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" GIT_TRACE2_EVENT_NESTING=10 \
+		git -C sparse-index commit -m "edit deep/a" &&
+	! grep ensure_full_index trace2.txt
+'
+
+test_expect_success 'other commands expand the sparse index' '
+	init_repos &&
+
+	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" GIT_TRACE2_EVENT_NESTING=10 \
+		git -C sparse-index ls-files >actual &&
+	grep ensure_full_index trace2.txt &&
+	git -C full-checkout ls-files >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'sparse-index is not used with non-cone patterns' '
+	init_repos &&
+	test_must_fail git -C sparse-index sparse-checkout init --sparse-index 2>err &&
+	test_i18ngrep "requires --cone" err
+'
+
+test_expect_success 'disable removes the sparse index' '
+	init_repos &&
+	git -C sparse-index sparse-checkout disable &&
+	test-tool -C sparse-index read-cache --table >cache &&
+	! grep " tree " cache &&
+	test_must_fail git -C sparse-index config index.sparse
+'
+
+test_done
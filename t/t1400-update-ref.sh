@@ -61,7 +61,7 @@ test_expect_success "delete $m without oldvalue verification" '
 	test_path_is_missing .git/$m
 '
 
-test_expect_success "fail to create $n" '
+test_expect_success REFFILES "fail to create $n" '
 	test_when_finished "rm -f .git/$n_dir" &&
 	touch .git/$n_dir &&
 	test_must_fail git update-ref $n $A
@@ -85,7 +85,7 @@ test_expect_success "delete $m (by HEAD)" '
 	test_path_is_missing .git/$m
 '
 
-test_expect_success "deleting current branch adds message to HEAD's log" '
+test_expect_success REFFILES "deleting current branch adds message to HEAD's log" '
 	test_when_finished "rm -f .git/$m" &&
 	git update-ref $m $A &&
 	git symbolic-ref HEAD $m &&
@@ -94,7 +94,7 @@ test_expect_success "deleting current branch adds message to HEAD's log" '
 	grep "delete-$m$" .git/logs/HEAD
 '
 
-test_expect_success "deleting by HEAD adds message to HEAD's log" '
+test_expect_success REFFILES "deleting by HEAD adds message to HEAD's log" '
 	test_when_finished "rm -f .git/$m" &&
 	git update-ref $m $A &&
 	git symbolic-ref HEAD $m &&
@@ -129,7 +129,7 @@ test_expect_success 'creates no reflog in bare repository' '
 	test_must_fail git -C $bare reflog exists $m
 '
 
-test_expect_success 'core.logAllRefUpdates=true creates reflog in bare repository' '
+test_expect_success REFFILES 'core.logAllRefUpdates=true creates reflog in bare repository' '
 	test_when_finished "git -C $bare config --unset core.logAllRefUpdates && \
 		rm $bare/logs/$m" &&
 	git -C $bare config core.logAllRefUpdates true &&
@@ -195,13 +195,13 @@ test_expect_success "delete $m (by HEAD) should remove both packed and loose $m"
 '
 
 cp -f .git/HEAD .git/HEAD.orig
-test_expect_success 'delete symref without dereference' '
+test_expect_success REFFILES 'delete symref without dereference' '
 	test_when_finished "cp -f .git/HEAD.orig .git/HEAD" &&
 	git update-ref --no-deref -d HEAD &&
 	test_path_is_missing .git/HEAD
 '
 
-test_expect_success 'delete symref without dereference when the referred ref is packed' '
+test_expect_success REFFILES 'delete symref without dereference when the referred ref is packed' '
 	test_when_finished "cp -f .git/HEAD.orig .git/HEAD" &&
 	echo foo >foo.c &&
 	git add foo.c &&
@@ -213,7 +213,7 @@ test_expect_success 'delete symref without dereference when the referred ref is
 
 git update-ref -d $m
 
-test_expect_success 'update-ref -d is not confused by self-reference' '
+test_expect_success REFFILES 'update-ref -d is not confused by self-reference' '
 	git symbolic-ref refs/heads/self refs/heads/self &&
 	test_when_finished "rm -f .git/refs/heads/self" &&
 	test_path_is_file .git/refs/heads/self &&
@@ -221,7 +221,7 @@ test_expect_success 'update-ref -d is not confused by self-reference' '
 	test_path_is_file .git/refs/heads/self
 '
 
-test_expect_success 'update-ref --no-deref -d can delete self-reference' '
+test_expect_success REFFILES 'update-ref --no-deref -d can delete self-reference' '
 	git symbolic-ref refs/heads/self refs/heads/self &&
 	test_when_finished "rm -f .git/refs/heads/self" &&
 	test_path_is_file .git/refs/heads/self &&
@@ -229,7 +229,7 @@ test_expect_success 'update-ref --no-deref -d can delete self-reference' '
 	test_path_is_missing .git/refs/heads/self
 '
 
-test_expect_success 'update-ref --no-deref -d can delete reference to bad ref' '
+test_expect_success REFFILES 'update-ref --no-deref -d can delete reference to bad ref' '
 	>.git/refs/heads/bad &&
 	test_when_finished "rm -f .git/refs/heads/bad" &&
 	git symbolic-ref refs/heads/ref-to-bad refs/heads/bad &&
@@ -259,26 +259,26 @@ test_expect_success "(not) changed .git/$m" '
 '
 
 rm -f .git/logs/refs/heads/master
-test_expect_success "create $m (logged by touch)" '
+test_expect_success REFFILES "create $m (logged by touch)" '
 	test_config core.logAllRefUpdates false &&
 	GIT_COMMITTER_DATE="2005-05-26 23:30" \
 	git update-ref --create-reflog HEAD $A -m "Initial Creation" &&
 	test $A = $(git show-ref -s --verify $m)
 '
-test_expect_success "update $m (logged by touch)" '
+test_expect_success REFFILES "update $m (logged by touch)" '
 	test_config core.logAllRefUpdates false &&
 	GIT_COMMITTER_DATE="2005-05-26 23:31" \
 	git update-ref HEAD $B $A -m "Switch" &&
 	test $B = $(git show-ref -s --verify $m)
 '
-test_expect_success "set $m (logged by touch)" '
+test_expect_success REFFILES "set $m (logged by touch)" '
 	test_config core.logAllRefUpdates false &&
 	GIT_COMMITTER_DATE="2005-05-26 23:41" \
 	git update-ref HEAD $A &&
 	test $A = $(git show-ref -s --verify $m)
 '
 
-test_expect_success 'empty directory removal' '
+test_expect_success REFFILES 'empty directory removal' '
 	git branch d1/d2/r1 HEAD &&
 	git branch d1/r2 HEAD &&
 	test_path_is_file .git/refs/heads/d1/d2/r1 &&
@@ -290,7 +290,7 @@ test_expect_success 'empty directory removal' '
 	test_path_is_file .git/logs/refs/heads/d1/r2
 '
 
-test_expect_success 'symref empty directory removal' '
+test_expect_success REFFILES 'symref empty directory removal' '
 	git branch e1/e2/r1 HEAD &&
 	git branch e1/r2 HEAD &&
 	git checkout e1/e2/r1 &&
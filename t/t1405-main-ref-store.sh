@@ -104,7 +104,7 @@ test_expect_success 'delete_reflog(HEAD)' '
 	! test -f .git/logs/HEAD
 '
 
-test_expect_success 'create-reflog(HEAD)' '
+test_expect_success REFFILES 'create-reflog(HEAD)' '
 	$RUN create-reflog HEAD 1 &&
 	test -f .git/logs/HEAD
 '
@@ -38,7 +38,7 @@ test_expect_success 'fast-import: fail on invalid branch name "bad[branch]name"'
 	test_must_fail git fast-import <input
 '
 
-test_expect_success 'git branch shows badly named ref as warning' '
+test_expect_success REFFILES 'git branch shows badly named ref as warning' '
 	cp .git/refs/heads/master .git/refs/heads/broken...ref &&
 	test_when_finished "rm -f .git/refs/heads/broken...ref" &&
 	git branch >output 2>error &&
@@ -46,7 +46,7 @@ test_expect_success 'git branch shows badly named ref as warning' '
 	! grep -e "broken\.\.\.ref" output
 '
 
-test_expect_success 'branch -d can delete badly named ref' '
+test_expect_success REFFILES 'branch -d can delete badly named ref' '
 	cp .git/refs/heads/master .git/refs/heads/broken...ref &&
 	test_when_finished "rm -f .git/refs/heads/broken...ref" &&
 	git branch -d broken...ref &&
@@ -55,7 +55,7 @@ test_expect_success 'branch -d can delete badly named ref' '
 	! grep -e "broken\.\.\.ref" output
 '
 
-test_expect_success 'branch -D can delete badly named ref' '
+test_expect_success REFFILES 'branch -D can delete badly named ref' '
 	cp .git/refs/heads/master .git/refs/heads/broken...ref &&
 	test_when_finished "rm -f .git/refs/heads/broken...ref" &&
 	git branch -D broken...ref &&
@@ -143,7 +143,7 @@ test_expect_failure C_LOCALE_OUTPUT 'push --mirror can delete badly named ref' '
 	! grep -e "broken\.\.\.ref" output
 '
 
-test_expect_success 'rev-parse skips symref pointing to broken name' '
+test_expect_success REFFILES 'rev-parse skips symref pointing to broken name' '
 	test_when_finished "rm -f .git/refs/heads/broken...ref" &&
 	git branch shadow one &&
 	cp .git/refs/heads/master .git/refs/heads/broken...ref &&
@@ -155,7 +155,7 @@ test_expect_success 'rev-parse skips symref pointing to broken name' '
 	test_i18ngrep "ignoring dangling symref refs/tags/shadow" err
 '
 
-test_expect_success 'for-each-ref emits warnings for broken names' '
+test_expect_success REFFILES 'for-each-ref emits warnings for broken names' '
 	cp .git/refs/heads/master .git/refs/heads/broken...ref &&
 	test_when_finished "rm -f .git/refs/heads/broken...ref" &&
 	printf "ref: refs/heads/broken...ref\n" >.git/refs/heads/badname &&
@@ -171,7 +171,7 @@ test_expect_success 'for-each-ref emits warnings for broken names' '
 	test_i18ngrep "ignoring ref with broken name refs/heads/broken\.\.\.symref" error
 '
 
-test_expect_success 'update-ref -d can delete broken name' '
+test_expect_success REFFILES 'update-ref -d can delete broken name' '
 	cp .git/refs/heads/master .git/refs/heads/broken...ref &&
 	test_when_finished "rm -f .git/refs/heads/broken...ref" &&
 	git update-ref -d refs/heads/broken...ref >output 2>error &&
@@ -182,7 +182,7 @@ test_expect_success 'update-ref -d can delete broken name' '
 	! grep -e "broken\.\.\.ref" output
 '
 
-test_expect_success 'branch -d can delete broken name' '
+test_expect_success REFFILES 'branch -d can delete broken name' '
 	cp .git/refs/heads/master .git/refs/heads/broken...ref &&
 	test_when_finished "rm -f .git/refs/heads/broken...ref" &&
 	git branch -d broken...ref >output 2>error &&
@@ -193,7 +193,7 @@ test_expect_success 'branch -d can delete broken name' '
 	! grep -e "broken\.\.\.ref" output
 '
 
-test_expect_success 'update-ref --no-deref -d can delete symref to broken name' '
+test_expect_success REFFILES 'update-ref --no-deref -d can delete symref to broken name' '
 	cp .git/refs/heads/master .git/refs/heads/broken...ref &&
 	test_when_finished "rm -f .git/refs/heads/broken...ref" &&
 	printf "ref: refs/heads/broken...ref\n" >.git/refs/heads/badname &&
@@ -204,7 +204,7 @@ test_expect_success 'update-ref --no-deref -d can delete symref to broken name'
 	test_must_be_empty error
 '
 
-test_expect_success 'branch -d can delete symref to broken name' '
+test_expect_success REFFILES 'branch -d can delete symref to broken name' '
 	cp .git/refs/heads/master .git/refs/heads/broken...ref &&
 	test_when_finished "rm -f .git/refs/heads/broken...ref" &&
 	printf "ref: refs/heads/broken...ref\n" >.git/refs/heads/badname &&
@@ -215,7 +215,7 @@ test_expect_success 'branch -d can delete symref to broken name' '
 	test_must_be_empty error
 '
 
-test_expect_success 'update-ref --no-deref -d can delete dangling symref to broken name' '
+test_expect_success REFFILES 'update-ref --no-deref -d can delete dangling symref to broken name' '
 	printf "ref: refs/heads/broken...ref\n" >.git/refs/heads/badname &&
 	test_when_finished "rm -f .git/refs/heads/badname" &&
 	git update-ref --no-deref -d refs/heads/badname >output 2>error &&
@@ -224,7 +224,7 @@ test_expect_success 'update-ref --no-deref -d can delete dangling symref to brok
 	test_must_be_empty error
 '
 
-test_expect_success 'branch -d can delete dangling symref to broken name' '
+test_expect_success REFFILES 'branch -d can delete dangling symref to broken name' '
 	printf "ref: refs/heads/broken...ref\n" >.git/refs/heads/badname &&
 	test_when_finished "rm -f .git/refs/heads/badname" &&
 	git branch -d badname >output 2>error &&
@@ -233,7 +233,7 @@ test_expect_success 'branch -d can delete dangling symref to broken name' '
 	test_must_be_empty error
 '
 
-test_expect_success 'update-ref -d can delete broken name through symref' '
+test_expect_success REFFILES 'update-ref -d can delete broken name through symref' '
 	cp .git/refs/heads/master .git/refs/heads/broken...ref &&
 	test_when_finished "rm -f .git/refs/heads/broken...ref" &&
 	printf "ref: refs/heads/broken...ref\n" >.git/refs/heads/badname &&
@@ -244,7 +244,7 @@ test_expect_success 'update-ref -d can delete broken name through symref' '
 	test_must_be_empty error
 '
 
-test_expect_success 'update-ref --no-deref -d can delete symref with broken name' '
+test_expect_success REFFILES 'update-ref --no-deref -d can delete symref with broken name' '
 	printf "ref: refs/heads/master\n" >.git/refs/heads/broken...symref &&
 	test_when_finished "rm -f .git/refs/heads/broken...symref" &&
 	git update-ref --no-deref -d refs/heads/broken...symref >output 2>error &&
@@ -253,7 +253,7 @@ test_expect_success 'update-ref --no-deref -d can delete symref with broken name
 	test_must_be_empty error
 '
 
-test_expect_success 'branch -d can delete symref with broken name' '
+test_expect_success REFFILES 'branch -d can delete symref with broken name' '
 	printf "ref: refs/heads/master\n" >.git/refs/heads/broken...symref &&
 	test_when_finished "rm -f .git/refs/heads/broken...symref" &&
 	git branch -d broken...symref >output 2>error &&
@@ -262,7 +262,7 @@ test_expect_success 'branch -d can delete symref with broken name' '
 	test_must_be_empty error
 '
 
-test_expect_success 'update-ref --no-deref -d can delete dangling symref with broken name' '
+test_expect_success REFFILES 'update-ref --no-deref -d can delete dangling symref with broken name' '
 	printf "ref: refs/heads/idonotexist\n" >.git/refs/heads/broken...symref &&
 	test_when_finished "rm -f .git/refs/heads/broken...symref" &&
 	git update-ref --no-deref -d refs/heads/broken...symref >output 2>error &&
@@ -271,7 +271,7 @@ test_expect_success 'update-ref --no-deref -d can delete dangling symref with br
 	test_must_be_empty error
 '
 
-test_expect_success 'branch -d can delete dangling symref with broken name' '
+test_expect_success REFFILES 'branch -d can delete dangling symref with broken name' '
 	printf "ref: refs/heads/idonotexist\n" >.git/refs/heads/broken...symref &&
 	test_when_finished "rm -f .git/refs/heads/broken...symref" &&
 	git branch -d broken...symref >output 2>error &&
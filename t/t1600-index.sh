@@ -97,4 +97,58 @@ test_expect_success 'index version config precedence' '
 	test_index_version 0 true 2 2
 '
 
+index_trailer () {
+	tail -c $(test_oid rawsz) .git/index | od -An -v -tx1 | tr -d " \n"
+}
+
+test_expect_success 'index.skipHash writes a null trailer' '
+	test_when_finished "rm -rf skip-hash" &&
+	git init skip-hash &&
+	(
+		cd skip-hash &&
+		echo content >file &&
+		git -c index.skipHash=true add file &&
+		test "$(index_trailer)" = "$(test_oid zero)" &&
+
+		# The index can still be read and checked.
+		git ls-files >actual &&
+		echo file >expect &&
+		test_cmp expect actual &&
+		git fsck &&
+
+		# Writing again without the option restores the checksum.
+		git -c index.skipHash=false update-index --force-write-index &&
+		test "$(index_trailer)" != "$(test_oid zero)" &&
+		git fsck
+	)
+'
+
+test_expect_success 'feature.manyFiles enables index.skipHash' '
+	test_when_finished "rm -rf many-files" &&
+	git init many-files &&
+	(
+		cd many-files &&
+		echo content >file &&
+		git -c feature.manyFiles=true add file &&
+		test "$(index_trailer)" = "$(test_oid zero)" &&
+		git -c feature.manyFiles=true -c index.skipHash=false \
+			update-index --force-write-index &&
+		test "$(index_trailer)" != "$(test_oid zero)"
+	)
+'
+
+test_expect_success 'index.skipHash is ignored with a split index' '
+	test_when_finished "rm -rf split" &&
+	git init split &&
+	(
+		cd split &&
+		echo content >file &&
+		git -c index.skipHash=true update-index --add --split-index file &&
+		test "$(index_trailer)" != "$(test_oid zero)" &&
+		git ls-files >actual &&
+		echo file >expect &&
+		test_cmp expect actual
+	)
+'
+
 test_done
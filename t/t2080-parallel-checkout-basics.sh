@@ -0,0 +1,165 @@
+#!/bin/sh
+
+test_description='parallel-checkout basics
+
+Ensure that parallel-checkout writes the same working tree as a
+sequential checkout, including for entries that need conversion and
+for entries that must fall back to being written sequentially.
+'
+
+. ./test-lib.sh
+
+# The tests below pick the number of workers themselves
+sane_unset GIT_TEST_CHECKOUT_WORKERS
+
+# Runs "git <args>" with the given number of workers and threshold, and
+# checks whether the parallel workers were (or were not) launched.
+test_checkout_workers () {
+	workers=$1 threshold=$2 expect=$3 &&
+	shift 3 &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git \
+		-c checkout.workers=$workers \
+		-c checkout.thresholdForParallelism=$threshold "$@" &&
+	if test "$expect" = parallel
+	then
+		grep "parallel_checkout/workers" trace
+	else
+		! grep "parallel_checkout/workers" trace
+	fi
+}
+
+test_expect_success 'setup' '
+	mkdir -p a/b c &&
+	for i in 1 2 3 4 5 6 7 8 9
+	do
+		echo "file $i" >a/f$i &&
+		echo "other $i" >a/b/g$i &&
+		echo "top $i" >c/h$i || return 1
+	done &&
+	echo "#!/bin/sh" >exec &&
+	chmod +x exec &&
+	printf "crlf\nfile\n" >text.crlf &&
+	printf "\$Id\$\n" >ident &&
+	test_ln_s_add a/f1 link &&
+	echo "*.crlf text eol=crlf" >.gitattributes &&
+	echo "ident ident" >>.gitattributes &&
+	git add . &&
+	git commit -m base &&
+	git tag base &&
+
+	for i in 1 2 3
+	do
+		echo "changed $i" >a/f$i || return 1
+	done &&
+	git rm -q c/h9 &&
+	git commit -qam changes &&
+	git tag changes
+'
+
+test_expect_success 'parallel checkout of a fresh working tree' '
+	test_checkout_workers 2 0 parallel \
+		clone -q . parallel &&
+	test_checkout_workers 1 0 sequential \
+		clone -q . sequential &&
+	(cd sequential && git ls-files -s) >expect &&
+	(cd parallel && git ls-files -s) >actual &&
+	test_cmp expect actual &&
+	git -C parallel diff-files --exit-code &&
+	git -C parallel status --porcelain >status &&
+	test_must_be_empty status &&
+	for f in $(git ls-files)
+	do
+		test_cmp sequential/$f parallel/$f || return 1
+	done
+'
+
+test_expect_success 'parallel checkout converts contents' '
+	printf "crlf\r\nfile\r\n" >expect &&
+	test_cmp expect parallel/text.crlf &&
+	grep "^.Id: [0-9a-f]* .$" parallel/ident
+'
+
+test_expect_success POSIXPERM 'parallel checkout keeps the executable bit' '
+	test -x parallel/exec &&
+	! test -x parallel/a/f1
+'
+
+test_expect_success SYMLINKS 'symlinks are checked out sequentially' '
+	test -h parallel/link
+'
+
+test_expect_success 'parallel checkout when switching branches' '
+	git -C parallel checkout -q -b old base &&
+	test_checkout_workers 2 0 parallel \
+		-C parallel checkout -q changes &&
+	echo "changed 1" >expect &&
+	test_cmp expect parallel/a/f1 &&
+	test_path_is_missing parallel/c/h9 &&
+	git -C parallel diff-files --exit-code
+'
+
+test_expect_success 'threshold falls back to sequential writes' '
+	git -C parallel checkout -q old &&
+	test_checkout_workers 2 100 sequential \
+		-C parallel checkout -q changes &&
+	git -C parallel diff-files --exit-code
+'
+
+test_expect_success 'entries with a smudge filter are written sequentially' '
+	git clone -q . filtered &&
+	(
+		cd filtered &&
+		git config filter.upper.smudge "tr a-z A-Z" &&
+		git config filter.upper.clean "tr A-Z a-z" &&
+		echo "a/* filter=upper" >.git/info/attributes &&
+		rm -r a &&
+		test_checkout_workers 2 0 parallel checkout -q -f HEAD &&
+		echo "CHANGED 1" >expect &&
+		test_cmp expect a/f1 &&
+		echo "top 1" >expect &&
+		test_cmp expect c/h1
+	)
+'
+
+test_expect_success 'many ident files get their own object names' '
+	git init idents &&
+	(
+		cd idents &&
+		echo "* ident" >.gitattributes &&
+		for i in $(test_seq 200)
+		do
+			printf "\$Id\$ %d\n" $i >id$i || return 1
+		done &&
+		git add . &&
+		git commit -q -m idents &&
+		rm id* &&
+		test_checkout_workers 8 0 parallel checkout -q -f HEAD &&
+		for i in $(test_seq 200)
+		do
+			printf "\$Id: %s \$ %d\n" \
+				$(git rev-parse HEAD:id$i) $i >expect &&
+			test_cmp expect id$i || return 1
+		done
+	)
+'
+
+test_expect_success CASE_INSENSITIVE_FS 'colliding paths fall back to sequential writes' '
+	git init collisions &&
+	(
+		cd collisions &&
+		empty_blob=$(git hash-object -w --stdin </dev/null) &&
+		blob=$(echo content | git hash-object -w --stdin) &&
+		git update-index --index-info <<-EOF &&
+		100644 $empty_blob 0	FILE
+		100644 $blob 0	file
+		EOF
+		git commit -q -m collisions &&
+		rm -f FILE file &&
+		test_checkout_workers 2 0 parallel checkout -q -f HEAD &&
+		echo content >expect &&
+		test_cmp expect file
+	)
+'
+
+test_done
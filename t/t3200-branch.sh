@@ -23,7 +23,7 @@ test_expect_success 'git branch --help should not have created a bogus branch' '
 	test_path_is_missing .git/refs/heads/--help
 '
 
-test_expect_success 'branch -h in broken repository' '
+test_expect_success REFFILES 'branch -h in broken repository' '
 	mkdir broken &&
 	(
 		cd broken &&
@@ -34,15 +34,15 @@ test_expect_success 'branch -h in broken repository' '
 	test_i18ngrep "[Uu]sage" broken/usage
 '
 
-test_expect_success 'git branch abc should create a branch' '
+test_expect_success REFFILES 'git branch abc should create a branch' '
 	git branch abc && test_path_is_file .git/refs/heads/abc
 '
 
-test_expect_success 'git branch a/b/c should create a branch' '
+test_expect_success REFFILES 'git branch a/b/c should create a branch' '
 	git branch a/b/c && test_path_is_file .git/refs/heads/a/b/c
 '
 
-test_expect_success 'git branch mb master... should create a branch' '
+test_expect_success REFFILES 'git branch mb master... should create a branch' '
 	git branch mb master... && test_path_is_file .git/refs/heads/mb
 '
 
@@ -53,7 +53,7 @@ test_expect_success 'git branch HEAD should fail' '
 cat >expect <<EOF
 $ZERO_OID $HEAD $GIT_COMMITTER_NAME <$GIT_COMMITTER_EMAIL> 1117150200 +0000	branch: Created from master
 EOF
-test_expect_success 'git branch --create-reflog d/e/f should create a branch and a log' '
+test_expect_success REFFILES 'git branch --create-reflog d/e/f should create a branch and a log' '
 	GIT_COMMITTER_DATE="2005-05-26 23:30" \
 	git -c core.logallrefupdates=false branch --create-reflog d/e/f &&
 	test_path_is_file .git/refs/heads/d/e/f &&
@@ -61,7 +61,7 @@ test_expect_success 'git branch --create-reflog d/e/f should create a branch and
 	test_cmp expect .git/logs/refs/heads/d/e/f
 '
 
-test_expect_success 'git branch -d d/e/f should delete a branch and a log' '
+test_expect_success REFFILES 'git branch -d d/e/f should delete a branch and a log' '
 	git branch -d d/e/f &&
 	test_path_is_missing .git/refs/heads/d/e/f &&
 	test_must_fail git reflog exists refs/heads/d/e/f
@@ -171,13 +171,13 @@ test_expect_success 'git branch -M baz bam should succeed when baz is checked ou
 	test $(git rev-parse --abbrev-ref HEAD) = bam
 '
 
-test_expect_success 'git branch -M baz bam should add entries to .git/logs/HEAD' '
+test_expect_success REFFILES 'git branch -M baz bam should add entries to .git/logs/HEAD' '
 	msg="Branch: renamed refs/heads/baz to refs/heads/bam" &&
 	grep " 0\{40\}.*$msg$" .git/logs/HEAD &&
 	grep "^0\{40\}.*$msg$" .git/logs/HEAD
 '
 
-test_expect_success 'git branch -M should leave orphaned HEAD alone' '
+test_expect_success REFFILES 'git branch -M should leave orphaned HEAD alone' '
 	git init orphan &&
 	(
 		cd orphan &&
@@ -190,7 +190,7 @@ test_expect_success 'git branch -M should leave orphaned HEAD alone' '
 	)
 '
 
-test_expect_success 'resulting reflog can be shown by log -g' '
+test_expect_success REFFILES 'resulting reflog can be shown by log -g' '
 	oid=$(git rev-parse HEAD) &&
 	cat >expect <<-EOF &&
 	HEAD@{0} $oid $msg
@@ -321,7 +321,7 @@ test_expect_success 'git branch --list -v with --abbrev' '
 
 '
 
-test_expect_success 'git branch --column' '
+test_expect_success REFFILES 'git branch --column' '
 	COLUMNS=81 git branch --column=column >actual &&
 	cat >expect <<\EOF &&
   a/b/c    bam      foo      l      * master   n        o/p      r
@@ -330,7 +330,7 @@ EOF
 	test_cmp expect actual
 '
 
-test_expect_success 'git branch --column with an extremely long branch name' '
+test_expect_success REFFILES 'git branch --column with an extremely long branch name' '
 	long=this/is/a/part/of/long/branch/name &&
 	long=z$long/$long/$long/$long &&
 	test_when_finished "git branch -d $long" &&
@@ -358,7 +358,7 @@ EOF
 	test_cmp expect actual
 '
 
-test_expect_success 'git branch with column.*' '
+test_expect_success REFFILES 'git branch with column.*' '
 	git config column.ui column &&
 	git config column.branch "dense" &&
 	COLUMNS=80 git branch >actual &&
@@ -375,7 +375,7 @@ test_expect_success 'git branch --column -v should fail' '
 	test_must_fail git branch --column -v
 '
 
-test_expect_success 'git branch -v with column.ui ignored' '
+test_expect_success REFFILES 'git branch -v with column.ui ignored' '
 	git config column.ui column &&
 	COLUMNS=80 git branch -v | cut -c -9 | sed "s/ *$//" >actual &&
 	git config --unset column.ui &&
@@ -402,7 +402,7 @@ EOF
 
 mv .git/config .git/config-saved
 
-test_expect_success SHA1 'git branch -m q q2 without config should succeed' '
+test_expect_success SHA1,REFFILES 'git branch -m q q2 without config should succeed' '
 	git branch -m q q2 &&
 	git branch -m q2 q
 '
@@ -539,13 +539,13 @@ test_expect_success 'git branch -c m2 m2 should work' '
 	test $(git config branch.m2.dummy) = Hello
 '
 
-test_expect_success 'git branch -c zz zz/zz should fail' '
+test_expect_success REFFILES 'git branch -c zz zz/zz should fail' '
 	git branch --create-reflog zz &&
 	git reflog exists refs/heads/zz &&
 	test_must_fail git branch -c zz zz/zz
 '
 
-test_expect_success 'git branch -c b/b b should fail' '
+test_expect_success REFFILES 'git branch -c b/b b should fail' '
 	git branch --create-reflog b/b &&
 	test_must_fail git branch -c b/b b
 '
@@ -682,7 +682,7 @@ EOF
 	test_cmp expect actual
 '
 
-test_expect_success 'deleting a symref' '
+test_expect_success REFFILES 'deleting a symref' '
 	git branch target &&
 	git symbolic-ref refs/heads/symref refs/heads/target &&
 	echo "Deleted branch symref (was refs/heads/target)." >expect &&
@@ -692,7 +692,7 @@ test_expect_success 'deleting a symref' '
 	test_i18ncmp expect actual
 '
 
-test_expect_success 'deleting a dangling symref' '
+test_expect_success REFFILES 'deleting a dangling symref' '
 	git symbolic-ref refs/heads/dangling-symref nowhere &&
 	test_path_is_file .git/refs/heads/dangling-symref &&
 	echo "Deleted branch dangling-symref (was nowhere)." >expect &&
@@ -701,7 +701,7 @@ test_expect_success 'deleting a dangling symref' '
 	test_i18ncmp expect actual
 '
 
-test_expect_success 'deleting a self-referential symref' '
+test_expect_success REFFILES 'deleting a self-referential symref' '
 	git symbolic-ref refs/heads/self-reference refs/heads/self-reference &&
 	test_path_is_file .git/refs/heads/self-reference &&
 	echo "Deleted branch self-reference (was refs/heads/self-reference)." >expect &&
@@ -710,7 +710,7 @@ test_expect_success 'deleting a self-referential symref' '
 	test_i18ncmp expect actual
 '
 
-test_expect_success 'renaming a symref is not allowed' '
+test_expect_success REFFILES 'renaming a symref is not allowed' '
 	git symbolic-ref refs/heads/topic refs/heads/master &&
 	test_must_fail git branch -m topic new-topic &&
 	git symbolic-ref refs/heads/topic &&
@@ -718,14 +718,14 @@ test_expect_success 'renaming a symref is not allowed' '
 	test_path_is_missing .git/refs/heads/new-topic
 '
 
-test_expect_success SYMLINKS 'git branch -m u v should fail when the reflog for u is a symlink' '
+test_expect_success SYMLINKS,REFFILES 'git branch -m u v should fail when the reflog for u is a symlink' '
 	git branch --create-reflog u &&
 	mv .git/logs/refs/heads/u real-u &&
 	ln -s real-u .git/logs/refs/heads/u &&
 	test_must_fail git branch -m u v
 '
 
-test_expect_success 'test tracking setup via --track' '
+test_expect_success REFFILES 'test tracking setup via --track' '
 	git config remote.local.url . &&
 	git config remote.local.fetch refs/heads/*:refs/remotes/local/* &&
 	(git show-ref -q refs/remotes/local/master || git fetch local) &&
@@ -958,7 +958,7 @@ test_expect_success '--set-upstream-to notices an error to set branch as own ups
 cat >expect <<EOF
 $ZERO_OID $HEAD $GIT_COMMITTER_NAME <$GIT_COMMITTER_EMAIL> 1117150200 +0000	branch: Created from master
 EOF
-test_expect_success 'git checkout -b g/h/i -l should create a branch and a log' '
+test_expect_success REFFILES 'git checkout -b g/h/i -l should create a branch and a log' '
 	GIT_COMMITTER_DATE="2005-05-26 23:30" \
 	git checkout -b g/h/i -l master &&
 	test_path_is_file .git/refs/heads/g/h/i &&
@@ -997,7 +997,7 @@ test_expect_success 'avoid ambiguous track' '
 	test -z "$(git config branch.all1.merge)"
 '
 
-test_expect_success 'autosetuprebase local on a tracked local branch' '
+test_expect_success REFFILES 'autosetuprebase local on a tracked local branch' '
 	git config remote.local.url . &&
 	git config remote.local.fetch refs/heads/*:refs/remotes/local/* &&
 	git config branch.autosetuprebase local &&
@@ -1009,7 +1009,7 @@ test_expect_success 'autosetuprebase local on a tracked local branch' '
 	test "$(git config branch.myr1.rebase)" = true
 '
 
-test_expect_success 'autosetuprebase always on a tracked local branch' '
+test_expect_success REFFILES 'autosetuprebase always on a tracked local branch' '
 	git config remote.local.url . &&
 	git config remote.local.fetch refs/heads/*:refs/remotes/local/* &&
 	git config branch.autosetuprebase always &&
@@ -1021,7 +1021,7 @@ test_expect_success 'autosetuprebase always on a tracked local branch' '
 	test "$(git config branch.myr2.rebase)" = true
 '
 
-test_expect_success 'autosetuprebase remote on a tracked local branch' '
+test_expect_success REFFILES 'autosetuprebase remote on a tracked local branch' '
 	git config remote.local.url . &&
 	git config remote.local.fetch refs/heads/*:refs/remotes/local/* &&
 	git config branch.autosetuprebase remote &&
@@ -1033,7 +1033,7 @@ test_expect_success 'autosetuprebase remote on a tracked local branch' '
 	! test "$(git config branch.myr3.rebase)" = true
 '
 
-test_expect_success 'autosetuprebase never on a tracked local branch' '
+test_expect_success REFFILES 'autosetuprebase never on a tracked local branch' '
 	git config remote.local.url . &&
 	git config remote.local.fetch refs/heads/*:refs/remotes/local/* &&
 	git config branch.autosetuprebase never &&
@@ -1100,7 +1100,7 @@ test_expect_success 'autosetuprebase unconfigured on a tracked remote branch' '
 	test "z$(git config branch.myr9.rebase)" = z
 '
 
-test_expect_success 'autosetuprebase unconfigured on a tracked local branch' '
+test_expect_success REFFILES 'autosetuprebase unconfigured on a tracked local branch' '
 	git config remote.local.url . &&
 	git config remote.local.fetch refs/heads/*:refs/remotes/local/* &&
 	(git show-ref -q refs/remotes/local/o || git fetch local) &&
@@ -1111,7 +1111,7 @@ test_expect_success 'autosetuprebase unconfigured on a tracked local branch' '
 	test "z$(git config branch.myr10.rebase)" = z
 '
 
-test_expect_success 'autosetuprebase unconfigured on untracked local branch' '
+test_expect_success REFFILES 'autosetuprebase unconfigured on untracked local branch' '
 	git config remote.local.url . &&
 	git config remote.local.fetch refs/heads/*:refs/remotes/local/* &&
 	(git show-ref -q refs/remotes/local/master || git fetch local) &&
@@ -1131,7 +1131,7 @@ test_expect_success 'autosetuprebase unconfigured on untracked remote branch' '
 	test "z$(git config branch.myr12.rebase)" = z
 '
 
-test_expect_success 'autosetuprebase never on an untracked local branch' '
+test_expect_success REFFILES 'autosetuprebase never on an untracked local branch' '
 	git config branch.autosetuprebase never &&
 	git config remote.local.url . &&
 	git config remote.local.fetch refs/heads/*:refs/remotes/local/* &&
@@ -1142,7 +1142,7 @@ test_expect_success 'autosetuprebase never on an untracked local branch' '
 	test "z$(git config branch.myr13.rebase)" = z
 '
 
-test_expect_success 'autosetuprebase local on an untracked local branch' '
+test_expect_success REFFILES 'autosetuprebase local on an untracked local branch' '
 	git config branch.autosetuprebase local &&
 	git config remote.local.url . &&
 	git config remote.local.fetch refs/heads/*:refs/remotes/local/* &&
@@ -1153,7 +1153,7 @@ test_expect_success 'autosetuprebase local on an untracked local branch' '
 	test "z$(git config branch.myr14.rebase)" = z
 '
 
-test_expect_success 'autosetuprebase remote on an untracked local branch' '
+test_expect_success REFFILES 'autosetuprebase remote on an untracked local branch' '
 	git config branch.autosetuprebase remote &&
 	git config remote.local.url . &&
 	git config remote.local.fetch refs/heads/*:refs/remotes/local/* &&
@@ -1164,7 +1164,7 @@ test_expect_success 'autosetuprebase remote on an untracked local branch' '
 	test "z$(git config branch.myr15.rebase)" = z
 '
 
-test_expect_success 'autosetuprebase always on an untracked local branch' '
+test_expect_success REFFILES 'autosetuprebase always on an untracked local branch' '
 	git config branch.autosetuprebase always &&
 	git config remote.local.url . &&
 	git config remote.local.fetch refs/heads/*:refs/remotes/local/* &&
@@ -24,7 +24,7 @@ test_expect_success \
 
 SHA1=
 
-test_expect_success \
+test_expect_success REFFILES \
     'see if git show-ref works as expected' \
     'git branch a &&
      SHA1=$(cat .git/refs/heads/a) &&
@@ -32,7 +32,7 @@ test_expect_success \
      git show-ref a >result &&
      test_cmp expect result'
 
-test_expect_success \
+test_expect_success REFFILES \
     'see if a branch still exists when packed' \
     'git branch b &&
      git pack-refs --all &&
@@ -48,7 +48,7 @@ test_expect_success 'git branch c/d should barf if branch c exists' '
      test_must_fail git branch c/d
 '
 
-test_expect_success \
+test_expect_success REFFILES \
     'see if a branch still exists after git pack-refs --prune' \
     'git branch e &&
      git pack-refs --all --prune &&
@@ -153,14 +153,14 @@ test_expect_success 'delete ref while another dangling packed ref' '
 	test_must_be_empty result
 '
 
-test_expect_success 'pack ref directly below refs/' '
+test_expect_success REFFILES 'pack ref directly below refs/' '
 	git update-ref refs/top HEAD &&
 	git pack-refs --all --prune &&
 	grep refs/top .git/packed-refs &&
 	test_path_is_missing .git/refs/top
 '
 
-test_expect_success 'do not pack ref in refs/bisect' '
+test_expect_success REFFILES 'do not pack ref in refs/bisect' '
 	git update-ref refs/bisect/local HEAD &&
 	git pack-refs --all --prune &&
 	! grep refs/bisect/local .git/packed-refs >/dev/null &&
@@ -194,7 +194,7 @@ test_expect_success 'notice d/f conflict with existing ref' '
 	test_must_fail git branch foo/bar/baz/lots/of/extra/components
 '
 
-test_expect_success 'reject packed-refs with unterminated line' '
+test_expect_success REFFILES 'reject packed-refs with unterminated line' '
 	cp .git/packed-refs .git/packed-refs.bak &&
 	test_when_finished "mv .git/packed-refs.bak .git/packed-refs" &&
 	printf "%s" "$HEAD refs/zzzzz" >>.git/packed-refs &&
@@ -203,7 +203,7 @@ test_expect_success 'reject packed-refs with unterminated line' '
 	test_cmp expected_err err
 '
 
-test_expect_success 'reject packed-refs containing junk' '
+test_expect_success REFFILES 'reject packed-refs containing junk' '
 	cp .git/packed-refs .git/packed-refs.bak &&
 	test_when_finished "mv .git/packed-refs.bak .git/packed-refs" &&
 	printf "%s\n" "bogus content" >>.git/packed-refs &&
@@ -212,7 +212,7 @@ test_expect_success 'reject packed-refs containing junk' '
 	test_cmp expected_err err
 '
 
-test_expect_success 'reject packed-refs with a short SHA-1' '
+test_expect_success REFFILES 'reject packed-refs with a short SHA-1' '
 	cp .git/packed-refs .git/packed-refs.bak &&
 	test_when_finished "mv .git/packed-refs.bak .git/packed-refs" &&
 	printf "%.7s %s\n" $HEAD refs/zzzzz >>.git/packed-refs &&
@@ -221,7 +221,7 @@ test_expect_success 'reject packed-refs with a short SHA-1' '
 	test_cmp expected_err err
 '
 
-test_expect_success 'timeout if packed-refs.lock exists' '
+test_expect_success REFFILES 'timeout if packed-refs.lock exists' '
 	LOCK=.git/packed-refs.lock &&
 	>"$LOCK" &&
 	test_when_finished "rm -f $LOCK" &&
@@ -238,7 +238,7 @@ test_expect_success 'retry acquiring packed-refs.lock' '
 	git -c core.packedrefstimeout=3000 pack-refs --all --prune
 '
 
-test_expect_success SYMLINKS 'pack symlinked packed-refs' '
+test_expect_success SYMLINKS,REFFILES 'pack symlinked packed-refs' '
 	# First make sure that symlinking works when reading:
 	git update-ref refs/heads/lossy refs/heads/master &&
 	git for-each-ref >all-refs-before &&
@@ -416,6 +416,29 @@ test_expect_success 'all statuses changed in folder if . is given' '
 	test $(git ls-files --stage | grep ^100755 | wc -l) -eq 0
 '
 
+test_expect_success 'add with core.fsyncMethod=batch' '
+	test_create_repo fsync-batch &&
+	(
+		cd fsync-batch &&
+		for i in $(test_seq 20)
+		do
+			echo "content $i" >file-$i || return 1
+		done &&
+		echo "content 1" >duplicate &&
+		git -c core.fsyncObjectFiles=true -c core.fsyncMethod=batch \
+			add file-* duplicate &&
+		git count-objects >actual &&
+		grep "^20 objects" actual &&
+		ls .git/objects >dirs &&
+		! grep bulk-fsync dirs &&
+		git ls-files -s | awk "{print \$2}" | sort -u >blobs &&
+		test_line_count = 20 blobs &&
+		git cat-file --batch-check <blobs >actual &&
+		! grep missing actual &&
+		git fsck
+	)
+'
+
 test_expect_success CASE_INSENSITIVE_FS 'path is case-insensitive' '
 	path="$(pwd)/BLUB" &&
 	touch "$path" &&
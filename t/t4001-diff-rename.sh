@@ -262,4 +262,107 @@ test_expect_success 'diff-tree -l0 defaults to a big rename limit, not zero' '
 	grep "myotherfile.*myfile" actual
 '
 
+test_expect_success 'basename similarity vs best similarity' '
+	mkdir subdir &&
+	test_write_lines line1 line2 line3 line4 line5 \
+			 line6 line7 line8 line9 line10 >subdir/file.txt &&
+	git add subdir/file.txt &&
+	git commit -m "base txt" &&
+
+	git rm subdir/file.txt &&
+	test_write_lines line1 line2 line3 line4 line5 \
+			 line6 line7 line8 >file.txt &&
+	test_write_lines line1 line2 line3 line4 line5 \
+			 line6 line7 line8 line9 >file.md &&
+	git add file.txt file.md &&
+	git commit -a -m "rename" &&
+	git diff-tree -r -M --name-status HEAD^ HEAD >actual &&
+	# subdir/file.txt is 88% similar to file.md and 78% similar to
+	# file.txt, but files with the same basename are paired first.
+	cat >expected <<-\EOF &&
+	A	file.md
+	R078	subdir/file.txt	file.txt
+	EOF
+	test_cmp expected actual
+'
+
+test_expect_success 'same basenames are matched past the rename limit' '
+	mkdir limit-old &&
+	for i in 1 2 3 4 5
+	do
+		test_write_lines $i a b c d e f g h i >limit-old/file$i || return 1
+	done &&
+	git add limit-old &&
+	git commit -m "limit base" &&
+
+	git mv limit-old limit-new &&
+	for i in 1 2 3 4 5
+	do
+		echo edit >>limit-new/file$i || return 1
+	done &&
+	git commit -a -m "move limit-old" &&
+	git diff-tree -r -M -l1 --name-status HEAD^ HEAD >actual &&
+	cat >expected <<-\EOF &&
+	R080	limit-old/file1	limit-new/file1
+	R080	limit-old/file2	limit-new/file2
+	R080	limit-old/file3	limit-new/file3
+	R080	limit-old/file4	limit-new/file4
+	R080	limit-old/file5	limit-new/file5
+	EOF
+	test_cmp expected actual
+'
+
+test_expect_success 'directory renames guide ambiguous basenames' '
+	mkdir -p one two &&
+	test_write_lines 1 2 3 4 5 6 7 8 9 >one/unique &&
+	test_write_lines a b c d e f g h i >one/common &&
+	test_write_lines A B C D E F G H I >two/common &&
+	git add one two &&
+	git commit -m "ambiguous base" &&
+
+	git mv one uno &&
+	git mv two dos &&
+	echo 10 >>uno/unique &&
+	echo j >>uno/common &&
+	echo J >>dos/common &&
+	git commit -a -m "move both" &&
+	# With a rename limit of 1, the full matrix only runs once
+	# one/common has been paired up through the rename of one/.
+	git diff-tree -r -M -l1 --name-status HEAD^ HEAD >actual &&
+	cat >expected <<-\EOF &&
+	R090	two/common	dos/common
+	R090	one/common	uno/common
+	R085	one/unique	uno/unique
+	EOF
+	test_cmp expected actual
+'
+
+test_expect_success 'threaded rename detection matches the serial one' '
+	mkdir threads-old &&
+	for i in $(test_seq 20)
+	do
+		test_seq $i $(($i + 30)) >threads-old/file$i || return 1
+	done &&
+	git add threads-old &&
+	git commit -m "threads base" &&
+
+	mkdir threads-new &&
+	for i in $(test_seq 20)
+	do
+		git mv threads-old/file$i threads-new/renamed$i &&
+		echo edit >>threads-new/renamed$i || return 1
+	done &&
+	git commit -a -m "threads rename" &&
+	for opt in -M -C "-C -C"
+	do
+		GIT_TEST_RENAME_THREADS=1 \
+			git diff-tree -r $opt --name-status HEAD^ HEAD >expect &&
+		GIT_TEST_RENAME_THREADS=4 \
+			git diff-tree -r $opt --name-status HEAD^ HEAD >actual &&
+		test_cmp expect actual || return 1
+	done &&
+	grep "^R" actual >renames &&
+	test_line_count = 20 renames
+'
+
 test_done
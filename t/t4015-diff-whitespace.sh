@@ -183,6 +183,25 @@ test_expect_success 'another test, without options' '
 	test_cmp expect out
 '
 
+test_expect_success 'whitespace options with long lines' '
+	l=abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 &&
+	printf "%s %s\n%s\t%s %s\n%s\n" $l $l $l $l $l $l >long-a &&
+	printf "%s  %s\n%s \t%s %s  \n%s\r\n" $l $l $l $l $l $l >long-b &&
+	printf "%s%s\n%s%s%s\n%s\n" $l $l $l $l $l $l >long-c &&
+	git diff --no-index -b long-a long-b &&
+	git diff --no-index -w long-a long-b &&
+	git diff --no-index -w long-a long-c &&
+	test_must_fail git diff --no-index -b long-a long-c &&
+	test_must_fail git diff --no-index --ignore-space-at-eol long-a long-b &&
+	for opt in -w -b --ignore-space-at-eol --ignore-cr-at-eol
+	do
+		test_might_fail git diff --no-index $opt long-b long-c >expect &&
+		test_might_fail env GIT_TEST_XDIFF_PORTABLE=1 \
+			git diff --no-index $opt long-b long-c >actual &&
+		test_cmp expect actual || return 1
+	done
+'
+
 test_expect_success 'ignore-blank-lines: only new lines' '
 	test_seq 5 >x &&
 	git update-index x &&
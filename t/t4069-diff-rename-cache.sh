@@ -0,0 +1,82 @@
+#!/bin/sh
+
+test_description='rename detection with diff.renameCache'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	for i in 1 2 3 4
+	do
+		test_seq $((i * 20)) >file$i || return 1
+	done &&
+	git add . &&
+	git commit -m initial &&
+	for i in 1 2 3 4
+	do
+		git mv file$i moved$i &&
+		echo change >>moved$i || return 1
+	done &&
+	git commit -a -m moved
+'
+
+test_expect_success 'cache is written and does not change the output' '
+	git diff -M --name-status HEAD^ HEAD >expect &&
+	git -c diff.renameCache=true diff -M --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual &&
+	test-tool rename-cache dump >dump &&
+	test_file_not_empty dump
+'
+
+test_expect_success 'cached scores are used' '
+	test-tool rename-cache dump >before &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -c diff.renameCache=true diff -M --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual &&
+	grep "\"key\":\"rename-cache/hits\",\"value\":\"[1-9]" trace &&
+	grep "\"key\":\"rename-cache/stored\",\"value\":\"0\"" trace &&
+	test-tool rename-cache dump >after &&
+	test_cmp before after
+'
+
+test_expect_success 'cached scores honor the rename threshold' '
+	for score in 10 95 100
+	do
+		git diff -M$score% --name-status HEAD^ HEAD >expect.$score &&
+		git -c diff.renameCache=true \
+			diff -M$score% --name-status HEAD^ HEAD >actual.$score &&
+		test_cmp expect.$score actual.$score || return 1
+	done
+'
+
+test_expect_success 'attributes are part of the key' '
+	test_when_finished "rm -f .git/info/attributes" &&
+	mkdir -p .git/info &&
+	echo "moved* -diff" >.git/info/attributes &&
+	git diff -M --name-status HEAD^ HEAD >expect &&
+	git -c diff.renameCache=true diff -M --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual &&
+	test-tool rename-cache dump >dump &&
+	grep " 0 [0-9]* [0-9]* [0-9]*\$" dump &&
+	grep " 8 [0-9]* [0-9]* [0-9]*\$" dump
+'
+
+test_expect_success 'diff.renameCacheLimit bounds the cache' '
+	rm -f .git/rename-cache &&
+	git -c diff.renameCache=true -c diff.renameCacheLimit=2 \
+		diff -M --name-status HEAD^ HEAD >actual &&
+	test-tool rename-cache dump >dump &&
+	test_line_count = 2 dump
+'
+
+test_expect_success 'a corrupt cache is ignored and replaced' '
+	git diff -M --name-status HEAD^ HEAD >expect &&
+	echo garbage >.git/rename-cache &&
+	git -c diff.renameCache=true diff -M --name-status HEAD^ HEAD \
+		>actual 2>err &&
+	test_cmp expect actual &&
+	test_i18ngrep "rename cache .* is too small" err &&
+	test-tool rename-cache dump >dump &&
+	test_file_not_empty dump
+'
+
+test_done
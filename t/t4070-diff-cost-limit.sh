@@ -0,0 +1,82 @@
+#!/bin/sh
+
+test_description='diff --cost-limit and diff.costLimit'
+
+. ./test-lib.sh
+
+# Lines that are all alike, with the two versions disagreeing on most
+# of them, so that looking for the smallest diff is a lot of work.
+generate () {
+	awk -v seed="$1" '
+	BEGIN {
+		for (i = 0; i < 2000; i++) {
+			if (i % 500 == 250)
+				printf "marker %d\n", i
+			else if ((i * i + seed * i) % 7 < 3)
+				print "},"
+			else
+				print "}"
+		}
+	}'
+}
+
+test_expect_success 'setup' '
+	generate 1 >lines &&
+	git add lines &&
+	git commit -m pre &&
+	generate 3 >lines &&
+	git commit -a -m post &&
+	git tag post
+'
+
+test_expect_success 'a large limit does not change the output' '
+	git diff HEAD^ HEAD >expect &&
+	git diff --cost-limit=1g HEAD^ HEAD >actual &&
+	test_cmp expect actual &&
+	git -c diff.costLimit=1g diff HEAD^ HEAD >actual &&
+	test_cmp expect actual
+'
+
+for alg in myers minimal patience histogram
+do
+	test_expect_success "a small limit still gives a correct diff ($alg)" '
+		test_when_finished "git reset --hard" &&
+		git diff --numstat --diff-algorithm=$alg HEAD^ HEAD >full &&
+		git diff --numstat --diff-algorithm=$alg --cost-limit=1 \
+			HEAD^ HEAD >limited &&
+		! test_cmp full limited &&
+		git diff --diff-algorithm=$alg --cost-limit=1 HEAD^ HEAD >patch &&
+		git checkout HEAD^ -- lines &&
+		git apply patch &&
+		git diff --exit-code HEAD -- lines
+	'
+done
+
+test_expect_success 'unique lines are kept when the limit is reached' '
+	git diff --cost-limit=1 HEAD^ HEAD >patch &&
+	! grep "^[-+]marker" patch
+'
+
+test_expect_success 'diff.costLimit can be overridden' '
+	git diff --numstat HEAD^ HEAD >full &&
+	git diff --numstat --cost-limit=1 HEAD^ HEAD >limited &&
+	git -c diff.costLimit=1 diff --numstat HEAD^ HEAD >actual &&
+	test_cmp limited actual &&
+	git -c diff.costLimit=1 diff --numstat --cost-limit=0 \
+		HEAD^ HEAD >actual &&
+	test_cmp full actual
+'
+
+test_expect_success 'the limit applies to combined diffs' '
+	git checkout -b side HEAD^ &&
+	generate 5 >lines &&
+	git commit -a -m side &&
+	test_must_fail git merge post &&
+	generate 4 >lines &&
+	git commit -a -m merged &&
+	git diff-tree --cc HEAD >full &&
+	git diff-tree --cc --cost-limit=1 HEAD >limited &&
+	! test_cmp full limited
+'
+
+test_done
@@ -468,6 +468,27 @@ test_expect_success 'pack-objects in too-many-packs mode' '
 	git fsck
 '
 
+test_expect_success 'pack-objects with core.threadedChecksum' '
+	git init threaded &&
+	(
+		cd threaded &&
+		test-tool genrandom "seed threaded" 1048576 >big &&
+		git add big &&
+		git commit -m big &&
+		echo HEAD >in &&
+		plain=$(git -c core.threadedChecksum=false \
+			pack-objects --revs --window=0 off <in) &&
+		threaded=$(git -c core.threadedChecksum=true \
+			pack-objects --revs --window=0 on <in) &&
+		test "$plain" = "$threaded" &&
+		test_cmp off-$plain.pack on-$threaded.pack &&
+		test_cmp off-$plain.idx on-$threaded.idx &&
+		git -c core.threadedChecksum=true \
+			index-pack -o threaded.idx on-$threaded.pack &&
+		test_cmp off-$plain.idx threaded.idx
+	)
+'
+
 test_expect_success 'setup: fake a SHA1 hash collision' '
 	git init corrupt &&
 	(
@@ -532,4 +553,58 @@ test_expect_success 'prefetch objects' '
 	test_line_count = 1 donelines
 '
 
+
+test_expect_success '--stdin-packs with excluded packs' '
+	git init stdin-packs &&
+	(
+		cd stdin-packs &&
+		test_commit A &&
+		test_commit B &&
+		test_commit C &&
+
+		A="$(echo A | git pack-objects --revs .git/objects/pack/pack)" &&
+		B="$(echo A..B | git pack-objects --revs .git/objects/pack/pack)" &&
+		C="$(echo B..C | git pack-objects --revs .git/objects/pack/pack)" &&
+
+		PACK=$(git pack-objects --stdin-packs stdin <<-EOF
+		pack-$A.pack
+		^pack-$B.pack
+		pack-$C.pack
+		EOF
+		) &&
+
+		{
+			git show-index <.git/objects/pack/pack-$A.idx &&
+			git show-index <.git/objects/pack/pack-$C.idx
+		} | cut -d" " -f2 | sort >expect &&
+		git show-index <stdin-$PACK.idx | cut -d" " -f2 | sort >actual &&
+		test_cmp expect actual
+	)
+'
+
+test_expect_success '--stdin-packs with --unpacked includes loose objects' '
+	(
+		cd stdin-packs &&
+		git prune-packed &&
+		test_commit D &&
+		git rev-list --objects --no-object-names C..D | sort >expect &&
+
+		PACK=$(git pack-objects --stdin-packs --unpacked unpacked </dev/null) &&
+		git show-index <unpacked-$PACK.idx | cut -d" " -f2 | sort >actual &&
+		test_cmp expect actual
+	)
+'
+
+test_expect_success '--stdin-packs rejects unknown packs and --revs' '
+	(
+		cd stdin-packs &&
+		test_must_fail git pack-objects --stdin-packs nope <<-EOF 2>err &&
+		pack-does-not-exist.pack
+		EOF
+		test_i18ngrep "could not find pack" err &&
+		test_must_fail git pack-objects --stdin-packs --revs nope </dev/null 2>err &&
+		test_i18ngrep "cannot use internal rev list with --stdin-packs" err
+	)
+'
+
 test_done
@@ -236,6 +236,37 @@ test_expect_success 'fetch (full bitmap)' '
 	test_cmp expect actual
 '
 
+test_expect_success 'full repack writes a bitmap lookup table' '
+	git -c pack.writeBitmapLookupTable=true repack -ad &&
+	bitmap=$(ls .git/objects/pack/*.bitmap) &&
+	echo 0015 >expect &&
+	od -An -tx1 -j6 -N2 $bitmap | tr -d " " >actual &&
+	test_cmp expect actual &&
+	git rev-list --test-bitmap HEAD
+'
+
+rev_list_tests 'lookup table'
+
+test_expect_success 'lookup table gives the same answers as a full read' '
+	GIT_TEST_READ_COMMIT_TABLE=0 \
+		git rev-list --use-bitmap-index --objects --all >expect &&
+	git rev-list --use-bitmap-index --objects --all >actual &&
+	test_cmp expect actual &&
+	GIT_TEST_READ_COMMIT_TABLE=0 \
+		git rev-list --use-bitmap-index --count other..master >expect &&
+	git rev-list --use-bitmap-index --count other..master >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'full repack reuses bitmaps from a lookup table' '
+	git -c pack.writeBitmapLookupTable=true repack -adf &&
+	git -c pack.writeBitmapLookupTable=true repack -ad &&
+	git rev-list --test-bitmap HEAD &&
+	git repack -ad &&
+	ls .git/objects/pack/ | grep bitmap >output &&
+	test_line_count = 1 output
+'
+
 test_expect_success 'create objects for missing-HAVE tests' '
 	blob=$(echo "missing have" | git hash-object -w --stdin) &&
 	tree=$(printf "100644 blob $blob\tfile\n" | git mktree) &&
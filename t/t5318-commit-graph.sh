@@ -75,16 +75,16 @@ graph_git_behavior 'no graph' full commits/3 commits/1
 
 graph_read_expect() {
 	OPTIONAL=""
-	NUM_CHUNKS=3
+	NUM_CHUNKS=4
 	if test ! -z $2
 	then
 		OPTIONAL=" $2"
-		NUM_CHUNKS=$((3 + $(echo "$2" | wc -w)))
+		NUM_CHUNKS=$((4 + $(echo "$2" | wc -w)))
 	fi
 	cat >expect <<- EOF
 	header: 43475048 1 $(test_oid oid_version) $NUM_CHUNKS 0
 	num_commits: $1
-	chunks: oid_fanout oid_lookup commit_metadata$OPTIONAL
+	chunks: oid_fanout oid_lookup commit_metadata generation_data$OPTIONAL
 	EOF
 	test-tool read-graph >output &&
 	test_cmp expect output
@@ -466,7 +466,7 @@ GRAPH_BYTE_HASH=5
 GRAPH_BYTE_CHUNK_COUNT=6
 GRAPH_CHUNK_LOOKUP_OFFSET=8
 GRAPH_CHUNK_LOOKUP_WIDTH=12
-GRAPH_CHUNK_LOOKUP_ROWS=5
+GRAPH_CHUNK_LOOKUP_ROWS=6
 GRAPH_BYTE_OID_FANOUT_ID=$GRAPH_CHUNK_LOOKUP_OFFSET
 GRAPH_BYTE_OID_LOOKUP_ID=$(($GRAPH_CHUNK_LOOKUP_OFFSET + \
 			    1 * $GRAPH_CHUNK_LOOKUP_WIDTH))
@@ -487,8 +487,12 @@ GRAPH_BYTE_COMMIT_WRONG_PARENT=$(($GRAPH_COMMIT_DATA_OFFSET + $HASH_LEN + 3))
 GRAPH_BYTE_COMMIT_GENERATION=$(($GRAPH_COMMIT_DATA_OFFSET + $HASH_LEN + 11))
 GRAPH_BYTE_COMMIT_DATE=$(($GRAPH_COMMIT_DATA_OFFSET + $HASH_LEN + 12))
 GRAPH_COMMIT_DATA_WIDTH=$(($HASH_LEN + 16))
-GRAPH_OCTOPUS_DATA_OFFSET=$(($GRAPH_COMMIT_DATA_OFFSET + \
-			     $GRAPH_COMMIT_DATA_WIDTH * $NUM_COMMITS))
+GRAPH_GENERATION_DATA_OFFSET=$(($GRAPH_COMMIT_DATA_OFFSET + \
+				$GRAPH_COMMIT_DATA_WIDTH * $NUM_COMMITS))
+GRAPH_GENERATION_DATA_WIDTH=4
+GRAPH_BYTE_GENERATION_DATA=$(($GRAPH_GENERATION_DATA_OFFSET + 3))
+GRAPH_OCTOPUS_DATA_OFFSET=$(($GRAPH_GENERATION_DATA_OFFSET + \
+			     $GRAPH_GENERATION_DATA_WIDTH * $NUM_COMMITS))
 GRAPH_BYTE_OCTOPUS=$(($GRAPH_OCTOPUS_DATA_OFFSET + 4))
 GRAPH_BYTE_FOOTER=$(($GRAPH_OCTOPUS_DATA_OFFSET + 4 * $NUM_OCTOPUS_EDGES))
 
@@ -631,6 +635,11 @@ test_expect_success 'detect incorrect generation number' '
 		"non-zero generation number"
 '
 
+test_expect_success 'detect incorrect corrected commit date' '
+	corrupt_graph_and_verify $GRAPH_BYTE_GENERATION_DATA "\01" \
+		"corrected commit date"
+'
+
 test_expect_success 'detect incorrect commit date' '
 	corrupt_graph_and_verify $GRAPH_BYTE_COMMIT_DATE "\01" \
 		"commit date"
@@ -741,4 +750,51 @@ test_expect_success 'corrupt commit-graph write (missing tree)' '
 	)
 '
 
+test_expect_success 'commitGraph.generationVersion=1 omits generation data' '
+	rm -rf repo &&
+	git init repo &&
+	(
+		cd repo &&
+		test_commit one &&
+		test_commit two &&
+		git -c commitGraph.generationVersion=1 commit-graph write --reachable &&
+		cat >expect <<-EOF &&
+		header: 43475048 1 $(test_oid oid_version) 3 0
+		num_commits: 2
+		chunks: oid_fanout oid_lookup commit_metadata
+		EOF
+		test-tool read-graph >actual &&
+		test_cmp expect actual &&
+		git commit-graph verify
+	)
+'
+
+test_expect_success 'corrected commit date offsets can overflow' '
+	rm -rf repo &&
+	git init repo &&
+	(
+		cd repo &&
+		GIT_COMMITTER_DATE="@4147483646 +0000" &&
+		export GIT_COMMITTER_DATE &&
+		test_commit --notick future &&
+		GIT_COMMITTER_DATE="@1000000000 +0000" &&
+		test_commit --notick past &&
+		GIT_COMMITTER_DATE="@1000000001 +0000" &&
+		test_commit --notick present &&
+		git commit-graph write --reachable &&
+		cat >expect <<-EOF &&
+		header: 43475048 1 $(test_oid oid_version) 5 0
+		num_commits: 3
+		chunks: oid_fanout oid_lookup commit_metadata generation_data generation_data_overflow
+		EOF
+		test-tool read-graph >actual &&
+		test_cmp expect actual &&
+		git commit-graph verify &&
+		git -c core.commitGraph=false rev-list --topo-order HEAD >expect &&
+		git rev-list --topo-order HEAD >actual &&
+		test_cmp expect actual &&
+		git merge-base --is-ancestor future present
+	)
+'
+
 test_done
@@ -0,0 +1,153 @@
+#!/bin/sh
+
+test_description='exercise basic multi-pack bitmap functionality'
+. ./test-lib.sh
+
+GIT_TEST_MULTI_PACK_INDEX=0
+export GIT_TEST_MULTI_PACK_INDEX
+
+objdir=.git/objects
+packdir=$objdir/pack
+
+midx_checksum () {
+	test-tool read-midx --checksum "${1:-$objdir}"
+}
+
+midx_pack_source () {
+	test-tool read-midx --show-objects "${1:-$objdir}" |
+	grep "^$2 " | cut -f2 | sed -e "s,.*/,,"
+}
+
+test_expect_success 'setup repo with multiple packs' '
+	git config core.multiPackIndex true &&
+	test_commit_bulk --id=file 10 &&
+	git repack -d &&
+	git checkout -b other HEAD~5 &&
+	test_commit_bulk --id=side 5 &&
+	git repack -d &&
+	git checkout master &&
+	test_commit_bulk --id=more 5 &&
+	git repack -d &&
+	ls $packdir/pack-*.idx >packs &&
+	test_line_count = 3 packs
+'
+
+test_expect_success 'write multi-pack bitmap' '
+	git multi-pack-index write --bitmap &&
+	test_path_is_file $packdir/multi-pack-index &&
+	test_path_is_file $packdir/multi-pack-index-$(midx_checksum).bitmap
+'
+
+test_expect_success 'rev-list --test-bitmap verifies multi-pack bitmaps' '
+	git rev-list --test-bitmap HEAD &&
+	git rev-list --test-bitmap other
+'
+
+test_expect_success 'counting objects via multi-pack bitmap' '
+	git rev-list --count --objects --all >expect &&
+	git rev-list --use-bitmap-index --count --objects --all >actual &&
+	test_cmp expect actual &&
+
+	git rev-list --objects --no-object-names other..master >expect &&
+	git rev-list --use-bitmap-index --objects --no-object-names \
+		other..master >actual &&
+	sort <expect >expect.sorted &&
+	sort <actual >actual.sorted &&
+	test_cmp expect.sorted actual.sorted
+'
+
+test_expect_success 'multi-pack bitmap with a lookup table' '
+	git -c pack.writeBitmapLookupTable=true multi-pack-index write --bitmap &&
+	bitmap=$packdir/multi-pack-index-$(midx_checksum).bitmap &&
+	echo 0011 >expect &&
+	od -An -tx1 -j6 -N2 $bitmap | tr -d " " >actual &&
+	test_cmp expect actual &&
+
+	git rev-list --test-bitmap HEAD &&
+	git rev-list --test-bitmap other &&
+	git rev-list --count --objects --all >expect &&
+	git rev-list --use-bitmap-index --count --objects --all >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'bitmap filters work with multi-pack bitmaps' '
+	git rev-list --objects --no-object-names --filter=blob:none HEAD >expect &&
+	git rev-list --use-bitmap-index --objects --no-object-names \
+		--filter=blob:none HEAD >actual &&
+	sort <expect >expect.sorted &&
+	sort <actual >actual.sorted &&
+	test_cmp expect.sorted actual.sorted
+'
+
+test_expect_success 'pack-objects reuses objects from the preferred pack' '
+	git rev-list --objects --no-object-names --all >objects &&
+	git pack-objects --stdout --revs --use-bitmap-index --all \
+		--progress </dev/null >out.pack 2>err &&
+	grep "pack-reused [1-9]" err &&
+	git index-pack --strict -o out.idx out.pack &&
+	git show-index <out.idx | cut -d" " -f2 | sort >got &&
+	sort objects >want &&
+	test_cmp want got
+'
+
+test_expect_success 'clone from a repository with a multi-pack bitmap' '
+	git clone --no-local --bare . clone.git &&
+	git rev-parse HEAD >expect &&
+	git --git-dir=clone.git rev-parse HEAD >actual &&
+	test_cmp expect actual &&
+	git -C clone.git fsck
+'
+
+test_expect_success 'preferred pack wins duplicate objects' '
+	git rev-parse HEAD >in &&
+	pack=$(git pack-objects --revs $packdir/pack <in) &&
+	git multi-pack-index write --bitmap \
+		--preferred-pack=pack-$pack.pack &&
+	test "$(midx_pack_source $objdir $(git rev-parse HEAD))" = "pack-$pack.pack" &&
+	test "$(midx_pack_source $objdir $(git rev-parse HEAD~3))" = "pack-$pack.pack" &&
+	git rev-list --test-bitmap HEAD
+'
+
+test_expect_success 'stale multi-pack bitmaps are removed' '
+	ls $packdir/multi-pack-index-*.bitmap >bitmaps &&
+	test_line_count = 1 bitmaps &&
+	test_commit extra &&
+	git repack -d &&
+	git multi-pack-index write --bitmap &&
+	ls $packdir/multi-pack-index-*.bitmap >bitmaps &&
+	test_line_count = 1 bitmaps &&
+	test_path_is_file $packdir/multi-pack-index-$(midx_checksum).bitmap
+'
+
+test_expect_success 'writing a MIDX without --bitmap removes old bitmaps' '
+	git multi-pack-index write --bitmap &&
+	test_commit another &&
+	git repack -d &&
+	git multi-pack-index write &&
+	ls $packdir/ >files &&
+	! grep "multi-pack-index-.*\.bitmap" files
+'
+
+test_expect_success 'rejects an unknown or empty preferred pack' '
+	test_must_fail git multi-pack-index write --bitmap \
+		--preferred-pack=pack-does-not-exist.pack 2>err &&
+	test_i18ngrep "unknown preferred pack" err &&
+
+	empty=$(git pack-objects $packdir/pack </dev/null) &&
+	test_must_fail git multi-pack-index write --bitmap \
+		--preferred-pack=pack-$empty.pack 2>err &&
+	test_i18ngrep "with no objects" err
+'
+
+test_expect_success '--bitmap is only valid for write' '
+	test_must_fail git multi-pack-index --bitmap verify 2>err &&
+	test_i18ngrep "only for .write" err
+'
+
+test_expect_success 'garbage collection does not report midx bitmaps' '
+	git multi-pack-index write --bitmap &&
+	git count-objects -v >out &&
+	grep "^garbage: 0" out
+'
+
+test_done
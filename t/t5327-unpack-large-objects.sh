@@ -0,0 +1,93 @@
+#!/bin/sh
+
+test_description='git unpack-objects with large objects'
+
+. ./test-lib.sh
+
+prepare_dest () {
+	test_when_finished "rm -rf dest.git" &&
+	git init --bare dest.git &&
+	git -C dest.git config core.bigFileThreshold "$1"
+}
+
+test_expect_success 'setup' '
+	test-tool genrandom foo 1500000 >big-blob &&
+	git add big-blob &&
+	git commit -m foo &&
+	test-tool genrandom bar 1500000 >big-blob &&
+	git commit -a -m bar &&
+	PACK=$(echo HEAD | git pack-objects --revs pack) &&
+	git verify-pack -v pack-$PACK.pack >out &&
+	sed -n -e "s/^\([0-9a-f][0-9a-f]*\).*\(commit\|tree\|blob\).*/\1/p" \
+		<out >obj-list
+'
+
+test_expect_success 'set memory limitation to 1MB' '
+	GIT_ALLOC_LIMIT=1m &&
+	export GIT_ALLOC_LIMIT
+'
+
+test_expect_success 'unpack-objects failed under memory limitation' '
+	prepare_dest 2m &&
+	test_must_fail git -C dest.git unpack-objects <pack-$PACK.pack 2>err &&
+	grep "fatal: attempting to allocate" err
+'
+
+test_expect_success 'unpack-objects works with memory limitation in dry-run mode' '
+	prepare_dest 2m &&
+	git -C dest.git unpack-objects -n <pack-$PACK.pack &&
+	find dest.git/objects -type f >objects &&
+	test_must_be_empty objects &&
+	test_dir_is_empty dest.git/objects/pack
+'
+
+test_expect_success 'unpack big object in stream' '
+	prepare_dest 1m &&
+	git -C dest.git unpack-objects <pack-$PACK.pack &&
+	test_dir_is_empty dest.git/objects/pack &&
+	git -C dest.git cat-file --batch-check="%(objectname)" <obj-list >current &&
+	test_cmp obj-list current &&
+	git -C dest.git fsck
+'
+
+test_expect_success 'unpack big object in stream with --strict' '
+	prepare_dest 1m &&
+	git -C dest.git unpack-objects --strict <pack-$PACK.pack &&
+	git -C dest.git cat-file --batch-check="%(objectname)" <obj-list >current &&
+	test_cmp obj-list current
+'
+
+test_expect_success 'do not unpack existing large objects' '
+	prepare_dest 1m &&
+	git -C dest.git index-pack --stdin <pack-$PACK.pack &&
+	git -C dest.git unpack-objects <pack-$PACK.pack &&
+
+	# The destination came up with the exact same pack...
+	DEST_PACK=$(echo dest.git/objects/pack/pack-*.pack) &&
+	test_cmp pack-$PACK.pack $DEST_PACK &&
+
+	# ...and wrote no loose objects
+	find dest.git/objects -type f ! -name "pack-*" >objects &&
+	test_must_be_empty objects
+'
+
+test_expect_success 'unpack deltas against a streamed blob' '
+	sane_unset GIT_ALLOC_LIMIT &&
+	test_create_repo delta &&
+	test-tool genrandom base 200000 >delta/blob &&
+	git -C delta add blob &&
+	git -C delta commit -m base &&
+	echo tail >>delta/blob &&
+	git -C delta commit -a -m tail &&
+	DELTA_PACK=$(echo HEAD | git -C delta pack-objects --revs ../delta-pack) &&
+	git verify-pack -v delta-pack-$DELTA_PACK.pack >out &&
+	grep "blob.* 1 [0-9a-f]*$" out &&
+	prepare_dest 100k &&
+	git -C dest.git unpack-objects <delta-pack-$DELTA_PACK.pack &&
+	git -C dest.git fsck &&
+	git -C delta rev-parse HEAD:blob HEAD^:blob >expect &&
+	git -C dest.git cat-file --batch-check="%(objectname)" <expect >actual &&
+	test_cmp expect actual
+'
+
+test_done
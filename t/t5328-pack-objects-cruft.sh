@@ -0,0 +1,163 @@
+#!/bin/sh
+
+test_description='cruft packs of unreachable objects'
+
+. ./test-lib.sh
+
+loose_objects () {
+	find .git/objects -path "*/objects/??/*" -type f
+}
+
+cruft_pack () {
+	basename $(ls .git/objects/pack/pack-*.mtimes)
+}
+
+cruft_objects () {
+	test-tool pack-mtimes "$(cruft_pack)" | cut -d" " -f1 | sort
+}
+
+test_expect_success 'setup' '
+	test_commit base &&
+	git checkout -b side &&
+	test_commit unreachable &&
+	git rev-list --objects --no-object-names base..side |
+		sort >unreachable &&
+	git checkout master &&
+	git branch -D side &&
+	git tag -d unreachable &&
+	git reflog expire --all --expire=all
+'
+
+test_expect_success 'repack --cruft writes unreachable objects to a cruft pack' '
+	git repack --cruft -d &&
+	ls .git/objects/pack/pack-*.pack >packs &&
+	test_line_count = 2 packs &&
+	ls .git/objects/pack/pack-*.mtimes >mtimes &&
+	test_line_count = 1 mtimes &&
+	cruft_objects >actual &&
+	test_cmp unreachable actual &&
+	loose_objects >loose &&
+	test_must_be_empty loose &&
+	git fsck
+'
+
+test_expect_success 'repack --cruft folds an existing cruft pack into a new one' '
+	extra=$(echo extra | git hash-object -w --stdin) &&
+	git repack --cruft -d &&
+	ls .git/objects/pack/pack-*.mtimes >mtimes &&
+	test_line_count = 1 mtimes &&
+	{ cat unreachable && echo $extra; } | sort >expect &&
+	cruft_objects >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'cruft packs record the mtime of each object' '
+	git init per-object &&
+	(
+		cd per-object &&
+		test_commit base &&
+		blob=$(echo unreachable | git hash-object -w --stdin) &&
+		test-tool chmtime =1000000000 .git/objects/$(test_oid_to_path $blob) &&
+		git repack --cruft -d &&
+		cruft=$(cruft_pack) &&
+		echo "$blob 1000000000" >expect &&
+		test-tool pack-mtimes $cruft >actual &&
+		test_cmp expect actual &&
+
+		git repack -A -d &&
+		test_path_is_missing .git/objects/pack/$cruft &&
+		test "$(test-tool chmtime --get .git/objects/$(test_oid_to_path $blob))" = 1000000000
+	)
+'
+
+test_expect_success 'setup expiring repository' '
+	git init expire &&
+	(
+		cd expire &&
+		test_commit base &&
+		old=$(echo old | git hash-object -w --stdin) &&
+		tree=$(printf "100644 blob $old\told\n" | git mktree) &&
+		gone=$(echo gone | git hash-object -w --stdin) &&
+		test-tool chmtime =-10000 \
+			.git/objects/$(test_oid_to_path $old) \
+			.git/objects/$(test_oid_to_path $gone) &&
+		echo $old >../old &&
+		echo $tree >../tree &&
+		echo $gone >../gone
+	)
+'
+
+test_expect_success 'repack --cruft-expiration keeps objects reachable from recent ones' '
+	(
+		cd expire &&
+		git repack -d --cruft --cruft-expiration=1.hour.ago &&
+		cat ../old ../tree | sort >expect &&
+		cruft_objects >actual &&
+		test_cmp expect actual &&
+		git cat-file -e $(cat ../gone) &&
+		git prune --expire=1.hour.ago &&
+		test_must_fail git cat-file -e $(cat ../gone) &&
+		git cat-file -e $(cat ../old)
+	)
+'
+
+test_expect_success 'repack -A honors per-object mtimes in cruft packs' '
+	(
+		cd expire &&
+		lone=$(echo lone | git hash-object -w --stdin) &&
+		test-tool chmtime =-10000 .git/objects/$(test_oid_to_path $lone) &&
+		git repack -d --cruft &&
+		git repack -A -d --unpack-unreachable=1.hour.ago &&
+		test_path_is_missing .git/objects/pack/pack-*.mtimes &&
+		git cat-file -e $(cat ../old) &&
+		git cat-file -e $(cat ../tree) &&
+		test_must_fail git cat-file -e $lone
+	)
+'
+
+test_expect_success 'gc --cruft writes a cruft pack' '
+	git init gc &&
+	(
+		cd gc &&
+		test_commit base &&
+		blob=$(echo unreachable | git hash-object -w --stdin) &&
+		git gc --cruft &&
+		test "$(test-tool pack-mtimes "$(cruft_pack)" | cut -d" " -f1)" = $blob &&
+		loose_objects >loose &&
+		test_must_be_empty loose &&
+
+		git -c gc.cruftPacks=true gc --prune=now &&
+		test_path_is_missing .git/objects/pack/pack-*.mtimes &&
+		test_must_fail git cat-file -e $blob
+	)
+'
+
+test_expect_success 'writing an expired cruft object again keeps it' '
+	git init rewrite &&
+	(
+		cd rewrite &&
+		test_commit base &&
+		blob=$(echo rewritten | git hash-object -w --stdin) &&
+		test-tool chmtime =-10000 .git/objects/$(test_oid_to_path $blob) &&
+		git repack -d --cruft &&
+		loose_objects >loose &&
+		test_must_be_empty loose &&
+
+		echo rewritten | git hash-object -w --stdin &&
+		git -c gc.cruftPacks=true gc --prune=1.hour.ago &&
+		git cat-file -e $blob
+	)
+'
+
+test_expect_success 'incompatible options are rejected' '
+	test_must_fail git repack --cruft -A 2>err &&
+	test_i18ngrep "are incompatible" err &&
+	test_must_fail git repack --cruft -k 2>err &&
+	test_i18ngrep "are incompatible" err &&
+	test_must_fail git repack --cruft-expiration=now 2>err &&
+	test_i18ngrep "requires --cruft" err &&
+	test_must_fail git pack-objects --cruft --stdout </dev/null 2>err &&
+	test_i18ngrep "cannot use --stdout with --cruft" err
+'
+
+test_done
@@ -586,6 +586,72 @@ test_expect_success 'tree:<depth> which filters out blob but given as arg' '
 	grep ^$blob_hash actual
 '
 
+# Test object:type=<type> filters.
+
+test_expect_success 'setup object:type' '
+	git init r6 &&
+	test_commit -C r6 one &&
+	test_commit -C r6 two &&
+	git -C r6 tag -a -m annotated three
+'
+
+# Objects given on the command line (here, the commit the tips peel to)
+# are always shown, as with the other filters.
+
+test_expect_success 'object:type=tag prints only the annotated tag' '
+	git -C r6 rev-parse three three^{commit} | sort >expect &&
+	git -C r6 rev-list --objects --filter=object:type=tag three >objects &&
+	awk -f print_1.awk objects | sort >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'object:type=commit prints only commits' '
+	git -C r6 rev-list HEAD >expect &&
+	git -C r6 rev-list --objects --filter=object:type=commit \
+		--no-object-names HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'object:type=tree prints only trees' '
+	git -C r6 rev-list --objects --no-object-names HEAD >all &&
+	git -C r6 cat-file --batch-check="%(objectname) %(objecttype)" <all |
+		sed -n -e "s/ tree$//p" -e "1s/ commit$//p" | sort >expect &&
+	git -C r6 rev-list --objects --filter=object:type=tree \
+		--no-object-names HEAD >objects &&
+	sort objects >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'object:type=blob prints only blobs' '
+	git -C r6 rev-list --objects --no-object-names HEAD >all &&
+	git -C r6 cat-file --batch-check="%(objectname) %(objecttype)" <all |
+		sed -n -e "s/ blob$//p" -e "1s/ commit$//p" | sort >expect &&
+	git -C r6 rev-list --objects --filter=object:type=blob \
+		--no-object-names HEAD >objects &&
+	sort objects >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'object:type filter still shows objects given explicitly' '
+	blob=$(git -C r6 rev-parse HEAD:one.t) &&
+	git -C r6 rev-list --objects --filter=object:type=tree \
+		--no-object-names HEAD $blob >actual &&
+	grep "^$blob" actual
+'
+
+test_expect_success 'object:type composes with other filters' '
+	git -C r6 rev-list --objects --filter=object:type=blob \
+		--filter=blob:none --no-object-names HEAD >actual &&
+	git -C r6 rev-parse HEAD >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'object:type rejects unknown types' '
+	test_must_fail git -C r6 rev-list --objects \
+		--filter=object:type=bogus HEAD 2>err &&
+	test_i18ngrep "not a valid object type" err
+'
+
 # Delete some loose objects and use rev-list, but WITHOUT any filtering.
 # This models previously omitted objects that we did not receive.
 
@@ -74,4 +74,51 @@ test_expect_success 'tree:1 filter' '
 	test_cmp expect actual
 '
 
+test_expect_success 'object:type filter' '
+	git tag -a -m annotated-tag annotated &&
+	for type in tag commit tree blob
+	do
+		git rev-list --objects --filter=object:type=$type \
+			HEAD annotated >expect &&
+		git rev-list --use-bitmap-index --objects \
+			--filter=object:type=$type HEAD annotated >actual &&
+		test_bitmap_traversal expect actual || return 1
+	done
+'
+
+test_expect_success 'object:type filter with specified blob' '
+	git rev-list --objects --filter=object:type=tree \
+		     HEAD HEAD:two.t >expect &&
+	git rev-list --use-bitmap-index \
+		     --objects --filter=object:type=tree \
+		     HEAD HEAD:two.t >actual &&
+	test_bitmap_traversal expect actual
+'
+
+test_expect_success 'combine filter' '
+	git rev-list --objects \
+		     --filter=blob:limit=5 --filter=object:type=blob \
+		     HEAD >expect &&
+	git rev-list --use-bitmap-index --objects \
+		     --filter=blob:limit=5 --filter=object:type=blob \
+		     HEAD >actual &&
+	test_bitmap_traversal expect actual
+'
+
+test_expect_success 'combine filter with tree:0' '
+	git rev-list --objects --filter=combine:tree:0+blob:none \
+		     HEAD >expect &&
+	git rev-list --use-bitmap-index \
+		     --objects --filter=combine:tree:0+blob:none HEAD >actual &&
+	test_bitmap_traversal expect actual
+'
+
+test_expect_success 'combine filter with unsupported sub-filter falls back' '
+	git rev-list --objects --filter=blob:none --filter=tree:1 \
+		     HEAD >expect &&
+	git rev-list --use-bitmap-index --objects \
+		     --filter=blob:none --filter=tree:1 HEAD >actual &&
+	test_cmp expect actual
+'
+
 test_done
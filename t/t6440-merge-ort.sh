@@ -0,0 +1,139 @@
+#!/bin/sh
+
+test_description='merge with the ort strategy
+
+The ort strategy resolves everything in memory and only updates the
+index and working tree once the result tree has been written.
+'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_write_lines 1 2 3 4 5 6 7 8 9 >numbers &&
+	test_write_lines a b c d e f g h i >letters &&
+	echo unchanged >unchanged &&
+	git add numbers letters unchanged &&
+	test_commit --notick base &&
+
+	git checkout -b renamer &&
+	git mv numbers renamed-numbers &&
+	test_write_lines a b c d e f g h i j >letters &&
+	git commit -qam "rename numbers" &&
+
+	git checkout -b modifier base &&
+	test_write_lines 1 2 3 4 5 6 7 8 9 10 >numbers &&
+	git commit -qam "modify numbers" &&
+	test_write_lines 0 1 2 3 4 5 6 7 8 9 10 >numbers &&
+	git commit -qam "modify numbers again" &&
+
+	git checkout -b conflicter base &&
+	test_write_lines a b c d e f g h i z >letters &&
+	git commit -qam "conflicting letters" &&
+
+	git checkout -b dir base &&
+	git rm -q unchanged &&
+	mkdir unchanged &&
+	echo file >unchanged/file &&
+	git add unchanged/file &&
+	git commit -qm "unchanged becomes a directory" &&
+
+	git checkout -b file-change base &&
+	echo changed >unchanged &&
+	git commit -qam "change unchanged" &&
+	git checkout base
+'
+
+test_expect_success 'clean merge with a rename' '
+	git checkout -b m1 renamer &&
+	git merge -s ort modifier &&
+	test_path_is_missing numbers &&
+	test_write_lines 0 1 2 3 4 5 6 7 8 9 10 >expect &&
+	test_cmp expect renamed-numbers &&
+	git diff --exit-code &&
+	git diff --cached --exit-code &&
+	git ls-files -s >actual &&
+	test_line_count = 4 actual
+'
+
+test_expect_success 'content conflict records all stages' '
+	git checkout -b m2 renamer &&
+	test_must_fail git merge -s ort conflicter >out &&
+	test_i18ngrep "CONFLICT (content): Merge conflict in letters" out &&
+	git ls-files -u letters >actual &&
+	test_line_count = 3 actual &&
+	grep "^<<<<<<<" letters &&
+	git diff --cached --name-only >staged &&
+	test_write_lines letters >expect &&
+	test_cmp expect staged &&
+	git reset --hard
+'
+
+test_expect_success 'modify/delete conflict in the way of a directory' '
+	git checkout -b m3 dir &&
+	test_must_fail git merge -s ort file-change >out &&
+	test_i18ngrep "CONFLICT (modify/delete): unchanged" out &&
+	test_i18ngrep "CONFLICT (directory/file)" out &&
+	test_path_is_file unchanged/file &&
+	test_path_is_file unchanged~file-change &&
+	git ls-files -u >actual &&
+	test_file_not_empty actual &&
+	git reset --hard
+'
+
+test_expect_success 'merge refuses to clobber staged changes' '
+	git checkout -b m4 renamer &&
+	echo dirty >>letters &&
+	git add letters &&
+	test_must_fail git merge -s ort modifier 2>err &&
+	test_i18ngrep "would be overwritten by merge" err &&
+	git reset --hard
+'
+
+test_expect_success 'cherry-pick with the ort strategy follows renames' '
+	git checkout -b c1 renamer &&
+	git cherry-pick --strategy=ort modifier~1 modifier &&
+	test_write_lines 0 1 2 3 4 5 6 7 8 9 10 >expect &&
+	test_cmp expect renamed-numbers &&
+	test_path_is_missing numbers &&
+	git diff --exit-code HEAD
+'
+
+test_expect_success 'cherry-pick with the ort strategy stops on conflicts' '
+	git checkout -b c2 renamer &&
+	test_must_fail git cherry-pick --strategy=ort conflicter &&
+	git ls-files -u letters >actual &&
+	test_line_count = 3 actual &&
+	git cherry-pick --abort &&
+	git diff --exit-code HEAD
+'
+
+test_expect_success 'rebase with the ort strategy' '
+	git checkout -b r1 modifier &&
+	git rebase -s ort renamer &&
+	test_write_lines 0 1 2 3 4 5 6 7 8 9 10 >expect &&
+	test_cmp expect renamed-numbers &&
+	test_path_is_missing numbers &&
+	git rev-list renamer..HEAD >commits &&
+	test_line_count = 2 commits &&
+	git diff --exit-code HEAD
+'
+
+test_expect_success 'recursive merge base with the ort strategy' '
+	git checkout -b cross1 base &&
+	echo one >cross && git add cross && git commit -qm cross1 &&
+	git checkout -b cross2 base &&
+	echo two >other && git add other && git commit -qm cross2 &&
+	git checkout -b cross1b cross1 &&
+	git merge -q -s ort cross2 -m m1 &&
+	git checkout -b cross2b cross2 &&
+	git merge -q -s ort cross1 -m m2 &&
+	echo more >>other &&
+	git commit -qam more &&
+	git checkout cross1b &&
+	git merge -s ort cross2b &&
+	test_write_lines two more >expect &&
+	test_cmp expect other &&
+	git diff --exit-code HEAD
+'
+
+test_done
@@ -267,9 +267,8 @@ test_expect_success 'can_all_from_reach_with_flag: tags case' '
 	test_three_modes can_all_from_reach_with_flag
 '
 
-test_expect_success 'commit_contains:hit' '
+test_expect_success 'tips_reaching_bases:hit' '
 	cat >input <<-\EOF &&
-	A:commit-7-7
 	X:commit-2-10
 	X:commit-3-9
 	X:commit-4-8
@@ -278,15 +277,17 @@ test_expect_success 'commit_contains:hit' '
 	X:commit-7-5
 	X:commit-8-4
 	X:commit-9-3
+	Y:commit-7-7
 	EOF
-	echo "commit_contains(_,A,X,_):1" >expect &&
-	test_three_modes commit_contains &&
-	test_three_modes commit_contains --tag
+	(
+		echo "tips_reaching_bases(X,Y)" &&
+		git rev-parse commit-7-7
+	) >expect &&
+	test_three_modes tips_reaching_bases
 '
 
-test_expect_success 'commit_contains:miss' '
+test_expect_success 'tips_reaching_bases:miss' '
 	cat >input <<-\EOF &&
-	A:commit-6-5
 	X:commit-2-10
 	X:commit-3-9
 	X:commit-4-8
@@ -295,10 +296,100 @@ test_expect_success 'commit_contains:miss' '
 	X:commit-7-5
 	X:commit-8-4
 	X:commit-9-3
+	Y:commit-6-5
+	EOF
+	echo "tips_reaching_bases(X,Y)" >expect &&
+	test_three_modes tips_reaching_bases
+'
+
+test_expect_success 'tips_reaching_bases:some' '
+	cat >input <<-\EOF &&
+	X:commit-4-6
+	X:commit-7-2
+	Y:commit-9-9
+	Y:commit-5-7
+	Y:commit-4-6
+	Y:commit-3-9
+	Y:commit-8-1
+	Y:commit-6-5
+	EOF
+	(
+		echo "tips_reaching_bases(X,Y)" &&
+		git rev-parse commit-9-9 \
+			      commit-5-7 \
+			      commit-4-6 | sort
+	) >expect &&
+	test_three_modes tips_reaching_bases
+'
+
+test_expect_success 'tips_reaching_bases:none' '
+	cat >input <<-\EOF &&
+	X:commit-8-8
+	Y:commit-9-7
+	Y:commit-7-9
+	Y:commit-1-1
+	EOF
+	echo "tips_reaching_bases(X,Y)" >expect &&
+	test_three_modes tips_reaching_bases
+'
+
+test_expect_success 'tips_reaching_bases:nested bases' '
+	cat >input <<-\EOF &&
+	X:commit-6-6
+	X:commit-4-4
+	X:commit-6-6
+	Y:commit-7-7
+	Y:commit-5-5
+	Y:commit-4-4
+	Y:commit-3-3
+	Y:commit-3-9
+	Y:commit-9-3
 	EOF
-	echo "commit_contains(_,A,X,_):0" >expect &&
-	test_three_modes commit_contains &&
-	test_three_modes commit_contains --tag
+	(
+		echo "tips_reaching_bases(X,Y)" &&
+		git rev-parse commit-7-7 \
+			      commit-5-5 \
+			      commit-4-4 | sort
+	) >expect &&
+	test_three_modes tips_reaching_bases
+'
+
+test_expect_success 'for-each-ref --contains and --no-contains' '
+	git for-each-ref --format="%(refname:short)" \
+		"refs/heads/commit-[0-9]-[0-9]" >all &&
+	sed -n -e "/commit-[6-9]-[5-9]/p" all >expect &&
+	run_three_modes git for-each-ref --format="%(refname:short)" \
+		--contains=commit-6-5 "refs/heads/commit-[0-9]-[0-9]" &&
+	sed -e "/commit-[6-9]-[5-9]/d" all >expect &&
+	run_three_modes git for-each-ref --format="%(refname:short)" \
+		--no-contains=commit-6-5 "refs/heads/commit-[0-9]-[0-9]" &&
+	sed -n -e "/commit-[6-9]-[4-9]/p" -e "/commit-[4-9]-[6-9]/p" all |
+		sort -u >expect &&
+	run_three_modes git for-each-ref --format="%(refname:short)" \
+		--contains=commit-6-4 --contains=commit-4-6 \
+		"refs/heads/commit-[0-9]-[0-9]"
+'
+
+test_expect_success 'tag --contains peels annotated tags' '
+	git tag --list "tag-[0-9]-[0-9]" >all &&
+	sed -n -e "/tag-[6-9]-[5-9]/p" all >expect &&
+	run_three_modes git tag --list --contains=commit-6-5 "tag-[0-9]-[0-9]"
+'
+
+test_expect_success 'for-each-ref --merged and --no-merged' '
+	git for-each-ref --format="%(refname:short)" \
+		"refs/heads/commit-[0-9]-[0-9]" >all &&
+	sed -n -e "/commit-[1-6]-[1-5]\$/p" all >expect &&
+	run_three_modes git for-each-ref --format="%(refname:short)" \
+		--merged=commit-6-5 "refs/heads/commit-[0-9]-[0-9]" &&
+	sed -e "/commit-[1-6]-[1-5]\$/d" all >expect &&
+	run_three_modes git for-each-ref --format="%(refname:short)" \
+		--no-merged=commit-6-5 "refs/heads/commit-[0-9]-[0-9]" &&
+	sed -n -e "/commit-[1-6]-[1-5]\$/p" -e "/commit-[1-3]-[1-8]\$/p" all |
+		sort -u >expect &&
+	run_three_modes git for-each-ref --format="%(refname:short)" \
+		--merged=commit-6-5 --merged=commit-3-8 \
+		"refs/heads/commit-[0-9]-[0-9]"
 '
 
 test_expect_success 'rev-list: basic topo-order' '
@@ -364,6 +364,16 @@ test_expect_success 'discard_index() also discards fsmonitor info' '
 	test_cmp expect actual
 '
 
+test_expect_success 'a hook named like a boolean is still run' '
+	mkdir -p bin &&
+	write_script bin/yes <<-\EOF &&
+	echo run >>hook-ran
+	printf "last_update_token\0/\0"
+	EOF
+	PATH="$PWD/bin:$PATH" git -c core.fsmonitor=yes status &&
+	test_path_is_file hook-ran
+'
+
 # Test unstaging entries that:
 #  - Are not flagged with CE_FSMONITOR_VALID
 #  - Have a position in the index >= the number of entries present in the index
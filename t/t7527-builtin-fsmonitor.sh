@@ -0,0 +1,185 @@
+#!/bin/sh
+
+test_description='built-in file system watcher'
+
+. ./test-lib.sh
+
+if ! test-tool fsmonitor-client is-supported
+then
+	skip_all='fsmonitor--daemon is not supported on this platform'
+	test_done
+fi
+
+stop_daemon () {
+	git fsmonitor--daemon stop || :
+}
+
+# Print the paths of the response to a query, without its token and
+# without the files the tests write their results to.
+query_paths () {
+	test-tool fsmonitor-client query --token "$1" >response &&
+	sed -e 1d -e "/^response$/d" -e "/^actual$/d" -e "/^expect$/d" \
+		response | sort
+}
+
+test_expect_success 'setup' '
+	mkdir dir1 dir2 &&
+	for f in tracked dir1/tracked dir2/tracked
+	do
+		echo initial >$f || return 1
+	done &&
+	cat >.gitignore <<-\EOF &&
+	.gitignore
+	response
+	expect*
+	actual*
+	EOF
+	git add . &&
+	git commit -m initial
+'
+
+test_expect_success 'start, status and stop' '
+	test_when_finished stop_daemon &&
+	test_must_fail git fsmonitor--daemon status &&
+	git fsmonitor--daemon start &&
+	git fsmonitor--daemon status >actual &&
+	test_i18ngrep "is watching" actual &&
+	git fsmonitor--daemon stop &&
+	test_must_fail git fsmonitor--daemon status &&
+	test_path_is_missing .git/fsmonitor--daemon.ipc
+'
+
+test_expect_success 'refuse to start twice' '
+	test_when_finished stop_daemon &&
+	git fsmonitor--daemon start &&
+	test_must_fail git fsmonitor--daemon start 2>err &&
+	test_i18ngrep "already running" err
+'
+
+test_expect_success 'stop fails without a daemon' '
+	test_must_fail git fsmonitor--daemon stop
+'
+
+test_expect_success 'unknown tokens get a trivial response' '
+	test_when_finished stop_daemon &&
+	git fsmonitor--daemon start &&
+	test-tool fsmonitor-client query --token 12345 >response &&
+	sed 1d response >actual &&
+	echo / >expect &&
+	test_cmp expect actual &&
+	grep "^builtin:" response
+'
+
+test_expect_success 'changes are reported since the token' '
+	test_when_finished stop_daemon &&
+	git fsmonitor--daemon start &&
+	test-tool fsmonitor-client query --token 0 >response &&
+	token=$(head -n 1 response) &&
+
+	echo changed >tracked &&
+	echo changed >dir1/tracked &&
+	: >dir2/untracked &&
+	query_paths "$token" >actual &&
+	cat >expect <<-\EOF &&
+	dir1/tracked
+	dir2/untracked
+	tracked
+	EOF
+	test_cmp expect actual &&
+
+	token=$(head -n 1 response) &&
+	query_paths "$token" >actual &&
+	test_must_be_empty actual &&
+
+	rm dir2/untracked &&
+	query_paths "$token" >actual &&
+	echo dir2/untracked >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'new and renamed directories are watched' '
+	test_when_finished stop_daemon &&
+	git fsmonitor--daemon start &&
+	test-tool fsmonitor-client query --token 0 >response &&
+	token=$(head -n 1 response) &&
+
+	mkdir -p new/sub &&
+	query_paths "$token" >actual &&
+	grep "^new/$" actual &&
+
+	token=$(head -n 1 response) &&
+	: >new/sub/file &&
+	query_paths "$token" >actual &&
+	echo new/sub/file >expect &&
+	test_cmp expect actual &&
+
+	token=$(head -n 1 response) &&
+	mv new renamed &&
+	query_paths "$token" >actual &&
+	printf "%s\n" new/ renamed/ >expect &&
+	test_cmp expect actual &&
+
+	token=$(head -n 1 response) &&
+	: >renamed/sub/other &&
+	query_paths "$token" >actual &&
+	echo renamed/sub/other >expect &&
+	test_cmp expect actual &&
+	rm -r renamed
+'
+
+test_expect_success 'flush invalidates all tokens' '
+	test_when_finished stop_daemon &&
+	git fsmonitor--daemon start &&
+	test-tool fsmonitor-client query --token 0 >response &&
+	token=$(head -n 1 response) &&
+	test-tool fsmonitor-client flush &&
+	query_paths "$token" >actual &&
+	echo / >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'status starts the daemon and uses its tokens' '
+	test_when_finished stop_daemon &&
+	git reset --hard &&
+	git config core.fsmonitor true &&
+	test_when_finished "git config --unset core.fsmonitor" &&
+	git update-index --fsmonitor &&
+	git status &&
+	git fsmonitor--daemon status &&
+	test-tool dump-fsmonitor >actual &&
+	grep "^fsmonitor last update builtin:" actual
+'
+
+test_expect_success 'status with the daemon matches status without it' '
+	test_when_finished stop_daemon &&
+	git reset --hard &&
+	git config core.fsmonitor true &&
+	test_when_finished "git config --unset core.fsmonitor" &&
+	git update-index --fsmonitor &&
+	git status --porcelain >actual &&
+	git status --porcelain >actual &&
+
+	for step in modify add-untracked new-dir remove rename-dir
+	do
+		case "$step" in
+		modify)
+			echo changed >dir1/tracked ;;
+		add-untracked)
+			: >dir2/untracked ;;
+		new-dir)
+			mkdir dir3 && : >dir3/untracked ;;
+		remove)
+			rm tracked ;;
+		rename-dir)
+			mv dir2 dir4 ;;
+		esac &&
+		git status --porcelain >actual &&
+		git -c core.fsmonitor=false status --porcelain >expect &&
+		test_cmp expect actual &&
+		git status --porcelain -uall >actual &&
+		git -c core.fsmonitor=false status --porcelain -uall >expect &&
+		test_cmp expect actual || return 1
+	done
+'
+
+test_done
@@ -978,6 +978,29 @@ do
 	"
 done
 
+test_expect_success PTHREADS 'threaded grep of packed deltas' '
+	git init packed-deltas &&
+	(
+		cd packed-deltas &&
+		for i in $(test_seq 20)
+		do
+			test_seq $i 1000 >file &&
+			git add file &&
+			git commit -q -m "commit $i" || return 1
+		done &&
+		git repack -a -d -q --depth=50 &&
+		git rev-list HEAD >revs &&
+		git -c core.packedGitWindowSize=1k \
+		    -c core.deltaBaseCacheLimit=4k \
+		    grep --threads=1 -c 500 $(cat revs) >expect &&
+		git -c core.packedGitWindowSize=1k \
+		    -c core.deltaBaseCacheLimit=4k \
+		    grep --threads=8 -c 500 $(cat revs) >actual &&
+		test_cmp expect actual &&
+		test_line_count = 20 actual
+	)
+'
+
 test_expect_success !PTHREADS,C_LOCALE_OUTPUT 'grep --threads=N or pack.threads=N warns when no pthreads' '
 	git grep --threads=2 Hello hello_world 2>err &&
 	grep ^warning: err >warnings &&
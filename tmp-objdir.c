@@ -121,7 +121,7 @@ static int setup_tmp_objdir(const char *root)
 	return ret;
 }
 
-struct tmp_objdir *tmp_objdir_create(void)
+struct tmp_objdir *tmp_objdir_create(const char *prefix)
 {
 	static int installed_handlers;
 	struct tmp_objdir *t;
@@ -133,7 +133,7 @@ struct tmp_objdir *tmp_objdir_create(void)
 	strbuf_init(&t->path, 0);
 	strvec_init(&t->env);
 
-	strbuf_addf(&t->path, "%s/incoming-XXXXXX", get_object_directory());
+	strbuf_addf(&t->path, "%s/%s-XXXXXX", get_object_directory(), prefix);
 
 	/*
 	 * Grow the strbuf beyond any filename we expect to be placed in it.
@@ -279,6 +279,11 @@ int tmp_objdir_migrate(struct tmp_objdir *t)
 	return ret;
 }
 
+const char *tmp_objdir_path(const struct tmp_objdir *t)
+{
+	return t->path.buf;
+}
+
 const char **tmp_objdir_env(const struct tmp_objdir *t)
 {
 	if (!t)
@@ -16,6 +16,8 @@
 #include "fsmonitor.h"
 #include "object-store.h"
 #include "promisor-remote.h"
+#include "parallel-checkout.h"
+#include "sparse-index.h"
 
 /*
  * Error messages expected by scripts out of plumbing commands such as
@@ -397,7 +399,7 @@ static int check_updates(struct unpack_trees_options *o,
 	int errs = 0;
 	struct progress *progress;
 	struct checkout state = CHECKOUT_INIT;
-	int i;
+	int i, pc_workers, pc_threshold;
 
 	trace_performance_enter();
 	state.force = 1;
@@ -460,6 +462,11 @@ static int check_updates(struct unpack_trees_options *o,
 					   to_fetch.oid, to_fetch.nr);
 		oid_array_clear(&to_fetch);
 	}
+
+	get_parallel_checkout_configs(&pc_workers, &pc_threshold);
+	if (pc_workers > 1)
+		init_parallel_checkout();
+
 	for (i = 0; i < index->cache_nr; i++) {
 		struct cache_entry *ce = index->cache[i];
 
@@ -472,6 +479,8 @@ static int check_updates(struct unpack_trees_options *o,
 			errs |= checkout_entry(ce, &state, NULL, NULL);
 		}
 	}
+	if (pc_workers > 1)
+		errs |= run_parallel_checkout(&state, pc_workers, pc_threshold);
 	stop_progress(&progress);
 	errs |= finish_delayed_checkout(&state, NULL);
 	git_attr_set_direction(GIT_ATTR_CHECKIN);
@@ -1226,6 +1235,69 @@ static void debug_unpack_callback(int n,
 		debug_name_entry(i, names + i);
 }
 
+/*
+ * Is ce a sparse directory entry for the tree entry p of the traversal?
+ */
+static int is_sparse_directory_entry(const struct cache_entry *ce,
+				     const struct name_entry *p,
+				     const struct traverse_info *info)
+{
+	size_t len = traverse_path_len(info, tree_entry_len(p));
+
+	return S_ISSPARSEDIR(ce->ce_mode) && S_ISDIR(p->mode) &&
+		ce_namelen(ce) == len + 1 &&
+		!do_compare_entry(ce, info, p->path, p->pathlen, p->mode);
+}
+
+/*
+ * The index has the sparse directory src[0] where the trees have
+ * directories (or files).  Hand the directories to the unpack function
+ * as sparse directory entries of their own, so that the whole tree can
+ * be compared without descending into it.
+ */
+static int unpack_sparse_directory(int n, unsigned long mask,
+				   unsigned long dirmask,
+				   struct cache_entry **src,
+				   const struct name_entry *names,
+				   const struct traverse_info *info)
+{
+	int i, rc;
+	struct unpack_trees_options *o = info->data;
+
+	for (i = 0; i < n; i++) {
+		unsigned int bit = 1ul << i;
+		struct cache_entry *ce;
+		size_t len;
+
+		if (!(mask & bit))
+			continue;
+		if (!(dirmask & bit)) {
+			src[i + 1] = o->df_conflict_entry;
+			continue;
+		}
+
+		len = traverse_path_len(info, tree_entry_len(names + i));
+		ce = make_empty_transient_cache_entry(len + 1);
+		ce->ce_mode = S_IFDIR;
+		ce->ce_flags = create_ce_flags(0) | CE_SKIP_WORKTREE;
+		ce->ce_namelen = len + 1;
+		oidcpy(&ce->oid, &names[i].oid);
+		make_traverse_path(ce->name, len + 1, info,
+				   names[i].path, names[i].pathlen);
+		ce->name[len] = '/';
+		src[i + 1] = ce;
+	}
+
+	rc = call_unpack_fn((const struct cache_entry * const *)src, o);
+
+	for (i = 0; i < n; i++) {
+		struct cache_entry *ce = src[i + 1];
+		if (ce != o->df_conflict_entry)
+			discard_cache_entry(ce);
+	}
+	return rc;
+}
+
 /*
  * Note that traverse_by_cache_tree() duplicates some logic in this function
  * without actually calling it. If you change the logic here you may need to
@@ -1277,11 +1349,20 @@ static int unpack_callback(int n, unsigned long mask, unsigned long dirmask, str
 					}
 				}
 				src[0] = ce;
+			} else if (is_sparse_directory_entry(ce, p, info)) {
+				src[0] = ce;
 			}
 			break;
 		}
 	}
 
+	if (src[0] && S_ISSPARSEDIR(src[0]->ce_mode)) {
+		if (unpack_sparse_directory(n, mask, dirmask, src, names, info) < 0)
+			return -1;
+		mark_ce_used(src[0], o);
+		return mask;
+	}
+
 	if (unpack_nondirectories(n, mask, dirmask, src, names, info) < 0)
 		return -1;
 
@@ -1579,6 +1660,13 @@ int unpack_trees(unsigned len, struct tree_desc *t, struct unpack_trees_options
 	if (len > MAX_UNPACK_TREES)
 		die("unpack_trees takes at most %d trees", MAX_UNPACK_TREES);
 
+	/*
+	 * Only "diff-index --cached" knows how to compare a sparse
+	 * directory entry with the trees as a whole.
+	 */
+	if (!o->diff_index_cached)
+		ensure_full_index(o->src_index);
+
 	trace_performance_enter();
 	if (!core_apply_sparse_checkout || !o->update)
 		o->skip_sparse_checkout = 1;
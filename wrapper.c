@@ -516,6 +516,42 @@ int git_mkstemp_mode(char *pattern, int mode)
 	return git_mkstemps_mode(pattern, 0, mode);
 }
 
+int git_fsync(int fd, enum fsync_action action)
+{
+	switch (action) {
+	case FSYNC_WRITEOUT_ONLY:
+#ifdef HAVE_SYNC_FILE_RANGE
+		/*
+		 * Write out the dirty pages and wait for the I/O to be
+		 * submitted, but do not ask the disk to flush its cache;
+		 * a later FSYNC_HARDWARE_FLUSH on any file of the same
+		 * filesystem takes care of that.
+		 */
+		for (;;) {
+			if (!sync_file_range(fd, 0, 0,
+					     SYNC_FILE_RANGE_WAIT_BEFORE |
+					     SYNC_FILE_RANGE_WRITE |
+					     SYNC_FILE_RANGE_WAIT_AFTER))
+				return 0;
+			if (errno != EINTR)
+				return -1;
+		}
+#else
+		errno = ENOSYS;
+		return -1;
+#endif
+	case FSYNC_HARDWARE_FLUSH:
+		for (;;) {
+			if (!fsync(fd))
+				return 0;
+			if (errno != EINTR)
+				return -1;
+		}
+	default:
+		BUG("unexpected git_fsync(%d) call", action);
+	}
+}
+
 int xmkstemp_mode(char *filename_template, int mode)
 {
 	int fd;
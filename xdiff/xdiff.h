@@ -82,6 +82,15 @@ typedef struct s_xpparam {
 	/* See Documentation/diff-options.txt. */
 	char **anchors;
 	size_t anchors_nr;
+
+	/*
+	 * Upper bound on the work spent looking for a small diff, in
+	 * lines compared (0 means no limit). Once it is used up, the
+	 * remaining parts of the files are matched up in linear time,
+	 * which gives a correct but possibly larger diff. A negative
+	 * value means the budget is already used up.
+	 */
+	long max_cost;
 } xpparam_t;
 
 typedef struct s_xdemitcb {
@@ -33,6 +33,12 @@ typedef struct s_xdpsplit {
 	int min_lo, min_hi;
 } xdpsplit_t;
 
+typedef struct s_xdlinear {
+	unsigned long ha;
+	long cnt1, cnt2;
+	long pos2;
+} xdlinear_t;
+
 /*
  * See "An O(ND) Difference Algorithm and its Variations", by Eugene Myers.
  * Basically considers a "box" (off1, off2, lim1, lim2) and scan from both
@@ -88,6 +94,7 @@ static long xdl_split(unsigned long const *ha1, long off1, long lim1,
 			prev1 = i1;
 			i2 = i1 - d;
 			for (; i1 < lim1 && i2 < lim2 && ha1[i1] == ha2[i2]; i1++, i2++);
+			xenv->cost_left -= i1 - prev1 + 1;
 			if (i1 - prev1 > xenv->snake_cnt)
 				got_snake = 1;
 			kvdf[d] = i1;
@@ -125,6 +132,7 @@ static long xdl_split(unsigned long const *ha1, long off1, long lim1,
 			prev1 = i1;
 			i2 = i1 - d;
 			for (; i1 > off1 && i2 > off2 && ha1[i1 - 1] == ha2[i2 - 1]; i1--, i2--);
+			xenv->cost_left -= prev1 - i1 + 1;
 			if (prev1 - i1 > xenv->snake_cnt)
 				got_snake = 1;
 			kvdb[d] = i1;
@@ -136,7 +144,7 @@ static long xdl_split(unsigned long const *ha1, long off1, long lim1,
 			}
 		}
 
-		if (need_min)
+		if (need_min && xenv->cost_left > 0)
 			continue;
 
 		/*
@@ -200,11 +208,11 @@ static long xdl_split(unsigned long const *ha1, long off1, long lim1,
 		}
 
 		/*
-		 * Enough is enough. We spent too much time here and now we
-		 * collect the furthest reaching path using the (i1 + i2)
-		 * measure.
+		 * Enough is enough. We spent too much time here (or used up
+		 * the budget of the whole diff) and now we collect the
+		 * furthest reaching path using the (i1 + i2) measure.
 		 */
-		if (ec >= xenv->mxcost) {
+		if (ec >= xenv->mxcost || xenv->cost_left <= 0) {
 			long fbest, fbest1, bbest, bbest1;
 
 			fbest = fbest1 = -1;
@@ -248,6 +256,118 @@ static long xdl_split(unsigned long const *ha1, long off1, long lim1,
 }
 
 
+static void xdl_linear_gap(diffdata_t *dd1, long off1, long lim1,
+			   diffdata_t *dd2, long off2, long lim2) {
+	unsigned long const *ha1 = dd1->ha, *ha2 = dd2->ha;
+
+	for (; off1 < lim1 && off2 < lim2 && ha1[off1] == ha2[off2]; off1++, off2++);
+	for (; off1 < lim1 && off2 < lim2 && ha1[lim1 - 1] == ha2[lim2 - 1]; lim1--, lim2--);
+	for (; off1 < lim1; off1++)
+		dd1->rchg[dd1->rindex[off1]] = 1;
+	for (; off2 < lim2; off2++)
+		dd2->rchg[dd2->rindex[off2]] = 1;
+}
+
+
+/*
+ * Match up a box in O(N log N) time, without looking for the smallest
+ * diff. The records that occur exactly once on both sides are used as
+ * anchors, keeping the longest run of them that appears in the same
+ * order on both sides (as patience diff does), and whatever is between
+ * two anchors is marked as changed, except for the records it has in
+ * common at either end.
+ */
+static int xdl_linear_cmp(diffdata_t *dd1, long off1, long lim1,
+			  diffdata_t *dd2, long off2, long lim2) {
+	unsigned long const *ha1 = dd1->ha, *ha2 = dd2->ha;
+	long n1 = lim1 - off1, i, k, len, lo, hi, mid;
+	long *buf, *anc1, *anc2, *prev, *tail;
+	unsigned long hsize, hmask, h;
+	unsigned int hbits;
+	xdlinear_t *tab;
+
+	hbits = xdl_hashbits((unsigned int) n1) + 1;
+	hsize = 1UL << hbits;
+	hmask = hsize - 1;
+	if (!(tab = (xdlinear_t *) xdl_malloc(hsize * sizeof(xdlinear_t))))
+		return -1;
+	memset(tab, 0, hsize * sizeof(xdlinear_t));
+	if (!(buf = (long *) xdl_malloc(4 * n1 * sizeof(long)))) {
+
+		xdl_free(tab);
+		return -1;
+	}
+	anc1 = buf;
+	anc2 = anc1 + n1;
+	prev = anc2 + n1;
+	tail = prev + n1;
+
+	/*
+	 * Count the occurrences of each record on both sides. Only the
+	 * records of the first side are entered, so that the table is
+	 * never more than half full.
+	 */
+	for (i = off1; i < lim1; i++) {
+		for (h = XDL_HASHLONG(ha1[i], hbits);
+		     tab[h].cnt1 && tab[h].ha != ha1[i]; h = (h + 1) & hmask);
+		tab[h].ha = ha1[i];
+		tab[h].cnt1++;
+	}
+	for (i = off2; i < lim2; i++) {
+		for (h = XDL_HASHLONG(ha2[i], hbits);
+		     tab[h].cnt1 && tab[h].ha != ha2[i]; h = (h + 1) & hmask);
+		if (tab[h].cnt1) {
+			tab[h].cnt2++;
+			tab[h].pos2 = i;
+		}
+	}
+
+	/*
+	 * Collect the unique records in the order of the first side, and
+	 * find the longest increasing sequence of their positions in the
+	 * second one; tail[l] is the anchor ending the best sequence of
+	 * length l + 1 found so far.
+	 */
+	for (k = 0, i = off1; i < lim1; i++) {
+		for (h = XDL_HASHLONG(ha1[i], hbits);
+		     tab[h].ha != ha1[i]; h = (h + 1) & hmask);
+		if (tab[h].cnt1 == 1 && tab[h].cnt2 == 1) {
+			anc1[k] = i;
+			anc2[k] = tab[h].pos2;
+			k++;
+		}
+	}
+	for (len = 0, i = 0; i < k; i++) {
+		for (lo = 0, hi = len; lo < hi;) {
+			mid = lo + (hi - lo) / 2;
+			if (anc2[tail[mid]] < anc2[i])
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		prev[i] = lo ? tail[lo - 1] : -1;
+		tail[lo] = i;
+		if (lo == len)
+			len++;
+	}
+	for (i = len ? tail[len - 1] : -1, k = len; i >= 0; i = prev[i])
+		tail[--k] = i;
+
+	for (k = 0; k < len; k++) {
+		i = tail[k];
+		xdl_linear_gap(dd1, off1, anc1[i], dd2, off2, anc2[i]);
+		off1 = anc1[i] + 1;
+		off2 = anc2[i] + 1;
+	}
+	xdl_linear_gap(dd1, off1, lim1, dd2, off2, lim2);
+
+	xdl_free(buf);
+	xdl_free(tab);
+
+	return 0;
+}
+
+
 /*
  * Rule: "Divide et Impera" (divide & conquer). Recursively split the box in
  * sub-boxes by calling the box splitting function. Note that the real job
@@ -280,6 +400,12 @@ int xdl_recs_cmp(diffdata_t *dd1, long off1, long lim1,
 
 		for (; off1 < lim1; off1++)
 			rchg1[rindex1[off1]] = 1;
+	} else if (xenv->cost_left <= 0) {
+		/*
+		 * The budget is used up, settle for a quick match of what
+		 * is left of the box.
+		 */
+		return xdl_linear_cmp(dd1, off1, lim1, dd2, off2, lim2);
 	} else {
 		xdpsplit_t spl;
 		spl.i1 = spl.i2 = 0;
@@ -349,6 +475,7 @@ int xdl_do_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
 		xenv.mxcost = XDL_MAX_COST_MIN;
 	xenv.snake_cnt = XDL_SNAKE_CNT;
 	xenv.heur_min = XDL_HEUR_MIN_COST;
+	xenv.cost_left = xe->cost_left;
 
 	dd1.nrec = xe->xdf1.nreff;
 	dd1.ha = xe->xdf1.ha;
@@ -368,6 +495,7 @@ int xdl_do_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
 	}
 
 	xdl_free(kvd);
+	xe->cost_left = xenv.cost_left;
 
 	return 0;
 }
@@ -236,6 +236,7 @@ static int fall_back_to_classic_diff(xpparam_t const *xpp, xdfenv_t *env,
 {
 	xpparam_t xpparam;
 	xpparam.flags = xpp->flags & ~XDF_DIFF_ALGORITHM_MASK;
+	xpparam.max_cost = xpp->max_cost;
 
 	return xdl_fall_back_diff(env, &xpparam,
 				  line1, count1, line2, count2);
@@ -336,6 +337,16 @@ static int histogram_diff(xpparam_t const *xpp, xdfenv_t *env,
 		return 0;
 	}
 
+	/*
+	 * Each level of recursion scans the whole region again, so
+	 * leave it to the classic diff once the budget is used up.
+	 */
+	if (env->cost_left <= 0) {
+		result = fall_back_to_classic_diff(xpp, env, line1, count1, line2, count2);
+		goto out;
+	}
+	env->cost_left -= count1 + count2;
+
 	memset(&lcs, 0, sizeof(lcs));
 	lcs_found = find_lcs(xpp, env, &lcs, line1, count1, line2, count2);
 	if (lcs_found < 0)
@@ -319,6 +319,7 @@ static int fall_back_to_classic_diff(struct hashmap *map,
 {
 	xpparam_t xpp;
 	xpp.flags = map->xpp->flags & ~XDF_DIFF_ALGORITHM_MASK;
+	xpp.max_cost = map->xpp->max_cost;
 
 	return xdl_fall_back_diff(map->env, &xpp,
 				  line1, count1, line2, count2);
@@ -350,6 +351,16 @@ static int patience_diff(mmfile_t *file1, mmfile_t *file2,
 	}
 
 	memset(&map, 0, sizeof(map));
+
+	/* leave it to the classic diff once the budget is used up */
+	if (env->cost_left <= 0) {
+		map.xpp = xpp;
+		map.env = env;
+		return fall_back_to_classic_diff(&map,
+			line1, count1, line2, count2);
+	}
+	env->cost_left -= count1 + count2;
+
 	if (fill_hashmap(file1, file2, xpp, env, &map,
 			line1, count1, line2, count2))
 		return -1;
@@ -308,6 +308,11 @@ int xdl_prepare_env(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
 	if (XDF_DIFF_ALG(xpp->flags) != XDF_HISTOGRAM_DIFF)
 		xdl_free_classifier(&cf);
 
+	if (!xpp->max_cost)
+		xe->cost_left = LONG_MAX;
+	else
+		xe->cost_left = XDL_MAX(xpp->max_cost, 0);
+
 	return 0;
 }
 
@@ -60,6 +60,7 @@ typedef struct s_xdfile {
 
 typedef struct s_xdfenv {
 	xdfile_t xdf1, xdf2;
+	long cost_left;
 } xdfenv_t;
 
 
@@ -249,65 +249,292 @@ int xdl_recmatch(const char *l1, long s1, const char *l2, long s2, long flags)
 	return 1;
 }
 
-static unsigned long xdl_hash_record_with_whitespace(char const **data,
-		char const *top, long flags) {
-	unsigned long ha = 5381;
-	char const *ptr = *data;
-	int cr_at_eol_only = (flags & XDF_WHITESPACE_FLAGS) == XDF_IGNORE_CR_AT_EOL;
-
-	for (; ptr < top && *ptr != '\n'; ptr++) {
-		if (cr_at_eol_only) {
-			/* do not ignore CR at the end of an incomplete line */
-			if (*ptr == '\r' &&
-			    (ptr + 1 < top && ptr[1] == '\n'))
-				continue;
+/*
+ * Records are hashed eight bytes at a time. The hash only depends on
+ * the bytes that are fed to it, not on how they are split between calls
+ * to xdl_hash_feed(), so that the whitespace-ignoring variants can feed
+ * the runs of bytes they keep and match the hash of a record that only
+ * differs in the whitespace they ignore.
+ */
+#define XDL_HASH_MULT 0x517cc1b727220a95ULL
+
+typedef struct s_xdhash {
+	uint64_t ha;
+	uint64_t len;
+	unsigned char buf[8];
+	unsigned int nbuf;
+} xdhash_t;
+
+static inline uint64_t xdl_hash_load(void const *ptr) {
+	uint64_t w;
+
+	memcpy(&w, ptr, sizeof(w));
+	return w;
+}
+
+static inline uint64_t xdl_hash_mix(uint64_t ha, uint64_t w) {
+	return (((ha << 5) | (ha >> 59)) ^ w) * XDL_HASH_MULT;
+}
+
+static inline void xdl_hash_init(xdhash_t *h) {
+	h->ha = 0;
+	h->len = 0;
+	h->nbuf = 0;
+}
+
+static inline void xdl_hash_feed(xdhash_t *h, char const *ptr, long size) {
+	h->len += size;
+	if (h->nbuf) {
+		for (; size && h->nbuf < 8; size--)
+			h->buf[h->nbuf++] = *ptr++;
+		if (h->nbuf < 8)
+			return;
+		h->ha = xdl_hash_mix(h->ha, xdl_hash_load(h->buf));
+		h->nbuf = 0;
+	}
+	for (; size >= 8; ptr += 8, size -= 8)
+		h->ha = xdl_hash_mix(h->ha, xdl_hash_load(ptr));
+	memcpy(h->buf, ptr, size);
+	h->nbuf = size;
+}
+
+static inline unsigned long xdl_hash_final(xdhash_t *h) {
+	uint64_t ha = h->ha;
+
+	if (h->nbuf) {
+		memset(h->buf + h->nbuf, 0, 8 - h->nbuf);
+		ha = xdl_hash_mix(ha, xdl_hash_load(h->buf));
+	}
+	ha = xdl_hash_mix(ha, h->len);
+
+	/* XDL_HASHLONG() uses the low bits, which the multiply mixes least */
+	return (unsigned long) (ha ^ (ha >> 32));
+}
+
+/*
+ * With XDF_IGNORE_WHITESPACE and XDF_IGNORE_WHITESPACE_CHANGE, the bytes
+ * that count are copied to a buffer that is hashed when it is full; with
+ * the latter, a run of whitespace becomes a single space unless it is at
+ * the end of the line.
+ */
+#define XDL_WS_BUFSIZE 512
+
+typedef struct s_xdwsfilter {
+	xdhash_t h;
+	int collapse;
+	int in_ws;
+	long nbuf;
+	char buf[XDL_WS_BUFSIZE];
+} xdwsfilter_t;
+
+static inline void xdl_ws_init(xdwsfilter_t *f, long flags) {
+	xdl_hash_init(&f->h);
+	f->collapse = !(flags & XDF_IGNORE_WHITESPACE);
+	f->in_ws = 0;
+	f->nbuf = 0;
+}
+
+/* Make room for "size" more bytes in the buffer. */
+static inline void xdl_ws_reserve(xdwsfilter_t *f, long size) {
+	/* the last space may be at the end of the line */
+	int keep = f->collapse && f->in_ws;
+
+	if (f->nbuf + size <= XDL_WS_BUFSIZE)
+		return;
+	xdl_hash_feed(&f->h, f->buf, f->nbuf - keep);
+	if (keep)
+		f->buf[0] = ' ';
+	f->nbuf = keep;
+}
+
+/* Copy at most 32 bytes, one at a time. */
+static inline void xdl_ws_bytes(xdwsfilter_t *f, char const *ptr, long size) {
+	char *buf;
+	long n, i;
+	int in_ws;
+
+	xdl_ws_reserve(f, size);
+	buf = f->buf;
+	n = f->nbuf;
+	in_ws = f->in_ws;
+	if (f->collapse) {
+		for (i = 0; i < size; i++) {
+			int ws = XDL_ISSPACE(ptr[i]) != 0;
+
+			buf[n] = ws ? ' ' : ptr[i];
+			n += !(ws & in_ws);
+			in_ws = ws;
 		}
-		else if (XDL_ISSPACE(*ptr)) {
-			const char *ptr2 = ptr;
-			int at_eol;
-			while (ptr + 1 < top && XDL_ISSPACE(ptr[1])
-					&& ptr[1] != '\n')
-				ptr++;
-			at_eol = (top <= ptr + 1 || ptr[1] == '\n');
-			if (flags & XDF_IGNORE_WHITESPACE)
-				; /* already handled */
-			else if (flags & XDF_IGNORE_WHITESPACE_CHANGE
-				 && !at_eol) {
-				ha += (ha << 5);
-				ha ^= (unsigned long) ' ';
-			}
-			else if (flags & XDF_IGNORE_WHITESPACE_AT_EOL
-				 && !at_eol) {
-				while (ptr2 != ptr + 1) {
-					ha += (ha << 5);
-					ha ^= (unsigned long) *ptr2;
-					ptr2++;
-				}
-			}
+	} else {
+		for (i = 0; i < size; i++) {
+			in_ws = XDL_ISSPACE(ptr[i]) != 0;
+			buf[n] = ptr[i];
+			n += !in_ws;
+		}
+	}
+	f->nbuf = n;
+	f->in_ws = in_ws;
+}
+
+static inline unsigned long xdl_ws_final(xdwsfilter_t *f, char const *ptr,
+					 char const *end) {
+	for (; end - ptr > 32; ptr += 32)
+		xdl_ws_bytes(f, ptr, 32);
+	xdl_ws_bytes(f, ptr, end - ptr);
+
+	if (f->collapse && f->in_ws)
+		f->nbuf--;
+	xdl_hash_feed(&f->h, f->buf, f->nbuf);
+	return xdl_hash_final(&f->h);
+}
+
+static unsigned long xdl_hash_ws_scalar(char const *ptr, char const *end,
+					long flags) {
+	xdwsfilter_t f;
+
+	xdl_ws_init(&f, flags);
+	return xdl_ws_final(&f, ptr, end);
+}
+
+/*
+ * On x86-64 with GCC or clang, the AVX2 version classifies 32 bytes at
+ * a time and packs the ones to keep with a byte shuffle, eight at a
+ * time, using a table of shuffles indexed by which of the eight to keep.
+ * It is compiled with the "target" attribute and only used when the CPU
+ * supports it.
+ */
+#if defined(__x86_64__) && \
+	(defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define XDL_AVX2
+#include <immintrin.h>
+
+static struct {
+	unsigned char shuffle[256][8];
+	unsigned char count[256];
+} xdl_ws_pack;
+
+static void xdl_ws_pack_init(void) {
+	int mask, i, n;
+
+	for (mask = 0; mask < 256; mask++) {
+		for (i = n = 0; i < 8; i++)
+			if (mask & (1 << i))
+				xdl_ws_pack.shuffle[mask][n++] = i;
+		xdl_ws_pack.count[mask] = n;
+		for (; n < 8; n++)
+			xdl_ws_pack.shuffle[mask][n] = 0x80;
+	}
+}
+
+__attribute__((target("avx2")))
+static unsigned long xdl_hash_ws_avx2(char const *ptr, char const *end,
+				      long flags) {
+	const __m256i sp = _mm256_set1_epi8(' '), ht = _mm256_set1_epi8('\t');
+	const __m256i lf = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+	xdwsfilter_t f;
+
+	xdl_ws_init(&f, flags);
+	for (; end - ptr >= 32; ptr += 32) {
+		__m256i v = _mm256_loadu_si256((__m256i const *) ptr);
+		__m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp),
+							     _mm256_cmpeq_epi8(v, ht)),
+					    _mm256_or_si256(_mm256_cmpeq_epi8(v, lf),
+							    _mm256_cmpeq_epi8(v, cr)));
+		uint32_t ws = _mm256_movemask_epi8(m), keep;
+		unsigned char bytes[32];
+		char *buf;
+		int i;
+
+		xdl_ws_reserve(&f, 32);
+		buf = f.buf + f.nbuf;
+		if (!ws) {
+			_mm256_storeu_si256((__m256i *) buf, v);
+			f.nbuf += 32;
+			f.in_ws = 0;
 			continue;
 		}
-		ha += (ha << 5);
-		ha ^= (unsigned long) *ptr;
+		if (f.collapse) {
+			/* keep the first byte of each run, as a space */
+			keep = ~(ws & ((ws << 1) | f.in_ws));
+			v = _mm256_blendv_epi8(v, sp, m);
+		} else {
+			keep = ~ws;
+		}
+		f.in_ws = ws >> 31;
+
+		_mm256_storeu_si256((__m256i *) bytes, v);
+		for (i = 0; i < 32; i += 8) {
+			unsigned int k = (keep >> i) & 0xff;
+			__m128i b = _mm_loadl_epi64((__m128i const *) (bytes + i));
+			__m128i s = _mm_loadl_epi64((__m128i const *) xdl_ws_pack.shuffle[k]);
+
+			_mm_storel_epi64((__m128i *) buf, _mm_shuffle_epi8(b, s));
+			buf += xdl_ws_pack.count[k];
+		}
+		f.nbuf = buf - f.buf;
 	}
-	*data = ptr < top ? ptr + 1: ptr;
+	return xdl_ws_final(&f, ptr, end);
+}
+#endif
 
-	return ha;
+typedef unsigned long (*xdl_hash_ws_fn)(char const *, char const *, long);
+static xdl_hash_ws_fn xdl_hash_ws = xdl_hash_ws_scalar;
+
+#ifdef XDL_AVX2
+/*
+ * Pick the implementation and build its table once at startup, before
+ * any thread can run a diff, so that readers never see a partially
+ * built table.
+ */
+__attribute__((constructor))
+static void xdl_hash_ws_select(void) {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") &&
+	    !getenv("GIT_TEST_XDIFF_PORTABLE")) {
+		xdl_ws_pack_init();
+		xdl_hash_ws = xdl_hash_ws_avx2;
+	}
+}
+#endif
+
+static unsigned long xdl_hash_record_with_whitespace(char const **data,
+		char const *top, long flags) {
+	xdhash_t h;
+	char const *ptr = *data, *end, *eol;
+
+	eol = memchr(ptr, '\n', top - ptr);
+	end = eol ? eol : top;
+	*data = eol ? eol + 1 : top;
+
+	if (flags & (XDF_IGNORE_WHITESPACE | XDF_IGNORE_WHITESPACE_CHANGE))
+		return xdl_hash_ws(ptr, end, flags);
+
+	if (flags & XDF_IGNORE_WHITESPACE_AT_EOL) {
+		while (end > ptr && XDL_ISSPACE(end[-1]))
+			end--;
+	} else if (eol && end > ptr && end[-1] == '\r') {
+		/* do not ignore CR at the end of an incomplete line */
+		end--;
+	}
+
+	xdl_hash_init(&h);
+	xdl_hash_feed(&h, ptr, end - ptr);
+	return xdl_hash_final(&h);
 }
 
 unsigned long xdl_hash_record(char const **data, char const *top, long flags) {
-	unsigned long ha = 5381;
-	char const *ptr = *data;
+	xdhash_t h;
+	char const *ptr = *data, *eol;
 
 	if (flags & XDF_WHITESPACE_FLAGS)
 		return xdl_hash_record_with_whitespace(data, top, flags);
 
-	for (; ptr < top && *ptr != '\n'; ptr++) {
-		ha += (ha << 5);
-		ha ^= (unsigned long) *ptr;
-	}
-	*data = ptr < top ? ptr + 1: ptr;
+	eol = memchr(ptr, '\n', top - ptr);
+	*data = eol ? eol + 1 : top;
+	xdl_hash_init(&h);
+	xdl_hash_feed(&h, ptr, (eol ? eol : top) - ptr);
 
-	return ha;
+	return xdl_hash_final(&h);
 }
 
 unsigned int xdl_hashbits(unsigned int size) {
@@ -414,6 +641,7 @@ int xdl_fall_back_diff(xdfenv_t *diff_env, xpparam_t const *xpp,
 	 * ranges of lines instead of the whole files.
 	 */
 	mmfile_t subfile1, subfile2;
+	xpparam_t subxpp = *xpp;
 	xdfenv_t env;
 
 	subfile1.ptr = (char *)diff_env->xdf1.recs[line1 - 1]->ptr;
@@ -422,8 +650,13 @@ int xdl_fall_back_diff(xdfenv_t *diff_env, xpparam_t const *xpp,
 	subfile2.ptr = (char *)diff_env->xdf2.recs[line2 - 1]->ptr;
 	subfile2.size = diff_env->xdf2.recs[line2 + count2 - 2]->ptr +
 		diff_env->xdf2.recs[line2 + count2 - 2]->size - subfile2.ptr;
-	if (xdl_do_diff(&subfile1, &subfile2, xpp, &env) < 0)
+	/* Whatever was already spent on the whole diff counts, too. */
+	if (xpp->max_cost)
+		subxpp.max_cost = diff_env->cost_left > 0 ? diff_env->cost_left : -1;
+	if (xdl_do_diff(&subfile1, &subfile2, &subxpp, &env) < 0)
 		return -1;
+	if (xpp->max_cost)
+		diff_env->cost_left = env.cost_left;
 
 	memcpy(diff_env->xdf1.rchg + line1 - 1, env.xdf1.rchg, count1);
 	memcpy(diff_env->xdf2.rchg + line2 - 1, env.xdf2.rchg, count2);